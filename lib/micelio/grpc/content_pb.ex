@@ -50,6 +50,32 @@ defmodule Micelio.GRPC.Content.V1.GetBlobResponse do
   field :content, 1, type: :bytes
 end
 
+defmodule Micelio.GRPC.Content.V1.BlobChunk do
+  use Protobuf, syntax: :proto3
+
+  field :data, 1, type: :bytes
+end
+
+defmodule Micelio.GRPC.Content.V1.GetBlobsRequest do
+  use Protobuf, syntax: :proto3
+
+  field :user_id, 1, type: :string, json_name: "userId"
+  field :account_handle, 2, type: :string, json_name: "accountHandle"
+  field :project_handle, 3, type: :string, json_name: "projectHandle"
+  field :blob_hashes, 4, repeated: true, type: :bytes, json_name: "blobHashes"
+  field :max_blob_bytes, 5, type: :uint64, json_name: "maxBlobBytes"
+  field :max_batch_bytes, 6, type: :uint64, json_name: "maxBatchBytes"
+end
+
+defmodule Micelio.GRPC.Content.V1.BlobEntry do
+  use Protobuf, syntax: :proto3
+
+  field :blob_hash, 1, type: :bytes, json_name: "blobHash"
+  field :content, 2, type: :bytes
+  field :size, 3, type: :uint64
+  field :deferred, 4, type: :bool
+end
+
 defmodule Micelio.GRPC.Content.V1.GetPathRequest do
   use Protobuf, syntax: :proto3
 
@@ -127,6 +153,18 @@ defmodule Micelio.GRPC.Content.V1.ContentService.Service do
     Micelio.GRPC.Content.V1.GetBlobResponse
   )
 
+  rpc(
+    :StreamBlob,
+    Micelio.GRPC.Content.V1.GetBlobRequest,
+    stream(Micelio.GRPC.Content.V1.BlobChunk)
+  )
+
+  rpc(
+    :GetBlobs,
+    Micelio.GRPC.Content.V1.GetBlobsRequest,
+    stream(Micelio.GRPC.Content.V1.BlobEntry)
+  )
+
   rpc(
     :GetPath,
     Micelio.GRPC.Content.V1.GetPathRequest,
@@ -1,5 +1,8 @@
 defmodule Micelio.GRPC.Content.V1.ContentService.Server do
-  use GRPC.Server, service: Micelio.GRPC.Content.V1.ContentService.Service
+  # Blobs are mostly source text, so let clients send and receive them gzip-compressed.
+  use GRPC.Server,
+    service: Micelio.GRPC.Content.V1.ContentService.Service,
+    compressors: [GRPC.Compressor.Gzip]
 
   alias GRPC.RPCError
   alias GRPC.Status
@@ -8,7 +11,10 @@ defmodule Micelio.GRPC.Content.V1.ContentService.Server do
 
   alias Micelio.GRPC.Content.V1.{
     BlameLine,
+    BlobChunk,
+    BlobEntry,
     GetBlobRequest,
+    GetBlobsRequest,
     GetBlobResponse,
     GetBlameRequest,
     GetBlameResponse,
@@ -31,6 +37,8 @@ defmodule Micelio.GRPC.Content.V1.ContentService.Server do
   alias Micelio.Storage
 
   @zero_hash <<0::size(256)>>
+  @blob_chunk_size 64 * 1024
+  @max_batch_blobs 256
 
   def get_head_tree(%GetHeadTreeRequest{} = request, stream) do
     with :ok <- require_field(request.account_handle, "account_handle"),
@@ -109,6 +117,99 @@ defmodule Micelio.GRPC.Content.V1.ContentService.Server do
     end
   end
 
+  def stream_blob(%GetBlobRequest{} = request, stream) do
+    with :ok <- require_field(request.account_handle, "account_handle"),
+         :ok <- require_field(request.project_handle, "project_handle"),
+         :ok <- require_hash(request.blob_hash, "blob_hash"),
+         {:ok, organization, project} <-
+           load_project(request.account_handle, request.project_handle),
+         :ok <- authorize_project_read(organization, project, request.user_id, stream),
+         {:ok, content} <- load_blob(project.id, request.blob_hash) do
+      content
+      |> blob_chunks()
+      |> Enum.each(&GRPC.Server.send_reply(stream, %BlobChunk{data: &1}))
+
+      stream
+    end
+  end
+
+  # Sends one BlobEntry per distinct hash, in request order. Blobs over
+  # max_blob_bytes are sent as deferred entries (size only) so the client can
+  # stream them individually. Once the next blob would take the response past
+  # max_batch_bytes the stream ends there, before anything else is loaded; the
+  # client asks again for the hashes that got no entry. A blob that fails to
+  # load ends the stream with its error.
+  def get_blobs(%GetBlobsRequest{} = request, stream) do
+    with :ok <- require_field(request.account_handle, "account_handle"),
+         :ok <- require_field(request.project_handle, "project_handle"),
+         :ok <- require_hashes(request.blob_hashes, "blob_hashes"),
+         {:ok, organization, project} <-
+           load_project(request.account_handle, request.project_handle),
+         :ok <- authorize_project_read(organization, project, request.user_id, stream) do
+      request.blob_hashes
+      |> Enum.uniq()
+      |> Enum.reduce_while({stream, 0}, fn blob_hash, {stream, sent_bytes} ->
+        case load_blob(project.id, blob_hash) do
+          {:ok, content} -> send_blob_entry(stream, request, blob_hash, content, sent_bytes)
+          {:error, status} -> {:halt, {:error, status}}
+        end
+      end)
+      |> case do
+        {:error, status} -> {:error, status}
+        {stream, _sent_bytes} -> stream
+      end
+    end
+  end
+
+  defp send_blob_entry(stream, request, blob_hash, content, sent_bytes) do
+    size = byte_size(content)
+
+    cond do
+      over_limit?(size, request.max_blob_bytes) ->
+        GRPC.Server.send_reply(stream, %BlobEntry{
+          blob_hash: blob_hash,
+          size: size,
+          deferred: true
+        })
+
+        {:cont, {stream, sent_bytes}}
+
+      # The first blob that fits max_blob_bytes is always sent, so every call makes progress.
+      sent_bytes > 0 and over_limit?(sent_bytes + size, request.max_batch_bytes) ->
+        {:halt, {stream, sent_bytes}}
+
+      true ->
+        GRPC.Server.send_reply(stream, %BlobEntry{
+          blob_hash: blob_hash,
+          content: content,
+          size: size
+        })
+
+        sent_bytes = sent_bytes + size
+
+        if budget_spent?(sent_bytes, request.max_batch_bytes) do
+          {:halt, {stream, sent_bytes}}
+        else
+          {:cont, {stream, sent_bytes}}
+        end
+    end
+  end
+
+  defp budget_spent?(_sent_bytes, 0), do: false
+  defp budget_spent?(sent_bytes, limit), do: sent_bytes >= limit
+
+  defp over_limit?(_bytes, 0), do: false
+  defp over_limit?(bytes, limit), do: bytes > limit
+
+  defp blob_chunks(<<>>), do: []
+
+  defp blob_chunks(content) when byte_size(content) <= @blob_chunk_size, do: [content]
+
+  defp blob_chunks(content) do
+    <<chunk::binary-size(@blob_chunk_size), rest::binary>> = content
+    [chunk | blob_chunks(rest)]
+  end
+
   def get_path(%GetPathRequest{} = request, stream) do
     with :ok <- require_field(request.account_handle, "account_handle"),
          :ok <- require_field(request.project_handle, "project_handle"),
@@ -332,6 +433,21 @@ defmodule Micelio.GRPC.Content.V1.ContentService.Server do
   defp require_hash(_value, field_name),
     do: {:error, invalid_status("#{field_name} is required.")}
 
+  defp require_hashes([], field_name),
+    do: {:error, invalid_status("#{field_name} is required.")}
+
+  defp require_hashes(hashes, field_name) when length(hashes) > @max_batch_blobs,
+    do: {:error, invalid_status("#{field_name} allows at most #{@max_batch_blobs} hashes.")}
+
+  defp require_hashes(hashes, field_name) do
+    Enum.reduce_while(hashes, :ok, fn hash, :ok ->
+      case require_hash(hash, field_name) do
+        :ok -> {:cont, :ok}
+        error -> {:halt, error}
+      end
+    end)
+  end
+
   defp ensure_text(content) when is_binary(content) do
     limit = 200_000
     content = if byte_size(content) > limit, do: binary_part(content, 0, limit), else: content
@@ -122,6 +122,12 @@ defmodule Micelio.GRPC.Sessions.V1.SessionService.Service do
     Micelio.GRPC.Sessions.V1.SessionResponse
   )
 
+  rpc(
+    :LandSessionStream,
+    stream(Micelio.GRPC.Sessions.V1.LandSessionRequest),
+    Micelio.GRPC.Sessions.V1.SessionResponse
+  )
+
   rpc(
     :GetSession,
     Micelio.GRPC.Sessions.V1.GetSessionRequest,
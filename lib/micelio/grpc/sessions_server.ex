@@ -1,5 +1,8 @@
 defmodule Micelio.GRPC.Sessions.V1.SessionService.Server do
-  use GRPC.Server, service: Micelio.GRPC.Sessions.V1.SessionService.Service
+  # LandSession batches carry whole source files and compress well.
+  use GRPC.Server,
+    service: Micelio.GRPC.Sessions.V1.SessionService.Service,
+    compressors: [GRPC.Compressor.Gzip]
 
   alias GRPC.RPCError
   alias GRPC.Status
@@ -168,6 +171,22 @@ defmodule Micelio.GRPC.Sessions.V1.SessionService.Server do
     end
   end
 
+  # Client-streaming variant of land_session/2: each message on the stream is
+  # one epoch batch, applied in order. The first error ends the call.
+  def land_session_stream(requests, stream) do
+    requests
+    |> Enum.reduce_while(nil, fn %LandSessionRequest{} = request, _last ->
+      case land_session(request, stream) do
+        {:error, _status} = error -> {:halt, error}
+        %SessionResponse{} = response -> {:cont, response}
+      end
+    end)
+    |> case do
+      nil -> {:error, invalid_status("At least one land request is required.")}
+      result -> result
+    end
+  end
+
   def get_session(%GetSessionRequest{} = request, stream) do
     with :ok <- require_field(request.session_id, "session_id"),
          {:ok, user} <- fetch_user(request.user_id, stream),
@@ -0,0 +1,595 @@
+//! gRPC transport benchmark (`zig build bench-grpc`).
+//!
+//! Forks a loopback gRPC server (cleartext and TLS, see grpc_bench_support.c)
+//! and drives the client transport through a matrix of call shapes, payload
+//! sizes, concurrency levels and connection reuse. Each scenario prints one
+//! row: throughput, p50/p99 latency, heap allocations per call, connections
+//! opened and peak RSS. Latency is per operation: one unary call, one batch,
+//! or one whole stream.
+//!
+//!   zig build bench-grpc -- [--quick] [--mode <mode>] [--transport h2c|tls]
+
+const std = @import("std");
+
+const c = @cImport({
+    @cInclude("grpc/client.h");
+    @cInclude("grpc_bench_support.h");
+    @cInclude("stdlib.h");
+});
+
+const Mode = enum {
+    /// mic_grpc_unary_call from `concurrency` threads
+    unary,
+    /// mic_grpc_unary_call_many with `concurrency` calls per batch
+    batch,
+    /// mic_grpc_call_start with `concurrency` calls in flight
+    async_unary,
+    /// mic_grpc_streaming_call receiving `size` bytes per stream
+    download,
+    /// mic_grpc_client_streaming_call sending `size` bytes per stream
+    upload,
+};
+
+const Transport = enum { h2c, tls };
+
+const Options = struct {
+    quick: bool = false,
+    mode: ?Mode = null,
+    transport: ?Transport = null,
+};
+
+const KiB = 1024;
+const MiB = 1024 * KiB;
+
+/// Echo round-trips hold the request and response in memory at once, so
+/// payloads beyond this are only measured as streams.
+const unary_sizes = [_]usize{ 100, 4 * KiB, 64 * KiB, 1 * MiB, 16 * MiB };
+const stream_sizes = [_]usize{ 64 * KiB, 1 * MiB, 16 * MiB, 256 * MiB };
+const concurrency_levels = [_]usize{ 1, 8, 64 };
+const quick_concurrency_levels = [_]usize{ 1, 8 };
+
+/// Largest gRPC message used for streamed payloads
+const stream_message_size = 1 * MiB;
+
+const Server = struct {
+    pid: c.pid_t,
+    transport: Transport,
+    target: [32]u8 = [_]u8{0} ** 32,
+
+    fn start(transport: Transport, cert_path: ?[*:0]const u8, key_path: ?[*:0]const u8) !Server {
+        var port: c_int = 0;
+        const pid = c.mic_bench_server_spawn(cert_path, key_path, &port);
+        if (pid < 0) return error.ServerStartFailed;
+
+        var server = Server{ .pid = pid, .transport = transport };
+        _ = try printZ(&server.target, "127.0.0.1:{d}", .{port});
+        return server;
+    }
+
+    fn stop(self: *const Server) void {
+        c.mic_bench_server_stop(self.pid);
+    }
+
+    fn targetZ(self: *const Server) [*c]const u8 {
+        return @ptrCast(&self.target);
+    }
+
+    fn useTls(self: *const Server) c_int {
+        return @intFromBool(self.transport == .tls);
+    }
+};
+
+const Scenario = struct {
+    mode: Mode,
+    size: usize,
+    concurrency: usize,
+    reuse: bool,
+};
+
+const Result = struct {
+    ops: usize,
+    calls: usize,
+    failed: usize,
+    bytes: u64,
+    elapsed_ns: u64,
+    p50_us: u64,
+    p99_us: u64,
+    allocations: u64,
+    connections: u64,
+    peak_rss_kb: ?u64,
+};
+
+pub fn main() !void {
+    const allocator = std.heap.c_allocator;
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseArgs(args[1..]) catch {
+        std.debug.print("Usage: grpc-bench [--quick] [--mode unary|batch|async_unary|download|upload] [--transport h2c|tls]\n", .{});
+        std.process.exit(2);
+    };
+
+    // The servers are forked before the client starts any threads.
+    const tmp_dir = std.posix.getenv("TMPDIR") orelse "/tmp";
+    var cert_buf: [std.fs.max_path_bytes]u8 = undefined;
+    var key_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const cert_path = try printZ(&cert_buf, "{s}/mic-grpc-bench-{d}.crt", .{ tmp_dir, std.c.getpid() });
+    const key_path = try printZ(&key_buf, "{s}/mic-grpc-bench-{d}.key", .{ tmp_dir, std.c.getpid() });
+    if (c.mic_bench_write_certificate(cert_path, key_path) != 0) return error.CertificateFailed;
+    defer std.fs.deleteFileAbsolute(cert_path) catch {};
+    defer std.fs.deleteFileAbsolute(key_path) catch {};
+    _ = c.setenv("SSL_CERT_FILE", cert_path, 1);
+
+    const servers = [_]Server{
+        try Server.start(.h2c, null, null),
+        try Server.start(.tls, cert_path, key_path),
+    };
+    defer for (&servers) |*server| server.stop();
+    defer c.mic_grpc_pool_shutdown();
+
+    var out_buf: [4096]u8 = undefined;
+    var stdout = std.fs.File.stdout().writer(&out_buf);
+    const out = &stdout.interface;
+
+    if (c.mic_bench_counts_allocations() == 0) {
+        try out.print("note: allocation counts are unavailable on this platform\n", .{});
+    }
+    try out.print("{s:<9} {s:<12} {s:>7} {s:>5} {s:<5} {s:>6} {s:>9} {s:>9} {s:>9} {s:>9} {s:>10} {s:>6} {s:>9} {s:>6}\n", .{
+        "transport", "mode", "size", "conc", "reuse", "ops", "MB/s", "calls/s", "p50 ms", "p99 ms", "allocs/call", "conns", "RSS MB", "failed",
+    });
+    try out.flush();
+
+    for (&servers) |*server| {
+        if (options.transport) |transport| if (transport != server.transport) continue;
+
+        inline for (std.meta.fields(Mode)) |field| {
+            const mode: Mode = @enumFromInt(field.value);
+            if (options.mode == null or options.mode.? == mode) {
+                try runMode(allocator, out, server, mode, options);
+            }
+        }
+    }
+}
+
+fn parseArgs(args: []const []const u8) !Options {
+    var options = Options{};
+    var i: usize = 0;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--quick")) {
+            options.quick = true;
+        } else if (std.mem.eql(u8, arg, "--mode") and i + 1 < args.len) {
+            i += 1;
+            options.mode = std.meta.stringToEnum(Mode, args[i]) orelse return error.InvalidArgument;
+        } else if (std.mem.eql(u8, arg, "--transport") and i + 1 < args.len) {
+            i += 1;
+            options.transport = std.meta.stringToEnum(Transport, args[i]) orelse return error.InvalidArgument;
+        } else {
+            return error.InvalidArgument;
+        }
+    }
+    return options;
+}
+
+fn runMode(allocator: std.mem.Allocator, out: *std.Io.Writer, server: *const Server, mode: Mode, options: Options) !void {
+    const sizes: []const usize = switch (mode) {
+        .unary, .batch, .async_unary => &unary_sizes,
+        .download, .upload => &stream_sizes,
+    };
+    const levels: []const usize = if (options.quick) &quick_concurrency_levels else &concurrency_levels;
+
+    for (sizes) |size| {
+        if (options.quick and size > 16 * MiB) continue;
+        for (levels) |concurrency| {
+            // Large payloads are about throughput of a single transfer.
+            if (size >= 16 * MiB and concurrency > 1) continue;
+            for ([_]bool{ true, false }) |reuse| {
+                // In-flight async calls always share the pool.
+                if (mode == .async_unary and !reuse) continue;
+
+                const scenario = Scenario{ .mode = mode, .size = size, .concurrency = concurrency, .reuse = reuse };
+                const result = try runScenario(allocator, server, scenario, options);
+                try printResult(out, server, scenario, result);
+                try out.flush();
+            }
+        }
+    }
+}
+
+/// Number of operations: enough to move the byte budget, within fixed bounds,
+/// and a whole number of rounds at the scenario's concurrency.
+fn operationCount(scenario: Scenario, options: Options) usize {
+    const budget: usize = if (options.quick) 64 * MiB else 512 * MiB;
+    const max_ops: usize = if (options.quick) 200 else 2000;
+    const per_op = if (scenario.mode == .batch) scenario.size * scenario.concurrency else scenario.size;
+    const ops = std.math.clamp(budget / per_op, 2, max_ops);
+    if (scenario.mode == .batch) return ops;
+    return std.mem.alignForward(usize, ops, scenario.concurrency);
+}
+
+fn runScenario(allocator: std.mem.Allocator, server: *const Server, scenario: Scenario, options: Options) !Result {
+    const ops = operationCount(scenario, options);
+    const latencies = try allocator.alloc(u64, ops);
+    defer allocator.free(latencies);
+    @memset(latencies, 0);
+
+    // Unary payloads are sent whole; streams send one message-sized chunk repeatedly.
+    const payload_len = switch (scenario.mode) {
+        .unary, .batch, .async_unary => scenario.size,
+        .download, .upload => @min(scenario.size, stream_message_size),
+    };
+    const payload = try allocator.alloc(u8, payload_len);
+    defer allocator.free(payload);
+    for (payload, 0..) |*byte, i| byte.* = @truncate(i);
+
+    // Every scenario starts without pooled connections.
+    c.mic_grpc_pool_shutdown();
+    resetPeakRss();
+
+    var stats_before: c.mic_grpc_stats = undefined;
+    c.mic_grpc_get_stats(&stats_before);
+    const allocations_before = c.mic_bench_allocations();
+    const started = std.time.nanoTimestamp();
+
+    const job = Job{ .server = server, .scenario = scenario, .payload = payload };
+    const failed = switch (scenario.mode) {
+        .unary, .download, .upload => try runThreads(job, latencies),
+        .batch => runBatches(job, latencies),
+        .async_unary => runAsync(allocator, job, latencies),
+    };
+
+    const elapsed_ns: u64 = @intCast(std.time.nanoTimestamp() - started);
+    const allocations = c.mic_bench_allocations() - allocations_before;
+    var stats_after: c.mic_grpc_stats = undefined;
+    c.mic_grpc_get_stats(&stats_after);
+
+    std.mem.sort(u64, latencies, {}, std.sort.asc(u64));
+    const calls = if (scenario.mode == .batch) ops * scenario.concurrency else ops;
+    const bytes_per_call: u64 = if (scenario.mode == .unary or scenario.mode == .batch or scenario.mode == .async_unary)
+        2 * scenario.size
+    else
+        scenario.size;
+
+    return .{
+        .ops = ops,
+        .calls = calls,
+        .failed = failed,
+        .bytes = bytes_per_call * (calls - @min(calls, failed)),
+        .elapsed_ns = elapsed_ns,
+        .p50_us = percentile(latencies, 50),
+        .p99_us = percentile(latencies, 99),
+        .allocations = allocations,
+        .connections = stats_after.connections_opened - stats_before.connections_opened,
+        .peak_rss_kb = peakRssKb(),
+    };
+}
+
+fn percentile(sorted: []const u64, p: usize) u64 {
+    if (sorted.len == 0) return 0;
+    return sorted[@min(sorted.len - 1, sorted.len * p / 100)];
+}
+
+const Job = struct {
+    server: *const Server,
+    scenario: Scenario,
+    payload: []const u8,
+
+    fn finishCall(self: Job) void {
+        if (!self.scenario.reuse) c.mic_grpc_pool_shutdown();
+    }
+};
+
+/// Blocking calls from `concurrency` threads, each taking an equal share of the operations.
+fn runThreads(job: Job, latencies: []u64) !usize {
+    const Worker = struct {
+        job: Job,
+        latencies: []u64,
+        failed: usize = 0,
+
+        fn run(self: *@This()) void {
+            for (self.latencies) |*latency| {
+                const started = std.time.nanoTimestamp();
+                const ok = switch (self.job.scenario.mode) {
+                    .download => download(self.job),
+                    .upload => upload(self.job),
+                    else => echo(self.job),
+                };
+                latency.* = elapsedUs(started);
+                if (!ok) self.failed += 1;
+                self.job.finishCall();
+            }
+        }
+    };
+
+    const count = job.scenario.concurrency;
+    var workers: [64]Worker = undefined;
+    var threads: [64]std.Thread = undefined;
+    std.debug.assert(count <= workers.len);
+
+    const share = latencies.len / count;
+    for (0..count) |i| {
+        workers[i] = .{ .job = job, .latencies = latencies[i * share .. (i + 1) * share] };
+    }
+    if (count == 1) {
+        workers[0].run();
+    } else {
+        var spawned: usize = 0;
+        defer for (threads[0..spawned]) |thread| thread.join();
+        for (0..count) |i| {
+            threads[i] = try std.Thread.spawn(.{}, Worker.run, .{&workers[i]});
+            spawned += 1;
+        }
+    }
+
+    var failed: usize = 0;
+    for (workers[0..count]) |worker| failed += worker.failed;
+    return failed;
+}
+
+fn echo(job: Job) bool {
+    var response: [*c]u8 = null;
+    var response_len: usize = 0;
+    var error_ptr: [*c]u8 = null;
+    const rc = c.mic_grpc_unary_call(
+        job.server.targetZ(),
+        "localhost",
+        c.MIC_BENCH_ECHO,
+        job.payload.ptr,
+        job.payload.len,
+        null,
+        job.server.useTls(),
+        null,
+        &response,
+        &response_len,
+        &error_ptr,
+    );
+    if (response != null) c.mic_grpc_free(response);
+    if (error_ptr != null) c.mic_grpc_free(error_ptr);
+    return rc == 0 and response_len == job.payload.len;
+}
+
+fn download(job: Job) bool {
+    var request: [12]u8 = undefined;
+    std.mem.writeInt(u64, request[0..8], job.scenario.size, .little);
+    std.mem.writeInt(u32, request[8..12], @intCast(job.payload.len), .little);
+
+    const Counter = struct {
+        received: usize = 0,
+
+        fn onMessage(ctx: ?*anyopaque, message: [*c]const u8, message_len: usize) callconv(.c) c_int {
+            _ = message;
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            self.received += message_len;
+            return 0;
+        }
+    };
+
+    var counter = Counter{};
+    var error_ptr: [*c]u8 = null;
+    const rc = c.mic_grpc_streaming_call(
+        job.server.targetZ(),
+        "localhost",
+        c.MIC_BENCH_DOWNLOAD,
+        &request,
+        request.len,
+        null,
+        job.server.useTls(),
+        c.MIC_GRPC_PROFILE_BULK,
+        null,
+        Counter.onMessage,
+        &counter,
+        &error_ptr,
+    );
+    if (error_ptr != null) c.mic_grpc_free(error_ptr);
+    return rc == 0 and counter.received == job.scenario.size;
+}
+
+fn upload(job: Job) bool {
+    const Producer = struct {
+        chunk: []const u8,
+        remaining: usize,
+
+        fn next(ctx: ?*anyopaque, message: [*c][*c]const u8, message_len: [*c]usize) callconv(.c) c_int {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            if (self.remaining == 0) return 0;
+            const len = @min(self.remaining, self.chunk.len);
+            message.* = self.chunk.ptr;
+            message_len.* = len;
+            self.remaining -= len;
+            return 1;
+        }
+    };
+
+    var producer = Producer{ .chunk = job.payload, .remaining = job.scenario.size };
+    var response: [*c]u8 = null;
+    var response_len: usize = 0;
+    var error_ptr: [*c]u8 = null;
+    const rc = c.mic_grpc_client_streaming_call(
+        job.server.targetZ(),
+        "localhost",
+        c.MIC_BENCH_UPLOAD,
+        null,
+        job.server.useTls(),
+        c.MIC_GRPC_PROFILE_BULK,
+        c.MIC_GRPC_COMPRESS_NONE,
+        null,
+        Producer.next,
+        &producer,
+        &response,
+        &response_len,
+        &error_ptr,
+    );
+    defer if (response != null) c.mic_grpc_free(response);
+    if (error_ptr != null) c.mic_grpc_free(error_ptr);
+    if (rc != 0 or response_len != 8) return false;
+
+    // The server counts raw DATA bytes, including the 5-byte gRPC message headers.
+    const messages = std.math.divCeil(usize, job.scenario.size, job.payload.len) catch unreachable;
+    return std.mem.readInt(u64, response[0..8], .little) == job.scenario.size + 5 * messages;
+}
+
+/// One mic_grpc_unary_call_many batch of `concurrency` echo calls per operation.
+fn runBatches(job: Job, latencies: []u64) usize {
+    var calls: [64]c.mic_grpc_batch_call = undefined;
+    const batch = calls[0..job.scenario.concurrency];
+    var failed: usize = 0;
+
+    for (latencies) |*latency| {
+        for (batch) |*call| {
+            call.* = std.mem.zeroes(c.mic_grpc_batch_call);
+            call.method = c.MIC_BENCH_ECHO;
+            call.request = job.payload.ptr;
+            call.request_len = job.payload.len;
+            call.compression = c.MIC_GRPC_COMPRESS_NONE;
+        }
+
+        const started = std.time.nanoTimestamp();
+        _ = c.mic_grpc_unary_call_many(
+            job.server.targetZ(),
+            "localhost",
+            null,
+            job.server.useTls(),
+            c.MIC_GRPC_PROFILE_LATENCY,
+            null,
+            batch.ptr,
+            batch.len,
+        );
+        latency.* = elapsedUs(started);
+
+        for (batch) |*call| {
+            if (call.error != null or call.response_len != job.payload.len) failed += 1;
+            if (call.response != null) c.mic_grpc_free(call.response);
+            if (call.error != null) c.mic_grpc_free(call.error);
+        }
+        job.finishCall();
+    }
+    return failed;
+}
+
+/// Keeps `concurrency` asynchronous echo calls in flight on one completion set.
+fn runAsync(allocator: std.mem.Allocator, job: Job, latencies: []u64) usize {
+    const set = c.mic_grpc_completion_set_new() orelse return latencies.len;
+    defer c.mic_grpc_completion_set_free(set);
+    const started = allocator.alloc(i128, latencies.len) catch return latencies.len;
+    defer allocator.free(started);
+
+    var failed: usize = 0;
+    var next: usize = 0;
+    var in_flight: usize = 0;
+    while (next < latencies.len or in_flight > 0) {
+        while (next < latencies.len and in_flight < job.scenario.concurrency) : (next += 1) {
+            var error_ptr: [*c]u8 = null;
+            started[next] = std.time.nanoTimestamp();
+            const call = c.mic_grpc_call_start(
+                set,
+                job.server.targetZ(),
+                "localhost",
+                job.server.useTls(),
+                c.MIC_GRPC_PROFILE_LATENCY,
+                c.MIC_BENCH_ECHO,
+                job.payload.ptr,
+                job.payload.len,
+                null,
+                null,
+                @ptrFromInt(next + 1),
+                &error_ptr,
+            );
+            if (call == null) {
+                if (error_ptr != null) c.mic_grpc_free(error_ptr);
+                failed += 1;
+                continue;
+            }
+            in_flight += 1;
+        }
+        if (in_flight == 0) continue;
+
+        const call = c.mic_grpc_completion_set_next(set, -1) orelse continue;
+        const index = @intFromPtr(c.mic_grpc_call_tag(call).?) - 1;
+        latencies[index] = @intCast(@divTrunc(std.time.nanoTimestamp() - started[index], std.time.ns_per_us));
+        in_flight -= 1;
+
+        var response: [*c]u8 = null;
+        var response_len: usize = 0;
+        var error_ptr: [*c]u8 = null;
+        const rc = c.mic_grpc_call_result(call, &response, &response_len, &error_ptr);
+        if (rc != 0 or response_len != job.payload.len) failed += 1;
+        if (response != null) c.mic_grpc_free(response);
+        if (error_ptr != null) c.mic_grpc_free(error_ptr);
+        c.mic_grpc_call_free(call);
+    }
+    return failed;
+}
+
+fn elapsedUs(started: i128) u64 {
+    return @intCast(@divTrunc(std.time.nanoTimestamp() - started, std.time.ns_per_us));
+}
+
+fn printResult(out: *std.Io.Writer, server: *const Server, scenario: Scenario, result: Result) !void {
+    const seconds = @as(f64, @floatFromInt(result.elapsed_ns)) / std.time.ns_per_s;
+    const mb_per_s = @as(f64, @floatFromInt(result.bytes)) / MiB / seconds;
+    const calls_per_s = @as(f64, @floatFromInt(result.calls)) / seconds;
+    const allocs_per_call = @as(f64, @floatFromInt(result.allocations)) / @as(f64, @floatFromInt(result.calls));
+
+    var size_buf: [16]u8 = undefined;
+    var rss_buf: [16]u8 = undefined;
+    const rss = if (result.peak_rss_kb) |kb|
+        try std.fmt.bufPrint(&rss_buf, "{d:.1}", .{@as(f64, @floatFromInt(kb)) / 1024})
+    else
+        "-";
+
+    try out.print("{s:<9} {s:<12} {s:>7} {d:>5} {s:<5} {d:>6} {d:>9.1} {d:>9.0} {d:>9.3} {d:>9.3} {d:>10.1} {d:>6} {s:>9} {d:>6}\n", .{
+        @tagName(server.transport),
+        @tagName(scenario.mode),
+        formatSize(&size_buf, scenario.size),
+        scenario.concurrency,
+        if (scenario.reuse) "on" else "off",
+        result.ops,
+        mb_per_s,
+        calls_per_s,
+        @as(f64, @floatFromInt(result.p50_us)) / 1000,
+        @as(f64, @floatFromInt(result.p99_us)) / 1000,
+        allocs_per_call,
+        result.connections,
+        rss,
+        result.failed,
+    });
+}
+
+fn formatSize(buf: []u8, size: usize) []const u8 {
+    const text = if (size >= MiB and size % MiB == 0)
+        std.fmt.bufPrint(buf, "{d}MiB", .{size / MiB})
+    else if (size >= KiB and size % KiB == 0)
+        std.fmt.bufPrint(buf, "{d}KiB", .{size / KiB})
+    else
+        std.fmt.bufPrint(buf, "{d}B", .{size});
+    return text catch "?";
+}
+
+/// Reset VmHWM so each scenario reports its own peak (Linux only).
+fn resetPeakRss() void {
+    const file = std.fs.openFileAbsolute("/proc/self/clear_refs", .{ .mode = .write_only }) catch return;
+    defer file.close();
+    file.writeAll("5") catch {};
+}
+
+fn peakRssKb() ?u64 {
+    const file = std.fs.openFileAbsolute("/proc/self/status", .{}) catch return null;
+    defer file.close();
+    var buf: [8192]u8 = undefined;
+    const len = file.readAll(&buf) catch return null;
+
+    var lines = std.mem.splitScalar(u8, buf[0..len], '\n');
+    while (lines.next()) |line| {
+        if (std.mem.startsWith(u8, line, "VmHWM:")) {
+            const value = std.mem.trim(u8, line["VmHWM:".len..], " \tkB");
+            return std.fmt.parseInt(u64, value, 10) catch null;
+        }
+    }
+    return null;
+}
+
+fn printZ(buf: []u8, comptime fmt: []const u8, args: anytype) ![:0]u8 {
+    const text = try std.fmt.bufPrint(buf[0 .. buf.len - 1], fmt, args);
+    buf[text.len] = 0;
+    return buf[0..text.len :0];
+}
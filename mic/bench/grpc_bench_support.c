@@ -0,0 +1,520 @@
+/*
+ * Support code for the gRPC transport benchmark: a loopback HTTP/2 gRPC
+ * server run in a child process, a throwaway TLS certificate for it, and
+ * allocation counting for the benchmarking process.
+ */
+
+#define _GNU_SOURCE
+
+#include "grpc_bench_support.h"
+
+#include <nghttp2/nghttp2.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+/* gRPC framing: 1 byte compression flag + 4 bytes big-endian length */
+#define GRPC_HEADER_SIZE 5
+
+/*
+ * Receive windows the server advertises. They are large so that the client's
+ * own flow-control settings, not the stand-in, decide throughput.
+ */
+#define SERVER_STREAM_WINDOW (16 << 20)
+#define SERVER_CONNECTION_WINDOW (1 << 30)
+
+#define READ_BUFFER_SIZE 65536
+#define PATTERN_SIZE 65536
+
+static uint64_t allocation_count = 0;
+
+#if defined(__GLIBC__)
+/*
+ * glibc lets the executable interpose malloc and keeps its own entry points
+ * under __libc_*, so every allocation in the process (transport, nghttp2,
+ * OpenSSL) can be counted and then forwarded.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+int mic_bench_counts_allocations(void) {
+    return 1;
+}
+#else
+int mic_bench_counts_allocations(void) {
+    return 0;
+}
+#endif
+
+uint64_t mic_bench_allocations(void) {
+    return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+}
+
+/* Certificate for localhost / 127.0.0.1, valid for a day */
+int mic_bench_write_certificate(const char *cert_path, const char *key_path) {
+    int rc = -1;
+    EVP_PKEY *key = NULL;
+    X509 *cert = NULL;
+    FILE *out = NULL;
+
+    EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (!key_ctx || EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) <= 0 ||
+        EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+        goto done;
+    }
+
+    cert = X509_new();
+    if (!cert) goto done;
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+    X509_set_pubkey(cert, key);
+
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    /* Self-signed and trusted directly, so it acts as its own CA */
+    X509V3_CTX ext_ctx;
+    X509V3_set_ctx_nodb(&ext_ctx);
+    X509V3_set_ctx(&ext_ctx, cert, cert, NULL, NULL, 0);
+    X509_EXTENSION *constraints = X509V3_EXT_conf_nid(NULL, &ext_ctx, NID_basic_constraints, "critical,CA:TRUE");
+    X509_EXTENSION *alt_names = X509V3_EXT_conf_nid(NULL, &ext_ctx, NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1");
+    int added = constraints && alt_names && X509_add_ext(cert, constraints, -1) && X509_add_ext(cert, alt_names, -1);
+    X509_EXTENSION_free(constraints);
+    X509_EXTENSION_free(alt_names);
+    if (!added || !X509_sign(cert, key, EVP_sha256())) goto done;
+
+    out = fopen(key_path, "w");
+    if (!out || !PEM_write_PrivateKey(out, key, NULL, NULL, 0, NULL, NULL)) goto done;
+    fclose(out);
+
+    out = fopen(cert_path, "w");
+    if (!out || !PEM_write_X509(out, cert)) goto done;
+    rc = 0;
+
+done:
+    if (out) fclose(out);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    EVP_PKEY_CTX_free(key_ctx);
+    return rc;
+}
+
+/* Server side of one request stream; nghttp2 stream user data */
+typedef enum {
+    METHOD_UNKNOWN = 0,
+    METHOD_ECHO,
+    METHOD_DOWNLOAD,
+    METHOD_UPLOAD,
+} bench_method;
+
+typedef struct {
+    bench_method method;
+
+    /* Request body (Echo, Download), or just its size (Upload) */
+    uint8_t *body;
+    size_t body_len;
+    size_t body_cap;
+    uint64_t received;
+
+    /* Response: a buffer (Echo, Upload) or generated messages (Download) */
+    uint8_t *response;
+    size_t response_len;
+    size_t response_sent;
+    uint8_t upload_reply[GRPC_HEADER_SIZE + 8];
+    uint64_t download_total;
+    uint64_t download_sent;
+    uint32_t message_size;
+    uint8_t message_header[GRPC_HEADER_SIZE];
+    size_t message_pos;
+    size_t message_len;
+} bench_stream;
+
+typedef struct {
+    int fd;
+    SSL *ssl;
+    nghttp2_session *session;
+} bench_connection;
+
+static uint8_t pattern[PATTERN_SIZE];
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const uint8_t *p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static void write_grpc_header(uint8_t *header, size_t len) {
+    header[0] = 0;
+    header[1] = (len >> 24) & 0xFF;
+    header[2] = (len >> 16) & 0xFF;
+    header[3] = (len >> 8) & 0xFF;
+    header[4] = len & 0xFF;
+}
+
+static ssize_t server_send_callback(nghttp2_session *session, const uint8_t *data,
+                                    size_t length, int flags, void *user_data) {
+    (void)session; (void)flags;
+    bench_connection *conn = user_data;
+    ssize_t ret = conn->ssl ? SSL_write(conn->ssl, data, (int)length)
+                            : send(conn->fd, data, length, MSG_NOSIGNAL);
+    return ret <= 0 ? NGHTTP2_ERR_CALLBACK_FAILURE : ret;
+}
+
+static int server_begin_headers_callback(nghttp2_session *session, const nghttp2_frame *frame,
+                                         void *user_data) {
+    (void)user_data;
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) return 0;
+
+    bench_stream *stream = calloc(1, sizeof(bench_stream));
+    if (!stream) return NGHTTP2_ERR_CALLBACK_FAILURE;
+    nghttp2_session_set_stream_user_data(session, frame->hd.stream_id, stream);
+    return 0;
+}
+
+static int server_header_callback(nghttp2_session *session, const nghttp2_frame *frame,
+                                  const uint8_t *name, size_t namelen,
+                                  const uint8_t *value, size_t valuelen,
+                                  uint8_t flags, void *user_data) {
+    (void)flags; (void)user_data;
+    bench_stream *stream = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if (!stream || namelen != 5 || memcmp(name, ":path", 5) != 0) return 0;
+
+    if (valuelen == strlen(MIC_BENCH_ECHO) && memcmp(value, MIC_BENCH_ECHO, valuelen) == 0) {
+        stream->method = METHOD_ECHO;
+    } else if (valuelen == strlen(MIC_BENCH_DOWNLOAD) && memcmp(value, MIC_BENCH_DOWNLOAD, valuelen) == 0) {
+        stream->method = METHOD_DOWNLOAD;
+    } else if (valuelen == strlen(MIC_BENCH_UPLOAD) && memcmp(value, MIC_BENCH_UPLOAD, valuelen) == 0) {
+        stream->method = METHOD_UPLOAD;
+    }
+    return 0;
+}
+
+static int server_data_chunk_callback(nghttp2_session *session, uint8_t flags, int32_t stream_id,
+                                      const uint8_t *data, size_t len, void *user_data) {
+    (void)flags; (void)user_data;
+    bench_stream *stream = nghttp2_session_get_stream_user_data(session, stream_id);
+    if (!stream) return 0;
+
+    stream->received += len;
+    if (stream->method == METHOD_UPLOAD) return 0;
+
+    if (stream->body_len + len > stream->body_cap) {
+        size_t cap = stream->body_cap ? stream->body_cap * 2 : 4096;
+        while (cap < stream->body_len + len) cap *= 2;
+        uint8_t *body = realloc(stream->body, cap);
+        if (!body) return NGHTTP2_ERR_CALLBACK_FAILURE;
+        stream->body = body;
+        stream->body_cap = cap;
+    }
+    memcpy(stream->body + stream->body_len, data, len);
+    stream->body_len += len;
+    return 0;
+}
+
+/* Copy the next part of a generated Download response into buf */
+static size_t fill_download(bench_stream *stream, uint8_t *buf, size_t length) {
+    size_t filled = 0;
+    while (filled < length) {
+        if (stream->message_pos == 0) {
+            if (stream->download_sent == stream->download_total) break;
+            uint64_t left = stream->download_total - stream->download_sent;
+            stream->message_len = left < stream->message_size ? (size_t)left : stream->message_size;
+            write_grpc_header(stream->message_header, stream->message_len);
+        }
+
+        size_t take;
+        if (stream->message_pos < GRPC_HEADER_SIZE) {
+            take = GRPC_HEADER_SIZE - stream->message_pos;
+            if (take > length - filled) take = length - filled;
+            memcpy(buf + filled, stream->message_header + stream->message_pos, take);
+        } else {
+            size_t offset = stream->message_pos - GRPC_HEADER_SIZE;
+            take = stream->message_len - offset;
+            if (take > length - filled) take = length - filled;
+            if (take > PATTERN_SIZE) take = PATTERN_SIZE;
+            memcpy(buf + filled, pattern, take);
+            stream->download_sent += take;
+        }
+        filled += take;
+        stream->message_pos += take;
+        if (stream->message_pos == GRPC_HEADER_SIZE + stream->message_len) stream->message_pos = 0;
+    }
+    return filled;
+}
+
+static ssize_t server_read_callback(nghttp2_session *session, int32_t stream_id,
+                                    uint8_t *buf, size_t length, uint32_t *data_flags,
+                                    nghttp2_data_source *source, void *user_data) {
+    (void)user_data;
+    bench_stream *stream = source->ptr;
+    size_t filled;
+    int done;
+
+    if (stream->method == METHOD_DOWNLOAD) {
+        filled = fill_download(stream, buf, length);
+        done = stream->download_sent == stream->download_total && stream->message_pos == 0;
+    } else {
+        filled = stream->response_len - stream->response_sent;
+        if (filled > length) filled = length;
+        memcpy(buf, stream->response + stream->response_sent, filled);
+        stream->response_sent += filled;
+        done = stream->response_sent == stream->response_len;
+    }
+
+    if (done) {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF | NGHTTP2_DATA_FLAG_NO_END_STREAM;
+        nghttp2_nv trailers[] = {
+            { (uint8_t *)"grpc-status", (uint8_t *)"0", 11, 1, NGHTTP2_NV_FLAG_NONE },
+        };
+        if (nghttp2_submit_trailer(session, stream_id, trailers, 1) != 0) {
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+    }
+    return (ssize_t)filled;
+}
+
+/* The request is complete; answer it */
+static int respond(nghttp2_session *session, int32_t stream_id, bench_stream *stream) {
+    nghttp2_nv headers[] = {
+        { (uint8_t *)":status", (uint8_t *)"200", 7, 3, NGHTTP2_NV_FLAG_NONE },
+        { (uint8_t *)"content-type", (uint8_t *)"application/grpc", 12, 16, NGHTTP2_NV_FLAG_NONE },
+        { (uint8_t *)"grpc-status", (uint8_t *)"12", 11, 2, NGHTTP2_NV_FLAG_NONE },
+    };
+
+    switch (stream->method) {
+    case METHOD_ECHO:
+        stream->response = stream->body;
+        stream->response_len = stream->body_len;
+        break;
+    case METHOD_UPLOAD:
+        write_grpc_header(stream->upload_reply, 8);
+        for (int i = 0; i < 8; i++) {
+            stream->upload_reply[GRPC_HEADER_SIZE + i] = (uint8_t)(stream->received >> (8 * i));
+        }
+        stream->response = stream->upload_reply;
+        stream->response_len = sizeof(stream->upload_reply);
+        break;
+    case METHOD_DOWNLOAD:
+        if (stream->body_len < GRPC_HEADER_SIZE + 12) {
+            stream->method = METHOD_UNKNOWN;
+            break;
+        }
+        stream->download_total = read_le64(stream->body + GRPC_HEADER_SIZE);
+        stream->message_size = read_le32(stream->body + GRPC_HEADER_SIZE + 8);
+        if (stream->message_size == 0) stream->message_size = 1;
+        break;
+    case METHOD_UNKNOWN:
+        break;
+    }
+
+    /* Unknown methods get a trailers-only UNIMPLEMENTED response */
+    if (stream->method == METHOD_UNKNOWN) {
+        return nghttp2_submit_response(session, stream_id, headers, 3, NULL);
+    }
+
+    nghttp2_data_provider provider;
+    provider.source.ptr = stream;
+    provider.read_callback = server_read_callback;
+    return nghttp2_submit_response(session, stream_id, headers, 2, &provider);
+}
+
+static int server_frame_recv_callback(nghttp2_session *session, const nghttp2_frame *frame,
+                                      void *user_data) {
+    (void)user_data;
+    if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+        !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+        return 0;
+    }
+    bench_stream *stream = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if (!stream) return 0;
+    return respond(session, frame->hd.stream_id, stream) == 0 ? 0 : NGHTTP2_ERR_CALLBACK_FAILURE;
+}
+
+static int server_stream_close_callback(nghttp2_session *session, int32_t stream_id,
+                                        uint32_t error_code, void *user_data) {
+    (void)error_code; (void)user_data;
+    bench_stream *stream = nghttp2_session_get_stream_user_data(session, stream_id);
+    if (stream) {
+        free(stream->body);
+        free(stream);
+    }
+    return 0;
+}
+
+static int server_alpn_callback(SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                                const unsigned char *in, unsigned int inlen, void *arg) {
+    (void)ssl; (void)arg;
+    if (SSL_select_next_proto((unsigned char **)out, outlen, (const unsigned char *)"\x02h2", 3,
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_ALERT_FATAL;
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+/* One thread per connection, blocking I/O: read, feed nghttp2, write what it queued */
+static void *serve_connection(void *arg) {
+    bench_connection *conn = arg;
+
+    int flag = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    if (conn->ssl) {
+        SSL_set_fd(conn->ssl, conn->fd);
+        if (SSL_accept(conn->ssl) != 1) goto done;
+    }
+
+    nghttp2_session_callbacks *callbacks;
+    if (nghttp2_session_callbacks_new(&callbacks) != 0) goto done;
+    nghttp2_session_callbacks_set_send_callback(callbacks, server_send_callback);
+    nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, server_begin_headers_callback);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, server_header_callback);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, server_data_chunk_callback);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, server_frame_recv_callback);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, server_stream_close_callback);
+    int ret = nghttp2_session_server_new(&conn->session, callbacks, conn);
+    nghttp2_session_callbacks_del(callbacks);
+    if (ret != 0) goto done;
+
+    nghttp2_settings_entry settings[] = {
+        { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 1000 },
+        { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, SERVER_STREAM_WINDOW },
+    };
+    nghttp2_submit_settings(conn->session, NGHTTP2_FLAG_NONE, settings, 2);
+    nghttp2_session_set_local_window_size(conn->session, NGHTTP2_FLAG_NONE, 0, SERVER_CONNECTION_WINDOW);
+
+    uint8_t buf[READ_BUFFER_SIZE];
+    while (nghttp2_session_send(conn->session) == 0 &&
+           (nghttp2_session_want_read(conn->session) || nghttp2_session_want_write(conn->session))) {
+        ssize_t n = conn->ssl ? SSL_read(conn->ssl, buf, sizeof(buf)) : recv(conn->fd, buf, sizeof(buf), 0);
+        if (n <= 0 && !(n < 0 && !conn->ssl && errno == EINTR)) break;
+        if (n > 0 && nghttp2_session_mem_recv(conn->session, buf, (size_t)n) < 0) break;
+    }
+
+done:
+    if (conn->session) nghttp2_session_del(conn->session);
+    if (conn->ssl) SSL_free(conn->ssl);
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+static void accept_loop(int listen_fd, SSL_CTX *tls_ctx) {
+    for (int i = 0; i < PATTERN_SIZE; i++) pattern[i] = (uint8_t)i;
+
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+
+        bench_connection *conn = calloc(1, sizeof(bench_connection));
+        if (conn) {
+            conn->fd = fd;
+            conn->ssl = tls_ctx ? SSL_new(tls_ctx) : NULL;
+        }
+        pthread_t thread;
+        if (!conn || (tls_ctx && !conn->ssl) || pthread_create(&thread, NULL, serve_connection, conn) != 0) {
+            if (conn && conn->ssl) SSL_free(conn->ssl);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+pid_t mic_bench_server_spawn(const char *cert_path, const char *key_path, int *port_out) {
+    SSL_CTX *tls_ctx = NULL;
+    if (cert_path) {
+        tls_ctx = SSL_CTX_new(TLS_server_method());
+        if (!tls_ctx ||
+            SSL_CTX_use_certificate_file(tls_ctx, cert_path, SSL_FILETYPE_PEM) != 1 ||
+            SSL_CTX_use_PrivateKey_file(tls_ctx, key_path, SSL_FILETYPE_PEM) != 1) {
+            SSL_CTX_free(tls_ctx);
+            return -1;
+        }
+        SSL_CTX_set_alpn_select_cb(tls_ctx, server_alpn_callback, NULL);
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 256) != 0 ||
+        getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        if (listen_fd >= 0) close(listen_fd);
+        SSL_CTX_free(tls_ctx);
+        return -1;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+#ifdef __linux__
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        signal(SIGPIPE, SIG_IGN);
+        accept_loop(listen_fd, tls_ctx);
+        _exit(0);
+    }
+
+    close(listen_fd);
+    SSL_CTX_free(tls_ctx);
+    if (pid < 0) return -1;
+    *port_out = ntohs(addr.sin_port);
+    return pid;
+}
+
+void mic_bench_server_stop(pid_t pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGTERM);
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MIC_GRPC_BENCH_SUPPORT_H
+#define MIC_GRPC_BENCH_SUPPORT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Loopback stand-in for the forge's gRPC server, used by the transport
+ * benchmark. It serves three methods; integers are little endian:
+ *
+ *   /mic.bench.Bench/Echo      responds with the request messages unchanged
+ *   /mic.bench.Bench/Download  request is a u64 byte total and a u32 message
+ *                              size; streams that many bytes back
+ *   /mic.bench.Bench/Upload    responds with the u64 count of request bytes
+ */
+#define MIC_BENCH_ECHO "/mic.bench.Bench/Echo"
+#define MIC_BENCH_DOWNLOAD "/mic.bench.Bench/Download"
+#define MIC_BENCH_UPLOAD "/mic.bench.Bench/Upload"
+
+/* Write a new self-signed certificate and private key (PEM) for localhost. Returns 0 on success. */
+int mic_bench_write_certificate(const char *cert_path, const char *key_path);
+
+/*
+ * Fork a server process listening on a kernel-chosen loopback port. With a
+ * certificate it speaks TLS (ALPN h2), otherwise cleartext HTTP/2. Returns the
+ * child's pid, or -1.
+ */
+pid_t mic_bench_server_spawn(const char *cert_path, const char *key_path, int *port_out);
+
+void mic_bench_server_stop(pid_t pid);
+
+/*
+ * Heap allocations (malloc, calloc, realloc) made by this process so far.
+ * Only counted where the C library allows interposing malloc; see
+ * mic_bench_counts_allocations.
+ */
+uint64_t mic_bench_allocations(void);
+int mic_bench_counts_allocations(void);
+
+#endif
@@ -48,6 +48,8 @@ pub fn build(b: *std.Build) void {
             exe_val.linkSystemLibrary("nghttp2");
             exe_val.linkSystemLibrary("ssl");
             exe_val.linkSystemLibrary("crypto");
+            exe_val.linkSystemLibrary("z");
+            exe_val.linkSystemLibrary("zstd");
         } else {
             // Legacy gRPC backend (heavy, 10+ minute build)
             exe_val.addCSourceFile(.{
@@ -77,6 +79,42 @@ pub fn build(b: *std.Build) void {
         run_step.dependOn(&run_cmd.step);
     }
 
+    // gRPC transport benchmark against a loopback server (nghttp2 backend only)
+    if (use_nghttp2 and target.result.os.tag != .freestanding) {
+        const bench_exe = b.addExecutable(.{
+            .name = "grpc-bench",
+            .root_module = b.createModule(.{
+                .root_source_file = b.path("bench/grpc_bench.zig"),
+                .target = target,
+                // Timings from a Debug build say little about the transport.
+                .optimize = if (optimize == .Debug) .ReleaseFast else optimize,
+            }),
+        });
+        bench_exe.addIncludePath(b.path("src"));
+        bench_exe.addIncludePath(b.path("bench"));
+        bench_exe.linkLibC();
+        bench_exe.addCSourceFile(.{
+            .file = b.path("src/grpc/http2_client.c"),
+            .flags = &.{"-std=c11"},
+        });
+        bench_exe.addCSourceFile(.{
+            .file = b.path("bench/grpc_bench_support.c"),
+            .flags = &.{"-std=c11"},
+        });
+        bench_exe.linkSystemLibrary("nghttp2");
+        bench_exe.linkSystemLibrary("ssl");
+        bench_exe.linkSystemLibrary("crypto");
+        bench_exe.linkSystemLibrary("z");
+        bench_exe.linkSystemLibrary("zstd");
+
+        const bench_cmd = b.addRunArtifact(bench_exe);
+        if (b.args) |args| {
+            bench_cmd.addArgs(args);
+        }
+        const bench_step = b.step("bench-grpc", "Benchmark the gRPC transport against a loopback server");
+        bench_step.dependOn(&bench_cmd.step);
+    }
+
     // Test step
     const test_step = b.step("test", "Run unit tests");
 
@@ -160,6 +198,36 @@ pub fn build(b: *std.Build) void {
     });
     test_step.dependOn(&b.addRunArtifact(nfs_tests).step);
 
+    // Mount block cache tests
+    const blocks_tests = b.addTest(.{
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/fs/blocks.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    test_step.dependOn(&b.addRunArtifact(blocks_tests).step);
+
+    // Overlay journal tests
+    const journal_tests = b.addTest(.{
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/fs/journal.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    test_step.dependOn(&b.addRunArtifact(journal_tests).step);
+
+    // mic-fs daemon tests (fs/server.zig, fs/state.zig and the overlay)
+    const fs_daemon_tests = b.addTest(.{
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/fs_daemon.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    test_step.dependOn(&b.addRunArtifact(fs_daemon_tests).step);
+
     // Mount module tests
     const mount_tests = b.addTest(.{
         .root_module = b.createModule(.{
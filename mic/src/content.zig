@@ -4,15 +4,20 @@ const config = @import("config.zig");
 const grpc_client = @import("grpc/client.zig");
 const content_proto = @import("grpc/content_proto.zig");
 const grpc_endpoint = @import("grpc/endpoint.zig");
-const http = @import("http.zig");
 const projects_proto = @import("grpc/projects_proto.zig");
 
 pub const BlobFetchOptions = struct {
     cdn_base_url: ?[]const u8 = null,
     project_id: ?[]const u8 = null,
     access_token: ?[]const u8 = null,
+    /// Parsed once up front so per-blob fetches skip URL parsing.
+    endpoint: ?grpc_endpoint.Endpoint = null,
+    /// Set together with `cdn_base_url`; shared by every fetch using these options.
+    cdn_client: ?*CdnClient = null,
 
     pub fn deinit(self: *BlobFetchOptions, allocator: std.mem.Allocator) void {
+        if (self.cdn_client) |cdn_client| cdn_client.destroy(allocator);
+        if (self.endpoint) |endpoint| allocator.free(endpoint.target);
         if (self.cdn_base_url) |url| allocator.free(url);
         if (self.project_id) |id| allocator.free(id);
         self.* = undefined;
@@ -42,7 +47,7 @@ pub fn ls(
 
     const response = try grpc_client.unaryCall(
         arena_alloc,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         if (position != null)
             "/micelio.content.v1.ContentService/GetTreeAtPosition"
         else
@@ -110,7 +115,7 @@ pub fn blame(
 
     const response = try grpc_client.unaryCall(
         arena_alloc,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetBlame",
         request,
         access_token,
@@ -162,7 +167,7 @@ pub fn getPath(
 
         const response = try grpc_client.unaryCall(
             arena_alloc,
-            endpoint,
+            endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
             "/micelio.content.v1.ContentService/GetTreeAtPosition",
             request,
             access_token,
@@ -209,6 +214,10 @@ pub fn prepareBlobFetchOptions(
     access_token: ?[]const u8,
 ) !BlobFetchOptions {
     var options = BlobFetchOptions{ .access_token = access_token };
+    if (grpc_endpoint.parseServer(allocator, server)) |endpoint| {
+        options.endpoint = endpoint.withProfile(.bulk);
+    } else |_| {}
+    errdefer options.deinit(allocator);
 
     var cfg = config.Config.load(allocator) catch return options;
     defer cfg.deinit();
@@ -221,6 +230,13 @@ pub fn prepareBlobFetchOptions(
             options.cdn_base_url = null;
             return options;
         };
+        options.cdn_client = CdnClient.create(allocator, CdnClient.default_max_connections) catch {
+            allocator.free(options.project_id.?);
+            options.project_id = null;
+            allocator.free(options.cdn_base_url.?);
+            options.cdn_base_url = null;
+            return options;
+        };
     }
 
     return options;
@@ -235,9 +251,10 @@ pub fn fetchBlobWithOptions(
     options: ?*const BlobFetchOptions,
 ) ![]const u8 {
     if (options) |opts| {
-        if (opts.cdn_base_url != null and opts.project_id != null) {
+        if (opts.cdn_client) |cdn_client| {
             const cdn_blob = fetchBlobFromCdn(
                 allocator,
+                cdn_client,
                 opts.cdn_base_url.?,
                 opts.project_id.?,
                 blob_hash,
@@ -254,25 +271,212 @@ pub fn fetchBlobWithOptions(
         account,
         project,
         blob_hash,
-        if (options) |opts| opts.access_token else null,
+        options,
     );
 }
 
+/// Streams a blob into `sink.writeChunk([]const u8) !void` as it arrives, from
+/// the CDN when one is configured and has it, otherwise over StreamBlob.
+/// Memory is bounded by the chunk size rather than the blob size. If a CDN
+/// response fails after some bytes reached the sink, the error is returned
+/// so the caller can start over.
+pub fn streamBlobWithOptions(
+    allocator: std.mem.Allocator,
+    server: []const u8,
+    account: []const u8,
+    project: []const u8,
+    blob_hash: []const u8,
+    options: ?*const BlobFetchOptions,
+    sink: anytype,
+) !void {
+    if (options) |opts| {
+        if (opts.cdn_client) |cdn_client| {
+            const CountingSink = struct {
+                inner: @TypeOf(sink),
+                bytes: usize = 0,
+
+                pub fn writeChunk(self: *@This(), chunk: []const u8) !void {
+                    self.bytes += chunk.len;
+                    try self.inner.writeChunk(chunk);
+                }
+            };
+            var counting = CountingSink{ .inner = sink };
+
+            const url = try cdnUrlForBlob(allocator, opts.cdn_base_url.?, opts.project_id.?, blob_hash);
+            defer allocator.free(url);
+
+            const found = cdn_client.stream(url, &counting) catch |err| blk: {
+                if (counting.bytes > 0) return err;
+                break :blk false;
+            };
+            if (found) return;
+        }
+    }
+
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const arena_alloc = arena.allocator();
+
+    const access_token = if (options) |opts| opts.access_token else null;
+    const token = access_token orelse try auth.requireAccessTokenWithMessage(arena_alloc);
+
+    const endpoint = try blobEndpoint(arena_alloc, server, options);
+    const request = try content_proto.encodeGetBlobRequest(arena_alloc, account, project, blob_hash);
+
+    const ChunkSink = struct {
+        inner: @TypeOf(sink),
+
+        pub fn onMessage(self: *@This(), message: []const u8) !void {
+            try self.inner.writeChunk(try content_proto.decodeBlobChunk(message));
+        }
+    };
+    var chunk_sink = ChunkSink{ .inner = sink };
+
+    const result = try grpc_client.streamCallResult(
+        arena_alloc,
+        endpoint,
+        "/micelio.content.v1.ContentService/StreamBlob",
+        request,
+        token,
+        &chunk_sink,
+    );
+    switch (result) {
+        .ok => {},
+        .err => return error.RequestFailed,
+    }
+}
+
+/// Limits for coalescing blob fetches into GetBlobs calls.
+pub const BatchOptions = struct {
+    /// Hashes per GetBlobs call.
+    max_blobs: usize = 64,
+    /// Blobs above this are handed back for the caller to stream on its own.
+    small_blob_bytes: u64 = 256 * 1024,
+    /// Response budget per call; the server stops before the blob that would
+    /// go past it, and the rest are asked for in the next call.
+    max_batch_bytes: u64 = 4 * 1024 * 1024,
+};
+
+/// Fetches `blob_hashes` over GetBlobs, `batch.max_blobs` at a time, instead
+/// of one call per blob. Each returned blob goes to
+/// `sink.onBlob(blob_hash, content) !void`, where `content` is only valid for
+/// the duration of the call. Blobs over `batch.small_blob_bytes` go to
+/// `sink.onLarge(blob_hash) !void` instead. The hashes passed to the sink are
+/// elements of `blob_hashes`, which must not contain duplicates. This path
+/// always uses gRPC; callers with a CDN configured should prefer per-blob
+/// fetches.
+pub fn fetchBlobsCoalesced(
+    allocator: std.mem.Allocator,
+    server: []const u8,
+    account: []const u8,
+    project: []const u8,
+    blob_hashes: []const []const u8,
+    options: ?*const BlobFetchOptions,
+    batch: BatchOptions,
+    sink: anytype,
+) !void {
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const arena_alloc = arena.allocator();
+
+    const access_token = if (options) |opts| opts.access_token else null;
+    const token = access_token orelse try auth.requireAccessTokenWithMessage(arena_alloc);
+    const endpoint = try blobEndpoint(arena_alloc, server, options);
+
+    var pending: std.ArrayList([]const u8) = .empty;
+    try pending.appendSlice(arena_alloc, blob_hashes);
+
+    var call_arena = std.heap.ArenaAllocator.init(allocator);
+    defer call_arena.deinit();
+
+    while (pending.items.len > 0) {
+        _ = call_arena.reset(.retain_capacity);
+        const call_alloc = call_arena.allocator();
+
+        const take = @min(@max(batch.max_blobs, 1), pending.items.len);
+        const hashes = pending.items[0..take];
+
+        const BatchSink = struct {
+            inner: @TypeOf(sink),
+            hashes: []const []const u8,
+            small_blob_bytes: u64,
+            allocator: std.mem.Allocator,
+            retry: std.ArrayList([]const u8) = .empty,
+            answered: []bool,
+
+            pub fn onMessage(self: *@This(), message: []const u8) !void {
+                const entry = try content_proto.decodeBlobEntry(message);
+                const idx = for (self.hashes, 0..) |candidate, i| {
+                    if (std.mem.eql(u8, candidate, entry.blob_hash)) break i;
+                } else return error.InvalidResponse;
+                if (self.answered[idx]) return error.InvalidResponse;
+                self.answered[idx] = true;
+                const blob_hash = self.hashes[idx];
+
+                if (!entry.deferred) return self.inner.onBlob(blob_hash, entry.content);
+                if (entry.size > self.small_blob_bytes) return self.inner.onLarge(blob_hash);
+                try self.retry.append(self.allocator, blob_hash);
+            }
+        };
+        var batch_sink = BatchSink{
+            .inner = sink,
+            .hashes = hashes,
+            .small_blob_bytes = batch.small_blob_bytes,
+            .allocator = arena_alloc,
+            .answered = try call_alloc.alloc(bool, take),
+        };
+        @memset(batch_sink.answered, false);
+
+        const request = try content_proto.encodeGetBlobsRequest(
+            call_alloc,
+            account,
+            project,
+            hashes,
+            batch.small_blob_bytes,
+            batch.max_batch_bytes,
+        );
+        const result = try grpc_client.streamCallResult(
+            call_alloc,
+            endpoint,
+            "/micelio.content.v1.ContentService/GetBlobs",
+            request,
+            token,
+            &batch_sink,
+        );
+        switch (result) {
+            .ok => {},
+            .err => return error.RequestFailed,
+        }
+
+        // Hashes past the response budget get no entry and go out again.
+        for (hashes, batch_sink.answered) |blob_hash, answered| {
+            if (!answered) try batch_sink.retry.append(arena_alloc, blob_hash);
+        }
+        // The server always sends the first blob that fits, so a batch that
+        // made no progress at all means it is misbehaving.
+        if (batch_sink.retry.items.len == take) return error.InvalidResponse;
+
+        try batch_sink.retry.appendSlice(arena_alloc, pending.items[take..]);
+        pending = batch_sink.retry;
+    }
+}
+
 fn fetchBlobFromGrpc(
     allocator: std.mem.Allocator,
     server: []const u8,
     account: []const u8,
     project: []const u8,
     blob_hash: []const u8,
-    access_token: ?[]const u8,
+    options: ?*const BlobFetchOptions,
 ) ![]const u8 {
     var arena = std.heap.ArenaAllocator.init(allocator);
     defer arena.deinit();
     const arena_alloc = arena.allocator();
 
+    const access_token = if (options) |opts| opts.access_token else null;
     const token = access_token orelse try auth.requireAccessTokenWithMessage(arena_alloc);
 
-    const endpoint = try grpc_endpoint.parseServer(arena_alloc, server);
+    const endpoint = try blobEndpoint(arena_alloc, server, options);
     const request = try content_proto.encodeGetBlobRequest(arena_alloc, account, project, blob_hash);
     defer arena_alloc.free(request);
 
@@ -289,8 +493,78 @@ fn fetchBlobFromGrpc(
     return allocator.dupe(u8, parsed);
 }
 
+fn blobEndpoint(
+    arena_alloc: std.mem.Allocator,
+    server: []const u8,
+    options: ?*const BlobFetchOptions,
+) !grpc_endpoint.Endpoint {
+    if (options) |opts| {
+        if (opts.endpoint) |endpoint| return endpoint;
+    }
+    return (try grpc_endpoint.parseServer(arena_alloc, server)).withProfile(.bulk);
+}
+
+/// Shared HTTP client for CDN blob reads. Connections are kept alive and
+/// reused across blobs, and at most `max_connections` requests are in
+/// flight at once. std.http.Client opens connections thread-safely, so one
+/// instance serves every fetch worker.
+pub const CdnClient = struct {
+    http_client: std.http.Client,
+    slots: std.Thread.Semaphore,
+
+    pub const default_max_connections: usize = 8;
+
+    pub fn create(allocator: std.mem.Allocator, max_connections: usize) !*CdnClient {
+        const self = try allocator.create(CdnClient);
+        self.* = .{
+            .http_client = .{ .allocator = allocator },
+            .slots = .{ .permits = max_connections },
+        };
+        self.http_client.connection_pool.free_size = max_connections;
+        return self;
+    }
+
+    pub fn destroy(self: *CdnClient, allocator: std.mem.Allocator) void {
+        self.http_client.deinit();
+        allocator.destroy(self);
+    }
+
+    /// Streams the object at `url` into `sink.writeChunk([]const u8) !void`
+    /// straight from the connection buffer. Returns false, without touching
+    /// the sink, when the CDN answers with anything but 200.
+    pub fn stream(self: *CdnClient, url: []const u8, sink: anytype) !bool {
+        self.slots.wait();
+        defer self.slots.post();
+
+        const uri = try std.Uri.parse(url);
+        var request = try self.http_client.request(.GET, uri, .{
+            // Blobs are stored raw; skip decompression and its extra copy.
+            .headers = .{ .accept_encoding = .omit },
+        });
+        defer request.deinit();
+
+        try request.sendBodiless();
+        var redirect_buffer: [1024]u8 = undefined;
+        var response = try request.receiveHead(&redirect_buffer);
+        if (response.head.status != .ok) return false;
+
+        var transfer_buffer: [64 * 1024]u8 = undefined;
+        const body = response.reader(&transfer_buffer);
+        while (true) {
+            const chunk = body.peekGreedy(1) catch |err| switch (err) {
+                error.EndOfStream => break,
+                error.ReadFailed => return response.bodyErr() orelse err,
+            };
+            try sink.writeChunk(chunk);
+            body.toss(chunk.len);
+        }
+        return true;
+    }
+};
+
 fn fetchBlobFromCdn(
     allocator: std.mem.Allocator,
+    cdn_client: *CdnClient,
     cdn_base_url: []const u8,
     project_id: []const u8,
     blob_hash: []const u8,
@@ -298,15 +572,22 @@ fn fetchBlobFromCdn(
     const url = try cdnUrlForBlob(allocator, cdn_base_url, project_id, blob_hash);
     defer allocator.free(url);
 
-    var client = std.http.Client{ .allocator = allocator };
-    defer client.deinit();
+    const BodySink = struct {
+        allocator: std.mem.Allocator,
+        body: std.ArrayList(u8) = .empty,
 
-    const response = try http.get(allocator, &client, url);
-    defer allocator.free(response.body);
+        pub fn writeChunk(self: *@This(), chunk: []const u8) !void {
+            try self.body.appendSlice(self.allocator, chunk);
+        }
+    };
+    var sink = BodySink{ .allocator = allocator };
+    errdefer sink.body.deinit(allocator);
 
-    if (response.status != .ok) return null;
-    const duped = try allocator.dupe(u8, response.body);
-    return duped;
+    if (!try cdn_client.stream(url, &sink)) {
+        sink.body.deinit(allocator);
+        return null;
+    }
+    return try sink.body.toOwnedSlice(allocator);
 }
 
 fn fetchProjectId(
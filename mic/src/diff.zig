@@ -99,7 +99,7 @@ fn fetchTreeAtPosition(
 
     const response = try grpc_client.unaryCall(
         allocator,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetTreeAtPosition",
         request,
         token,
@@ -126,7 +126,7 @@ fn fetchHeadTree(
 
     const response = try grpc_client.unaryCall(
         allocator,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetHeadTree",
         request,
         token,
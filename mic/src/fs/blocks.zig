@@ -0,0 +1,367 @@
+//! Block storage behind NFS READ and WRITE.
+//!
+//! Committed content is held whole in refcounted, page-aligned buffers keyed
+//! by blob hash, so a run of READs slices one fetched copy instead of fetching
+//! the blob per call. Writes land in fixed-size dirty blocks layered over that
+//! content, and the full file is only assembled when the client commits.
+
+const std = @import("std");
+
+/// Dirty block granularity; matches the wtmax advertised in FSINFO.
+pub const block_size: usize = 64 * 1024;
+
+/// Cached content kept when the caller does not pick a limit.
+pub const default_max_bytes: usize = 256 * 1024 * 1024;
+
+const page_align = std.heap.page_size_min;
+const page_alignment: std.mem.Alignment = .fromByteUnits(page_align);
+
+/// Immutable file content shared between the cache and readers. Freed when
+/// the last reference is released.
+pub const Blob = struct {
+    allocator: std.mem.Allocator,
+    data: []align(page_align) u8,
+    refs: std.atomic.Value(u32),
+    last_use: u64 = 0,
+
+    /// Copies `content`; the caller holds the only reference.
+    pub fn create(allocator: std.mem.Allocator, content: []const u8) !*Blob {
+        const data = try allocator.alignedAlloc(u8, page_alignment, content.len);
+        errdefer allocator.free(data);
+        @memcpy(data, content);
+
+        const blob = try allocator.create(Blob);
+        blob.* = .{ .allocator = allocator, .data = data, .refs = std.atomic.Value(u32).init(1) };
+        return blob;
+    }
+
+    pub fn retain(self: *Blob) void {
+        _ = self.refs.fetchAdd(1, .monotonic);
+    }
+
+    pub fn release(self: *Blob) void {
+        if (self.refs.fetchSub(1, .acq_rel) != 1) return;
+        const allocator = self.allocator;
+        allocator.free(self.data);
+        allocator.destroy(self);
+    }
+};
+
+/// Blobs recently read or written over the mount, evicted least recently
+/// used first once `max_bytes` is reached. Thread-safe.
+pub const ContentCache = struct {
+    allocator: std.mem.Allocator,
+    max_bytes: usize,
+    mutex: std.Thread.Mutex = .{},
+    blobs: std.StringHashMap(*Blob),
+    bytes: usize = 0,
+    clock: u64 = 0,
+
+    pub fn init(allocator: std.mem.Allocator, max_bytes: usize) ContentCache {
+        return .{
+            .allocator = allocator,
+            .max_bytes = max_bytes,
+            .blobs = std.StringHashMap(*Blob).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *ContentCache) void {
+        var iter = self.blobs.iterator();
+        while (iter.next()) |entry| {
+            self.allocator.free(entry.key_ptr.*);
+            entry.value_ptr.*.release();
+        }
+        self.blobs.deinit();
+        self.* = undefined;
+    }
+
+    /// Returns a reference the caller must release, or null on a miss.
+    pub fn acquire(self: *ContentCache, hash_hex: []const u8) ?*Blob {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const blob = self.blobs.get(hash_hex) orelse return null;
+        self.touch(blob);
+        blob.retain();
+        return blob;
+    }
+
+    /// Caches a copy of `content` and returns a reference to it. If another
+    /// thread cached the same blob first, that copy is returned instead.
+    pub fn insert(self: *ContentCache, hash_hex: []const u8, content: []const u8) !*Blob {
+        const blob = try Blob.create(self.allocator, content);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.blobs.get(hash_hex)) |existing| {
+            self.touch(existing);
+            existing.retain();
+            blob.release();
+            return existing;
+        }
+
+        // Too large to keep; the caller's reference is the only one.
+        if (content.len > self.max_bytes) return blob;
+
+        self.evictFor(content.len);
+        const key = self.allocator.dupe(u8, hash_hex) catch return blob;
+        self.blobs.put(key, blob) catch {
+            self.allocator.free(key);
+            return blob;
+        };
+        blob.retain();
+        self.touch(blob);
+        self.bytes += content.len;
+        return blob;
+    }
+
+    fn touch(self: *ContentCache, blob: *Blob) void {
+        self.clock += 1;
+        blob.last_use = self.clock;
+    }
+
+    fn evictFor(self: *ContentCache, incoming: usize) void {
+        while (self.bytes + incoming > self.max_bytes and self.blobs.count() > 0) {
+            var oldest: ?std.StringHashMap(*Blob).Entry = null;
+            var iter = self.blobs.iterator();
+            while (iter.next()) |entry| {
+                if (oldest == null or entry.value_ptr.*.last_use < oldest.?.value_ptr.*.last_use) {
+                    oldest = entry;
+                }
+            }
+
+            const removed = self.blobs.fetchRemove(oldest.?.key_ptr.*).?;
+            self.bytes -= removed.value.data.len;
+            self.allocator.free(removed.key);
+            // Readers still holding it keep it alive until they finish.
+            removed.value.release();
+        }
+    }
+};
+
+/// A run of written bytes within a file.
+pub const Extent = struct {
+    offset: u64,
+    data: []const u8,
+
+    fn lessThan(_: void, a: Extent, b: Extent) bool {
+        return a.offset < b.offset;
+    }
+};
+
+/// Unflushed writes to one file: its content before the first write, plus
+/// every block written since. Not thread-safe; RepoState guards it.
+pub const DirtyFile = struct {
+    allocator: std.mem.Allocator,
+    /// Content before the first write.
+    base: []const u8,
+    /// Keeps `base` alive when it came from the cache; null when it is
+    /// borrowed or the file started empty.
+    base_blob: ?*Blob,
+    size: u64,
+    blocks: std.AutoHashMap(u64, []align(page_align) u8),
+
+    /// Takes over the caller's reference to `base`.
+    pub fn create(allocator: std.mem.Allocator, base: ?*Blob) !*DirtyFile {
+        const dirty = try createOver(allocator, if (base) |blob| blob.data else &[_]u8{});
+        dirty.base_blob = base;
+        return dirty;
+    }
+
+    /// Layers writes over `base` without copying it. The caller keeps it
+    /// alive and unchanged until the DirtyFile is destroyed.
+    pub fn createOver(allocator: std.mem.Allocator, base: []const u8) !*DirtyFile {
+        const dirty = try allocator.create(DirtyFile);
+        dirty.* = .{
+            .allocator = allocator,
+            .base = base,
+            .base_blob = null,
+            .size = base.len,
+            .blocks = std.AutoHashMap(u64, []align(page_align) u8).init(allocator),
+        };
+        return dirty;
+    }
+
+    pub fn destroy(self: *DirtyFile) void {
+        var iter = self.blocks.valueIterator();
+        while (iter.next()) |block| self.allocator.free(block.*);
+        self.blocks.deinit();
+        if (self.base_blob) |blob| blob.release();
+        self.allocator.destroy(self);
+    }
+
+    pub fn read(self: *const DirtyFile, allocator: std.mem.Allocator, offset: u64, count: u64) ![]u8 {
+        if (offset >= self.size) return allocator.alloc(u8, 0);
+        const end = @min(self.size, offset + count);
+        const out = try allocator.alloc(u8, @intCast(end - offset));
+
+        var pos = offset;
+        while (pos < end) {
+            const within: usize = @intCast(pos % block_size);
+            const len: usize = @intCast(@min(block_size - within, end - pos));
+            const dest = out[@intCast(pos - offset)..][0..len];
+            if (self.blocks.get(pos / block_size)) |block| {
+                @memcpy(dest, block[within..][0..len]);
+            } else {
+                self.copyBase(pos, dest);
+            }
+            pos += len;
+        }
+        return out;
+    }
+
+    pub fn write(self: *DirtyFile, offset: u64, data: []const u8) !void {
+        var pos = offset;
+        var rest = data;
+        while (rest.len > 0) {
+            const within: usize = @intCast(pos % block_size);
+            const len = @min(block_size - within, rest.len);
+            const block = try self.blockFor(pos / block_size);
+            @memcpy(block[within..][0..len], rest[0..len]);
+            pos += len;
+            rest = rest[len..];
+        }
+        self.size = @max(self.size, offset + data.len);
+    }
+
+    /// Written blocks in file order, clipped to the file size. Slices point
+    /// into the blocks and are valid until the next write.
+    pub fn extents(self: *const DirtyFile, allocator: std.mem.Allocator) ![]Extent {
+        const list = try allocator.alloc(Extent, self.blocks.count());
+        var iter = self.blocks.iterator();
+        var idx: usize = 0;
+        while (iter.next()) |entry| : (idx += 1) {
+            const offset = entry.key_ptr.* * block_size;
+            const len: usize = @intCast(@min(block_size, self.size - offset));
+            list[idx] = .{ .offset = offset, .data = entry.value_ptr.*[0..len] };
+        }
+        std.mem.sort(Extent, list, {}, Extent.lessThan);
+        return list;
+    }
+
+    /// The whole current content, for handing to the overlay on commit.
+    pub fn materialize(self: *const DirtyFile, allocator: std.mem.Allocator) ![]u8 {
+        return self.read(allocator, 0, self.size);
+    }
+
+    /// Copy-on-write: a block starts out as whatever it held before.
+    fn blockFor(self: *DirtyFile, index: u64) ![]align(page_align) u8 {
+        const slot = try self.blocks.getOrPut(index);
+        if (slot.found_existing) return slot.value_ptr.*;
+        errdefer _ = self.blocks.remove(index);
+
+        const block = try self.allocator.alignedAlloc(u8, page_alignment, block_size);
+        self.copyBase(index * block_size, block);
+        slot.value_ptr.* = block;
+        return block;
+    }
+
+    /// Bytes past the end of the base read as zeros.
+    fn copyBase(self: *const DirtyFile, pos: u64, dest: []u8) void {
+        const base = self.base;
+        const available: usize = if (pos < base.len) @intCast(@min(dest.len, base.len - pos)) else 0;
+        if (available > 0) {
+            const start: usize = @intCast(pos);
+            @memcpy(dest[0..available], base[start..][0..available]);
+        }
+        @memset(dest[available..], 0);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "DirtyFile writes over its base block by block" {
+    const allocator = std.testing.allocator;
+    const base_content = try allocator.alloc(u8, block_size + 10);
+    defer allocator.free(base_content);
+    @memset(base_content, 'b');
+
+    const dirty = try DirtyFile.create(allocator, try Blob.create(allocator, base_content));
+    defer dirty.destroy();
+
+    // Straddles the first block boundary and leaves the rest of the base alone.
+    try dirty.write(block_size - 2, "wxyz");
+    try std.testing.expectEqual(@as(u64, block_size + 10), dirty.size);
+    try std.testing.expectEqual(@as(u32, 2), dirty.blocks.count());
+
+    const around = try dirty.read(allocator, block_size - 4, 8);
+    defer allocator.free(around);
+    try std.testing.expectEqualStrings("bbwxyzbb", around);
+
+    // Growing past the end reads the gap as zeros.
+    try dirty.write(block_size + 12, "!");
+    const tail = try dirty.read(allocator, block_size + 8, 16);
+    defer allocator.free(tail);
+    try std.testing.expectEqualSlices(u8, "bb\x00\x00!", tail);
+}
+
+test "DirtyFile over a borrowed base reads through without copying it" {
+    const allocator = std.testing.allocator;
+    const base = "committed content";
+
+    const dirty = try DirtyFile.createOver(allocator, base);
+    defer dirty.destroy();
+    try std.testing.expectEqual(@as(usize, base.len), dirty.size);
+    try std.testing.expectEqual(@as(u32, 0), dirty.blocks.count());
+
+    try dirty.write(0, "COMMITTED");
+    const content = try dirty.materialize(allocator);
+    defer allocator.free(content);
+    try std.testing.expectEqualStrings("COMMITTED content", content);
+    try std.testing.expectEqualStrings("committed content", base);
+}
+
+test "DirtyFile extents are ordered and clipped to the size" {
+    const allocator = std.testing.allocator;
+    const dirty = try DirtyFile.create(allocator, null);
+    defer dirty.destroy();
+
+    try dirty.write(block_size + 1, "second");
+    try dirty.write(0, "first");
+
+    const list = try dirty.extents(allocator);
+    defer allocator.free(list);
+    try std.testing.expectEqual(@as(usize, 2), list.len);
+    try std.testing.expectEqual(@as(u64, 0), list[0].offset);
+    try std.testing.expectEqual(block_size, list[0].data.len);
+    try std.testing.expectEqual(@as(u64, block_size), list[1].offset);
+    try std.testing.expectEqual(@as(usize, 7), list[1].data.len);
+    try std.testing.expectEqualStrings("second", list[1].data[1..]);
+
+    const content = try dirty.materialize(allocator);
+    defer allocator.free(content);
+    try std.testing.expectEqual(@as(usize, block_size + 7), content.len);
+    try std.testing.expectEqualStrings("first", content[0..5]);
+}
+
+test "ContentCache shares one copy and evicts least recently used" {
+    const allocator = std.testing.allocator;
+    var cache = ContentCache.init(allocator, 8);
+    defer cache.deinit();
+
+    const first = try cache.insert("a", "1234");
+    defer first.release();
+    const again = try cache.insert("a", "1234");
+    defer again.release();
+    try std.testing.expectEqual(first, again);
+
+    const second = try cache.insert("b", "5678");
+    second.release();
+    // Touch "a" so "b" is the oldest when "c" needs room.
+    cache.acquire("a").?.release();
+    const third = try cache.insert("c", "9abc");
+    third.release();
+
+    try std.testing.expect(cache.acquire("b") == null);
+    const kept = cache.acquire("a").?;
+    kept.release();
+    try std.testing.expectEqual(@as(usize, 8), cache.bytes);
+
+    // Larger than the whole cache: handed back but not kept.
+    const huge = try cache.insert("d", "too large to cache");
+    huge.release();
+    try std.testing.expect(cache.acquire("d") == null);
+}
@@ -0,0 +1,568 @@
+//! Append-only log of overlay changes.
+//!
+//! Each record is framed as a little-endian body length and CRC-32, then the
+//! body: op, change type, path length, path, offset, size, data. Records are
+//! written behind the NFS calls that make them and replayed on load; a torn
+//! or corrupt tail left by a crash mid-append is cut off.
+
+const std = @import("std");
+
+pub const ChangeType = enum {
+    added,
+    modified,
+    deleted,
+};
+
+/// Pending records beyond this are written out without waiting.
+const pending_max_bytes: usize = 8 * 1024 * 1024;
+/// The flusher writes pending records once appends pause for this long.
+const idle_flush_ns: u64 = 500 * std.time.ns_per_ms;
+
+pub const RecordOp = enum(u8) {
+    /// Whole content of a file.
+    set = 1,
+    /// Bytes at an offset of a file already in the overlay, and its new size.
+    extent = 2,
+    delete = 3,
+};
+
+pub const record_header_len = 8;
+
+pub const Record = struct {
+    op: RecordOp,
+    change_type: ChangeType,
+    path: []const u8,
+    offset: u64,
+    size: u64,
+    data: []const u8,
+
+    pub const fixed_len = 1 + 1 + 4 + 8 + 8;
+
+    /// Appends the framed record to `list`; on error `list` is left as it was.
+    pub fn encode(allocator: std.mem.Allocator, list: *std.ArrayList(u8), record: Record) !void {
+        const start = list.items.len;
+        errdefer list.shrinkRetainingCapacity(start);
+
+        try list.ensureUnusedCapacity(allocator, record_header_len + fixed_len + record.path.len + record.data.len);
+        list.appendNTimesAssumeCapacity(0, record_header_len);
+        list.appendAssumeCapacity(@intFromEnum(record.op));
+        list.appendAssumeCapacity(@intFromEnum(record.change_type));
+        appendInt(list, u32, @intCast(record.path.len));
+        list.appendSliceAssumeCapacity(record.path);
+        appendInt(list, u64, record.offset);
+        appendInt(list, u64, record.size);
+        list.appendSliceAssumeCapacity(record.data);
+
+        const body = list.items[start + record_header_len ..];
+        std.mem.writeInt(u32, list.items[start..][0..4], @intCast(body.len), .little);
+        std.mem.writeInt(u32, list.items[start + 4 ..][0..4], std.hash.Crc32.hash(body), .little);
+    }
+
+    /// Parses a record body. Path and data point into `body`.
+    pub fn decode(body: []const u8) !Record {
+        if (body.len < fixed_len) return error.CorruptJournal;
+        const path_len = std.mem.readInt(u32, body[2..6], .little);
+        if (body.len < fixed_len + path_len) return error.CorruptJournal;
+
+        const rest = body[6 + path_len ..];
+        const record = Record{
+            .op = std.meta.intToEnum(RecordOp, body[0]) catch return error.CorruptJournal,
+            .change_type = std.meta.intToEnum(ChangeType, body[1]) catch return error.CorruptJournal,
+            .path = body[6 .. 6 + path_len],
+            .offset = std.mem.readInt(u64, rest[0..8], .little),
+            .size = std.mem.readInt(u64, rest[8..16], .little),
+            .data = rest[16..],
+        };
+        if (record.op == .extent and record.offset + record.data.len > record.size) return error.CorruptJournal;
+        return record;
+    }
+
+    fn appendInt(list: *std.ArrayList(u8), comptime T: type, value: T) void {
+        var bytes: [@sizeOf(T)]u8 = undefined;
+        std.mem.writeInt(T, &bytes, value, .little);
+        list.appendSliceAssumeCapacity(&bytes);
+    }
+};
+
+/// Records collect in `pending` and go out in one write on `sync`, when
+/// appends go idle, or when too much piles up. Heap-allocated so the flusher
+/// thread keeps a stable pointer while the owner moves.
+pub const Journal = struct {
+    allocator: std.mem.Allocator,
+    path: []const u8,
+    file: std.fs.File,
+    /// Guards everything below.
+    mutex: std.Thread.Mutex = .{},
+    cond: std.Thread.Condition = .{},
+    /// Bytes already in the file.
+    bytes: u64 = 0,
+    pending: std.ArrayList(u8) = .empty,
+    last_append: i128 = 0,
+    stopping: bool = false,
+    flusher: ?std.Thread = null,
+
+    pub fn open(allocator: std.mem.Allocator, path: []const u8) !*Journal {
+        try ensureDir(std.fs.path.dirname(path) orelse ".");
+        const file = try std.fs.createFileAbsolute(path, .{ .read = true, .truncate = false, .mode = 0o600 });
+        errdefer file.close();
+
+        const journal = try allocator.create(Journal);
+        errdefer allocator.destroy(journal);
+        journal.* = .{
+            .allocator = allocator,
+            .path = try allocator.dupe(u8, path),
+            .file = file,
+        };
+        return journal;
+    }
+
+    /// Starts the background flusher; call once replay is done.
+    pub fn start(self: *Journal) !void {
+        self.flusher = try std.Thread.spawn(.{}, flushLoop, .{self});
+    }
+
+    /// Stops the flusher, makes everything pending durable and frees the journal.
+    pub fn close(self: *Journal) void {
+        {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.stopping = true;
+            self.cond.signal();
+        }
+        if (self.flusher) |thread| thread.join();
+
+        self.flushLocked(true) catch |err| {
+            std.log.warn("Overlay journal flush failed: {}", .{err});
+        };
+        self.file.close();
+        self.pending.deinit(self.allocator);
+
+        const allocator = self.allocator;
+        allocator.free(self.path);
+        allocator.destroy(self);
+    }
+
+    /// Bytes journaled so far, written or pending.
+    pub fn size(self: *Journal) u64 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.bytes + self.pending.items.len;
+    }
+
+    /// Hands every intact record in the file to `handler.applyRecord(Record) !void`,
+    /// in order, then cuts off whatever follows the last one. Record slices
+    /// are only valid during the call.
+    pub fn replay(self: *Journal, handler: anytype) !void {
+        const data = try self.file.readToEndAlloc(self.allocator, std.math.maxInt(usize));
+        defer self.allocator.free(data);
+
+        var offset: usize = 0;
+        while (offset + record_header_len <= data.len) {
+            const body_len = std.mem.readInt(u32, data[offset..][0..4], .little);
+            const crc = std.mem.readInt(u32, data[offset + 4 ..][0..4], .little);
+            const body_start = offset + record_header_len;
+            if (body_start + body_len > data.len) break;
+
+            const body = data[body_start .. body_start + body_len];
+            if (std.hash.Crc32.hash(body) != crc) break;
+            const record = Record.decode(body) catch break;
+            try handler.applyRecord(record);
+            offset = body_start + body_len;
+        }
+
+        if (offset < data.len) {
+            std.log.warn("Dropping {d} damaged bytes at the end of the overlay journal", .{data.len - offset});
+            try self.file.setEndPos(offset);
+        }
+        self.bytes = offset;
+    }
+
+    /// Queues a record. An error means it was not queued; once queued, a
+    /// failed write is retried by the flusher and reported by `sync`.
+    pub fn append(
+        self: *Journal,
+        op: RecordOp,
+        change_type: ChangeType,
+        path: []const u8,
+        offset: u64,
+        total_size: u64,
+        data: []const u8,
+    ) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        try Record.encode(self.allocator, &self.pending, .{
+            .op = op,
+            .change_type = change_type,
+            .path = path,
+            .offset = offset,
+            .size = total_size,
+            .data = data,
+        });
+        self.last_append = std.time.nanoTimestamp();
+
+        if (self.pending.items.len >= pending_max_bytes) {
+            self.flushLocked(false) catch |err| {
+                std.log.warn("Overlay journal flush failed: {}", .{err});
+            };
+        } else {
+            self.cond.signal();
+        }
+    }
+
+    /// Writes out everything pending and fsyncs the file.
+    pub fn sync(self: *Journal) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.flushLocked(true);
+    }
+
+    fn flushLocked(self: *Journal, durable: bool) !void {
+        if (self.pending.items.len > 0) {
+            try self.file.pwriteAll(self.pending.items, self.bytes);
+            self.bytes += self.pending.items.len;
+            self.pending.clearRetainingCapacity();
+        }
+        if (durable) try self.file.sync();
+    }
+
+    /// Replaces the file with one record per entry of `entries`, a string
+    /// hash map whose values have `content` and `change_type`. Goes through
+    /// a temporary file so a crash leaves either the old journal or the new one.
+    pub fn rewrite(self: *Journal, entries: anytype) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const tmp_path = try std.fmt.allocPrint(self.allocator, "{s}.tmp", .{self.path});
+        defer self.allocator.free(tmp_path);
+
+        const tmp = try std.fs.createFileAbsolute(tmp_path, .{ .read = true, .truncate = true, .mode = 0o600 });
+        var tmp_open = true;
+        defer if (tmp_open) tmp.close();
+        errdefer std.fs.deleteFileAbsolute(tmp_path) catch {};
+
+        var buf: std.ArrayList(u8) = .empty;
+        defer buf.deinit(self.allocator);
+        var written: u64 = 0;
+
+        var iter = entries.iterator();
+        while (iter.next()) |entry| {
+            const value = entry.value_ptr.*;
+            try Record.encode(self.allocator, &buf, .{
+                .op = if (value.change_type == .deleted) .delete else .set,
+                .change_type = value.change_type,
+                .path = entry.key_ptr.*,
+                .offset = 0,
+                .size = value.content.len,
+                .data = value.content,
+            });
+            if (buf.items.len >= pending_max_bytes) {
+                try tmp.pwriteAll(buf.items, written);
+                written += buf.items.len;
+                buf.clearRetainingCapacity();
+            }
+        }
+        try tmp.pwriteAll(buf.items, written);
+        written += buf.items.len;
+        try tmp.sync();
+
+        try std.fs.renameAbsolute(tmp_path, self.path);
+        self.file.close();
+        self.file = tmp;
+        tmp_open = false;
+        self.bytes = written;
+        // Everything pending is already part of the snapshot.
+        self.pending.clearRetainingCapacity();
+
+        // The rename itself is only durable once the directory is synced.
+        var dir = try std.fs.openDirAbsolute(std.fs.path.dirname(self.path) orelse "/", .{});
+        defer dir.close();
+        try std.posix.fsync(dir.fd);
+    }
+
+    fn flushLoop(self: *Journal) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (!self.stopping) {
+            if (self.pending.items.len == 0) {
+                self.cond.wait(&self.mutex);
+                continue;
+            }
+
+            const idle_for: u64 = @intCast(@max(0, std.time.nanoTimestamp() - self.last_append));
+            if (idle_for < idle_flush_ns) {
+                self.cond.timedWait(&self.mutex, idle_flush_ns - idle_for) catch {};
+                continue;
+            }
+
+            self.flushLocked(true) catch |err| {
+                std.log.warn("Overlay journal flush failed: {}", .{err});
+                self.cond.timedWait(&self.mutex, idle_flush_ns) catch {};
+            };
+        }
+    }
+};
+
+fn ensureDir(path: []const u8) !void {
+    if (path.len == 0) return;
+    std.fs.cwd().makePath(path) catch |err| {
+        if (err != error.PathAlreadyExists) return err;
+    };
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "Record encode and decode round trip" {
+    const allocator = std.testing.allocator;
+    var buf: std.ArrayList(u8) = .empty;
+    defer buf.deinit(allocator);
+
+    try Record.encode(allocator, &buf, .{
+        .op = .extent,
+        .change_type = .modified,
+        .path = "src/main.zig",
+        .offset = 4096,
+        .size = 8192,
+        .data = "written",
+    });
+
+    const body_len = std.mem.readInt(u32, buf.items[0..4], .little);
+    try std.testing.expectEqual(buf.items.len - record_header_len, body_len);
+    const body = buf.items[record_header_len..];
+    try std.testing.expectEqual(std.hash.Crc32.hash(body), std.mem.readInt(u32, buf.items[4..8], .little));
+
+    const record = try Record.decode(body);
+    try std.testing.expectEqual(RecordOp.extent, record.op);
+    try std.testing.expectEqual(ChangeType.modified, record.change_type);
+    try std.testing.expectEqualStrings("src/main.zig", record.path);
+    try std.testing.expectEqual(@as(u64, 4096), record.offset);
+    try std.testing.expectEqual(@as(u64, 8192), record.size);
+    try std.testing.expectEqualStrings("written", record.data);
+}
+
+test "Record decode rejects malformed bodies" {
+    const allocator = std.testing.allocator;
+    var buf: std.ArrayList(u8) = .empty;
+    defer buf.deinit(allocator);
+
+    try Record.encode(allocator, &buf, .{ .op = .set, .change_type = .added, .path = "a", .offset = 0, .size = 1, .data = "x" });
+    const body = buf.items[record_header_len..];
+
+    try std.testing.expectError(error.CorruptJournal, Record.decode(body[0 .. Record.fixed_len - 1]));
+    // Claims a longer path than the body holds.
+    try std.testing.expectError(error.CorruptJournal, Record.decode(body[0 .. Record.fixed_len]));
+
+    const bad_op = try allocator.dupe(u8, body);
+    defer allocator.free(bad_op);
+    bad_op[0] = 9;
+    try std.testing.expectError(error.CorruptJournal, Record.decode(bad_op));
+
+    buf.clearRetainingCapacity();
+    try Record.encode(allocator, &buf, .{ .op = .extent, .change_type = .modified, .path = "a", .offset = 4, .size = 5, .data = "xy" });
+    try std.testing.expectError(error.CorruptJournal, Record.decode(buf.items[record_header_len..]));
+}
+
+const TestEntry = struct {
+    content: []u8,
+    change_type: ChangeType,
+};
+
+/// Applies replayed records the way the overlay does, keeping file contents
+/// in a map shaped like the overlay's.
+const TestReplay = struct {
+    allocator: std.mem.Allocator,
+    entries: std.StringHashMap(TestEntry),
+    records: usize = 0,
+
+    fn init(allocator: std.mem.Allocator) TestReplay {
+        return .{ .allocator = allocator, .entries = std.StringHashMap(TestEntry).init(allocator) };
+    }
+
+    fn deinit(self: *TestReplay) void {
+        var iter = self.entries.iterator();
+        while (iter.next()) |entry| {
+            self.allocator.free(entry.key_ptr.*);
+            self.allocator.free(entry.value_ptr.content);
+        }
+        self.entries.deinit();
+    }
+
+    fn content(self: *TestReplay, path: []const u8) ?[]const u8 {
+        const entry = self.entries.get(path) orelse return null;
+        return entry.content;
+    }
+
+    pub fn applyRecord(self: *TestReplay, record: Record) !void {
+        self.records += 1;
+        switch (record.op) {
+            .set, .delete => {
+                const owned = try self.allocator.dupe(u8, record.data);
+                errdefer self.allocator.free(owned);
+                const slot = try self.entries.getOrPut(record.path);
+                if (slot.found_existing) {
+                    self.allocator.free(slot.value_ptr.content);
+                } else {
+                    slot.key_ptr.* = try self.allocator.dupe(u8, record.path);
+                }
+                slot.value_ptr.* = .{ .content = owned, .change_type = record.change_type };
+            },
+            .extent => {
+                const entry = self.entries.getPtr(record.path) orelse return error.CorruptJournal;
+                const old_len = entry.content.len;
+                entry.content = try self.allocator.realloc(entry.content, @intCast(record.size));
+                if (entry.content.len > old_len) @memset(entry.content[old_len..], 0);
+                @memcpy(entry.content[@intCast(record.offset)..][0..record.data.len], record.data);
+            },
+        }
+    }
+};
+
+fn testJournalPath(allocator: std.mem.Allocator, temp: *std.testing.TmpDir) ![]u8 {
+    const base_dir = try temp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(base_dir);
+    return std.fs.path.join(allocator, &.{ base_dir, "overlay.journal" });
+}
+
+test "Journal replays sets, extents and deletes in order" {
+    const allocator = std.testing.allocator;
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const path = try testJournalPath(allocator, &temp);
+    defer allocator.free(path);
+
+    {
+        const journal = try Journal.open(allocator, path);
+        defer journal.close();
+        try journal.append(.set, .modified, "a.txt", 0, 5, "hello");
+        // Overwrites in place, then grows past the end with a gap of zeros.
+        try journal.append(.extent, .modified, "a.txt", 1, 5, "EL");
+        try journal.append(.extent, .modified, "a.txt", 7, 8, "!");
+        try journal.append(.set, .added, "b.txt", 0, 1, "b");
+        try journal.append(.delete, .deleted, "b.txt", 0, 0, "");
+        try journal.sync();
+    }
+
+    const journal = try Journal.open(allocator, path);
+    defer journal.close();
+    var replayed = TestReplay.init(allocator);
+    defer replayed.deinit();
+    try journal.replay(&replayed);
+
+    try std.testing.expectEqual(@as(usize, 5), replayed.records);
+    try std.testing.expectEqualSlices(u8, "hELlo\x00\x00!", replayed.content("a.txt").?);
+    try std.testing.expectEqual(ChangeType.deleted, replayed.entries.get("b.txt").?.change_type);
+    try std.testing.expectEqual((try journal.file.stat()).size, journal.size());
+}
+
+test "Journal replay stops at a record that fails its CRC" {
+    const allocator = std.testing.allocator;
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const path = try testJournalPath(allocator, &temp);
+    defer allocator.free(path);
+
+    var buf: std.ArrayList(u8) = .empty;
+    defer buf.deinit(allocator);
+    try Record.encode(allocator, &buf, .{ .op = .set, .change_type = .added, .path = "a", .offset = 0, .size = 3, .data = "one" });
+    const intact_len = buf.items.len;
+    try Record.encode(allocator, &buf, .{ .op = .set, .change_type = .added, .path = "b", .offset = 0, .size = 3, .data = "two" });
+    try Record.encode(allocator, &buf, .{ .op = .set, .change_type = .added, .path = "c", .offset = 0, .size = 5, .data = "three" });
+    // Flip a data byte of the second record; the third is lost with it.
+    buf.items[intact_len + record_header_len + Record.fixed_len + 1] ^= 0xff;
+    try temp.dir.writeFile(.{ .sub_path = "overlay.journal", .data = buf.items });
+
+    const journal = try Journal.open(allocator, path);
+    defer journal.close();
+    var replayed = TestReplay.init(allocator);
+    defer replayed.deinit();
+    try journal.replay(&replayed);
+
+    try std.testing.expectEqual(@as(usize, 1), replayed.records);
+    try std.testing.expectEqualStrings("one", replayed.content("a").?);
+    try std.testing.expect(replayed.content("b") == null);
+    try std.testing.expectEqual(@as(u64, intact_len), journal.size());
+    try std.testing.expectEqual(@as(u64, intact_len), (try journal.file.stat()).size);
+}
+
+test "Journal replay truncates a torn tail and appends after it" {
+    const allocator = std.testing.allocator;
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const path = try testJournalPath(allocator, &temp);
+    defer allocator.free(path);
+
+    var buf: std.ArrayList(u8) = .empty;
+    defer buf.deinit(allocator);
+    try Record.encode(allocator, &buf, .{ .op = .set, .change_type = .added, .path = "a", .offset = 0, .size = 3, .data = "one" });
+    const intact_len = buf.items.len;
+    try Record.encode(allocator, &buf, .{ .op = .set, .change_type = .added, .path = "b", .offset = 0, .size = 3, .data = "two" });
+    // A crash mid-append left half of the second record.
+    try temp.dir.writeFile(.{ .sub_path = "overlay.journal", .data = buf.items[0 .. intact_len + 10] });
+
+    {
+        const journal = try Journal.open(allocator, path);
+        defer journal.close();
+        var replayed = TestReplay.init(allocator);
+        defer replayed.deinit();
+        try journal.replay(&replayed);
+
+        try std.testing.expectEqual(@as(usize, 1), replayed.records);
+        try std.testing.expectEqual(@as(u64, intact_len), (try journal.file.stat()).size);
+        try journal.append(.set, .added, "c", 0, 5, "three");
+    }
+
+    // The new record follows the intact one rather than the torn bytes.
+    const journal = try Journal.open(allocator, path);
+    defer journal.close();
+    var replayed = TestReplay.init(allocator);
+    defer replayed.deinit();
+    try journal.replay(&replayed);
+    try std.testing.expectEqual(@as(usize, 2), replayed.records);
+    try std.testing.expectEqualStrings("three", replayed.content("c").?);
+}
+
+test "Journal rewrite compacts to one record per entry" {
+    const allocator = std.testing.allocator;
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const path = try testJournalPath(allocator, &temp);
+    defer allocator.free(path);
+
+    var live = TestReplay.init(allocator);
+    defer live.deinit();
+    {
+        const journal = try Journal.open(allocator, path);
+        defer journal.close();
+        for (0..20) |round| {
+            var content: [8]u8 = undefined;
+            const text = try std.fmt.bufPrint(&content, "v{d}", .{round});
+            try journal.append(.set, .modified, "a.txt", 0, text.len, text);
+            try live.applyRecord(.{ .op = .set, .change_type = .modified, .path = "a.txt", .offset = 0, .size = text.len, .data = text });
+        }
+        try journal.append(.delete, .deleted, "gone.txt", 0, 0, "");
+        try live.applyRecord(.{ .op = .delete, .change_type = .deleted, .path = "gone.txt", .offset = 0, .size = 0, .data = "" });
+        // Left pending: the snapshot already covers it.
+        try journal.append(.set, .added, "b.txt", 0, 1, "b");
+        try live.applyRecord(.{ .op = .set, .change_type = .added, .path = "b.txt", .offset = 0, .size = 1, .data = "b" });
+
+        const before = journal.size();
+        try journal.rewrite(&live.entries);
+        try std.testing.expect(journal.size() < before);
+        try std.testing.expectEqual(@as(usize, 0), journal.pending.items.len);
+    }
+    try std.testing.expectError(error.FileNotFound, temp.dir.access("overlay.journal.tmp", .{}));
+
+    const journal = try Journal.open(allocator, path);
+    defer journal.close();
+    var replayed = TestReplay.init(allocator);
+    defer replayed.deinit();
+    try journal.replay(&replayed);
+
+    try std.testing.expectEqual(@as(usize, 3), replayed.records);
+    try std.testing.expectEqualStrings("v19", replayed.content("a.txt").?);
+    try std.testing.expectEqualStrings("b", replayed.content("b.txt").?);
+    try std.testing.expectEqual(ChangeType.deleted, replayed.entries.get("gone.txt").?.change_type);
+}
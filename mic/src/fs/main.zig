@@ -1,13 +1,13 @@
 const std = @import("std");
-const fs_server = @import("mic/fs/server.zig");
-const state_mod = @import("mic/fs/state.zig");
+const fs_server = @import("server.zig");
+const state_mod = @import("state.zig");
 
 pub fn main() !void {
     var gpa = std.heap.GeneralPurposeAllocator(.{}){};
     defer _ = gpa.deinit();
     const allocator = gpa.allocator();
 
-    var args = try std.process.argsAlloc(allocator);
+    const args = try std.process.argsAlloc(allocator);
     defer std.process.argsFree(allocator, args);
 
     var server: ?[]const u8 = null;
@@ -1,8 +1,9 @@
 //! Minimal NFSv3 server core for mic-fs.
 //!
 //! This module implements NFSv3 RPC parsing and responses for a small subset
-//! of procedures backed by an in-memory virtual filesystem. It is intentionally
-//! read-only and transport-agnostic so the network daemon can be layered on top.
+//! of procedures backed by a virtual filesystem whose file contents can be
+//! loaded on first access. It is intentionally read-only and
+//! transport-agnostic so the network daemon can be layered on top.
 
 const std = @import("std");
 
@@ -74,11 +75,39 @@ const NodeType = enum {
 const Node = struct {
     kind: NodeType,
     content: []const u8,
+    /// Blob hash of a lazily added file; empty for directories and eager files.
+    hash: []const u8 = "",
+    /// Known once the content has been loaded at least once.
+    size: ?u64 = null,
+    loaded: bool = true,
+    /// Siblings have already been offered to the loader for prefetch.
+    hinted: bool = false,
+    last_access: u64 = 0,
 };
 
+/// Fetches content for files added with `addLazyFile`.
+pub const BlobLoader = struct {
+    ctx: *anyopaque,
+    /// Returns the blob's content, allocated with the VirtualFs allocator.
+    load: *const fn (ctx: *anyopaque, hash: []const u8) anyerror![]u8,
+    /// Hint that these blobs are likely to be read soon. Must not block.
+    prefetch: ?*const fn (ctx: *anyopaque, hashes: []const []const u8) void = null,
+};
+
+/// Lazily loaded content kept in memory before cold files are evicted.
+pub const default_content_max_bytes: usize = 256 * 1024 * 1024;
+
+/// Siblings offered to `BlobLoader.prefetch` when a file is first loaded.
+const prefetch_max = 16;
+
 pub const VirtualFs = struct {
     allocator: std.mem.Allocator,
     nodes: std.StringHashMap(Node),
+    loader: ?BlobLoader = null,
+    content_max_bytes: usize = default_content_max_bytes,
+    /// Bytes held by loaded lazy files; eager files are not counted.
+    content_bytes: usize = 0,
+    access_clock: u64 = 0,
 
     pub fn init(allocator: std.mem.Allocator) !VirtualFs {
         var fs = VirtualFs{
@@ -95,7 +124,8 @@ pub const VirtualFs = struct {
             const key = entry.key_ptr.*;
             self.allocator.free(key);
             if (entry.value_ptr.kind == .file) {
-                self.allocator.free(entry.value_ptr.content);
+                if (entry.value_ptr.loaded) self.allocator.free(entry.value_ptr.content);
+                if (entry.value_ptr.hash.len > 0) self.allocator.free(entry.value_ptr.hash);
             }
         }
         self.nodes.deinit();
@@ -114,13 +144,101 @@ pub const VirtualFs = struct {
         if (self.nodes.contains(normalized)) return;
         const copy = try self.allocator.dupe(u8, content);
         errdefer self.allocator.free(copy);
-        try self.nodes.put(normalized, .{ .kind = .file, .content = copy });
+        try self.nodes.put(normalized, .{ .kind = .file, .content = copy, .size = copy.len });
+    }
+
+    /// Adds a file whose content is fetched through `loader` on first access.
+    pub fn addLazyFile(self: *VirtualFs, path: []const u8, hash: []const u8) !void {
+        const normalized = try normalizePath(self.allocator, path);
+        errdefer self.allocator.free(normalized);
+        if (self.nodes.contains(normalized)) return;
+        const hash_copy = try self.allocator.dupe(u8, hash);
+        errdefer self.allocator.free(hash_copy);
+        try self.nodes.put(normalized, .{
+            .kind = .file,
+            .content = "",
+            .hash = hash_copy,
+            .loaded = false,
+        });
     }
 
     pub fn lookup(self: *VirtualFs, path: []const u8) ?Node {
         return self.nodes.get(path);
     }
 
+    /// Like `lookup`, but loads a lazy file whose size is not yet known.
+    pub fn stat(self: *VirtualFs, path: []const u8) !?Node {
+        const node = self.nodes.getPtr(path) orelse return null;
+        if (node.kind == .file and node.size == null) _ = try self.readFile(path);
+        return node.*;
+    }
+
+    /// Returns a file's content, loading it if needed. The slice stays valid
+    /// until the next call that may load another file.
+    pub fn readFile(self: *VirtualFs, path: []const u8) ![]const u8 {
+        const node = self.nodes.getPtr(path) orelse return error.FileNotFound;
+        if (node.kind != .file) return error.IsDir;
+
+        self.access_clock += 1;
+        node.last_access = self.access_clock;
+        if (node.loaded) return node.content;
+
+        const loader = self.loader orelse return error.NoLoader;
+        const content = try loader.load(loader.ctx, node.hash);
+
+        self.evictFor(content.len, node);
+        node.content = content;
+        node.loaded = true;
+        node.size = content.len;
+        self.content_bytes += content.len;
+
+        if (!node.hinted) {
+            node.hinted = true;
+            self.prefetchSiblings(path);
+        }
+        return node.content;
+    }
+
+    /// Drops least recently read lazy files until `incoming` more bytes fit.
+    fn evictFor(self: *VirtualFs, incoming: usize, keep: *const Node) void {
+        while (self.content_bytes + incoming > self.content_max_bytes) {
+            var oldest: ?*Node = null;
+            var it = self.nodes.valueIterator();
+            while (it.next()) |node| {
+                if (!node.loaded or node.hash.len == 0 or node == keep) continue;
+                if (oldest == null or node.last_access < oldest.?.last_access) oldest = node;
+            }
+
+            const victim = oldest orelse return;
+            self.content_bytes -= victim.content.len;
+            self.allocator.free(victim.content);
+            victim.content = "";
+            victim.loaded = false;
+        }
+    }
+
+    fn prefetchSiblings(self: *VirtualFs, path: []const u8) void {
+        const loader = self.loader orelse return;
+        const prefetch = loader.prefetch orelse return;
+        const dir = std.fs.path.dirnamePosix(path) orelse return;
+
+        var hashes: [prefetch_max][]const u8 = undefined;
+        var count: usize = 0;
+        var it = self.nodes.iterator();
+        while (it.next()) |entry| {
+            if (count == prefetch_max) break;
+            const node = entry.value_ptr;
+            if (node.loaded or node.hinted or node.hash.len == 0) continue;
+            const parent = std.fs.path.dirnamePosix(entry.key_ptr.*) orelse continue;
+            if (!std.mem.eql(u8, parent, dir)) continue;
+
+            node.hinted = true;
+            hashes[count] = node.hash;
+            count += 1;
+        }
+        if (count > 0) prefetch(loader.ctx, hashes[0..count]);
+    }
+
     pub fn listDir(self: *VirtualFs, path: []const u8, allocator: std.mem.Allocator) !std.ArrayList(DirEntry) {
         var entries = std.ArrayList(DirEntry).empty;
         errdefer entries.deinit(allocator);
@@ -219,7 +337,11 @@ pub const NfsServer = struct {
 
     fn handleGetattr(self: *NfsServer, reader: *XdrReader, writer: *XdrWriter) !void {
         const handle = try reader.readOpaque();
-        const node = self.fs.lookup(handle) orelse {
+        const found = self.fs.stat(handle) catch {
+            try writer.writeU32(@intFromEnum(NfsStatus.io));
+            return;
+        };
+        const node = found orelse {
             try writer.writeU32(@intFromEnum(NfsStatus.noent));
             return;
         };
@@ -256,7 +378,12 @@ pub const NfsServer = struct {
         const child_path = try joinPath(self.allocator, dir_handle, name);
         defer self.allocator.free(child_path);
 
-        const child = self.fs.lookup(child_path) orelse {
+        const found = self.fs.stat(child_path) catch {
+            try writer.writeU32(@intFromEnum(NfsStatus.io));
+            try writePostOpAttr(writer, dir_handle, dir);
+            return;
+        };
+        const child = found orelse {
             try writer.writeU32(@intFromEnum(NfsStatus.noent));
             try writePostOpAttr(writer, dir_handle, dir);
             return;
@@ -284,10 +411,17 @@ pub const NfsServer = struct {
             return;
         }
 
-        const size = node.content.len;
+        const content = self.fs.readFile(handle) catch {
+            try writer.writeU32(@intFromEnum(NfsStatus.io));
+            try writePostOpAttr(writer, null, null);
+            return;
+        };
+        const loaded = self.fs.lookup(handle).?;
+
+        const size = content.len;
         if (offset >= @as(u64, @intCast(size))) {
             try writer.writeU32(@intFromEnum(NfsStatus.ok));
-            try writePostOpAttr(writer, handle, node);
+            try writePostOpAttr(writer, handle, loaded);
             try writer.writeU32(0);
             try writer.writeBool(true);
             try writer.writeOpaque("");
@@ -298,11 +432,11 @@ pub const NfsServer = struct {
         const remaining = size - start;
         const max_len = @min(@as(usize, @intCast(count)), remaining);
         const end = start + max_len;
-        const data = node.content[start..end];
+        const data = content[start..end];
         const eof = end >= size;
 
         try writer.writeU32(@intFromEnum(NfsStatus.ok));
-        try writePostOpAttr(writer, handle, node);
+        try writePostOpAttr(writer, handle, loaded);
         try writer.writeU32(@intCast(max_len));
         try writer.writeBool(eof);
         try writer.writeOpaque(data);
@@ -527,7 +661,7 @@ fn writeFattr3(writer: *XdrWriter, path: []const u8, node: Node) !void {
         .dir => 0o755,
     };
     const size: u64 = switch (node.kind) {
-        .file => node.content.len,
+        .file => node.size orelse 0,
         .dir => 0,
     };
     const file_id = fileIdForPath(path);
@@ -722,3 +856,47 @@ test "nfs readdir returns entries" {
     try std.testing.expectEqual(false, try reader.readBool());
     try std.testing.expectEqual(true, try reader.readBool());
 }
+
+const FakeLoader = struct {
+    loads: usize = 0,
+    prefetched: usize = 0,
+
+    fn load(ctx: *anyopaque, hash: []const u8) anyerror![]u8 {
+        const self: *FakeLoader = @ptrCast(@alignCast(ctx));
+        self.loads += 1;
+        return std.testing.allocator.dupe(u8, hash);
+    }
+
+    fn prefetch(ctx: *anyopaque, hashes: []const []const u8) void {
+        const self: *FakeLoader = @ptrCast(@alignCast(ctx));
+        self.prefetched += hashes.len;
+    }
+};
+
+test "lazy files load on first read and evict cold content" {
+    var fs = try VirtualFs.init(std.testing.allocator);
+    defer fs.deinit();
+
+    var fake = FakeLoader{};
+    fs.loader = .{ .ctx = &fake, .load = FakeLoader.load, .prefetch = FakeLoader.prefetch };
+    fs.content_max_bytes = 8;
+
+    try fs.addLazyFile("/a", "aaaaa");
+    try fs.addLazyFile("/b", "bbbbb");
+    try std.testing.expectEqual(@as(?u64, null), fs.lookup("/a").?.size);
+    try std.testing.expectEqual(@as(usize, 0), fake.loads);
+
+    const node = (try fs.stat("/a")).?;
+    try std.testing.expectEqual(@as(?u64, 5), node.size);
+    try std.testing.expectEqual(@as(usize, 1), fake.loads);
+    try std.testing.expectEqual(@as(usize, 1), fake.prefetched);
+
+    try std.testing.expectEqualStrings("bbbbb", try fs.readFile("/b"));
+    try std.testing.expect(!fs.lookup("/a").?.loaded);
+    try std.testing.expectEqual(@as(?u64, 5), fs.lookup("/a").?.size);
+    try std.testing.expectEqual(@as(usize, 5), fs.content_bytes);
+
+    try std.testing.expectEqualStrings("aaaaa", try fs.readFile("/a"));
+    try std.testing.expectEqual(@as(usize, 3), fake.loads);
+    try std.testing.expectEqual(@as(usize, 1), fake.prefetched);
+}
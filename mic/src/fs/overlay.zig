@@ -1,11 +1,12 @@
 const std = @import("std");
-const xdg = @import("mic/xdg.zig");
+const xdg = @import("../xdg.zig");
+const journal_mod = @import("journal.zig");
 
-pub const ChangeType = enum {
-    added,
-    modified,
-    deleted,
-};
+const Journal = journal_mod.Journal;
+const Record = journal_mod.Record;
+const record_header_len = journal_mod.record_header_len;
+
+pub const ChangeType = journal_mod.ChangeType;
 
 pub const OverlayEntry = struct {
     path: []const u8,
@@ -44,13 +45,25 @@ const SessionFile = struct {
     bloom_hashes: u32 = 7,
 };
 
+/// Journaled bytes below this never trigger compaction.
+const compact_min_bytes: u64 = 16 * 1024 * 1024;
+
+const journal_filename = "overlay.journal";
+
+/// Changes made through the mount. Session metadata lives in the session
+/// file; file changes are appended to a journal next to it and replayed on
+/// load. Callers serialize access to `entries` (RepoState holds its tree
+/// lock); the journal has its own lock for its flusher thread.
 pub const Overlay = struct {
     allocator: std.mem.Allocator,
     session_path: []const u8,
     account: []const u8,
     project: []const u8,
+    /// Owns every string in `session`.
+    session_arena: std.heap.ArenaAllocator,
     session: ?SessionFile,
     entries: std.StringHashMap(OverlayEntry),
+    journal: *Journal,
 
     pub fn init(
         allocator: std.mem.Allocator,
@@ -58,47 +71,36 @@ pub const Overlay = struct {
         account: []const u8,
         project: []const u8,
     ) !Overlay {
+        const journal_path = try std.fs.path.join(allocator, &.{ std.fs.path.dirname(session_path) orelse ".", journal_filename });
+        defer allocator.free(journal_path);
+
         var overlay = Overlay{
             .allocator = allocator,
             .session_path = try allocator.dupe(u8, session_path),
             .account = try allocator.dupe(u8, account),
             .project = try allocator.dupe(u8, project),
+            .session_arena = std.heap.ArenaAllocator.init(allocator),
             .session = null,
             .entries = std.StringHashMap(OverlayEntry).init(allocator),
+            .journal = try Journal.open(allocator, journal_path),
         };
         errdefer overlay.deinit();
 
-        try overlay.loadSession();
+        const imported = try overlay.loadSession();
+        try overlay.replayJournal();
+        if (imported) {
+            // Snapshot into the journal before dropping the inline copies.
+            try overlay.compact();
+            try overlay.writeSession();
+        } else if (overlay.shouldCompact()) {
+            try overlay.compact();
+        }
+        try overlay.journal.start();
         return overlay;
     }
 
     pub fn deinit(self: *Overlay) void {
-        if (self.session) |session| {
-            self.allocator.free(session.id);
-            self.allocator.free(session.goal);
-            self.allocator.free(session.project_org);
-            self.allocator.free(session.project_handle);
-            self.allocator.free(session.started_at);
-            if (session.bloom_data) |data| self.allocator.free(data);
-            for (session.conversation) |item| {
-                self.allocator.free(item.role);
-                self.allocator.free(item.message);
-                self.allocator.free(item.timestamp);
-            }
-            self.allocator.free(session.conversation);
-            for (session.decisions) |item| {
-                self.allocator.free(item.description);
-                self.allocator.free(item.reasoning);
-                self.allocator.free(item.timestamp);
-            }
-            self.allocator.free(session.decisions);
-            for (session.files) |item| {
-                self.allocator.free(item.path);
-                self.allocator.free(item.content);
-                self.allocator.free(item.change_type);
-            }
-            self.allocator.free(session.files);
-        }
+        self.journal.close();
 
         var iter = self.entries.iterator();
         while (iter.next()) |entry| {
@@ -107,6 +109,7 @@ pub const Overlay = struct {
         }
         self.entries.deinit();
 
+        self.session_arena.deinit();
         self.allocator.free(self.session_path);
         self.allocator.free(self.account);
         self.allocator.free(self.project);
@@ -117,119 +120,209 @@ pub const Overlay = struct {
         return self.entries.get(path);
     }
 
+    /// Replaces the whole content of `path`.
     pub fn setFile(self: *Overlay, path: []const u8, content: []const u8, change_type: ChangeType) !void {
-        const owned_path = if (self.entries.contains(path)) null else try self.allocator.dupe(u8, path);
-        const owned_content = try self.allocator.dupe(u8, content);
-
-        if (self.entries.fetchPut(path, .{
-            .path = path,
-            .content = owned_content,
-            .change_type = change_type,
-        })) |old| {
-            self.allocator.free(old.value.content);
-        } else if (owned_path) |value| {
-            _ = value;
+        try self.ensureSession();
+
+        const owned = try self.allocator.dupe(u8, content);
+        errdefer self.allocator.free(owned);
+        const key = try self.reserveEntry(path);
+        errdefer if (key) |new_key| self.allocator.free(new_key);
+
+        try self.journal.append(.set, change_type, path, 0, content.len, content);
+        self.putEntry(path, key, owned, change_type);
+    }
+
+    /// Overwrites `data` at `offset` in a file already in the overlay and
+    /// sets its length to `size`. Only the bytes written are journaled.
+    pub fn writeExtent(self: *Overlay, path: []const u8, offset: u64, data: []const u8, size: u64) !void {
+        const entry = self.entries.getPtr(path) orelse return error.FileNotFound;
+        if (offset + data.len > size) return error.InvalidExtent;
+
+        var resized: ?[]u8 = null;
+        if (size != entry.content.len) {
+            const buf = try self.allocator.alloc(u8, @intCast(size));
+            const kept = @min(buf.len, entry.content.len);
+            @memcpy(buf[0..kept], entry.content[0..kept]);
+            @memset(buf[kept..], 0);
+            resized = buf;
         }
+        errdefer if (resized) |buf| self.allocator.free(buf);
 
-        try self.persist();
+        try self.journal.append(.extent, entry.change_type, path, offset, size, data);
+        if (resized) |buf| {
+            self.allocator.free(entry.content);
+            entry.content = buf;
+        }
+        const start: usize = @intCast(offset);
+        @memcpy(@constCast(entry.content[start..][0..data.len]), data);
     }
 
     pub fn remove(self: *Overlay, path: []const u8) !void {
-        const owned_path = if (self.entries.contains(path)) null else try self.allocator.dupe(u8, path);
-
-        if (self.entries.fetchPut(path, .{
-            .path = path,
-            .content = &[_]u8{},
-            .change_type = .deleted,
-        })) |old| {
-            self.allocator.free(old.value.content);
-        } else if (owned_path) |value| {
-            _ = value;
+        try self.ensureSession();
+
+        const empty = try self.allocator.alloc(u8, 0);
+        errdefer self.allocator.free(empty);
+        const key = try self.reserveEntry(path);
+        errdefer if (key) |new_key| self.allocator.free(new_key);
+
+        try self.journal.append(.delete, .deleted, path, 0, 0, &[_]u8{});
+        self.putEntry(path, key, empty, .deleted);
+    }
+
+    /// Makes every change so far durable with one write and fsync. Only
+    /// takes the journal's own lock, so it may run alongside reads and
+    /// changes. Called on NFS COMMIT.
+    pub fn sync(self: *Overlay) !void {
+        try self.journal.sync();
+    }
+
+    /// Compacts the journal if it has grown well past the live content.
+    /// Reads every entry, so no change may run meanwhile; reads may.
+    pub fn compactIfLarge(self: *Overlay) !void {
+        if (self.shouldCompact()) try self.compact();
+    }
+
+    fn storeEntry(self: *Overlay, path: []const u8, content: []u8, change_type: ChangeType) !void {
+        const key = try self.reserveEntry(path);
+        self.putEntry(path, key, content, change_type);
+    }
+
+    /// Makes room for `path` if it is new and returns the key to insert it
+    /// under; null if it already has an entry. Changes reserve before they
+    /// journal and only `putEntry` after, so an entry never changes without
+    /// its record or the other way round.
+    fn reserveEntry(self: *Overlay, path: []const u8) !?[]u8 {
+        if (self.entries.contains(path)) return null;
+
+        const key = try self.allocator.dupe(u8, path);
+        errdefer self.allocator.free(key);
+        try self.entries.ensureUnusedCapacity(1);
+        return key;
+    }
+
+    /// Stores `content` under `path`, taking ownership of it. Cannot fail
+    /// once `reserveEntry` has returned `key` for the same path.
+    fn putEntry(self: *Overlay, path: []const u8, key: ?[]u8, content: []u8, change_type: ChangeType) void {
+        if (key) |new_key| {
+            self.entries.putAssumeCapacityNoClobber(new_key, .{ .path = new_key, .content = content, .change_type = change_type });
+            return;
         }
 
-        try self.persist();
+        const existing = self.entries.getPtr(path).?;
+        self.allocator.free(existing.content);
+        existing.content = content;
+        existing.change_type = change_type;
+    }
+
+    fn applyExtent(self: *Overlay, entry: *OverlayEntry, offset: u64, data: []const u8, size: u64) !void {
+        if (size != entry.content.len) {
+            const old_len = entry.content.len;
+            const resized = try self.allocator.realloc(@constCast(entry.content), @intCast(size));
+            if (resized.len > old_len) @memset(resized[old_len..], 0);
+            entry.content = resized;
+        }
+        const start: usize = @intCast(offset);
+        @memcpy(@constCast(entry.content[start..][0..data.len]), data);
     }
 
-    fn loadSession(self: *Overlay) !void {
+    /// Loads session metadata. Files saved inline by older versions are
+    /// imported; returns true if there were any, so they move to the journal.
+    fn loadSession(self: *Overlay) !bool {
         const data = try xdg.readFileAlloc(self.allocator, self.session_path, 8 * 1024 * 1024);
-        if (data == null) return;
+        if (data == null) return false;
         defer self.allocator.free(data.?);
 
-        var parsed = try std.json.parseFromSlice(SessionFile, self.allocator, data.?, .{
+        const session = try std.json.parseFromSliceLeaky(SessionFile, self.session_arena.allocator(), data.?, .{
             .ignore_unknown_fields = true,
             .allocate = .alloc_always,
         });
-        errdefer parsed.deinit();
-        const session = parsed.value;
+        self.session = session;
+        if (session.files.len == 0) return false;
 
-        var entries = std.StringHashMap(OverlayEntry).init(self.allocator);
         for (session.files) |file| {
-            const change_type = parseChangeType(file.change_type);
-            try entries.put(try self.allocator.dupe(u8, file.path), .{
-                .path = file.path,
-                .content = try self.allocator.dupe(u8, file.content),
-                .change_type = change_type,
-            });
+            const owned = try self.allocator.dupe(u8, file.content);
+            errdefer self.allocator.free(owned);
+            try self.storeEntry(file.path, owned, parseChangeType(file.change_type));
         }
+        self.session.?.files = &[_]FileChange{};
+        return true;
+    }
 
-        self.entries.deinit();
-        self.entries = entries;
-        self.session = session;
-        parsed.deinit();
+    /// Applies every intact record; the journal cuts off a damaged tail.
+    fn replayJournal(self: *Overlay) !void {
+        const Replay = struct {
+            overlay: *Overlay,
+
+            pub fn applyRecord(replay: @This(), record: Record) !void {
+                try replay.overlay.applyRecord(record);
+            }
+        };
+        try self.journal.replay(Replay{ .overlay = self });
     }
 
-    fn persist(self: *Overlay) !void {
-        var session = self.session orelse try self.createSession();
-        const file_list = try self.buildFileList();
-        session.files = file_list;
-        self.session = session;
+    fn applyRecord(self: *Overlay, record: Record) !void {
+        switch (record.op) {
+            .set, .delete => {
+                const owned = try self.allocator.dupe(u8, record.data);
+                errdefer self.allocator.free(owned);
+                try self.storeEntry(record.path, owned, record.change_type);
+            },
+            .extent => {
+                const entry = self.entries.getPtr(record.path) orelse return error.CorruptJournal;
+                try self.applyExtent(entry, record.offset, record.data, record.size);
+            },
+        }
+    }
 
-        var buf = std.ArrayList(u8).init(self.allocator);
-        defer buf.deinit();
+    fn shouldCompact(self: *const Overlay) bool {
+        const journaled = self.journal.size();
+        if (journaled < compact_min_bytes) return false;
 
-        const formatter = std.json.fmt(session, .{});
-        try formatter.format(buf.writer());
+        var live: u64 = 0;
+        var iter = self.entries.iterator();
+        while (iter.next()) |entry| {
+            live += record_header_len + Record.fixed_len + entry.key_ptr.len + entry.value_ptr.content.len;
+        }
+        return journaled > 2 * live;
+    }
 
-        try ensureDir(std.fs.path.dirname(self.session_path) orelse ".");
+    /// Rewrites the journal as one record per path.
+    fn compact(self: *Overlay) !void {
+        try self.ensureSession();
+        try self.journal.rewrite(&self.entries);
+    }
+
+    fn ensureSession(self: *Overlay) !void {
+        if (self.session != null) return;
+        self.session = try self.createSession();
+        try self.writeSession();
+    }
+
+    fn writeSession(self: *Overlay) !void {
+        var payload_buf = std.Io.Writer.Allocating.init(self.allocator);
+        defer payload_buf.deinit();
+
+        const formatter = std.json.fmt(self.session.?, .{});
+        try formatter.format(&payload_buf.writer);
+
+        // The journal next to it was opened first, so the directory exists.
         const file = try std.fs.createFileAbsolute(self.session_path, .{ .truncate = true, .read = true, .mode = 0o600 });
         defer file.close();
-        try file.writeAll(buf.items);
+        try file.writeAll(payload_buf.written());
     }
 
     fn createSession(self: *Overlay) !SessionFile {
-        const session_id = try randomId(self.allocator);
-        const goal = try self.allocator.dupe(u8, "filesystem mount");
-        const now = try timestamp(self.allocator);
+        const arena_alloc = self.session_arena.allocator();
         return .{
-            .id = session_id,
-            .goal = goal,
-            .project_org = try self.allocator.dupe(u8, self.account),
-            .project_handle = try self.allocator.dupe(u8, self.project),
-            .started_at = now,
+            .id = try randomId(arena_alloc),
+            .goal = try arena_alloc.dupe(u8, "filesystem mount"),
+            .project_org = try arena_alloc.dupe(u8, self.account),
+            .project_handle = try arena_alloc.dupe(u8, self.project),
+            .started_at = try timestamp(arena_alloc),
         };
     }
 
-    fn buildFileList(self: *Overlay) ![]FileChange {
-        var files = std.ArrayList(FileChange).init(self.allocator);
-        errdefer files.deinit();
-
-        var iter = self.entries.iterator();
-        while (iter.next()) |entry| {
-            const change_type = switch (entry.value_ptr.change_type) {
-                .added => "added",
-                .modified => "modified",
-                .deleted => "deleted",
-            };
-            try files.append(.{
-                .path = try self.allocator.dupe(u8, entry.key_ptr.*),
-                .content = try self.allocator.dupe(u8, entry.value_ptr.content),
-                .change_type = try self.allocator.dupe(u8, change_type),
-            });
-        }
-
-        return try files.toOwnedSlice();
-    }
-
     fn parseChangeType(value: []const u8) ChangeType {
         if (std.mem.eql(u8, value, "added")) return .added;
         if (std.mem.eql(u8, value, "deleted")) return .deleted;
@@ -250,10 +343,3 @@ fn timestamp(allocator: std.mem.Allocator) ![]u8 {
     const value = std.time.timestamp();
     return std.fmt.allocPrint(allocator, "{}", .{value});
 }
-
-fn ensureDir(path: []const u8) !void {
-    if (path.len == 0) return;
-    std.fs.cwd().makePath(path) catch |err| {
-        if (err != error.PathAlreadyExists) return err;
-    };
-}
@@ -1,6 +1,6 @@
 const std = @import("std");
-const xdr = @import("mic/fs/xdr.zig");
-const state_mod = @import("mic/fs/state.zig");
+const xdr = @import("xdr.zig");
+const state_mod = @import("state.zig");
 
 const Rpc = struct {
     const CALL: u32 = 0;
@@ -51,6 +51,7 @@ const Nfs = struct {
     const NF3REG: u32 = 1;
     const NF3DIR: u32 = 2;
 
+    const UNSTABLE: u32 = 0;
     const FILE_SYNC: u32 = 2;
 };
 
@@ -73,106 +74,306 @@ pub const ServerConfig = struct {
     address: []const u8 = "127.0.0.1",
     nfs_port: u16 = 2049,
     mount_port: u16 = 2050,
+    /// Threads running RPC calls for all connections; null means one per CPU.
+    workers: ?usize = null,
+    /// Calls from one connection queued or running before it stops reading.
+    max_in_flight: usize = 64,
 };
 
 pub fn serve(state: *state_mod.RepoState, config: ServerConfig) !void {
-    var mount_thread = try std.Thread.spawn(.{}, serveMount, .{ state, config });
-    defer mount_thread.detach();
+    var server = Server{ .state = state, .config = config, .pool = undefined };
+    try server.pool.init(.{ .allocator = state.allocator, .n_jobs = config.workers });
+    // Runs last: every thread that could still queue work has exited.
+    defer server.pool.deinit();
+    defer server.threads.wait();
+    defer server.stop();
+
+    server.threads.start();
+    const mount_thread = std.Thread.spawn(.{}, serveMount, .{&server}) catch |err| {
+        server.threads.finish();
+        return err;
+    };
+    mount_thread.detach();
+
+    try server.listen(config.nfs_port, .nfs);
+}
 
-    try serveNfs(state, config);
+fn serveMount(server: *Server) void {
+    defer server.threads.finish();
+    server.listen(server.config.mount_port, .mountd) catch |err| {
+        std.log.warn("Mountd listener error: {}", .{err});
+    };
 }
 
-fn serveNfs(state: *state_mod.RepoState, config: ServerConfig) !void {
-    var server = std.net.StreamServer.init(.{});
-    defer server.deinit();
+/// What the listeners and connection threads share. The worker pool lives
+/// here so `serve` can stop and wait for every thread that queues calls
+/// on it before tearing it down.
+const Server = struct {
+    state: *state_mod.RepoState,
+    config: ServerConfig,
+    pool: std.Thread.Pool,
+    /// The mount listener and every connection thread.
+    threads: std.Thread.WaitGroup = .{},
+    /// Guards the fields below.
+    mutex: std.Thread.Mutex = .{},
+    stopping: bool = false,
+    /// Listening and connected sockets, shut down on stop to wake their threads.
+    sockets: std.ArrayList(std.posix.socket_t) = .empty,
+
+    fn listen(self: *Server, port: u16, service: RpcService) !void {
+        const addr = try std.net.Address.parseIp4(self.config.address, port);
+        var listener = try addr.listen(.{ .reuse_address = true });
+        defer listener.deinit();
+
+        try self.acceptLoop(&listener, service);
+    }
 
-    const addr = try std.net.Address.parseIp4(config.address, config.nfs_port);
-    try server.listen(addr);
+    /// Accepts connections on `listener` until the server stops.
+    fn acceptLoop(self: *Server, listener: *std.net.Server, service: RpcService) !void {
+        if (!self.track(listener.stream.handle)) return;
+        defer self.untrack(listener.stream.handle);
+
+        while (true) {
+            const conn = listener.accept() catch |err| {
+                if (self.isStopping()) return;
+                return err;
+            };
+            self.spawnConnection(conn.stream, service);
+        }
+    }
 
-    while (true) {
-        var conn = try server.accept();
-        handleRpcStream(state, conn.stream, .nfs) catch |err| {
-            std.log.warn("NFS connection error: {}", .{err});
+    /// Gives each accepted transport its own reader thread, so one busy
+    /// connection no longer holds up the next accept.
+    fn spawnConnection(self: *Server, stream: std.net.Stream, service: RpcService) void {
+        self.threads.start();
+        const thread = std.Thread.spawn(.{}, serveConnection, .{ self, stream, service }) catch |err| {
+            self.threads.finish();
+            std.log.warn("{s} connection error: {}", .{ service.label(), err });
+            stream.close();
+            return;
         };
-        conn.stream.close();
+        thread.detach();
     }
-}
 
-fn serveMount(state: *state_mod.RepoState, config: ServerConfig) !void {
-    var server = std.net.StreamServer.init(.{});
-    defer server.deinit();
+    /// Registers a socket to shut down on stop. Returns false, leaving the
+    /// socket alone, if the server is already stopping.
+    fn track(self: *Server, socket: std.posix.socket_t) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.stopping) return false;
+        // Untracked, the socket just is not woken early on stop.
+        self.sockets.append(self.state.allocator, socket) catch {};
+        return true;
+    }
 
-    const addr = try std.net.Address.parseIp4(config.address, config.mount_port);
-    try server.listen(addr);
+    fn untrack(self: *Server, socket: std.posix.socket_t) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        for (self.sockets.items, 0..) |tracked, idx| {
+            if (tracked == socket) {
+                _ = self.sockets.swapRemove(idx);
+                return;
+            }
+        }
+    }
 
-    while (true) {
-        var conn = try server.accept();
-        handleRpcStream(state, conn.stream, .mountd) catch |err| {
-            std.log.warn("Mountd connection error: {}", .{err});
+    fn isStopping(self: *Server) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.stopping;
+    }
+
+    /// Wakes the listeners and connection threads so they wind down.
+    fn stop(self: *Server) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.stopping = true;
+        for (self.sockets.items) |socket| std.posix.shutdown(socket, .both) catch {};
+        self.sockets.deinit(self.state.allocator);
+        self.sockets = .empty;
+    }
+};
+
+const RpcService = enum {
+    nfs,
+    mountd,
+
+    fn label(self: RpcService) []const u8 {
+        return switch (self) {
+            .nfs => "NFS",
+            .mountd => "Mountd",
         };
-        conn.stream.close();
     }
+};
+
+/// Most replies a single writev carries.
+const max_iovecs = 64;
+
+fn serveConnection(server: *Server, stream: std.net.Stream, service: RpcService) void {
+    defer server.threads.finish();
+
+    var connection = Connection{
+        .state = server.state,
+        .stream = stream,
+        .service = service,
+        .slots = .{ .permits = server.config.max_in_flight },
+    };
+    defer connection.deinit();
+
+    if (!server.track(stream.handle)) return;
+    defer server.untrack(stream.handle);
+
+    connection.readCalls(&server.pool) catch |err| connection.fail(err);
+    // Calls still running write to the stream and queue into the outbox.
+    connection.in_flight.wait();
 }
 
-const RpcService = enum { nfs, mountd };
+/// One client transport. The reader thread hands each call to the pool as
+/// soon as its record arrives, and replies go out in completion order; the
+/// client matches them to calls by XID.
+const Connection = struct {
+    state: *state_mod.RepoState,
+    stream: std.net.Stream,
+    service: RpcService,
+    in_flight: std.Thread.WaitGroup = .{},
+    slots: std.Thread.Semaphore,
+    /// Guards the fields below.
+    out_mutex: std.Thread.Mutex = .{},
+    /// Finished replies, record marker included, waiting to be written.
+    outbox: std.ArrayList([]u8) = .empty,
+    /// Set while a worker is writing; it also drains whatever others queue
+    /// meanwhile, so replies that finish together share a writev.
+    flushing: bool = false,
+    failed: bool = false,
+
+    fn deinit(self: *Connection) void {
+        for (self.outbox.items) |reply| self.state.allocator.free(reply);
+        self.outbox.deinit(self.state.allocator);
+        self.stream.close();
+    }
+
+    fn readCalls(self: *Connection, pool: *std.Thread.Pool) !void {
+        while (true) {
+            const record = readRecord(self.state.allocator, self.stream) catch |err| switch (err) {
+                error.EndOfStream => return,
+                else => return err,
+            };
+            if (record.len == 0) {
+                self.state.allocator.free(record);
+                return;
+            }
+
+            self.slots.wait();
+            pool.spawnWg(&self.in_flight, handleCall, .{ self, record });
+        }
+    }
+
+    /// Queues a reply and, unless another worker is already writing, writes
+    /// out everything queued.
+    fn send(self: *Connection, reply: []u8) !void {
+        const allocator = self.state.allocator;
 
-fn handleRpcStream(state: *state_mod.RepoState, stream: std.net.Stream, service: RpcService) !void {
-    while (true) {
-        const record = readRecord(stream) catch |err| switch (err) {
-            error.EndOfStream => return,
-            else => return err,
+        self.out_mutex.lock();
+        self.outbox.append(allocator, reply) catch |err| {
+            self.out_mutex.unlock();
+            allocator.free(reply);
+            return err;
         };
-        if (record.len == 0) return;
-        defer state.allocator.free(record);
-
-        var reader = xdr.Reader.init(record);
-        const xid = try reader.readU32();
-        const msg_type = try reader.readU32();
-        if (msg_type != Rpc.CALL) return error.InvalidRpc;
-
-        _ = try reader.readU32(); // rpc version
-        const prog = try reader.readU32();
-        _ = try reader.readU32(); // version
-        const proc = try reader.readU32();
-
-        _ = try reader.readU32(); // cred flavor
-        _ = try reader.readOpaque();
-        _ = try reader.readU32(); // verf flavor
-        _ = try reader.readOpaque();
-
-        var body = xdr.Writer.init(state.allocator);
-        defer body.deinit();
-
-        switch (service) {
-            .nfs => {
-                if (prog != Nfs.PROG) return error.InvalidRpc;
-                try handleNfs(state, proc, &reader, &body);
-            },
-            .mountd => {
-                if (prog != Mount.PROG) return error.InvalidRpc;
-                try handleMount(state, proc, &reader, &body);
-            },
+        if (self.flushing) {
+            self.out_mutex.unlock();
+            return;
         }
+        self.flushing = true;
+
+        var batch: std.ArrayList([]u8) = .empty;
+        defer batch.deinit(allocator);
 
-        const body_bytes = try body.toOwnedSlice(state.allocator);
-        defer state.allocator.free(body_bytes);
+        while (self.outbox.items.len > 0 and !self.failed) {
+            std.mem.swap(std.ArrayList([]u8), &batch, &self.outbox);
+            self.out_mutex.unlock();
 
-        var reply = xdr.Writer.init(state.allocator);
-        defer reply.deinit();
+            const result = writeReplies(self.stream, batch.items);
+            for (batch.items) |bytes| allocator.free(bytes);
+            batch.clearRetainingCapacity();
+
+            self.out_mutex.lock();
+            result catch |err| {
+                self.flushing = false;
+                self.out_mutex.unlock();
+                return err;
+            };
+        }
+        self.flushing = false;
+        self.out_mutex.unlock();
+    }
 
-        try reply.writeU32(xid);
-        try reply.writeU32(Rpc.REPLY);
-        try reply.writeU32(Rpc.MSG_ACCEPTED);
-        try reply.writeU32(Rpc.AUTH_NULL);
-        try reply.writeU32(0);
-        try reply.writeU32(Rpc.SUCCESS);
-        try reply.list.appendSlice(body_bytes);
+    /// Drops the connection on the first error, as the serial server did.
+    fn fail(self: *Connection, err: anyerror) void {
+        self.out_mutex.lock();
+        defer self.out_mutex.unlock();
 
-        const reply_bytes = try reply.toOwnedSlice(state.allocator);
-        defer state.allocator.free(reply_bytes);
+        if (self.failed) return;
+        self.failed = true;
+        std.log.warn("{s} connection error: {}", .{ self.service.label(), err });
+        // Wakes the reader so the connection winds down.
+        std.posix.shutdown(self.stream.handle, .both) catch {};
+    }
+};
+
+fn handleCall(connection: *Connection, record: []u8) void {
+    defer connection.slots.post();
+    defer connection.state.allocator.free(record);
+
+    const reply = buildReply(connection.state, connection.service, record) catch |err| {
+        connection.fail(err);
+        return;
+    };
+    connection.send(reply) catch |err| connection.fail(err);
+}
+
+/// Runs one call and returns the whole reply record, marker included.
+fn buildReply(state: *state_mod.RepoState, service: RpcService, record: []const u8) ![]u8 {
+    var reader = xdr.Reader.init(record);
+    const xid = try reader.readU32();
+    const msg_type = try reader.readU32();
+    if (msg_type != Rpc.CALL) return error.InvalidRpc;
+
+    _ = try reader.readU32(); // rpc version
+    const prog = try reader.readU32();
+    _ = try reader.readU32(); // version
+    const proc = try reader.readU32();
+
+    _ = try reader.readU32(); // cred flavor
+    _ = try reader.readOpaque();
+    _ = try reader.readU32(); // verf flavor
+    _ = try reader.readOpaque();
 
-        try writeRecord(stream, reply_bytes);
+    var reply = xdr.Writer.init(state.allocator);
+    defer reply.deinit();
+
+    try reply.writeU32(0); // record marker, set once the length is known
+    try reply.writeU32(xid);
+    try reply.writeU32(Rpc.REPLY);
+    try reply.writeU32(Rpc.MSG_ACCEPTED);
+    try reply.writeU32(Rpc.AUTH_NULL);
+    try reply.writeU32(0);
+    try reply.writeU32(Rpc.SUCCESS);
+
+    switch (service) {
+        .nfs => {
+            if (prog != Nfs.PROG) return error.InvalidRpc;
+            try handleNfs(state, proc, &reader, &reply);
+        },
+        .mountd => {
+            if (prog != Mount.PROG) return error.InvalidRpc;
+            try handleMount(state, proc, &reader, &reply);
+        },
     }
+
+    const reply_bytes = try reply.toOwnedSlice();
+    const length = @as(u32, @intCast(reply_bytes.len - 4)) | 0x80000000;
+    std.mem.writeInt(u32, reply_bytes[0..4], length, .big);
+    return reply_bytes;
 }
 
 fn handleMount(
@@ -231,7 +432,7 @@ fn handleNfs(
         Nfs.FSSTAT => try nfsFsstat(state, reader, writer),
         Nfs.FSINFO => try nfsFsinfo(writer),
         Nfs.PATHCONF => try nfsPathconf(writer),
-        Nfs.COMMIT => try nfsCommit(writer),
+        Nfs.COMMIT => try nfsCommit(state, reader, writer),
         else => try writer.writeU32(Nfs.NFS3ERR_NOTSUPP),
     }
 }
@@ -338,7 +539,7 @@ fn nfsWrite(state: *state_mod.RepoState, reader: *xdr.Reader, writer: *xdr.Write
     const handle = try readHandle(reader);
     const offset = try reader.readU64();
     _ = try reader.readU32(); // count
-    _ = try reader.readU32(); // stable
+    const stable = try reader.readU32();
     const data = try reader.readOpaque();
 
     const path = state.pathFromHandle(handle) orelse {
@@ -347,13 +548,16 @@ fn nfsWrite(state: *state_mod.RepoState, reader: *xdr.Reader, writer: *xdr.Write
     };
 
     const written = try state.writeFile(path, offset, data);
+    // Unstable writes stay in dirty blocks until the client sends COMMIT.
+    const committed = if (stable == Nfs.UNSTABLE) Nfs.UNSTABLE else Nfs.FILE_SYNC;
+    if (committed == Nfs.FILE_SYNC) try state.commitFile(path);
     const attr = try state.getAttr(path);
 
     try writer.writeU32(Nfs.NFS3_OK);
     try writeWccData(writer, null, attr);
     try writer.writeU32(@intCast(written));
-    try writer.writeU32(Nfs.FILE_SYNC);
-    try writer.writeU64(0);
+    try writer.writeU32(committed);
+    try writer.writeU64(state.write_verifier);
 }
 
 fn nfsCreate(state: *state_mod.RepoState, reader: *xdr.Reader, writer: *xdr.Writer) !void {
@@ -568,42 +772,86 @@ fn nfsPathconf(writer: *xdr.Writer) !void {
     try writer.writeBool(true); // case_preserving
 }
 
-fn nfsCommit(writer: *xdr.Writer) !void {
+fn nfsCommit(state: *state_mod.RepoState, reader: *xdr.Reader, writer: *xdr.Writer) !void {
+    const handle = try readHandle(reader);
+    _ = try reader.readU64(); // offset
+    _ = try reader.readU32(); // count
+
+    const path = state.pathFromHandle(handle) orelse {
+        try writer.writeU32(Nfs.NFS3ERR_STALE);
+        return;
+    };
+
+    // Ranges are not tracked per commit; the whole file goes at once.
+    try state.commitFile(path);
+    const attr = try state.getAttr(path);
+
     try writer.writeU32(Nfs.NFS3_OK);
-    try writer.writeU64(0);
+    try writeWccData(writer, null, attr);
+    try writer.writeU64(state.write_verifier);
 }
 
-fn readRecord(stream: std.net.Stream) ![]u8 {
+fn readRecord(allocator: std.mem.Allocator, stream: std.net.Stream) ![]u8 {
     var header: [4]u8 = undefined;
-    const read_len = try stream.readAll(&header);
-    if (read_len == 0) return error.EndOfStream;
-    if (read_len != 4) return error.EndOfStream;
+    if (try readFull(stream, &header) != header.len) return error.EndOfStream;
 
     const raw = std.mem.readInt(u32, &header, .big);
     const length = raw & 0x7fffffff;
     const last = (raw & 0x80000000) != 0;
     if (!last) return error.InvalidRpc;
 
-    const buf = try std.heap.page_allocator.alloc(u8, length);
-    errdefer std.heap.page_allocator.free(buf);
+    const buf = try allocator.alloc(u8, length);
+    errdefer allocator.free(buf);
 
-    const read_payload = try stream.readAll(buf);
-    if (read_payload != length) return error.EndOfStream;
+    if (try readFull(stream, buf) != length) return error.EndOfStream;
     return buf;
 }
 
-fn writeRecord(stream: std.net.Stream, payload: []const u8) !void {
-    const length = @as(u32, @intCast(payload.len)) | 0x80000000;
-    var header: [4]u8 = undefined;
-    std.mem.writeInt(u32, &header, length, .big);
-    try stream.writeAll(&header);
-    try stream.writeAll(payload);
+/// Reads until `buf` is full or the peer closes; returns the bytes read.
+fn readFull(stream: std.net.Stream, buf: []u8) !usize {
+    var total: usize = 0;
+    while (total < buf.len) {
+        const read_len = try stream.read(buf[total..]);
+        if (read_len == 0) break;
+        total += read_len;
+    }
+    return total;
+}
+
+/// Writes whole records back to back, `max_iovecs` at a time.
+fn writeReplies(stream: std.net.Stream, replies: []const []u8) !void {
+    var iovecs: [max_iovecs]std.posix.iovec_const = undefined;
+    var start: usize = 0;
+    while (start < replies.len) {
+        const chunk = replies[start..@min(start + max_iovecs, replies.len)];
+        for (chunk, iovecs[0..chunk.len]) |bytes, *iovec| {
+            iovec.* = .{ .base = bytes.ptr, .len = bytes.len };
+        }
+        try writevAll(stream, iovecs[0..chunk.len]);
+        start += chunk.len;
+    }
+}
+
+/// Writes every iovec, picking up where a short write stopped.
+fn writevAll(stream: std.net.Stream, iovecs: []std.posix.iovec_const) !void {
+    var remaining = iovecs;
+    while (remaining.len > 0) {
+        var written = try std.posix.writev(stream.handle, remaining);
+        while (remaining.len > 0 and written >= remaining[0].len) {
+            written -= remaining[0].len;
+            remaining = remaining[1..];
+        }
+        if (remaining.len > 0) {
+            remaining[0].base += written;
+            remaining[0].len -= written;
+        }
+    }
 }
 
 fn readHandle(reader: *xdr.Reader) !u64 {
     const data = try reader.readOpaque();
     if (data.len != 8) return error.InvalidHandle;
-    return std.mem.readInt(u64, data, .big);
+    return std.mem.readInt(u64, data[0..8], .big);
 }
 
 fn writeHandle(writer: *xdr.Writer, handle: u64) !void {
@@ -696,3 +944,151 @@ fn currentGid() u32 {
     }
     return 0;
 }
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+/// An NFS call record with AUTH_NULL credentials and, if given, a file handle
+/// as its only argument.
+fn encodeTestCall(allocator: std.mem.Allocator, xid: u32, proc: u32, handle: ?u64) ![]u8 {
+    var call = xdr.Writer.init(allocator);
+    defer call.deinit();
+
+    try call.writeU32(0); // record marker
+    try call.writeU32(xid);
+    try call.writeU32(Rpc.CALL);
+    try call.writeU32(2); // rpc version
+    try call.writeU32(Nfs.PROG);
+    try call.writeU32(Nfs.VERS);
+    try call.writeU32(proc);
+    try call.writeU32(Rpc.AUTH_NULL);
+    try call.writeOpaque(&[_]u8{});
+    try call.writeU32(Rpc.AUTH_NULL);
+    try call.writeOpaque(&[_]u8{});
+    if (handle) |value| try writeHandle(&call, value);
+
+    const bytes = try call.toOwnedSlice();
+    std.mem.writeInt(u32, bytes[0..4], @as(u32, @intCast(bytes.len - 4)) | 0x80000000, .big);
+    return bytes;
+}
+
+const TestReply = struct {
+    xid: u32,
+    /// Positioned at the procedure's results.
+    reader: xdr.Reader,
+};
+
+/// Checks the accepted-reply header.
+fn parseTestReply(record: []const u8) !TestReply {
+    var reader = xdr.Reader.init(record);
+    const xid = try reader.readU32();
+    try std.testing.expectEqual(Rpc.REPLY, try reader.readU32());
+    try std.testing.expectEqual(Rpc.MSG_ACCEPTED, try reader.readU32());
+    _ = try reader.readU32(); // verf flavor
+    _ = try reader.readOpaque();
+    try std.testing.expectEqual(Rpc.SUCCESS, try reader.readU32());
+    return .{ .xid = xid, .reader = reader };
+}
+
+fn runTestListener(server: *Server, listener: *std.net.Server) void {
+    defer server.threads.finish();
+    server.acceptLoop(listener, .nfs) catch |err| {
+        std.log.warn("Test listener error: {}", .{err});
+    };
+}
+
+test "pipelined calls are answered as they finish" {
+    const allocator = std.testing.allocator;
+    var repo: state_mod.TestRepo = undefined;
+    try repo.init();
+    defer repo.deinit();
+    try repo.track("slow.txt", "held by the fake forge");
+    const slow_handle = try repo.state.handleForPath("slow.txt");
+
+    const addr = try std.net.Address.parseIp4("127.0.0.1", 0);
+    var listener = try addr.listen(.{ .reuse_address = true });
+    defer listener.deinit();
+
+    // Torn down the way `serve` does it, once any held download is let go.
+    var server = Server{ .state = &repo.state, .config = .{ .workers = 2 }, .pool = undefined };
+    try server.pool.init(.{ .allocator = allocator, .n_jobs = 2 });
+    defer server.pool.deinit();
+    defer server.threads.wait();
+    defer server.stop();
+    defer repo.gate.set();
+
+    server.threads.start();
+    const listener_thread = std.Thread.spawn(.{}, runTestListener, .{ &server, &listener }) catch |err| {
+        server.threads.finish();
+        return err;
+    };
+    listener_thread.detach();
+
+    const client = try std.net.tcpConnectToAddress(listener.listen_address);
+    defer client.close();
+
+    const getattr = try encodeTestCall(allocator, 1, Nfs.GETATTR, slow_handle);
+    defer allocator.free(getattr);
+    const null_call = try encodeTestCall(allocator, 2, Nfs.NULL, null);
+    defer allocator.free(null_call);
+    try writeReplies(client, &.{ getattr, null_call });
+
+    // GETATTR cannot finish until its download is let go, so the NULL sent
+    // after it on the same connection is answered first.
+    const first = try readRecord(allocator, client);
+    defer allocator.free(first);
+    const null_reply = try parseTestReply(first);
+    try std.testing.expectEqual(@as(u32, 2), null_reply.xid);
+    try std.testing.expectEqual(null_reply.reader.data.len, null_reply.reader.offset);
+
+    repo.gate.set();
+    const second = try readRecord(allocator, client);
+    defer allocator.free(second);
+    var getattr_reply = try parseTestReply(second);
+    try std.testing.expectEqual(@as(u32, 1), getattr_reply.xid);
+    try std.testing.expectEqual(Nfs.NFS3_OK, try getattr_reply.reader.readU32());
+    try std.testing.expectEqual(Nfs.NF3REG, try getattr_reply.reader.readU32());
+    for (0..4) |_| _ = try getattr_reply.reader.readU32(); // mode, nlink, uid, gid
+    try std.testing.expectEqual(@as(u64, "held by the fake forge".len), try getattr_reply.reader.readU64());
+    try std.testing.expectEqual(@as(u32, 1), repo.downloads.load(.monotonic));
+}
+
+test "writeReplies sends more replies than fit one writev, in order" {
+    const allocator = std.testing.allocator;
+    var fds: [2]i32 = undefined;
+    try std.testing.expectEqual(@as(usize, 0), std.os.linux.socketpair(std.os.linux.AF.UNIX, std.os.linux.SOCK.STREAM, 0, &fds));
+    const writer: std.net.Stream = .{ .handle = fds[0] };
+    defer writer.close();
+    const reader: std.net.Stream = .{ .handle = fds[1] };
+    defer reader.close();
+
+    const reply_len = 8 * 1024;
+    var replies: [max_iovecs + 6][]u8 = undefined;
+    var allocated: usize = 0;
+    defer for (replies[0..allocated]) |reply| allocator.free(reply);
+    for (&replies, 0..) |*reply, idx| {
+        reply.* = try allocator.alloc(u8, reply_len);
+        allocated += 1;
+        @memset(reply.*, @intCast(idx));
+    }
+
+    // More than the socket buffers, so the writer blocks until this drains.
+    const Drain = struct {
+        fn run(stream: std.net.Stream, out: []u8) void {
+            _ = readFull(stream, out) catch {};
+        }
+    };
+    const received = try allocator.alloc(u8, replies.len * reply_len);
+    defer allocator.free(received);
+    const drain = try std.Thread.spawn(.{}, Drain.run, .{ reader, received });
+
+    const written = writeReplies(writer, &replies);
+    // Lets the reader give up if the write stopped short.
+    if (written) |_| {} else |_| std.posix.shutdown(fds[0], .both) catch {};
+    drain.join();
+    try written;
+    for (replies, 0..) |reply, idx| {
+        try std.testing.expectEqualSlices(u8, reply, received[idx * reply_len ..][0..reply_len]);
+    }
+}
@@ -1,10 +1,11 @@
 const std = @import("std");
-const auth = @import("mic/auth.zig");
-const cache_mod = @import("mic/cache.zig");
-const content_proto = @import("mic/grpc/content_proto.zig");
-const grpc_client = @import("mic/grpc/client.zig");
-const grpc_endpoint = @import("mic/grpc/endpoint.zig");
-const overlay_mod = @import("mic/fs/overlay.zig");
+const auth = @import("../auth.zig");
+const cache_mod = @import("../cache.zig");
+const content_proto = @import("../grpc/content_proto.zig");
+const grpc_client = @import("../grpc/client.zig");
+const grpc_endpoint = @import("../grpc/endpoint.zig");
+const blocks = @import("blocks.zig");
+const overlay_mod = @import("overlay.zig");
 
 pub const EntryKind = enum {
     file,
@@ -31,6 +32,23 @@ const FileEntry = struct {
     hash_hex: []const u8,
 };
 
+/// Fetches a blob's bytes from the forge; the caller owns the result.
+const DownloadFn = *const fn (state: *RepoState, entry: FileEntry) anyerror![]u8;
+
+/// A blob fetch that other readers of the same hash wait on instead of
+/// fetching it again. Lives on the fetching thread's stack, which stays put
+/// until every waiter has taken the result.
+const BlobFetch = struct {
+    done: bool = false,
+    blob: ?*blocks.Blob = null,
+    failure: anyerror = error.FetchFailed,
+    waiters: usize = 0,
+};
+
+/// Shared by every NFS worker thread. `entries` is fixed after init; `dirs`,
+/// `overlay` and `dirty` sit behind `tree_lock`, which is never held across a
+/// blob fetch or a journal fsync so one slow call does not stall the rest of
+/// the mount. Journal compaction holds it shared.
 pub const RepoState = struct {
     allocator: std.mem.Allocator,
     server: []const u8,
@@ -43,6 +61,30 @@ pub const RepoState = struct {
     next_id: u64,
     overlay: overlay_mod.Overlay,
     cache: cache_mod.BlobCache,
+    /// Content of files being read or written right now.
+    content: blocks.ContentCache,
+    /// Uncommitted writes by path. Keys are owned. A dirty file over an
+    /// overlay entry borrows its content, so that entry only changes when
+    /// the dirty file is flushed and discarded.
+    dirty: std.StringHashMap(*blocks.DirtyFile),
+    /// Blob fetches in progress, by hash; keys borrow `entries`.
+    fetching: std.StringHashMap(*BlobFetch),
+    /// Changes whenever the server restarts, telling clients to resend
+    /// unstable writes that were never committed.
+    write_verifier: u64,
+    tree_lock: std.Thread.RwLock = .{},
+    /// Guards `handles`, `paths` and `next_id`. May be taken under `tree_lock`.
+    handle_mutex: std.Thread.Mutex = .{},
+    /// Guards `cache`. May be taken under `tree_lock`.
+    cache_mutex: std.Thread.Mutex = .{},
+    /// Guards `fetching` and every BlobFetch in it. Never held across a fetch.
+    fetch_mutex: std.Thread.Mutex = .{},
+    /// Signalled when a fetch finishes and when its last waiter leaves.
+    fetch_cond: std.Thread.Condition = .{},
+    /// Held by the one commit compacting the overlay journal.
+    compact_mutex: std.Thread.Mutex = .{},
+    /// Where blob misses go; `downloadBlob` outside tests.
+    download: DownloadFn,
 
     pub fn init(
         allocator: std.mem.Allocator,
@@ -51,7 +93,24 @@ pub const RepoState = struct {
         project: []const u8,
         state_dir: []const u8,
     ) !RepoState {
-        var cache = try cache_mod.BlobCache.init(allocator, .{});
+        var state = try create(allocator, server, account, project, state_dir, .{}, downloadBlob);
+        errdefer state.deinit();
+
+        try state.loadTree();
+        return state;
+    }
+
+    /// Everything `init` sets up but the tree.
+    fn create(
+        allocator: std.mem.Allocator,
+        server: []const u8,
+        account: []const u8,
+        project: []const u8,
+        state_dir: []const u8,
+        cache_options: cache_mod.CacheOptions,
+        download: DownloadFn,
+    ) !RepoState {
+        var cache = try cache_mod.BlobCache.init(allocator, cache_options);
         errdefer cache.deinit();
 
         const session_path = try std.fs.path.join(allocator, &.{ state_dir, "session.json" });
@@ -60,7 +119,7 @@ pub const RepoState = struct {
         var overlay = try overlay_mod.Overlay.init(allocator, session_path, account, project);
         errdefer overlay.deinit();
 
-        var state = RepoState{
+        return .{
             .allocator = allocator,
             .server = try allocator.dupe(u8, server),
             .account = try allocator.dupe(u8, account),
@@ -72,11 +131,12 @@ pub const RepoState = struct {
             .next_id = 1,
             .overlay = overlay,
             .cache = cache,
+            .content = blocks.ContentCache.init(allocator, blocks.default_max_bytes),
+            .dirty = std.StringHashMap(*blocks.DirtyFile).init(allocator),
+            .fetching = std.StringHashMap(*BlobFetch).init(allocator),
+            .write_verifier = std.crypto.random.int(u64),
+            .download = download,
         };
-        errdefer state.deinit();
-
-        try state.loadTree();
-        return state;
     }
 
     pub fn deinit(self: *RepoState) void {
@@ -106,8 +166,19 @@ pub const RepoState = struct {
         }
         self.paths.deinit();
 
+        // Writes the client never committed are still worth keeping.
+        var dirty_iter = self.dirty.iterator();
+        while (dirty_iter.next()) |entry| {
+            self.flushDirty(entry.key_ptr.*, entry.value_ptr.*) catch {};
+            self.allocator.free(entry.key_ptr.*);
+            entry.value_ptr.*.destroy();
+        }
+        self.dirty.deinit();
+        self.fetching.deinit();
+
         self.overlay.deinit();
         self.cache.deinit();
+        self.content.deinit();
 
         self.allocator.free(self.server);
         self.allocator.free(self.account);
@@ -115,11 +186,16 @@ pub const RepoState = struct {
         self.* = undefined;
     }
 
-    pub fn pathFromHandle(self: *const RepoState, handle: u64) ?[]const u8 {
+    pub fn pathFromHandle(self: *RepoState, handle: u64) ?[]const u8 {
+        self.handle_mutex.lock();
+        defer self.handle_mutex.unlock();
         return self.paths.get(handle);
     }
 
     pub fn handleForPath(self: *RepoState, path: []const u8) !u64 {
+        self.handle_mutex.lock();
+        defer self.handle_mutex.unlock();
+
         if (self.handles.get(path)) |existing| return existing;
 
         const owned_path = try self.allocator.dupe(u8, path);
@@ -135,6 +211,9 @@ pub const RepoState = struct {
         const child_path = try joinPath(self.allocator, dir_path, name);
         defer self.allocator.free(child_path);
 
+        self.tree_lock.lockShared();
+        defer self.tree_lock.unlockShared();
+
         if (self.isDeleted(child_path)) return null;
 
         if (self.overlay.get(child_path)) |overlay| {
@@ -157,16 +236,20 @@ pub const RepoState = struct {
     }
 
     pub fn listDir(self: *RepoState, dir_path: []const u8) ![]DirEntry {
-        var entries = std.ArrayList(DirEntry).init(self.allocator);
-        errdefer entries.deinit();
+        var entries: std.ArrayList(DirEntry) = .empty;
+        errdefer entries.deinit(self.allocator);
 
+        // Keys borrow the tree, which stays put while the lock is held.
         var seen = std.StringHashMap(EntryKind).init(self.allocator);
         defer seen.deinit();
 
+        self.tree_lock.lockShared();
+        defer self.tree_lock.unlockShared();
+
         try self.collectDirEntries(dir_path, &entries, &seen);
         try self.collectOverlayEntries(dir_path, &entries, &seen);
 
-        return try entries.toOwnedSlice();
+        return try entries.toOwnedSlice(self.allocator);
     }
 
     pub fn getAttr(self: *RepoState, path: []const u8) !?Attr {
@@ -175,69 +258,127 @@ pub const RepoState = struct {
             return .{ .kind = .dir, .size = 0, .fileid = handle, .mode = 0o755, .mtime = std.time.timestamp() };
         }
 
-        if (self.overlay.get(path)) |overlay| {
-            if (overlay.change_type == .deleted) return null;
-            const handle = try self.handleForPath(path);
-            return .{ .kind = .file, .size = overlay.content.len, .fileid = handle, .mode = 0o644, .mtime = std.time.timestamp() };
-        }
+        const entry = blk: {
+            self.tree_lock.lockShared();
+            defer self.tree_lock.unlockShared();
 
-        if (self.entries.get(path)) |entry| {
-            const handle = try self.handleForPath(path);
-            const size = try self.fileSize(entry);
-            return .{ .kind = .file, .size = size, .fileid = handle, .mode = 0o644, .mtime = std.time.timestamp() };
-        }
+            if (self.dirty.get(path)) |dirty| {
+                const handle = try self.handleForPath(path);
+                return .{ .kind = .file, .size = dirty.size, .fileid = handle, .mode = 0o644, .mtime = std.time.timestamp() };
+            }
 
-        if (self.dirs.contains(path)) {
-            const handle = try self.handleForPath(path);
-            return .{ .kind = .dir, .size = 0, .fileid = handle, .mode = 0o755, .mtime = std.time.timestamp() };
-        }
+            if (self.overlay.get(path)) |overlay| {
+                if (overlay.change_type == .deleted) return null;
+                const handle = try self.handleForPath(path);
+                return .{ .kind = .file, .size = overlay.content.len, .fileid = handle, .mode = 0o644, .mtime = std.time.timestamp() };
+            }
 
-        return null;
+            if (self.entries.get(path)) |tracked| break :blk tracked;
+
+            if (self.dirs.contains(path)) {
+                const handle = try self.handleForPath(path);
+                return .{ .kind = .dir, .size = 0, .fileid = handle, .mode = 0o755, .mtime = std.time.timestamp() };
+            }
+
+            return null;
+        };
+
+        // Sizing a tracked file may fetch it, so the lock is already released.
+        // The content stays cached for the READs that usually follow.
+        const handle = try self.handleForPath(path);
+        const blob = try self.acquireBlob(entry);
+        defer blob.release();
+        return .{ .kind = .file, .size = blob.data.len, .fileid = handle, .mode = 0o644, .mtime = std.time.timestamp() };
     }
 
     pub fn readFile(self: *RepoState, path: []const u8, offset: u64, count: u32) !?[]u8 {
-        if (self.overlay.get(path)) |overlay| {
-            if (overlay.change_type == .deleted) return null;
-            return sliceContent(self.allocator, overlay.content, offset, count);
-        }
+        const entry = blk: {
+            self.tree_lock.lockShared();
+            defer self.tree_lock.unlockShared();
 
-        const entry = self.entries.get(path) orelse return null;
-        const content = try self.fetchFile(entry);
-        defer self.allocator.free(content);
+            if (self.dirty.get(path)) |dirty| {
+                return try dirty.read(self.allocator, offset, count);
+            }
 
-        return sliceContent(self.allocator, content, offset, count);
+            if (self.overlay.get(path)) |overlay| {
+                if (overlay.change_type == .deleted) return null;
+                return try sliceContent(self.allocator, overlay.content, offset, count);
+            }
+
+            break :blk self.entries.get(path) orelse return null;
+        };
+
+        const blob = try self.acquireBlob(entry);
+        defer blob.release();
+
+        return sliceContent(self.allocator, blob.data, offset, count);
     }
 
+    /// Records the write in the file's dirty blocks. Nothing reaches the
+    /// overlay until `commitFile`.
     pub fn writeFile(self: *RepoState, path: []const u8, offset: u64, data: []const u8) !usize {
-        const existing = if (self.overlay.get(path)) |overlay| overlay.content else blk: {
-            if (self.entries.get(path)) |entry| {
-                const content = try self.fetchFile(entry);
-                defer self.allocator.free(content);
-                break :blk try self.allocator.dupe(u8, content);
-            }
-            break :blk &[_]u8{};
+        // The first write to a tracked file needs its committed content.
+        const fetched = try self.fetchUnlessOverlaid(path);
+        defer if (fetched) |blob| blob.release();
+
+        self.tree_lock.lock();
+        defer self.tree_lock.unlock();
+
+        const dirty = self.dirty.get(path) orelse blk: {
+            // Another write may have reached the overlay while this one fetched.
+            // Its content is borrowed rather than copied; see `dirty`.
+            const created = if (self.overlay.get(path)) |overlay|
+                try blocks.DirtyFile.createOver(self.allocator, overlay.content)
+            else base: {
+                if (fetched) |blob| blob.retain();
+                errdefer if (fetched) |blob| blob.release();
+                break :base try blocks.DirtyFile.create(self.allocator, fetched);
+            };
+            errdefer created.destroy();
+            const key = try self.allocator.dupe(u8, path);
+            errdefer self.allocator.free(key);
+            try self.dirty.put(key, created);
+            break :blk created;
         };
-        defer if (existing.len > 0 and self.overlay.get(path) == null) self.allocator.free(existing);
-
-        const new_len = @max(existing.len, @as(usize, @intCast(offset)) + data.len);
-        var new_content = try self.allocator.alloc(u8, new_len);
-        @memset(new_content, 0);
-        if (existing.len > 0) {
-            @memcpy(new_content[0..existing.len], existing);
-        }
-        @memcpy(new_content[@intCast(offset) .. @intCast(offset) + data.len], data);
 
-        const change_type: overlay_mod.ChangeType = if (self.entries.contains(path)) .modified else .added;
-        try self.overlay.setFile(path, new_content, change_type);
+        try dirty.write(offset, data);
         self.addDirPrefixes(path) catch {};
-        self.allocator.free(new_content);
         return data.len;
     }
 
+    /// Moves the file's dirty blocks into the overlay and makes the overlay
+    /// durable, along with whatever else was written since the last commit.
+    pub fn commitFile(self: *RepoState, path: []const u8) !void {
+        {
+            self.tree_lock.lock();
+            defer self.tree_lock.unlock();
+            try self.commitLocked(path);
+        }
+
+        try self.overlay.sync();
+        try self.compactOverlay();
+    }
+
+    /// Rewrites the overlay journal once it has grown well past the live
+    /// content. Readers carry on meanwhile; changes wait for the rewrite.
+    fn compactOverlay(self: *RepoState) !void {
+        // Another commit is already on it.
+        if (!self.compact_mutex.tryLock()) return;
+        defer self.compact_mutex.unlock();
+
+        self.tree_lock.lockShared();
+        defer self.tree_lock.unlockShared();
+        try self.overlay.compactIfLarge();
+    }
+
     pub fn createFile(self: *RepoState, dir_path: []const u8, name: []const u8) !DirEntry {
         const child_path = try joinPath(self.allocator, dir_path, name);
         defer self.allocator.free(child_path);
 
+        self.tree_lock.lock();
+        defer self.tree_lock.unlock();
+
+        self.discardDirty(child_path);
         try self.overlay.setFile(child_path, &[_]u8{}, .added);
         self.addDirPrefixes(child_path) catch {};
         const handle = try self.handleForPath(child_path);
@@ -248,16 +389,32 @@ pub const RepoState = struct {
         const child_path = try joinPath(self.allocator, dir_path, name);
         defer self.allocator.free(child_path);
 
+        self.tree_lock.lock();
+        defer self.tree_lock.unlock();
+
         try self.ensureDir(child_path);
         const handle = try self.handleForPath(child_path);
         return .{ .name = name, .path = try self.allocator.dupe(u8, child_path), .kind = .dir, .handle = handle };
     }
 
     pub fn removePath(self: *RepoState, path: []const u8) !void {
+        self.tree_lock.lock();
+        defer self.tree_lock.unlock();
+
+        self.discardDirty(path);
         try self.overlay.remove(path);
     }
 
     pub fn renamePath(self: *RepoState, from: []const u8, to: []const u8) !void {
+        const fetched = try self.fetchUnlessOverlaid(from);
+        defer if (fetched) |blob| blob.release();
+
+        self.tree_lock.lock();
+        defer self.tree_lock.unlock();
+
+        try self.commitLocked(from);
+        self.discardDirty(to);
+
         if (self.overlay.get(from)) |overlay| {
             if (overlay.change_type != .deleted) {
                 try self.overlay.setFile(to, overlay.content, .modified);
@@ -266,10 +423,8 @@ pub const RepoState = struct {
             return;
         }
 
-        if (self.entries.get(from)) |entry| {
-            const content = try self.fetchFile(entry);
-            defer self.allocator.free(content);
-            try self.overlay.setFile(to, content, .added);
+        if (fetched) |blob| {
+            try self.overlay.setFile(to, blob.data, .added);
             try self.overlay.remove(from);
             return;
         }
@@ -292,17 +447,123 @@ pub const RepoState = struct {
 
         for (entries) |entry| {
             if (entry.kind != .file) continue;
-            const path = entry.path;
-            if (self.overlay.get(path)) |overlay| {
-                if (overlay.change_type == .deleted) continue;
-                _ = self.cache.put(path, overlay.content) catch {};
-                continue;
-            }
+            const file_entry = self.prefetchTarget(entry.path) orelse continue;
+            const data = self.fetchFile(file_entry) catch continue;
+            self.allocator.free(data);
+        }
+    }
 
-            if (self.entries.get(path)) |file_entry| {
-                _ = self.fetchFile(file_entry) catch {};
+    /// Caches overlay content right away; returns the tracked entry to fetch
+    /// otherwise.
+    fn prefetchTarget(self: *RepoState, path: []const u8) ?FileEntry {
+        self.tree_lock.lockShared();
+        defer self.tree_lock.unlockShared();
+
+        if (self.overlay.get(path)) |overlay| {
+            if (overlay.change_type == .deleted) return null;
+            self.cache_mutex.lock();
+            defer self.cache_mutex.unlock();
+            _ = self.cache.put(path, overlay.content) catch {};
+            return null;
+        }
+
+        return self.entries.get(path);
+    }
+
+    /// Acquires the committed content of `path` if it is tracked and has
+    /// neither dirty blocks nor an overlay copy, without holding `tree_lock`
+    /// during the fetch.
+    fn fetchUnlessOverlaid(self: *RepoState, path: []const u8) !?*blocks.Blob {
+        const entry = blk: {
+            self.tree_lock.lockShared();
+            defer self.tree_lock.unlockShared();
+
+            if (self.dirty.contains(path) or self.overlay.get(path) != null) return null;
+            break :blk self.entries.get(path) orelse return null;
+        };
+        return try self.acquireBlob(entry);
+    }
+
+    /// Returns a reference to the blob's content, fetching it on a miss.
+    /// Concurrent misses on one hash share a single fetch.
+    fn acquireBlob(self: *RepoState, entry: FileEntry) !*blocks.Blob {
+        if (self.content.acquire(entry.hash_hex)) |blob| return blob;
+
+        self.fetch_mutex.lock();
+        if (self.fetching.get(entry.hash_hex)) |fetch| {
+            fetch.waiters += 1;
+            while (!fetch.done) self.fetch_cond.wait(&self.fetch_mutex);
+
+            const blob = fetch.blob;
+            const failure = fetch.failure;
+            if (blob) |shared| shared.retain();
+            fetch.waiters -= 1;
+            if (fetch.waiters == 0) self.fetch_cond.broadcast();
+            self.fetch_mutex.unlock();
+            return blob orelse return failure;
+        }
+        // A fetch may have finished between the first check and the lock.
+        if (self.content.acquire(entry.hash_hex)) |blob| {
+            self.fetch_mutex.unlock();
+            return blob;
+        }
+
+        var fetch = BlobFetch{};
+        self.fetching.put(entry.hash_hex, &fetch) catch |err| {
+            self.fetch_mutex.unlock();
+            return err;
+        };
+        self.fetch_mutex.unlock();
+
+        const result = self.fetchBlob(entry);
+
+        self.fetch_mutex.lock();
+        defer self.fetch_mutex.unlock();
+        _ = self.fetching.remove(entry.hash_hex);
+        if (result) |blob| fetch.blob = blob else |err| fetch.failure = err;
+        fetch.done = true;
+        self.fetch_cond.broadcast();
+        while (fetch.waiters > 0) self.fetch_cond.wait(&self.fetch_mutex);
+        return result;
+    }
+
+    fn fetchBlob(self: *RepoState, entry: FileEntry) !*blocks.Blob {
+        const data = try self.fetchFile(entry);
+        defer self.allocator.free(data);
+        return self.content.insert(entry.hash_hex, data);
+    }
+
+    fn commitLocked(self: *RepoState, path: []const u8) !void {
+        const dirty = self.dirty.get(path) orelse return;
+        try self.flushDirty(path, dirty);
+        self.discardDirty(path);
+    }
+
+    fn flushDirty(self: *RepoState, path: []const u8, dirty: *const blocks.DirtyFile) !void {
+        // The dirty file was based on the overlay copy, so only the blocks
+        // written since need to reach it.
+        if (self.overlay.get(path)) |existing| {
+            if (existing.change_type != .deleted) {
+                const extents = try dirty.extents(self.allocator);
+                defer self.allocator.free(extents);
+                for (extents) |extent| {
+                    try self.overlay.writeExtent(path, extent.offset, extent.data, dirty.size);
+                }
+                return;
             }
         }
+
+        const content = try dirty.materialize(self.allocator);
+        defer self.allocator.free(content);
+
+        const change_type: overlay_mod.ChangeType = if (self.entries.contains(path)) .modified else .added;
+        try self.overlay.setFile(path, content, change_type);
+    }
+
+    fn discardDirty(self: *RepoState, path: []const u8) void {
+        const removed = self.dirty.fetchRemove(path) orelse return;
+        self.allocator.free(removed.key);
+        removed.value.destroy();
     }
 
     fn loadTree(self: *RepoState) !void {
@@ -317,7 +578,7 @@ pub const RepoState = struct {
 
         const response = try grpc_client.unaryCall(
             arena_alloc,
-            endpoint,
+            endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
             "/micelio.content.v1.ContentService/GetHeadTree",
             request,
             access_token,
@@ -349,9 +610,9 @@ pub const RepoState = struct {
         while (dir_iter.next()) |entry| {
             const child = childName(dir_path, entry.key_ptr.*) orelse continue;
             if (seen.contains(child.name)) continue;
-            try seen.put(try self.allocator.dupe(u8, child.name), .dir);
+            try seen.put(child.name, .dir);
             const handle = try self.handleForPath(child.path);
-            try entries.append(.{ .name = try self.allocator.dupe(u8, child.name), .path = try self.allocator.dupe(u8, child.path), .kind = .dir, .handle = handle });
+            try entries.append(self.allocator, .{ .name = try self.allocator.dupe(u8, child.name), .path = try self.allocator.dupe(u8, child.path), .kind = .dir, .handle = handle });
         }
 
         var file_iter = self.entries.iterator();
@@ -360,9 +621,9 @@ pub const RepoState = struct {
             if (child.kind != .file) continue;
             if (self.isDeleted(child.path)) continue;
             if (seen.contains(child.name)) continue;
-            try seen.put(try self.allocator.dupe(u8, child.name), .file);
+            try seen.put(child.name, .file);
             const handle = try self.handleForPath(child.path);
-            try entries.append(.{ .name = try self.allocator.dupe(u8, child.name), .path = try self.allocator.dupe(u8, child.path), .kind = .file, .handle = handle });
+            try entries.append(self.allocator, .{ .name = try self.allocator.dupe(u8, child.name), .path = try self.allocator.dupe(u8, child.path), .kind = .file, .handle = handle });
         }
     }
 
@@ -379,9 +640,9 @@ pub const RepoState = struct {
             const child = childName(dir_path, entry.key_ptr.*) orelse continue;
             if (child.kind != .file) continue;
             if (seen.contains(child.name)) continue;
-            try seen.put(try self.allocator.dupe(u8, child.name), .file);
+            try seen.put(child.name, .file);
             const handle = try self.handleForPath(child.path);
-            try entries.append(.{ .name = try self.allocator.dupe(u8, child.name), .path = try self.allocator.dupe(u8, child.path), .kind = .file, .handle = handle });
+            try entries.append(self.allocator, .{ .name = try self.allocator.dupe(u8, child.name), .path = try self.allocator.dupe(u8, child.path), .kind = .file, .handle = handle });
         }
     }
 
@@ -411,39 +672,45 @@ pub const RepoState = struct {
     }
 
     fn fetchFile(self: *RepoState, entry: FileEntry) ![]u8 {
-        if (self.cache.get(entry.hash_hex)) |cached| {
+        if (self.cacheGet(entry.hash_hex)) |cached| {
             return cached;
         }
 
-        const access_token = try auth.requireAccessTokenWithMessage(self.allocator);
-        const endpoint = try grpc_endpoint.parseServer(self.allocator, self.server);
-        const request = try content_proto.encodeGetBlobRequest(self.allocator, self.account, self.project, entry.hash);
-        defer self.allocator.free(request);
+        const blob = try self.download(self, entry);
+        errdefer self.allocator.free(blob);
+        {
+            self.cache_mutex.lock();
+            defer self.cache_mutex.unlock();
+            try self.cache.put(entry.hash_hex, blob);
+        }
+        return blob;
+    }
+
+    fn downloadBlob(self: *RepoState, entry: FileEntry) anyerror![]u8 {
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+        const arena_alloc = arena.allocator();
+
+        const access_token = try auth.requireAccessTokenWithMessage(arena_alloc);
+        const endpoint = try grpc_endpoint.parseServer(arena_alloc, self.server);
+        const request = try content_proto.encodeGetBlobRequest(arena_alloc, self.account, self.project, entry.hash);
 
         const response = try grpc_client.unaryCall(
-            self.allocator,
-            endpoint,
+            arena_alloc,
+            endpoint.withProfile(.bulk),
             "/micelio.content.v1.ContentService/GetBlob",
             request,
             access_token,
         );
-        defer self.allocator.free(response.bytes);
 
-        const blob = try content_proto.decodeBlobResponse(self.allocator, response.bytes);
-        try self.cache.put(entry.hash_hex, blob);
-        return try self.allocator.dupe(u8, blob);
+        const blob = try content_proto.decodeBlobResponse(arena_alloc, response.bytes);
+        return self.allocator.dupe(u8, blob);
     }
 
-    fn fileSize(self: *RepoState, entry: FileEntry) !u64 {
-        if (self.cache.get(entry.hash_hex)) |cached| {
-            const size = cached.len;
-            self.allocator.free(cached);
-            return size;
-        }
-
-        const content = try self.fetchFile(entry);
-        defer self.allocator.free(content);
-        return content.len;
+    fn cacheGet(self: *RepoState, hash_hex: []const u8) ?[]u8 {
+        self.cache_mutex.lock();
+        defer self.cache_mutex.unlock();
+        return self.cache.get(hash_hex);
     }
 };
 
@@ -497,10 +764,171 @@ fn sliceContent(allocator: std.mem.Allocator, content: []const u8, offset: u64,
 
 fn hexEncode(allocator: std.mem.Allocator, bytes: []const u8) ![]u8 {
     const hex_chars = "0123456789abcdef";
-    var out = try allocator.alloc(u8, bytes.len * 2);
+    const out = try allocator.alloc(u8, bytes.len * 2);
     for (bytes, 0..) |b, idx| {
         out[idx * 2] = hex_chars[b >> 4];
         out[idx * 2 + 1] = hex_chars[b & 0x0f];
     }
     return out;
 }
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+/// A RepoState over a temporary state directory, with downloads served by a
+/// fake forge that holds each one until `gate` is set. Test blobs use their
+/// content as their hash. Also used by the server tests.
+pub const TestRepo = struct {
+    temp: std.testing.TmpDir,
+    state: RepoState,
+    gate: std.Thread.ResetEvent = .{},
+    downloads: std.atomic.Value(u32) = .init(0),
+    /// Returned by every download instead of the content, when set.
+    failure: ?anyerror = null,
+
+    /// Initializes in place: downloads find the repo from its `state`.
+    pub fn init(self: *TestRepo) !void {
+        const allocator = std.testing.allocator;
+        self.* = .{ .temp = std.testing.tmpDir(.{}), .state = undefined };
+        errdefer self.temp.cleanup();
+
+        const state_dir = try self.temp.dir.realpathAlloc(allocator, ".");
+        defer allocator.free(state_dir);
+
+        self.state = try RepoState.create(allocator, "http://localhost:4000", "acme", "widgets", state_dir, .{ .ssd_enabled = false }, download);
+        errdefer self.state.deinit();
+        _ = try self.state.handleForPath("");
+    }
+
+    pub fn deinit(self: *TestRepo) void {
+        self.gate.set();
+        self.state.deinit();
+        self.temp.cleanup();
+    }
+
+    /// Adds a committed file, as if it came with the tree.
+    pub fn track(self: *TestRepo, path: []const u8, content: []const u8) !void {
+        const allocator = self.state.allocator;
+        const owned_path = try allocator.dupe(u8, path);
+        errdefer allocator.free(owned_path);
+        const hash = try allocator.dupe(u8, content);
+        errdefer allocator.free(hash);
+        const hash_hex = try hexEncode(allocator, content);
+        errdefer allocator.free(hash_hex);
+
+        try self.state.entries.put(owned_path, .{ .hash = hash, .hash_hex = hash_hex });
+        try self.state.addDirPrefixes(path);
+    }
+
+    /// Blocks until `count` readers wait on the download in flight for `path`.
+    pub fn waitForWaiters(self: *TestRepo, path: []const u8, count: usize) void {
+        const hash_hex = self.state.entries.get(path).?.hash_hex;
+        while (true) {
+            self.state.fetch_mutex.lock();
+            const waiting = if (self.state.fetching.get(hash_hex)) |fetch| fetch.waiters else 0;
+            self.state.fetch_mutex.unlock();
+            if (waiting >= count) return;
+            std.Thread.sleep(std.time.ns_per_ms);
+        }
+    }
+
+    fn download(state: *RepoState, entry: FileEntry) anyerror![]u8 {
+        const self: *TestRepo = @fieldParentPtr("state", state);
+        _ = self.downloads.fetchAdd(1, .monotonic);
+        self.gate.wait();
+        if (self.failure) |err| return err;
+        return state.allocator.dupe(u8, entry.hash);
+    }
+};
+
+const TestReader = struct {
+    path: []const u8,
+    result: anyerror!void = {},
+    thread: std.Thread = undefined,
+
+    fn start(self: *TestReader, state: *RepoState) !void {
+        self.thread = try std.Thread.spawn(.{}, run, .{ self, state });
+    }
+
+    fn run(self: *TestReader, state: *RepoState) void {
+        self.result = check(state, self.path);
+    }
+
+    fn check(state: *RepoState, path: []const u8) !void {
+        const data = try state.readFile(path, 0, 64) orelse return error.FileNotFound;
+        defer state.allocator.free(data);
+        try std.testing.expectEqualStrings("shared content", data);
+    }
+};
+
+test "concurrent misses on one hash share a single download" {
+    var repo: TestRepo = undefined;
+    try repo.init();
+    defer repo.deinit();
+    try repo.track("a.txt", "shared content");
+    try repo.track("docs/copy.txt", "shared content");
+
+    var readers: [6]TestReader = undefined;
+    for (&readers, 0..) |*reader, idx| {
+        reader.* = .{ .path = if (idx % 2 == 0) "a.txt" else "docs/copy.txt" };
+        try reader.start(&repo.state);
+    }
+
+    // One reader downloads; hold it until every other one is waiting on it.
+    repo.waitForWaiters("a.txt", readers.len - 1);
+    repo.gate.set();
+    for (&readers) |*reader| reader.thread.join();
+
+    for (readers) |reader| try reader.result;
+    try std.testing.expectEqual(@as(u32, 1), repo.downloads.load(.monotonic));
+
+    // Later reads are served from the content cache.
+    try TestReader.check(&repo.state, "docs/copy.txt");
+    try std.testing.expectEqual(@as(u32, 1), repo.downloads.load(.monotonic));
+}
+
+test "a failed download fails its waiters and is retried afterwards" {
+    var repo: TestRepo = undefined;
+    try repo.init();
+    defer repo.deinit();
+    try repo.track("a.txt", "shared content");
+    repo.failure = error.ConnectionRefused;
+
+    var readers: [3]TestReader = undefined;
+    for (&readers) |*reader| {
+        reader.* = .{ .path = "a.txt" };
+        try reader.start(&repo.state);
+    }
+
+    repo.waitForWaiters("a.txt", readers.len - 1);
+    repo.gate.set();
+    for (&readers) |*reader| reader.thread.join();
+
+    for (readers) |reader| try std.testing.expectError(error.ConnectionRefused, reader.result);
+    try std.testing.expectEqual(@as(u32, 1), repo.downloads.load(.monotonic));
+
+    repo.failure = null;
+    try TestReader.check(&repo.state, "a.txt");
+    try std.testing.expectEqual(@as(u32, 2), repo.downloads.load(.monotonic));
+}
+
+test "committed writes reach the overlay" {
+    var repo: TestRepo = undefined;
+    try repo.init();
+    defer repo.deinit();
+    try repo.track("a.txt", "shared content");
+    repo.gate.set();
+
+    _ = try repo.state.writeFile("a.txt", 0, "SHARED");
+    try std.testing.expect(repo.state.overlay.get("a.txt") == null);
+    try repo.state.commitFile("a.txt");
+
+    const committed = repo.state.overlay.get("a.txt").?;
+    try std.testing.expectEqualStrings("SHARED content", committed.content);
+    try std.testing.expectEqual(overlay_mod.ChangeType.modified, committed.change_type);
+
+    const data = (try repo.state.readFile("a.txt", 0, 64)).?;
+    defer std.testing.allocator.free(data);
+    try std.testing.expectEqualStrings("SHARED content", data);
+}
@@ -10,7 +10,7 @@ pub const Reader = struct {
 
     pub fn readU32(self: *Reader) !u32 {
         if (self.offset + 4 > self.data.len) return error.EndOfStream;
-        const value = std.mem.readInt(u32, self.data[self.offset .. self.offset + 4], .big);
+        const value = std.mem.readInt(u32, self.data[self.offset..][0..4], .big);
         self.offset += 4;
         return value;
     }
@@ -44,21 +44,22 @@ pub const Reader = struct {
 };
 
 pub const Writer = struct {
-    list: std.ArrayList(u8),
+    allocator: std.mem.Allocator,
+    list: std.ArrayList(u8) = .empty,
 
     pub fn init(allocator: std.mem.Allocator) Writer {
-        return .{ .list = std.ArrayList(u8).init(allocator) };
+        return .{ .allocator = allocator };
     }
 
     pub fn deinit(self: *Writer) void {
-        self.list.deinit();
+        self.list.deinit(self.allocator);
         self.* = undefined;
     }
 
     pub fn writeU32(self: *Writer, value: u32) !void {
         var buf: [4]u8 = undefined;
         std.mem.writeInt(u32, &buf, value, .big);
-        try self.list.appendSlice(&buf);
+        try self.list.appendSlice(self.allocator, &buf);
     }
 
     pub fn writeU64(self: *Writer, value: u64) !void {
@@ -72,11 +73,11 @@ pub const Writer = struct {
 
     pub fn writeOpaque(self: *Writer, bytes: []const u8) !void {
         try self.writeU32(@intCast(bytes.len));
-        try self.list.appendSlice(bytes);
+        try self.list.appendSlice(self.allocator, bytes);
         const pad = padLen(bytes.len);
         if (pad > 0) {
-            var zeros: [3]u8 = .{ 0, 0, 0 };
-            try self.list.appendSlice(zeros[0..pad]);
+            const zeros: [3]u8 = .{ 0, 0, 0 };
+            try self.list.appendSlice(self.allocator, zeros[0..pad]);
         }
     }
 
@@ -84,8 +85,8 @@ pub const Writer = struct {
         try self.writeOpaque(value);
     }
 
-    pub fn toOwnedSlice(self: *Writer, allocator: std.mem.Allocator) ![]u8 {
-        return self.list.toOwnedSlice(allocator);
+    pub fn toOwnedSlice(self: *Writer) ![]u8 {
+        return self.list.toOwnedSlice(self.allocator);
     }
 };
 
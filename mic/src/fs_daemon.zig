@@ -0,0 +1,12 @@
+//! Root of the mic-fs NFS daemon in fs/. Its state reaches into the CLI's
+//! auth, cache and gRPC code, which a module rooted in fs/ cannot import, so
+//! the daemon's entry point and tests hang off this file instead.
+
+pub const server = @import("fs/server.zig");
+pub const state = @import("fs/state.zig");
+pub const main = @import("fs/main.zig").main;
+
+test {
+    _ = server;
+    _ = state;
+}
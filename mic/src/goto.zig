@@ -31,7 +31,7 @@ pub fn show(
 
         const response = try grpc_client.unaryCall(
             arena_alloc,
-            endpoint,
+            endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
             "/micelio.content.v1.ContentService/GetTreeAtPosition",
             request,
             tokens.access_token,
@@ -49,7 +49,7 @@ pub fn show(
 
         const response = try grpc_client.unaryCall(
             arena_alloc,
-            endpoint,
+            endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
             "/micelio.content.v1.ContentService/GetHeadTree",
             request,
             tokens.access_token,
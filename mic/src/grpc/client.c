@@ -6,6 +6,7 @@
 #include <grpc/support/alloc.h>
 #include <grpc/support/time.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,42 @@ void mic_grpc_free(void *ptr) {
     }
 }
 
+/* Defaults mirror the nghttp2 backend; gRPC core applies them as channel args. */
+static mic_grpc_flow_control flow_profiles[] = {
+    [MIC_GRPC_PROFILE_LATENCY] = { 65535, 1 << 20, 16384, 4 << 20 },
+    [MIC_GRPC_PROFILE_BULK] = { 4 << 20, 16 << 20, 1 << 20, 64 << 20 },
+};
+
+/* gRPC core negotiates encodings itself and has no zstd; gzip stands in for it. */
+static const grpc_channel_args *profile_channel_args(mic_grpc_profile profile, mic_grpc_compression compression,
+                                                     grpc_arg *args, grpc_channel_args *out) {
+    const mic_grpc_flow_control *flow = &flow_profiles[profile];
+
+    args[0].type = GRPC_ARG_INTEGER;
+    args[0].key = GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES;
+    args[0].value.integer = (int)flow->stream_window;
+    args[1].type = GRPC_ARG_INTEGER;
+    args[1].key = GRPC_ARG_HTTP2_MAX_FRAME_SIZE;
+    args[1].value.integer = (int)flow->max_frame_size;
+    args[2].type = GRPC_ARG_INTEGER;
+    args[2].key = GRPC_ARG_HTTP2_BDP_PROBE;
+    args[2].value.integer = flow->max_window > flow->stream_window;
+    args[3].type = GRPC_ARG_INTEGER;
+    args[3].key = GRPC_COMPRESSION_CHANNEL_DEFAULT_ALGORITHM;
+    args[3].value.integer = compression == MIC_GRPC_COMPRESS_NONE ? GRPC_COMPRESS_NONE : GRPC_COMPRESS_GZIP;
+    /* Same keepalive cadence as the nghttp2 pool: one PING per 30 s of quiet, 5 s to answer */
+    args[4].type = GRPC_ARG_INTEGER;
+    args[4].key = GRPC_ARG_KEEPALIVE_TIME_MS;
+    args[4].value.integer = 30000;
+    args[5].type = GRPC_ARG_INTEGER;
+    args[5].key = GRPC_ARG_KEEPALIVE_TIMEOUT_MS;
+    args[5].value.integer = 5000;
+
+    out->num_args = 6;
+    out->args = args;
+    return out;
+}
+
 static char *dup_cstring(const char *value) {
     if (value == NULL) {
         return NULL;
@@ -30,63 +67,353 @@ static char *dup_cstring(const char *value) {
     return copy;
 }
 
-int mic_grpc_unary_call(const char *target,
-                        const char *host,
-                        const char *method,
-                        const uint8_t *request,
-                        size_t request_len,
-                        const char *auth_token,
-                        int use_tls,
-                        uint8_t **response_out,
-                        size_t *response_len_out,
-                        char **error_out) {
-    if (response_out == NULL || response_len_out == NULL || error_out == NULL) {
-        return 1;
+/*
+ * gRPC core sends the deadline as grpc-timeout and resets the stream when it
+ * passes. Cancellation tokens remember the calls running under them so that
+ * cancelling can hand each one to grpc_call_cancel.
+ */
+typedef struct token_call {
+    grpc_call *call;
+    struct token_call *next;
+} token_call;
+
+struct mic_grpc_cancel_token {
+    pthread_mutex_t mutex;
+    int cancelled;
+    token_call *calls;
+};
+
+static gpr_timespec call_deadline(const mic_grpc_call_options *options, mic_grpc_profile profile) {
+    uint32_t timeout_ms = options != NULL ? options->timeout_ms : 0;
+    if (timeout_ms == 0) {
+        timeout_ms = profile == MIC_GRPC_PROFILE_BULK ? MIC_GRPC_BULK_TIMEOUT_MS : MIC_GRPC_LATENCY_TIMEOUT_MS;
     }
+    return gpr_time_add(gpr_now(GPR_CLOCK_REALTIME), gpr_time_from_millis(timeout_ms, GPR_TIMESPAN));
+}
 
-    *response_out = NULL;
-    *response_len_out = 0;
-    *error_out = NULL;
+static mic_grpc_cancel_token *call_token(const mic_grpc_call_options *options) {
+    return options != NULL ? options->cancel : NULL;
+}
 
+/* Put a call under a token; one started after the token was cancelled is cancelled at once */
+static void token_attach(mic_grpc_cancel_token *token, grpc_call *call) {
+    if (token == NULL) {
+        return;
+    }
+    token_call *entry = gpr_malloc(sizeof(token_call));
+    pthread_mutex_lock(&token->mutex);
+    if (token->cancelled) {
+        grpc_call_cancel(call, NULL);
+    } else if (entry != NULL) {
+        entry->call = call;
+        entry->next = token->calls;
+        token->calls = entry;
+        entry = NULL;
+    }
+    pthread_mutex_unlock(&token->mutex);
+    if (entry != NULL) {
+        gpr_free(entry);
+    }
+}
+
+static void token_detach(mic_grpc_cancel_token *token, grpc_call *call) {
+    if (token == NULL) {
+        return;
+    }
+    token_call *found = NULL;
+    pthread_mutex_lock(&token->mutex);
+    for (token_call **link = &token->calls; *link != NULL; link = &(*link)->next) {
+        if ((*link)->call == call) {
+            found = *link;
+            *link = found->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&token->mutex);
+    if (found != NULL) {
+        gpr_free(found);
+    }
+}
+
+mic_grpc_cancel_token *mic_grpc_cancel_token_new(void) {
+    mic_grpc_cancel_token *token = gpr_malloc(sizeof(mic_grpc_cancel_token));
+    if (token == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&token->mutex, NULL);
+    token->cancelled = 0;
+    token->calls = NULL;
+    return token;
+}
+
+void mic_grpc_cancel_token_cancel(mic_grpc_cancel_token *token) {
+    if (token == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&token->mutex);
+    token->cancelled = 1;
+    for (token_call *entry = token->calls; entry != NULL; entry = entry->next) {
+        grpc_call_cancel(entry->call, NULL);
+    }
+    pthread_mutex_unlock(&token->mutex);
+}
+
+int mic_grpc_cancel_token_is_cancelled(const mic_grpc_cancel_token *token) {
+    if (token == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock((pthread_mutex_t *)&token->mutex);
+    int cancelled = token->cancelled;
+    pthread_mutex_unlock((pthread_mutex_t *)&token->mutex);
+    return cancelled;
+}
+
+void mic_grpc_cancel_token_free(mic_grpc_cancel_token *token) {
+    if (token == NULL) {
+        return;
+    }
+    while (token->calls != NULL) {
+        token_call *next = token->calls->next;
+        gpr_free(token->calls);
+        token->calls = next;
+    }
+    pthread_mutex_destroy(&token->mutex);
+    gpr_free(token);
+}
+
+/* What a call returns once it has finished, given its status and error */
+static int call_return_code(grpc_status_code status, const char *error) {
+    if (error == NULL) return 0;
+    return status == GRPC_STATUS_UNIMPLEMENTED ? MIC_GRPC_UNIMPLEMENTED : 1;
+}
+
+/* Error text for a non-OK status; deadlines and cancellation read the same as in the nghttp2 backend */
+static char *status_error(grpc_status_code status, grpc_slice status_details) {
+    if (status == GRPC_STATUS_DEADLINE_EXCEEDED) {
+        return dup_cstring("gRPC deadline exceeded");
+    }
+    if (status == GRPC_STATUS_CANCELLED) {
+        return dup_cstring("gRPC call cancelled");
+    }
+    const char *details = grpc_slice_to_c_string(status_details);
+    char *error = (details != NULL && details[0] != '\0')
+        ? dup_cstring(details)
+        : dup_cstring("gRPC call failed.");
+    gpr_free((void *)details);
+    return error;
+}
+
+/*
+ * gRPC core is initialized once per process and channels are cached per
+ * (TLS mode, profile, compression, target), so calls share core's subchannels
+ * and multiplex over its HTTP/2 connections. Blocking calls pluck their own
+ * completions from a queue kept per calling thread.
+ */
+typedef struct cached_channel {
+    char *key;
+    grpc_channel *channel;
+    struct cached_channel *next;
+} cached_channel;
+
+static pthread_once_t core_once = PTHREAD_ONCE_INIT;
+static pthread_key_t call_queue_key;
+static pthread_mutex_t channel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cached_channel *channel_cache = NULL;
+
+static void call_queue_destroy(void *value) {
+    grpc_completion_queue *cq = value;
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+}
+
+static void core_init(void) {
     grpc_init();
+    pthread_key_create(&call_queue_key, call_queue_destroy);
+}
 
-    grpc_channel_credentials *creds = NULL;
-    if (use_tls) {
-        creds = grpc_ssl_credentials_create(NULL, NULL, NULL, NULL);
-        if (creds == NULL) {
-            *error_out = dup_cstring("Failed to create TLS credentials.");
-            grpc_shutdown();
-            return 1;
+static grpc_completion_queue *call_queue(void) {
+    pthread_once(&core_once, core_init);
+    grpc_completion_queue *cq = pthread_getspecific(call_queue_key);
+    if (cq == NULL) {
+        cq = grpc_completion_queue_create_for_pluck(NULL);
+        if (cq != NULL && pthread_setspecific(call_queue_key, cq) != 0) {
+            call_queue_destroy(cq);
+            cq = NULL;
         }
-    } else {
-        creds = grpc_insecure_credentials_create();
-        if (creds == NULL) {
-            *error_out = dup_cstring("Failed to create insecure credentials.");
-            grpc_shutdown();
-            return 1;
+    }
+    return cq;
+}
+
+static grpc_channel *shared_channel(const char *target, int use_tls, mic_grpc_profile profile,
+                                    mic_grpc_compression compression) {
+    pthread_once(&core_once, core_init);
+
+    size_t key_len = strlen(target) + 32;
+    char *key = gpr_malloc(key_len);
+    if (key == NULL) {
+        return NULL;
+    }
+    snprintf(key, key_len, "%d|%d|%d|%s", use_tls ? 1 : 0, (int)profile, (int)compression, target);
+
+    pthread_mutex_lock(&channel_mutex);
+    for (cached_channel *entry = channel_cache; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            pthread_mutex_unlock(&channel_mutex);
+            gpr_free(key);
+            return entry->channel;
         }
     }
 
-    grpc_channel *channel = grpc_channel_create(target, creds, NULL);
-    grpc_channel_credentials_release(creds);
+    grpc_channel *channel = NULL;
+    cached_channel *entry = gpr_malloc(sizeof(cached_channel));
+    grpc_channel_credentials *creds = use_tls
+        ? grpc_ssl_credentials_create(NULL, NULL, NULL, NULL)
+        : grpc_insecure_credentials_create();
+    if (entry != NULL && creds != NULL) {
+        grpc_arg channel_arg_storage[6];
+        grpc_channel_args channel_args;
+        channel = grpc_channel_create(target, creds,
+                                      profile_channel_args(profile, compression, channel_arg_storage, &channel_args));
+    }
+    if (creds != NULL) {
+        grpc_channel_credentials_release(creds);
+    }
 
     if (channel == NULL) {
-        *error_out = dup_cstring("Failed to create gRPC channel.");
-        grpc_shutdown();
+        gpr_free(entry);
+        gpr_free(key);
+    } else {
+        entry->key = key;
+        entry->channel = channel;
+        entry->next = channel_cache;
+        channel_cache = entry;
+    }
+    pthread_mutex_unlock(&channel_mutex);
+    return channel;
+}
+
+/*
+ * Telemetry. gRPC core keeps its transport to itself, so calls report their
+ * total time and message bytes only; phase times, frames and window stalls
+ * stay 0 in this backend.
+ */
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mic_grpc_stats stats;
+static mic_grpc_trace_fn trace_fn = NULL;
+static void *trace_ctx = NULL;
+
+static void histogram_add(mic_grpc_histogram *histogram, uint64_t us) {
+    int bucket = us < 2 ? 0 : 63 - __builtin_clzll(us);
+    if (bucket >= MIC_GRPC_HISTOGRAM_BUCKETS) {
+        bucket = MIC_GRPC_HISTOGRAM_BUCKETS - 1;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_us += us;
+    if (us > histogram->max_us) {
+        histogram->max_us = us;
+    }
+}
+
+static void report_call(const char *method, int ok, gpr_timespec started,
+                        uint64_t bytes_sent, uint64_t bytes_received) {
+    gpr_timespec elapsed = gpr_time_sub(gpr_now(GPR_CLOCK_MONOTONIC), started);
+
+    mic_grpc_call_trace trace;
+    memset(&trace, 0, sizeof(trace));
+    trace.method = method != NULL ? method : "";
+    trace.ok = ok;
+    trace.attempts = 1;
+    trace.total_us = (uint64_t)elapsed.tv_sec * 1000000u + (uint64_t)elapsed.tv_nsec / 1000u;
+    trace.bytes_sent = bytes_sent;
+    trace.bytes_received = bytes_received;
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.calls++;
+    if (!ok) {
+        stats.calls_failed++;
+    }
+    stats.bytes_sent += bytes_sent;
+    stats.bytes_received += bytes_received;
+    histogram_add(&stats.total, trace.total_us);
+    mic_grpc_trace_fn fn = trace_fn;
+    void *ctx = trace_ctx;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (fn != NULL) {
+        fn(ctx, &trace);
+    }
+}
+
+/*
+ * Copy a received message slice by slice into one buffer from alloc, or
+ * gpr_malloc when alloc is NULL. The reader has already decompressed it, so
+ * the decoded length is known up front. Returns an error string or NULL.
+ */
+static const char *read_message(grpc_byte_buffer *payload, mic_grpc_alloc_fn alloc, void *alloc_ctx,
+                                uint8_t **message_out, size_t *message_len_out) {
+    grpc_byte_buffer_reader reader;
+    if (!grpc_byte_buffer_reader_init(&reader, payload)) {
+        return "Failed to read gRPC response.";
+    }
+
+    size_t len = grpc_byte_buffer_length(reader.buffer_out);
+    uint8_t *buffer = alloc != NULL ? alloc(alloc_ctx, len) : gpr_malloc(len > 0 ? len : 1);
+    if (buffer == NULL && len > 0) {
+        grpc_byte_buffer_reader_destroy(&reader);
+        return "Failed to allocate response buffer.";
+    }
+
+    size_t offset = 0;
+    grpc_slice slice;
+    while (grpc_byte_buffer_reader_next(&reader, &slice)) {
+        size_t slice_len = GRPC_SLICE_LENGTH(slice);
+        if (slice_len > len - offset) {
+            slice_len = len - offset;
+        }
+        memcpy(buffer + offset, GRPC_SLICE_START_PTR(slice), slice_len);
+        offset += slice_len;
+        grpc_slice_unref(slice);
+    }
+    grpc_byte_buffer_reader_destroy(&reader);
+
+    *message_out = buffer;
+    *message_len_out = offset;
+    return NULL;
+}
+
+static int unary_call(const char *target,
+                      const char *host,
+                      const char *method,
+                      const uint8_t *request,
+                      size_t request_len,
+                      const char *auth_token,
+                      int use_tls,
+                      const mic_grpc_call_options *options,
+                      mic_grpc_alloc_fn alloc,
+                      void *alloc_ctx,
+                      uint8_t **response_out,
+                      size_t *response_len_out,
+                      char **error_out) {
+    if (response_out == NULL || response_len_out == NULL || error_out == NULL) {
         return 1;
     }
 
-    grpc_completion_queue *cq = grpc_completion_queue_create_for_next(NULL);
-    if (cq == NULL) {
-        *error_out = dup_cstring("Failed to create completion queue.");
-        grpc_channel_destroy(channel);
-        grpc_shutdown();
+    *response_out = NULL;
+    *response_len_out = 0;
+    *error_out = NULL;
+
+    grpc_channel *channel = shared_channel(target, use_tls, MIC_GRPC_PROFILE_LATENCY, MIC_GRPC_COMPRESS_NONE);
+    grpc_completion_queue *cq = call_queue();
+    if (channel == NULL || cq == NULL) {
+        *error_out = dup_cstring(channel == NULL ? "Failed to create gRPC channel." : "Failed to create completion queue.");
         return 1;
     }
 
+    gpr_timespec started = gpr_now(GPR_CLOCK_MONOTONIC);
     grpc_slice method_slice = grpc_slice_from_copied_string(method);
     grpc_slice host_slice = grpc_slice_from_copied_string(host);
-    gpr_timespec deadline = gpr_time_add(gpr_now(GPR_CLOCK_REALTIME), gpr_time_from_seconds(20, GPR_TIMESPAN));
+    gpr_timespec deadline = call_deadline(options, MIC_GRPC_PROFILE_LATENCY);
 
     grpc_call *call = grpc_channel_create_call(channel, NULL, GRPC_PROPAGATE_DEFAULTS, cq, method_slice, &host_slice, deadline, NULL);
     grpc_slice_unref(method_slice);
@@ -94,11 +421,9 @@ int mic_grpc_unary_call(const char *target,
 
     if (call == NULL) {
         *error_out = dup_cstring("Failed to create gRPC call.");
-        grpc_completion_queue_destroy(cq);
-        grpc_channel_destroy(channel);
-        grpc_shutdown();
         return 1;
     }
+    token_attach(call_token(options), call);
 
     grpc_metadata meta[1];
     size_t meta_count = 0;
@@ -156,21 +481,403 @@ int mic_grpc_unary_call(const char *target,
     ops[5].data.recv_status_on_client.status = &status;
     ops[5].data.recv_status_on_client.status_details = &status_details;
 
-    grpc_call_error call_error = grpc_call_start_batch(call, ops, 6, (void *)1, NULL);
+    grpc_call_error call_error = grpc_call_start_batch(call, ops, 6, (void *)ops, NULL);
     if (call_error != GRPC_CALL_OK) {
         *error_out = dup_cstring("Failed to start gRPC call.");
     } else {
-        grpc_event event = grpc_completion_queue_next(cq, deadline, NULL);
+        /* The call deadline bounds the wait; a pluck timeout would strand the event on the shared queue */
+        grpc_event event = grpc_completion_queue_pluck(cq, (void *)ops, gpr_inf_future(GPR_CLOCK_REALTIME), NULL);
         if (event.type != GRPC_OP_COMPLETE || event.success == 0) {
             *error_out = dup_cstring("gRPC call did not complete.");
         } else if (status != GRPC_STATUS_OK) {
-            const char *details = grpc_slice_to_c_string(status_details);
-            if (details != NULL && details[0] != '\0') {
-                *error_out = dup_cstring(details);
-            } else {
-                *error_out = dup_cstring("gRPC call failed.");
+            *error_out = status_error(status, status_details);
+        } else if (response_payload != NULL) {
+            const char *read_error = read_message(response_payload, alloc, alloc_ctx, response_out, response_len_out);
+            if (read_error != NULL) {
+                *error_out = dup_cstring(read_error);
             }
-            gpr_free((void *)details);
+        } else {
+            *error_out = dup_cstring("Empty gRPC response.");
+        }
+    }
+
+    if (request_buffer != NULL) {
+        grpc_byte_buffer_destroy(request_buffer);
+    }
+
+    grpc_metadata_array_destroy(&initial_metadata);
+    grpc_metadata_array_destroy(&trailing_metadata);
+
+    if (meta_count > 0) {
+        grpc_slice_unref(auth_value_slice);
+    }
+
+    if (auth_value != NULL) {
+        gpr_free(auth_value);
+    }
+
+    if (response_payload != NULL) {
+        grpc_byte_buffer_destroy(response_payload);
+    }
+
+    grpc_slice_unref(status_details);
+    token_detach(call_token(options), call);
+    grpc_call_unref(call);
+    report_call(method, *error_out == NULL, started, request_len, *response_len_out);
+
+    return call_return_code(status, *error_out);
+}
+
+int mic_grpc_unary_call(const char *target,
+                        const char *host,
+                        const char *method,
+                        const uint8_t *request,
+                        size_t request_len,
+                        const char *auth_token,
+                        int use_tls,
+                        const mic_grpc_call_options *options,
+                        uint8_t **response_out,
+                        size_t *response_len_out,
+                        char **error_out) {
+    return unary_call(target, host, method, request, request_len, auth_token, use_tls, options,
+                      NULL, NULL, response_out, response_len_out, error_out);
+}
+
+int mic_grpc_unary_call_into(const char *target,
+                             const char *host,
+                             const char *method,
+                             const uint8_t *request,
+                             size_t request_len,
+                             const char *auth_token,
+                             int use_tls,
+                             const mic_grpc_call_options *options,
+                             mic_grpc_alloc_fn alloc,
+                             void *alloc_ctx,
+                             uint8_t **response_out,
+                             size_t *response_len_out,
+                             char **error_out) {
+    if (alloc == NULL) {
+        if (error_out != NULL) {
+            *error_out = dup_cstring("Invalid gRPC call arguments.");
+        }
+        return 1;
+    }
+
+    return unary_call(target, host, method, request, request_len, auth_token, use_tls, options,
+                      alloc, alloc_ctx, response_out, response_len_out, error_out);
+}
+
+static int deliver_byte_buffer(grpc_byte_buffer *payload, mic_grpc_message_fn on_message, void *ctx) {
+    grpc_byte_buffer_reader reader;
+    if (!grpc_byte_buffer_reader_init(&reader, payload)) {
+        return -1;
+    }
+    grpc_slice slice = grpc_byte_buffer_reader_readall(&reader);
+    int rc = on_message(ctx, GRPC_SLICE_START_PTR(slice), GRPC_SLICE_LENGTH(slice));
+    grpc_slice_unref(slice);
+    grpc_byte_buffer_reader_destroy(&reader);
+    return rc;
+}
+
+/* Run one batch to completion; the call's own deadline bounds the wait */
+static int run_batch(grpc_call *call, grpc_completion_queue *cq, const grpc_op *ops, size_t count) {
+    if (grpc_call_start_batch(call, ops, count, (void *)ops, NULL) != GRPC_CALL_OK) {
+        return -1;
+    }
+    grpc_event event = grpc_completion_queue_pluck(cq, (void *)ops, gpr_inf_future(GPR_CLOCK_REALTIME), NULL);
+    return event.type == GRPC_OP_COMPLETE && event.success ? 0 : -1;
+}
+
+int mic_grpc_streaming_call(const char *target,
+                            const char *host,
+                            const char *method,
+                            const uint8_t *request,
+                            size_t request_len,
+                            const char *auth_token,
+                            int use_tls,
+                            mic_grpc_profile profile,
+                            const mic_grpc_call_options *options,
+                            mic_grpc_message_fn on_message,
+                            void *ctx,
+                            char **error_out) {
+    if (error_out == NULL) {
+        return 1;
+    }
+    *error_out = NULL;
+
+    if (on_message == NULL) {
+        *error_out = dup_cstring("Invalid gRPC call arguments.");
+        return 1;
+    }
+
+    grpc_channel *channel = shared_channel(target, use_tls, profile, MIC_GRPC_COMPRESS_NONE);
+    grpc_completion_queue *cq = call_queue();
+    if (channel == NULL || cq == NULL) {
+        *error_out = dup_cstring(channel == NULL ? "Failed to create gRPC channel." : "Failed to create completion queue.");
+        return 1;
+    }
+
+    gpr_timespec started = gpr_now(GPR_CLOCK_MONOTONIC);
+    grpc_slice method_slice = grpc_slice_from_copied_string(method);
+    grpc_slice host_slice = grpc_slice_from_copied_string(host);
+    gpr_timespec deadline = call_deadline(options, profile);
+
+    grpc_call *call = grpc_channel_create_call(channel, NULL, GRPC_PROPAGATE_DEFAULTS, cq, method_slice, &host_slice, deadline, NULL);
+    grpc_slice_unref(method_slice);
+    grpc_slice_unref(host_slice);
+
+    if (call == NULL) {
+        *error_out = dup_cstring("Failed to create gRPC call.");
+        return 1;
+    }
+    token_attach(call_token(options), call);
+
+    grpc_metadata meta[1];
+    size_t meta_count = 0;
+    char *auth_value = NULL;
+
+    if (auth_token != NULL && auth_token[0] != '\0') {
+        size_t auth_len = strlen(auth_token);
+        auth_value = gpr_malloc(auth_len + 8);
+        if (auth_value != NULL) {
+            snprintf(auth_value, auth_len + 8, "Bearer %s", auth_token);
+            meta[0].key = grpc_slice_from_static_string("authorization");
+            meta[0].value = grpc_slice_from_copied_string(auth_value);
+            meta_count = 1;
+        }
+    }
+
+    grpc_byte_buffer *request_buffer = NULL;
+    if (request != NULL && request_len > 0) {
+        grpc_slice request_slice = grpc_slice_from_copied_buffer((const char *)request, request_len);
+        request_buffer = grpc_raw_byte_buffer_create(&request_slice, 1);
+        grpc_slice_unref(request_slice);
+    }
+
+    grpc_metadata_array initial_metadata;
+    grpc_metadata_array trailing_metadata;
+    grpc_metadata_array_init(&initial_metadata);
+    grpc_metadata_array_init(&trailing_metadata);
+
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    grpc_slice status_details = grpc_slice_from_static_string("");
+
+    grpc_op send_ops[4];
+    memset(send_ops, 0, sizeof(send_ops));
+    send_ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    send_ops[0].data.send_initial_metadata.count = meta_count;
+    send_ops[0].data.send_initial_metadata.metadata = meta_count > 0 ? meta : NULL;
+    send_ops[1].op = GRPC_OP_SEND_MESSAGE;
+    send_ops[1].data.send_message.send_message = request_buffer;
+    send_ops[2].op = GRPC_OP_SEND_CLOSE_FROM_CLIENT;
+    send_ops[3].op = GRPC_OP_RECV_INITIAL_METADATA;
+    send_ops[3].data.recv_initial_metadata.recv_initial_metadata = &initial_metadata;
+
+    int cancelled = 0;
+    uint64_t received = 0;
+    if (run_batch(call, cq, send_ops, 4) != 0) {
+        *error_out = dup_cstring("Failed to start gRPC call.");
+        grpc_call_cancel(call, NULL);
+    } else {
+        /* Read messages one at a time until the server closes the stream. */
+        for (;;) {
+            grpc_byte_buffer *payload = NULL;
+            grpc_op recv_op;
+            memset(&recv_op, 0, sizeof(recv_op));
+            recv_op.op = GRPC_OP_RECV_MESSAGE;
+            recv_op.data.recv_message.recv_message = &payload;
+
+            if (run_batch(call, cq, &recv_op, 1) != 0 || payload == NULL) {
+                break;
+            }
+
+            received += grpc_byte_buffer_length(payload);
+            int rc = deliver_byte_buffer(payload, on_message, ctx);
+            grpc_byte_buffer_destroy(payload);
+            if (rc != 0) {
+                cancelled = 1;
+                grpc_call_cancel(call, NULL);
+                break;
+            }
+        }
+    }
+
+    grpc_op status_op;
+    memset(&status_op, 0, sizeof(status_op));
+    status_op.op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    status_op.data.recv_status_on_client.trailing_metadata = &trailing_metadata;
+    status_op.data.recv_status_on_client.status = &status;
+    status_op.data.recv_status_on_client.status_details = &status_details;
+
+    if (*error_out == NULL) {
+        if (cancelled) {
+            run_batch(call, cq, &status_op, 1);
+            *error_out = dup_cstring("gRPC stream cancelled by receiver.");
+        } else if (run_batch(call, cq, &status_op, 1) != 0) {
+            *error_out = dup_cstring("gRPC call did not complete.");
+        } else if (status != GRPC_STATUS_OK) {
+            *error_out = status_error(status, status_details);
+        }
+    }
+
+    if (request_buffer != NULL) {
+        grpc_byte_buffer_destroy(request_buffer);
+    }
+
+    grpc_metadata_array_destroy(&initial_metadata);
+    grpc_metadata_array_destroy(&trailing_metadata);
+
+    if (meta_count > 0) {
+        grpc_slice_unref(meta[0].value);
+    }
+
+    if (auth_value != NULL) {
+        gpr_free(auth_value);
+    }
+
+    grpc_slice_unref(status_details);
+    token_detach(call_token(options), call);
+    grpc_call_unref(call);
+    report_call(method, *error_out == NULL, started, request_len, received);
+
+    return call_return_code(status, *error_out);
+}
+
+int mic_grpc_client_streaming_call(const char *target,
+                                   const char *host,
+                                   const char *method,
+                                   const char *auth_token,
+                                   int use_tls,
+                                   mic_grpc_profile profile,
+                                   mic_grpc_compression compression,
+                                   const mic_grpc_call_options *options,
+                                   mic_grpc_producer_fn producer,
+                                   void *ctx,
+                                   uint8_t **response_out,
+                                   size_t *response_len_out,
+                                   char **error_out) {
+    if (response_out == NULL || response_len_out == NULL || error_out == NULL) {
+        return 1;
+    }
+    *response_out = NULL;
+    *response_len_out = 0;
+    *error_out = NULL;
+
+    if (producer == NULL) {
+        *error_out = dup_cstring("Invalid gRPC call arguments.");
+        return 1;
+    }
+
+    grpc_channel *channel = shared_channel(target, use_tls, profile, compression);
+    grpc_completion_queue *cq = call_queue();
+    if (channel == NULL || cq == NULL) {
+        *error_out = dup_cstring(channel == NULL ? "Failed to create gRPC channel." : "Failed to create completion queue.");
+        return 1;
+    }
+
+    gpr_timespec started = gpr_now(GPR_CLOCK_MONOTONIC);
+    grpc_slice method_slice = grpc_slice_from_copied_string(method);
+    grpc_slice host_slice = grpc_slice_from_copied_string(host);
+    gpr_timespec deadline = call_deadline(options, profile);
+
+    grpc_call *call = grpc_channel_create_call(channel, NULL, GRPC_PROPAGATE_DEFAULTS, cq, method_slice, &host_slice, deadline, NULL);
+    grpc_slice_unref(method_slice);
+    grpc_slice_unref(host_slice);
+
+    if (call == NULL) {
+        *error_out = dup_cstring("Failed to create gRPC call.");
+        return 1;
+    }
+    token_attach(call_token(options), call);
+
+    grpc_metadata meta[1];
+    size_t meta_count = 0;
+    char *auth_value = NULL;
+
+    if (auth_token != NULL && auth_token[0] != '\0') {
+        size_t auth_len = strlen(auth_token);
+        auth_value = gpr_malloc(auth_len + 8);
+        if (auth_value != NULL) {
+            snprintf(auth_value, auth_len + 8, "Bearer %s", auth_token);
+            meta[0].key = grpc_slice_from_static_string("authorization");
+            meta[0].value = grpc_slice_from_copied_string(auth_value);
+            meta_count = 1;
+        }
+    }
+
+    grpc_metadata_array initial_metadata;
+    grpc_metadata_array trailing_metadata;
+    grpc_metadata_array_init(&initial_metadata);
+    grpc_metadata_array_init(&trailing_metadata);
+
+    grpc_byte_buffer *response_payload = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    grpc_slice status_details = grpc_slice_from_static_string("");
+
+    grpc_op start_op;
+    memset(&start_op, 0, sizeof(start_op));
+    start_op.op = GRPC_OP_SEND_INITIAL_METADATA;
+    start_op.data.send_initial_metadata.count = meta_count;
+    start_op.data.send_initial_metadata.metadata = meta_count > 0 ? meta : NULL;
+
+    if (run_batch(call, cq, &start_op, 1) != 0) {
+        *error_out = dup_cstring("Failed to start gRPC call.");
+    }
+
+    /* One SEND_MESSAGE batch per produced message; only one may be in flight. */
+    uint64_t sent = 0;
+    while (*error_out == NULL) {
+        const uint8_t *message = NULL;
+        size_t message_len = 0;
+        int produced = producer(ctx, &message, &message_len);
+        if (produced == 0) {
+            break;
+        }
+        if (produced < 0) {
+            *error_out = dup_cstring("gRPC request stream aborted by producer.");
+            break;
+        }
+
+        grpc_slice message_slice = grpc_slice_from_copied_buffer((const char *)message, message_len);
+        grpc_byte_buffer *message_buffer = grpc_raw_byte_buffer_create(&message_slice, 1);
+        grpc_slice_unref(message_slice);
+
+        grpc_op send_op;
+        memset(&send_op, 0, sizeof(send_op));
+        send_op.op = GRPC_OP_SEND_MESSAGE;
+        send_op.data.send_message.send_message = message_buffer;
+        int rc = run_batch(call, cq, &send_op, 1);
+        grpc_byte_buffer_destroy(message_buffer);
+        if (rc != 0) {
+            /* The server may have already failed the call; its status says why. */
+            break;
+        }
+        sent += message_len;
+    }
+
+    if (*error_out != NULL) {
+        grpc_call_cancel(call, NULL);
+    }
+
+    grpc_op finish_ops[4];
+    memset(finish_ops, 0, sizeof(finish_ops));
+    finish_ops[0].op = GRPC_OP_SEND_CLOSE_FROM_CLIENT;
+    finish_ops[1].op = GRPC_OP_RECV_INITIAL_METADATA;
+    finish_ops[1].data.recv_initial_metadata.recv_initial_metadata = &initial_metadata;
+    finish_ops[2].op = GRPC_OP_RECV_MESSAGE;
+    finish_ops[2].data.recv_message.recv_message = &response_payload;
+    finish_ops[3].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    finish_ops[3].data.recv_status_on_client.trailing_metadata = &trailing_metadata;
+    finish_ops[3].data.recv_status_on_client.status = &status;
+    finish_ops[3].data.recv_status_on_client.status_details = &status_details;
+
+    int finished = run_batch(call, cq, finish_ops, 4);
+
+    if (*error_out == NULL) {
+        if (finished != 0) {
+            *error_out = dup_cstring("gRPC call did not complete.");
+        } else if (status != GRPC_STATUS_OK) {
+            *error_out = status_error(status, status_details);
         } else if (response_payload != NULL) {
             grpc_byte_buffer_reader reader;
             if (grpc_byte_buffer_reader_init(&reader, response_payload)) {
@@ -194,15 +901,11 @@ int mic_grpc_unary_call(const char *target,
         }
     }
 
-    if (request_buffer != NULL) {
-        grpc_byte_buffer_destroy(request_buffer);
-    }
-
     grpc_metadata_array_destroy(&initial_metadata);
     grpc_metadata_array_destroy(&trailing_metadata);
 
     if (meta_count > 0) {
-        grpc_slice_unref(auth_value_slice);
+        grpc_slice_unref(meta[0].value);
     }
 
     if (auth_value != NULL) {
@@ -214,14 +917,541 @@ int mic_grpc_unary_call(const char *target,
     }
 
     grpc_slice_unref(status_details);
+    token_detach(call_token(options), call);
     grpc_call_unref(call);
+    report_call(method, *error_out == NULL, started, sent, *response_len_out);
 
-    grpc_completion_queue_shutdown(cq);
-    while (grpc_completion_queue_next(cq, gpr_inf_future(GPR_CLOCK_REALTIME), NULL).type != GRPC_QUEUE_SHUTDOWN) {
+    return call_return_code(status, *error_out);
+}
+
+typedef struct {
+    const struct iovec *messages;
+    size_t count;
+    size_t next;
+} iov_producer;
+
+static int iov_produce(void *ctx, const uint8_t **message, size_t *message_len) {
+    iov_producer *state = (iov_producer *)ctx;
+    if (state->next >= state->count) {
+        return 0;
     }
-    grpc_completion_queue_destroy(cq);
-    grpc_channel_destroy(channel);
-    grpc_shutdown();
+    *message = state->messages[state->next].iov_base;
+    *message_len = state->messages[state->next].iov_len;
+    state->next++;
+    return 1;
+}
+
+int mic_grpc_client_streaming_call_iov(const char *target,
+                                       const char *host,
+                                       const char *method,
+                                       const char *auth_token,
+                                       int use_tls,
+                                       mic_grpc_profile profile,
+                                       mic_grpc_compression compression,
+                                       const mic_grpc_call_options *options,
+                                       const struct iovec *messages,
+                                       size_t count,
+                                       uint8_t **response_out,
+                                       size_t *response_len_out,
+                                       char **error_out) {
+    iov_producer state = { messages, count, 0 };
+    return mic_grpc_client_streaming_call(target, host, method, auth_token, use_tls, profile,
+                                          compression, options, iov_produce, &state,
+                                          response_out, response_len_out, error_out);
+}
+
+struct mic_grpc_channel {
+    char *target;
+    char *host;
+    int use_tls;
+    mic_grpc_profile profile;
+};
+
+mic_grpc_channel *mic_grpc_channel_new(const char *target, const char *host, int use_tls,
+                                       mic_grpc_profile profile) {
+    if (target == NULL || host == NULL) {
+        return NULL;
+    }
+
+    mic_grpc_channel *channel = gpr_malloc(sizeof(mic_grpc_channel));
+    if (channel == NULL) {
+        return NULL;
+    }
+
+    channel->target = dup_cstring(target);
+    channel->host = dup_cstring(host);
+    channel->use_tls = use_tls;
+    channel->profile = profile;
+
+    if (channel->target == NULL || channel->host == NULL) {
+        mic_grpc_channel_free(channel);
+        return NULL;
+    }
+
+    return channel;
+}
+
+int mic_grpc_channel_unary_call(mic_grpc_channel *channel,
+                                const char *method,
+                                const uint8_t *request,
+                                size_t request_len,
+                                const char *auth_token,
+                                const mic_grpc_call_options *options,
+                                uint8_t **response_out,
+                                size_t *response_len_out,
+                                char **error_out) {
+    if (channel == NULL) {
+        if (error_out != NULL) {
+            *error_out = dup_cstring("Invalid gRPC channel.");
+        }
+        return 1;
+    }
+
+    return mic_grpc_unary_call(channel->target,
+                               channel->host,
+                               method,
+                               request,
+                               request_len,
+                               auth_token,
+                               channel->use_tls,
+                               options,
+                               response_out,
+                               response_len_out,
+                               error_out);
+}
+
+int mic_grpc_channel_unary_call_into(mic_grpc_channel *channel,
+                                     const char *method,
+                                     const uint8_t *request,
+                                     size_t request_len,
+                                     const char *auth_token,
+                                     const mic_grpc_call_options *options,
+                                     mic_grpc_alloc_fn alloc,
+                                     void *alloc_ctx,
+                                     uint8_t **response_out,
+                                     size_t *response_len_out,
+                                     char **error_out) {
+    if (channel == NULL) {
+        if (error_out != NULL) {
+            *error_out = dup_cstring("Invalid gRPC channel.");
+        }
+        return 1;
+    }
+
+    return mic_grpc_unary_call_into(channel->target,
+                                    channel->host,
+                                    method,
+                                    request,
+                                    request_len,
+                                    auth_token,
+                                    channel->use_tls,
+                                    options,
+                                    alloc,
+                                    alloc_ctx,
+                                    response_out,
+                                    response_len_out,
+                                    error_out);
+}
+
+int mic_grpc_unary_call_many(const char *target,
+                             const char *host,
+                             const char *auth_token,
+                             int use_tls,
+                             mic_grpc_profile profile,
+                             const mic_grpc_call_options *options,
+                             mic_grpc_batch_call *calls,
+                             size_t count) {
+    if (calls == NULL) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        calls[i].response = NULL;
+        calls[i].response_len = 0;
+        calls[i].error = NULL;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    /* Start every call on the shared channel so gRPC core multiplexes them, then collect. */
+    mic_grpc_completion_set *set = mic_grpc_completion_set_new();
+    if (set == NULL) {
+        for (size_t i = 0; i < count; i++) {
+            calls[i].error = dup_cstring("Failed to create completion queue.");
+        }
+        return 1;
+    }
+
+    int rc = 0;
+    size_t started = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (mic_grpc_call_start(set, target, host, use_tls, profile, calls[i].method,
+                                calls[i].request, calls[i].request_len, auth_token, options,
+                                &calls[i], &calls[i].error) == NULL) {
+            rc = 1;
+            continue;
+        }
+        started++;
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        mic_grpc_async_call *async = mic_grpc_completion_set_next(set, -1);
+        if (async == NULL) {
+            break;
+        }
+        mic_grpc_batch_call *call = mic_grpc_call_tag(async);
+        if (mic_grpc_call_result(async, &call->response, &call->response_len, &call->error) != 0) {
+            rc = 1;
+        }
+        mic_grpc_call_free(async);
+    }
+
+    mic_grpc_completion_set_free(set);
+    return rc;
+}
+
+int mic_grpc_channel_unary_call_many(mic_grpc_channel *channel,
+                                     const char *auth_token,
+                                     const mic_grpc_call_options *options,
+                                     mic_grpc_batch_call *calls,
+                                     size_t count) {
+    if (channel == NULL) {
+        for (size_t i = 0; calls != NULL && i < count; i++) {
+            calls[i].response = NULL;
+            calls[i].response_len = 0;
+            calls[i].error = dup_cstring("Invalid gRPC channel.");
+        }
+        return 1;
+    }
+
+    return mic_grpc_unary_call_many(channel->target,
+                                    channel->host,
+                                    auth_token,
+                                    channel->use_tls,
+                                    channel->profile,
+                                    options,
+                                    calls,
+                                    count);
+}
+
+void mic_grpc_channel_free(mic_grpc_channel *channel) {
+    if (channel == NULL) {
+        return;
+    }
+    gpr_free(channel->target);
+    gpr_free(channel->host);
+    gpr_free(channel);
+}
+
+void mic_grpc_set_flow_control(mic_grpc_profile profile, const mic_grpc_flow_control *settings) {
+    if (settings == NULL || profile < MIC_GRPC_PROFILE_LATENCY || profile > MIC_GRPC_PROFILE_BULK) {
+        return;
+    }
+    flow_profiles[profile] = *settings;
+}
+
+void mic_grpc_pool_shutdown(void) {
+    pthread_mutex_lock(&channel_mutex);
+    cached_channel *entry = channel_cache;
+    channel_cache = NULL;
+    pthread_mutex_unlock(&channel_mutex);
+
+    while (entry != NULL) {
+        cached_channel *next = entry->next;
+        grpc_channel_destroy(entry->channel);
+        gpr_free(entry->key);
+        gpr_free(entry);
+        entry = next;
+    }
+}
+
+void mic_grpc_set_trace(mic_grpc_trace_fn fn, void *ctx) {
+    pthread_mutex_lock(&stats_mutex);
+    trace_fn = fn;
+    trace_ctx = ctx;
+    pthread_mutex_unlock(&stats_mutex);
+}
 
+void mic_grpc_get_stats(mic_grpc_stats *stats_out) {
+    if (stats_out == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&stats_mutex);
+    *stats_out = stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void mic_grpc_tls_stats(uint64_t *handshakes_out, uint64_t *resumed_out) {
+    /* gRPC core owns TLS for this backend and does not expose resumption. */
+    if (handshakes_out != NULL) {
+        *handshakes_out = 0;
+    }
+    if (resumed_out != NULL) {
+        *resumed_out = 0;
+    }
+}
+
+/*
+ * Asynchronous calls map directly onto gRPC core: each completion set owns a
+ * completion queue that core's own threads complete into, and each call runs
+ * its whole unary exchange as one batch tagged with the call, on the shared
+ * channel for its target.
+ */
+struct mic_grpc_completion_set {
+    grpc_completion_queue *cq;
+};
+
+struct mic_grpc_async_call {
+    grpc_call *call;
+    void *tag;
+    int success;
+    char *method;
+    size_t request_len;
+    gpr_timespec started;
+    mic_grpc_cancel_token *cancel;
+
+    grpc_metadata meta[1];
+    size_t meta_count;
+    grpc_byte_buffer *request_buffer;
+    grpc_byte_buffer *response_payload;
+    grpc_metadata_array initial_metadata;
+    grpc_metadata_array trailing_metadata;
+    grpc_status_code status;
+    grpc_slice status_details;
+};
+
+mic_grpc_completion_set *mic_grpc_completion_set_new(void) {
+    mic_grpc_completion_set *set = gpr_malloc(sizeof(mic_grpc_completion_set));
+    if (set == NULL) {
+        return NULL;
+    }
+    pthread_once(&core_once, core_init);
+    set->cq = grpc_completion_queue_create_for_next(NULL);
+    if (set->cq == NULL) {
+        gpr_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+void mic_grpc_completion_set_free(mic_grpc_completion_set *set) {
+    if (set == NULL) {
+        return;
+    }
+    grpc_completion_queue_shutdown(set->cq);
+    for (;;) {
+        grpc_event event = grpc_completion_queue_next(set->cq, gpr_inf_future(GPR_CLOCK_REALTIME), NULL);
+        if (event.type == GRPC_QUEUE_SHUTDOWN) {
+            break;
+        }
+        if (event.type == GRPC_OP_COMPLETE) {
+            mic_grpc_call_free(event.tag);
+        }
+    }
+    grpc_completion_queue_destroy(set->cq);
+    gpr_free(set);
+}
+
+mic_grpc_async_call *mic_grpc_call_start(mic_grpc_completion_set *set,
+                                         const char *target,
+                                         const char *host,
+                                         int use_tls,
+                                         mic_grpc_profile profile,
+                                         const char *method,
+                                         const uint8_t *request,
+                                         size_t request_len,
+                                         const char *auth_token,
+                                         const mic_grpc_call_options *options,
+                                         void *tag,
+                                         char **error_out) {
+    if (error_out == NULL) {
+        return NULL;
+    }
+    *error_out = NULL;
+
+    if (set == NULL || target == NULL || host == NULL || method == NULL) {
+        *error_out = dup_cstring("Invalid gRPC call arguments.");
+        return NULL;
+    }
+
+    mic_grpc_async_call *async = gpr_malloc(sizeof(mic_grpc_async_call));
+    if (async == NULL) {
+        *error_out = dup_cstring("Failed to allocate gRPC call.");
+        return NULL;
+    }
+    memset(async, 0, sizeof(*async));
+    async->tag = tag;
+    async->status = GRPC_STATUS_UNKNOWN;
+    async->status_details = grpc_slice_from_static_string("");
+    grpc_metadata_array_init(&async->initial_metadata);
+    grpc_metadata_array_init(&async->trailing_metadata);
+
+    grpc_channel *channel = shared_channel(target, use_tls, profile, MIC_GRPC_COMPRESS_NONE);
+    if (channel == NULL) {
+        *error_out = dup_cstring("Failed to create gRPC channel.");
+        mic_grpc_call_free(async);
+        return NULL;
+    }
+
+    async->method = dup_cstring(method);
+    async->request_len = request_len;
+    async->started = gpr_now(GPR_CLOCK_MONOTONIC);
+    grpc_slice method_slice = grpc_slice_from_copied_string(method);
+    grpc_slice host_slice = grpc_slice_from_copied_string(host);
+    gpr_timespec deadline = call_deadline(options, profile);
+    async->call = grpc_channel_create_call(channel, NULL, GRPC_PROPAGATE_DEFAULTS, set->cq,
+                                           method_slice, &host_slice, deadline, NULL);
+    grpc_slice_unref(method_slice);
+    grpc_slice_unref(host_slice);
+    if (async->call == NULL) {
+        *error_out = dup_cstring("Failed to create gRPC call.");
+        mic_grpc_call_free(async);
+        return NULL;
+    }
+
+    if (auth_token != NULL && auth_token[0] != '\0') {
+        size_t auth_len = strlen(auth_token) + 8;
+        char *auth_value = gpr_malloc(auth_len);
+        if (auth_value != NULL) {
+            snprintf(auth_value, auth_len, "Bearer %s", auth_token);
+            async->meta[0].key = grpc_slice_from_static_string("authorization");
+            async->meta[0].value = grpc_slice_from_copied_string(auth_value);
+            async->meta_count = 1;
+            gpr_free(auth_value);
+        }
+    }
+
+    if (request != NULL && request_len > 0) {
+        grpc_slice request_slice = grpc_slice_from_copied_buffer((const char *)request, request_len);
+        async->request_buffer = grpc_raw_byte_buffer_create(&request_slice, 1);
+        grpc_slice_unref(request_slice);
+    }
+
+    grpc_op ops[6];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[0].data.send_initial_metadata.count = async->meta_count;
+    ops[0].data.send_initial_metadata.metadata = async->meta_count > 0 ? async->meta : NULL;
+    ops[1].op = GRPC_OP_SEND_MESSAGE;
+    ops[1].data.send_message.send_message = async->request_buffer;
+    ops[2].op = GRPC_OP_SEND_CLOSE_FROM_CLIENT;
+    ops[3].op = GRPC_OP_RECV_INITIAL_METADATA;
+    ops[3].data.recv_initial_metadata.recv_initial_metadata = &async->initial_metadata;
+    ops[4].op = GRPC_OP_RECV_MESSAGE;
+    ops[4].data.recv_message.recv_message = &async->response_payload;
+    ops[5].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[5].data.recv_status_on_client.trailing_metadata = &async->trailing_metadata;
+    ops[5].data.recv_status_on_client.status = &async->status;
+    ops[5].data.recv_status_on_client.status_details = &async->status_details;
+
+    if (grpc_call_start_batch(async->call, ops, 6, async, NULL) != GRPC_CALL_OK) {
+        *error_out = dup_cstring("Failed to start gRPC call.");
+        mic_grpc_call_free(async);
+        return NULL;
+    }
+    async->cancel = call_token(options);
+    token_attach(async->cancel, async->call);
+
+    return async;
+}
+
+void mic_grpc_call_cancel(mic_grpc_async_call *async) {
+    if (async != NULL && async->call != NULL) {
+        grpc_call_cancel(async->call, NULL);
+    }
+}
+
+mic_grpc_async_call *mic_grpc_completion_set_next(mic_grpc_completion_set *set, int timeout_ms) {
+    if (set == NULL) {
+        return NULL;
+    }
+
+    gpr_timespec deadline = timeout_ms < 0
+        ? gpr_inf_future(GPR_CLOCK_REALTIME)
+        : gpr_time_add(gpr_now(GPR_CLOCK_REALTIME), gpr_time_from_millis(timeout_ms, GPR_TIMESPAN));
+    grpc_event event = grpc_completion_queue_next(set->cq, deadline, NULL);
+    if (event.type != GRPC_OP_COMPLETE) {
+        return NULL;
+    }
+
+    mic_grpc_async_call *async = event.tag;
+    async->success = event.success;
+    token_detach(async->cancel, async->call);
+    report_call(async->method, async->success && async->status == GRPC_STATUS_OK, async->started,
+                async->request_len,
+                async->response_payload != NULL ? grpc_byte_buffer_length(async->response_payload) : 0);
+    return async;
+}
+
+void *mic_grpc_call_tag(const mic_grpc_async_call *async) {
+    return async != NULL ? async->tag : NULL;
+}
+
+int mic_grpc_call_result(mic_grpc_async_call *async,
+                         uint8_t **response_out,
+                         size_t *response_len_out,
+                         char **error_out) {
+    if (async == NULL || response_out == NULL || response_len_out == NULL || error_out == NULL) {
+        return 1;
+    }
+    *response_out = NULL;
+    *response_len_out = 0;
+    *error_out = NULL;
+
+    if (!async->success) {
+        *error_out = dup_cstring("gRPC call did not complete.");
+        return 1;
+    }
+    if (async->status != GRPC_STATUS_OK) {
+        *error_out = status_error(async->status, async->status_details);
+        return call_return_code(async->status, *error_out);
+    }
+    if (async->response_payload == NULL) {
+        *error_out = dup_cstring("Empty gRPC response.");
+        return 1;
+    }
+
+    grpc_byte_buffer_reader reader;
+    if (!grpc_byte_buffer_reader_init(&reader, async->response_payload)) {
+        *error_out = dup_cstring("Failed to read gRPC response.");
+        return 1;
+    }
+    grpc_slice response_slice = grpc_byte_buffer_reader_readall(&reader);
+    size_t len = GRPC_SLICE_LENGTH(response_slice);
+    uint8_t *buffer = gpr_malloc(len);
+    if (buffer == NULL) {
+        *error_out = dup_cstring("Failed to allocate response buffer.");
+    } else {
+        memcpy(buffer, GRPC_SLICE_START_PTR(response_slice), len);
+        *response_out = buffer;
+        *response_len_out = len;
+    }
+    grpc_slice_unref(response_slice);
+    grpc_byte_buffer_reader_destroy(&reader);
     return *error_out == NULL ? 0 : 1;
 }
+
+void mic_grpc_call_free(mic_grpc_async_call *async) {
+    if (async == NULL) {
+        return;
+    }
+    if (async->call != NULL) {
+        token_detach(async->cancel, async->call);
+        grpc_call_unref(async->call);
+    }
+    gpr_free(async->method);
+    if (async->meta_count > 0) {
+        grpc_slice_unref(async->meta[0].value);
+    }
+    if (async->request_buffer != NULL) {
+        grpc_byte_buffer_destroy(async->request_buffer);
+    }
+    if (async->response_payload != NULL) {
+        grpc_byte_buffer_destroy(async->response_payload);
+    }
+    grpc_metadata_array_destroy(&async->initial_metadata);
+    grpc_metadata_array_destroy(&async->trailing_metadata);
+    grpc_slice_unref(async->status_details);
+    gpr_free(async);
+}
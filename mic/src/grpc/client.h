@@ -3,6 +3,44 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * Cancellation token. Cancelling it stops every call started with it: open
+ * streams are reset and the calls fail with "gRPC call cancelled". Safe to
+ * cancel from any thread; a token cannot be reset. Free it only once no call
+ * using it is still running.
+ */
+typedef struct mic_grpc_cancel_token mic_grpc_cancel_token;
+
+mic_grpc_cancel_token *mic_grpc_cancel_token_new(void);
+void mic_grpc_cancel_token_cancel(mic_grpc_cancel_token *token);
+int mic_grpc_cancel_token_is_cancelled(const mic_grpc_cancel_token *token);
+void mic_grpc_cancel_token_free(mic_grpc_cancel_token *token);
+
+/*
+ * Calls return 0 on success and nonzero on failure, with a message in
+ * *error_out. A server that does not implement the method (gRPC status
+ * UNIMPLEMENTED) fails the call with this code rather than 1, so callers can
+ * fall back to an older RPC.
+ */
+#define MIC_GRPC_UNIMPLEMENTED 12
+
+/* Deadlines used when a call sets no timeout_ms */
+#define MIC_GRPC_LATENCY_TIMEOUT_MS 30000
+#define MIC_GRPC_BULK_TIMEOUT_MS 300000
+
+/*
+ * Per-call options; every call takes a pointer to them, NULL for defaults.
+ * timeout_ms bounds the whole call, connection setup included, and is sent
+ * to the server as grpc-timeout. A call that runs out of time has its stream
+ * reset and fails with "gRPC deadline exceeded"; other streams on the same
+ * connection carry on.
+ */
+typedef struct {
+    uint32_t timeout_ms;            /* 0: the profile's default */
+    mic_grpc_cancel_token *cancel;  /* optional */
+} mic_grpc_call_options;
 
 int mic_grpc_unary_call(const char *target,
                         const char *host,
@@ -11,10 +49,346 @@ int mic_grpc_unary_call(const char *target,
                         size_t request_len,
                         const char *auth_token,
                         int use_tls,
+                        const mic_grpc_call_options *options,
                         uint8_t **response_out,
                         size_t *response_len_out,
                         char **error_out);
 
+/*
+ * Supplies memory for a response message of exactly len bytes; NULL fails
+ * the call. The memory stays the caller's.
+ */
+typedef uint8_t *(*mic_grpc_alloc_fn)(void *ctx, size_t len);
+
+/*
+ * mic_grpc_unary_call with the response written once, straight into memory
+ * from alloc: it is asked for as soon as the gRPC length prefix arrives (for
+ * a compressed message, once it is decoded) and DATA is copied into it as it
+ * comes off the socket. On success *response_out points into that memory and
+ * is not released with mic_grpc_free. alloc may have been called even when
+ * the call fails, and again if the call is retried on another connection;
+ * the last buffer holds the response.
+ */
+int mic_grpc_unary_call_into(const char *target,
+                             const char *host,
+                             const char *method,
+                             const uint8_t *request,
+                             size_t request_len,
+                             const char *auth_token,
+                             int use_tls,
+                             const mic_grpc_call_options *options,
+                             mic_grpc_alloc_fn alloc,
+                             void *alloc_ctx,
+                             uint8_t **response_out,
+                             size_t *response_len_out,
+                             char **error_out);
+
 void mic_grpc_free(void *ptr);
 
+/*
+ * Connection tuning. LATENCY suits small metadata RPCs and is what
+ * mic_grpc_unary_call uses; BULK opens large HTTP/2 windows and frames for
+ * blob transfers and uploads. Calls only share connections of one profile.
+ */
+typedef enum {
+    MIC_GRPC_PROFILE_LATENCY = 0,
+    MIC_GRPC_PROFILE_BULK = 1,
+} mic_grpc_profile;
+
+typedef struct {
+    uint32_t stream_window;     /* SETTINGS_INITIAL_WINDOW_SIZE we advertise */
+    uint32_t connection_window; /* connection-level receive window */
+    uint32_t max_frame_size;    /* SETTINGS_MAX_FRAME_SIZE, also caps DATA we send */
+    uint32_t max_window;        /* limit for growing stream windows from measured BDP */
+} mic_grpc_flow_control;
+
+/* Replace a profile's flow-control settings for connections opened afterwards. */
+void mic_grpc_set_flow_control(mic_grpc_profile profile, const mic_grpc_flow_control *settings);
+
+/*
+ * Request message compression. Messages are only compressed once the server
+ * has listed the encoding (or gzip, as a fallback) in grpc-accept-encoding,
+ * and only when they are large enough to benefit. Compressed responses are
+ * always decompressed transparently.
+ */
+typedef enum {
+    MIC_GRPC_COMPRESS_NONE = 0,
+    MIC_GRPC_COMPRESS_GZIP = 1,
+    MIC_GRPC_COMPRESS_ZSTD = 2,
+} mic_grpc_compression;
+
+/*
+ * Receives one response message. The bytes are only valid for the duration of
+ * the callback. Return 0 to keep receiving, nonzero to cancel the call.
+ */
+typedef int (*mic_grpc_message_fn)(void *ctx, const uint8_t *message, size_t message_len);
+
+/*
+ * Like mic_grpc_unary_call, but response messages (one for unary methods, any
+ * number for server-streaming ones) are passed to on_message as they arrive
+ * instead of being collected into a single buffer.
+ */
+int mic_grpc_streaming_call(const char *target,
+                            const char *host,
+                            const char *method,
+                            const uint8_t *request,
+                            size_t request_len,
+                            const char *auth_token,
+                            int use_tls,
+                            mic_grpc_profile profile,
+                            const mic_grpc_call_options *options,
+                            mic_grpc_message_fn on_message,
+                            void *ctx,
+                            char **error_out);
+
+/*
+ * Supplies request messages for a client-streaming call. Set *message and
+ * *message_len and return 1 to send a message, return 0 to end the request
+ * stream, or -1 to abort the call. The bytes are sent without being copied and
+ * must stay valid until the producer is called again (or the call returns).
+ */
+typedef int (*mic_grpc_producer_fn)(void *ctx, const uint8_t **message, size_t *message_len);
+
+/*
+ * Sends every produced message on a single stream and returns the single
+ * response message of a client-streaming method. Calls that already pulled
+ * messages from the producer are never retried.
+ */
+int mic_grpc_client_streaming_call(const char *target,
+                                   const char *host,
+                                   const char *method,
+                                   const char *auth_token,
+                                   int use_tls,
+                                   mic_grpc_profile profile,
+                                   mic_grpc_compression compression,
+                                   const mic_grpc_call_options *options,
+                                   mic_grpc_producer_fn producer,
+                                   void *ctx,
+                                   uint8_t **response_out,
+                                   size_t *response_len_out,
+                                   char **error_out);
+
+/* Client-streaming call that sends each iovec as one request message. */
+int mic_grpc_client_streaming_call_iov(const char *target,
+                                       const char *host,
+                                       const char *method,
+                                       const char *auth_token,
+                                       int use_tls,
+                                       mic_grpc_profile profile,
+                                       mic_grpc_compression compression,
+                                       const mic_grpc_call_options *options,
+                                       const struct iovec *messages,
+                                       size_t count,
+                                       uint8_t **response_out,
+                                       size_t *response_len_out,
+                                       char **error_out);
+
+/*
+ * Channel handle for repeated calls against one server. Calls made through a
+ * channel (and through mic_grpc_unary_call) share pooled HTTP/2 connections.
+ */
+typedef struct mic_grpc_channel mic_grpc_channel;
+
+mic_grpc_channel *mic_grpc_channel_new(const char *target, const char *host, int use_tls,
+                                       mic_grpc_profile profile);
+
+int mic_grpc_channel_unary_call(mic_grpc_channel *channel,
+                                const char *method,
+                                const uint8_t *request,
+                                size_t request_len,
+                                const char *auth_token,
+                                const mic_grpc_call_options *options,
+                                uint8_t **response_out,
+                                size_t *response_len_out,
+                                char **error_out);
+
+/* mic_grpc_unary_call_into over the channel's connections */
+int mic_grpc_channel_unary_call_into(mic_grpc_channel *channel,
+                                     const char *method,
+                                     const uint8_t *request,
+                                     size_t request_len,
+                                     const char *auth_token,
+                                     const mic_grpc_call_options *options,
+                                     mic_grpc_alloc_fn alloc,
+                                     void *alloc_ctx,
+                                     uint8_t **response_out,
+                                     size_t *response_len_out,
+                                     char **error_out);
+
+void mic_grpc_channel_free(mic_grpc_channel *channel);
+
+/*
+ * One entry of a batch. method/request/compression are inputs; response (on
+ * success) or error (on failure) is filled in and must be released with
+ * mic_grpc_free.
+ */
+typedef struct {
+    const char *method;
+    const uint8_t *request;
+    size_t request_len;
+    mic_grpc_compression compression;
+    uint8_t *response;
+    size_t response_len;
+    char *error;
+} mic_grpc_batch_call;
+
+/*
+ * Issue every call in the batch concurrently, multiplexed as HTTP/2 streams on
+ * one connection. options apply to each call, so one slow call times out on
+ * its own. Returns 0 when all calls succeeded, 1 if any failed.
+ */
+int mic_grpc_unary_call_many(const char *target,
+                             const char *host,
+                             const char *auth_token,
+                             int use_tls,
+                             mic_grpc_profile profile,
+                             const mic_grpc_call_options *options,
+                             mic_grpc_batch_call *calls,
+                             size_t count);
+
+int mic_grpc_channel_unary_call_many(mic_grpc_channel *channel,
+                                     const char *auth_token,
+                                     const mic_grpc_call_options *options,
+                                     mic_grpc_batch_call *calls,
+                                     size_t count);
+
+/*
+ * Asynchronous unary calls. mic_grpc_call_start hands a call to a background
+ * I/O thread and returns at once; the request is copied. Finished calls are
+ * delivered to the completion set given at start, in completion order, and
+ * picked up with mic_grpc_completion_set_next. Every started call completes
+ * exactly once, including cancelled ones, and must then be released with
+ * mic_grpc_call_free.
+ */
+typedef struct mic_grpc_completion_set mic_grpc_completion_set;
+typedef struct mic_grpc_async_call mic_grpc_async_call;
+
+mic_grpc_completion_set *mic_grpc_completion_set_new(void);
+
+/* Frees the set and any completed calls not yet taken; no call may still be running. */
+void mic_grpc_completion_set_free(mic_grpc_completion_set *set);
+
+/* Returns NULL (with *error_out set) if the call could not be started. */
+mic_grpc_async_call *mic_grpc_call_start(mic_grpc_completion_set *set,
+                                         const char *target,
+                                         const char *host,
+                                         int use_tls,
+                                         mic_grpc_profile profile,
+                                         const char *method,
+                                         const uint8_t *request,
+                                         size_t request_len,
+                                         const char *auth_token,
+                                         const mic_grpc_call_options *options,
+                                         void *tag,
+                                         char **error_out);
+
+/* Ask for a running call to be stopped; it still completes, with an error. */
+void mic_grpc_call_cancel(mic_grpc_async_call *call);
+
+/*
+ * Take the next completed call, waiting up to timeout_ms (0 polls, -1 waits
+ * indefinitely). Returns NULL if none completed in time.
+ */
+mic_grpc_async_call *mic_grpc_completion_set_next(mic_grpc_completion_set *set, int timeout_ms);
+
+void *mic_grpc_call_tag(const mic_grpc_async_call *call);
+
+/*
+ * Outcome of a completed call, as for mic_grpc_unary_call. Ownership of the
+ * response or error passes to the caller.
+ */
+int mic_grpc_call_result(mic_grpc_async_call *call,
+                         uint8_t **response_out,
+                         size_t *response_len_out,
+                         char **error_out);
+
+void mic_grpc_call_free(mic_grpc_async_call *call);
+
+/* Stop the keepalive thread and close every idle pooled connection. Safe to call at process exit. */
+void mic_grpc_pool_shutdown(void);
+
+/*
+ * TLS handshakes completed so far and how many of them resumed a cached
+ * session. Either pointer may be NULL.
+ */
+void mic_grpc_tls_stats(uint64_t *handshakes_out, uint64_t *resumed_out);
+
+/*
+ * Per-call transport telemetry. Times are microseconds since the call was
+ * started; 0 means the phase was not reached. The connection phases are only
+ * set when the call had to open a new connection. Byte and frame counts cover
+ * the HTTP/2 frames of the call's stream, headers included; a window stall is
+ * a pause in sending because the peer's flow-control window ran out.
+ */
+typedef struct {
+    const char *method;
+    int ok;
+    int attempts;
+    int new_connection;
+    uint64_t resolved_us;
+    uint64_t connected_us;
+    uint64_t tls_done_us;
+    uint64_t headers_sent_us;
+    uint64_t first_byte_us;
+    uint64_t trailers_us;
+    uint64_t total_us;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint32_t frames_sent;
+    uint32_t frames_received;
+    uint32_t window_stalls;
+    uint64_t stall_us;
+    uint64_t rtt_us;  /* connection's smoothed round-trip time when the call was sent; 0 if unmeasured */
+} mic_grpc_call_trace;
+
+/*
+ * Called once for every finished call, on whichever thread finished it (the
+ * caller's, or the I/O thread for asynchronous calls). The trace and its
+ * method string are only valid during the callback.
+ */
+typedef void (*mic_grpc_trace_fn)(void *ctx, const mic_grpc_call_trace *trace);
+
+/* Install a trace hook for calls finishing from now on; NULL removes it. */
+void mic_grpc_set_trace(mic_grpc_trace_fn fn, void *ctx);
+
+/*
+ * Latency histogram with power-of-two buckets: bucket 0 counts values under
+ * 2 us, bucket i values in [2^i, 2^(i+1)) us, and the last bucket everything
+ * above.
+ */
+#define MIC_GRPC_HISTOGRAM_BUCKETS 32
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint64_t buckets[MIC_GRPC_HISTOGRAM_BUCKETS];
+} mic_grpc_histogram;
+
+/* Process-wide totals since start. Byte counts are what went over the socket. */
+typedef struct {
+    uint64_t calls;
+    uint64_t calls_failed;
+    uint64_t retries;
+    uint64_t connections_opened;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t frames_sent;
+    uint64_t frames_received;
+    uint64_t window_stalls;
+    uint64_t dns_lookups;           /* resolver queries made for new connections */
+    uint64_t dns_cache_hits;        /* new connections that reused a cached lookup */
+    uint64_t connect_fallbacks;     /* connections won by an address other than the first */
+    uint64_t keepalive_pings;       /* PINGs sent to idle pooled connections */
+    uint64_t keepalive_failures;    /* idle connections dropped for a missing PING ACK */
+    mic_grpc_histogram resolve;     /* DNS lookup (or cache hit) of new connections */
+    mic_grpc_histogram connect;     /* TCP connect of new connections, racing all attempts */
+    mic_grpc_histogram tls;         /* TLS handshakes */
+    mic_grpc_histogram rtt;         /* PING round trips, keepalive and BDP probes */
+    mic_grpc_histogram first_byte;  /* call start to first response DATA */
+    mic_grpc_histogram total;       /* call start to completion */
+} mic_grpc_stats;
+
+void mic_grpc_get_stats(mic_grpc_stats *stats_out);
+
 #endif
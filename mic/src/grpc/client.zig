@@ -40,9 +40,17 @@ pub fn unaryCallResult(
     request: []const u8,
     auth_token: ?[]const u8,
 ) !CallResult {
+    // The plain C entry point always uses the latency profile; others go through a channel.
+    if (endpoint.profile != .latency) {
+        var channel = try Channel.init(allocator, endpoint);
+        defer channel.deinit();
+        return channel.unaryCallResult(allocator, method, request, auth_token);
+    }
+
     var response_ptr: [*c]u8 = null;
     var response_len: usize = 0;
     var error_ptr: [*c]u8 = null;
+    var buffer = ResponseBuffer{ .allocator = allocator };
 
     const target_z = try toNullTerminated(allocator, endpoint.target);
     defer allocator.free(target_z);
@@ -53,7 +61,8 @@ pub fn unaryCallResult(
     const token_z = if (auth_token) |token| try toNullTerminated(allocator, token) else null;
     defer if (token_z) |value| allocator.free(value);
 
-    const rc = c.mic_grpc_unary_call(
+    const options = callOptions(endpoint);
+    const rc = c.mic_grpc_unary_call_into(
         target_z.ptr,
         host_z.ptr,
         method_z.ptr,
@@ -61,11 +70,746 @@ pub fn unaryCallResult(
         request.len,
         if (token_z) |value| value.ptr else null,
         @intFromBool(endpoint.use_tls),
+        &options,
+        ResponseBuffer.alloc,
+        &buffer,
         &response_ptr,
         &response_len,
         &error_ptr,
     );
 
+    return buffer.finish(rc, response_len, error_ptr);
+}
+
+pub const StreamResult = union(enum) {
+    ok,
+    err: []u8,
+};
+
+/// Runs a call whose response messages are handed to `sink.onMessage([]const u8) !void`
+/// as they arrive, so large or server-streaming responses are never buffered whole.
+/// The message slice is only valid during the callback. An error from the sink
+/// cancels the call and is returned, as is `error.Unimplemented` when the
+/// server does not have the method.
+pub fn streamCallResult(
+    allocator: std.mem.Allocator,
+    endpoint: grpc_endpoint.Endpoint,
+    method: []const u8,
+    request: []const u8,
+    auth_token: ?[]const u8,
+    sink: anytype,
+) !StreamResult {
+    const Sink = @TypeOf(sink);
+    const Context = struct {
+        sink: Sink,
+        failure: ?anyerror = null,
+
+        fn onMessage(ctx: ?*anyopaque, message: [*c]const u8, message_len: usize) callconv(.c) c_int {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            const bytes: []const u8 = if (message_len > 0) message[0..message_len] else &.{};
+            self.sink.onMessage(bytes) catch |err| {
+                self.failure = err;
+                return 1;
+            };
+            return 0;
+        }
+    };
+
+    var context = Context{ .sink = sink };
+    var error_ptr: [*c]u8 = null;
+
+    const target_z = try toNullTerminated(allocator, endpoint.target);
+    defer allocator.free(target_z);
+    const host_z = try toNullTerminated(allocator, endpoint.host);
+    defer allocator.free(host_z);
+    const method_z = try toNullTerminated(allocator, method);
+    defer allocator.free(method_z);
+    const token_z = if (auth_token) |token| try toNullTerminated(allocator, token) else null;
+    defer if (token_z) |value| allocator.free(value);
+
+    const options = callOptions(endpoint);
+    const rc = c.mic_grpc_streaming_call(
+        target_z.ptr,
+        host_z.ptr,
+        method_z.ptr,
+        if (request.len > 0) request.ptr else null,
+        request.len,
+        if (token_z) |value| value.ptr else null,
+        @intFromBool(endpoint.use_tls),
+        @intFromEnum(endpoint.profile),
+        &options,
+        Context.onMessage,
+        &context,
+        &error_ptr,
+    );
+    defer if (error_ptr != null) c.mic_grpc_free(error_ptr);
+
+    if (context.failure) |err| return err;
+    if (rc == c.MIC_GRPC_UNIMPLEMENTED) return error.Unimplemented;
+    if (rc != 0) {
+        const message = if (error_ptr != null) std.mem.span(error_ptr) else "gRPC call failed";
+        return .{ .err = try allocator.dupe(u8, message) };
+    }
+    return .ok;
+}
+
+/// Request compression for a call; values match `mic_grpc_compression` in
+/// client.h. Requests are compressed only once the server has advertised the
+/// encoding and only when large enough to benefit; responses are always
+/// decompressed transparently.
+pub const Compression = enum(u8) {
+    none = 0,
+    gzip = 1,
+    zstd = 2,
+};
+
+/// Runs a client-streaming call. Request messages are pulled from
+/// `producer.next() !?[]const u8` one at a time and written to the stream
+/// without copying; each slice must stay valid until `next` is called again.
+/// Returning null ends the request stream. An error from the producer aborts
+/// the call and is returned. A server without the method fails the call with
+/// `error.Unimplemented`.
+pub fn clientStreamCallResult(
+    allocator: std.mem.Allocator,
+    endpoint: grpc_endpoint.Endpoint,
+    method: []const u8,
+    auth_token: ?[]const u8,
+    compression: Compression,
+    producer: anytype,
+) !CallResult {
+    const Producer = @TypeOf(producer);
+    const Context = struct {
+        producer: Producer,
+        failure: ?anyerror = null,
+
+        fn next(ctx: ?*anyopaque, message: [*c][*c]const u8, message_len: [*c]usize) callconv(.c) c_int {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            const bytes = self.producer.next() catch |err| {
+                self.failure = err;
+                return -1;
+            } orelse return 0;
+            message.* = bytes.ptr;
+            message_len.* = bytes.len;
+            return 1;
+        }
+    };
+
+    var context = Context{ .producer = producer };
+    var response_ptr: [*c]u8 = null;
+    var response_len: usize = 0;
+    var error_ptr: [*c]u8 = null;
+
+    const target_z = try toNullTerminated(allocator, endpoint.target);
+    defer allocator.free(target_z);
+    const host_z = try toNullTerminated(allocator, endpoint.host);
+    defer allocator.free(host_z);
+    const method_z = try toNullTerminated(allocator, method);
+    defer allocator.free(method_z);
+    const token_z = if (auth_token) |token| try toNullTerminated(allocator, token) else null;
+    defer if (token_z) |value| allocator.free(value);
+
+    const options = callOptions(endpoint);
+    const rc = c.mic_grpc_client_streaming_call(
+        target_z.ptr,
+        host_z.ptr,
+        method_z.ptr,
+        if (token_z) |value| value.ptr else null,
+        @intFromBool(endpoint.use_tls),
+        @intFromEnum(endpoint.profile),
+        @intFromEnum(compression),
+        &options,
+        Context.next,
+        &context,
+        &response_ptr,
+        &response_len,
+        &error_ptr,
+    );
+
+    if (context.failure != null or rc == c.MIC_GRPC_UNIMPLEMENTED) {
+        if (error_ptr != null) c.mic_grpc_free(error_ptr);
+        if (response_ptr != null) c.mic_grpc_free(response_ptr);
+        return context.failure orelse error.Unimplemented;
+    }
+    return collectResult(allocator, rc, response_ptr, response_len, error_ptr);
+}
+
+pub const BatchRequest = struct {
+    method: []const u8,
+    request: []const u8,
+    compression: Compression = .none,
+};
+
+/// Issues all requests concurrently as multiplexed streams on one connection.
+/// Results are returned in request order; release them with `freeResults`.
+pub fn unaryCallMany(
+    allocator: std.mem.Allocator,
+    endpoint: grpc_endpoint.Endpoint,
+    requests: []const BatchRequest,
+    auth_token: ?[]const u8,
+) ![]CallResult {
+    const target_z = try toNullTerminated(allocator, endpoint.target);
+    defer allocator.free(target_z);
+    const host_z = try toNullTerminated(allocator, endpoint.host);
+    defer allocator.free(host_z);
+    const token_z = if (auth_token) |token| try toNullTerminated(allocator, token) else null;
+    defer if (token_z) |value| allocator.free(value);
+
+    const methods = try allocator.alloc([]u8, requests.len);
+    var methods_len: usize = 0;
+    defer {
+        for (methods[0..methods_len]) |method_z| allocator.free(method_z);
+        allocator.free(methods);
+    }
+
+    const calls = try allocator.alloc(c.mic_grpc_batch_call, requests.len);
+    defer allocator.free(calls);
+
+    for (requests, 0..) |request, i| {
+        methods[i] = try toNullTerminated(allocator, request.method);
+        methods_len += 1;
+        calls[i] = std.mem.zeroes(c.mic_grpc_batch_call);
+        calls[i].method = methods[i].ptr;
+        calls[i].request = if (request.request.len > 0) request.request.ptr else null;
+        calls[i].request_len = request.request.len;
+        calls[i].compression = @intFromEnum(request.compression);
+    }
+
+    const options = callOptions(endpoint);
+    _ = c.mic_grpc_unary_call_many(
+        target_z.ptr,
+        host_z.ptr,
+        if (token_z) |value| value.ptr else null,
+        @intFromBool(endpoint.use_tls),
+        @intFromEnum(endpoint.profile),
+        &options,
+        calls.ptr,
+        calls.len,
+    );
+
+    defer for (calls) |call| {
+        if (call.response != null) c.mic_grpc_free(call.response);
+        if (call.error != null) c.mic_grpc_free(call.error);
+    };
+
+    const results = try allocator.alloc(CallResult, calls.len);
+    var results_len: usize = 0;
+    errdefer {
+        for (results[0..results_len]) |result| freeResult(allocator, result);
+        allocator.free(results);
+    }
+
+    for (calls) |call| {
+        results[results_len] = if (call.error != null)
+            .{ .err = try allocator.dupe(u8, std.mem.span(call.error)) }
+        else if (call.response == null or call.response_len == 0)
+            .{ .err = try allocator.dupe(u8, "Empty gRPC response") }
+        else
+            .{ .ok = .{ .bytes = try allocator.dupe(u8, call.response[0..call.response_len]) } };
+        results_len += 1;
+    }
+
+    return results;
+}
+
+pub fn freeResults(allocator: std.mem.Allocator, results: []CallResult) void {
+    for (results) |result| freeResult(allocator, result);
+    allocator.free(results);
+}
+
+fn freeResult(allocator: std.mem.Allocator, result: CallResult) void {
+    switch (result) {
+        .ok => |response| allocator.free(response.bytes),
+        .err => |message| allocator.free(message),
+    }
+}
+
+/// Long-lived handle for issuing many calls to one endpoint over pooled connections.
+pub const Channel = struct {
+    handle: *c.mic_grpc_channel,
+    options: c.mic_grpc_call_options,
+
+    pub fn init(allocator: std.mem.Allocator, endpoint: grpc_endpoint.Endpoint) !Channel {
+        const target_z = try toNullTerminated(allocator, endpoint.target);
+        defer allocator.free(target_z);
+        const host_z = try toNullTerminated(allocator, endpoint.host);
+        defer allocator.free(host_z);
+
+        const handle = c.mic_grpc_channel_new(
+            target_z.ptr,
+            host_z.ptr,
+            @intFromBool(endpoint.use_tls),
+            @intFromEnum(endpoint.profile),
+        ) orelse
+            return error.OutOfMemory;
+        return .{ .handle = handle, .options = callOptions(endpoint) };
+    }
+
+    pub fn deinit(self: *Channel) void {
+        c.mic_grpc_channel_free(self.handle);
+    }
+
+    pub fn unaryCallResult(
+        self: *Channel,
+        allocator: std.mem.Allocator,
+        method: []const u8,
+        request: []const u8,
+        auth_token: ?[]const u8,
+    ) !CallResult {
+        var response_ptr: [*c]u8 = null;
+        var response_len: usize = 0;
+        var error_ptr: [*c]u8 = null;
+        var buffer = ResponseBuffer{ .allocator = allocator };
+
+        const method_z = try toNullTerminated(allocator, method);
+        defer allocator.free(method_z);
+        const token_z = if (auth_token) |token| try toNullTerminated(allocator, token) else null;
+        defer if (token_z) |value| allocator.free(value);
+
+        const rc = c.mic_grpc_channel_unary_call_into(
+            self.handle,
+            method_z.ptr,
+            if (request.len > 0) request.ptr else null,
+            request.len,
+            if (token_z) |value| value.ptr else null,
+            &self.options,
+            ResponseBuffer.alloc,
+            &buffer,
+            &response_ptr,
+            &response_len,
+            &error_ptr,
+        );
+
+        return buffer.finish(rc, response_len, error_ptr);
+    }
+
+    pub fn unaryCall(
+        self: *Channel,
+        allocator: std.mem.Allocator,
+        method: []const u8,
+        request: []const u8,
+        auth_token: ?[]const u8,
+    ) !Response {
+        const result = try self.unaryCallResult(allocator, method, request, auth_token);
+
+        switch (result) {
+            .ok => |response| return response,
+            .err => |message| {
+                defer allocator.free(message);
+                std.debug.print("gRPC error: {s}\n", .{message});
+                return error.RequestFailed;
+            },
+        }
+    }
+};
+
+/// In-flight asynchronous calls. Calls started on a set run on the transport's
+/// I/O thread and come back from `next` in completion order, so one thread can
+/// overlap many RPCs. Every started call must be collected before `deinit`.
+pub const CompletionSet = struct {
+    handle: *c.mic_grpc_completion_set,
+
+    pub fn init() !CompletionSet {
+        const handle = c.mic_grpc_completion_set_new() orelse return error.OutOfMemory;
+        return .{ .handle = handle };
+    }
+
+    pub fn deinit(self: *CompletionSet) void {
+        c.mic_grpc_completion_set_free(self.handle);
+    }
+
+    /// Starts a unary call and returns without waiting; the request is copied.
+    /// `tag` identifies the call when it completes.
+    pub fn start(
+        self: *CompletionSet,
+        allocator: std.mem.Allocator,
+        endpoint: grpc_endpoint.Endpoint,
+        method: []const u8,
+        request: []const u8,
+        auth_token: ?[]const u8,
+        tag: usize,
+    ) !AsyncCall {
+        var error_ptr: [*c]u8 = null;
+
+        const target_z = try toNullTerminated(allocator, endpoint.target);
+        defer allocator.free(target_z);
+        const host_z = try toNullTerminated(allocator, endpoint.host);
+        defer allocator.free(host_z);
+        const method_z = try toNullTerminated(allocator, method);
+        defer allocator.free(method_z);
+        const token_z = if (auth_token) |token| try toNullTerminated(allocator, token) else null;
+        defer if (token_z) |value| allocator.free(value);
+
+        const options = callOptions(endpoint);
+        const handle = c.mic_grpc_call_start(
+            self.handle,
+            target_z.ptr,
+            host_z.ptr,
+            @intFromBool(endpoint.use_tls),
+            @intFromEnum(endpoint.profile),
+            method_z.ptr,
+            if (request.len > 0) request.ptr else null,
+            request.len,
+            if (token_z) |value| value.ptr else null,
+            &options,
+            @ptrFromInt(tag),
+            &error_ptr,
+        ) orelse {
+            if (error_ptr != null) {
+                std.debug.print("gRPC error: {s}\n", .{std.mem.span(error_ptr)});
+                c.mic_grpc_free(error_ptr);
+            }
+            return error.RequestFailed;
+        };
+        return .{ .handle = handle };
+    }
+
+    /// Next completed call, or null if none finished within `timeout_ms`
+    /// (0 polls, -1 waits indefinitely).
+    pub fn next(self: *CompletionSet, timeout_ms: i32) ?AsyncCall {
+        const handle = c.mic_grpc_completion_set_next(self.handle, timeout_ms) orelse return null;
+        return .{ .handle = handle };
+    }
+};
+
+pub const AsyncCall = struct {
+    handle: *c.mic_grpc_async_call,
+
+    pub fn tag(self: AsyncCall) usize {
+        return if (c.mic_grpc_call_tag(self.handle)) |value| @intFromPtr(value) else 0;
+    }
+
+    /// Stops a running call; it still completes, with an error.
+    pub fn cancel(self: AsyncCall) void {
+        c.mic_grpc_call_cancel(self.handle);
+    }
+
+    /// Outcome of a completed call. Releases the call.
+    pub fn finish(self: AsyncCall, allocator: std.mem.Allocator) !CallResult {
+        defer c.mic_grpc_call_free(self.handle);
+
+        var response_ptr: [*c]u8 = null;
+        var response_len: usize = 0;
+        var error_ptr: [*c]u8 = null;
+        const rc = c.mic_grpc_call_result(self.handle, &response_ptr, &response_len, &error_ptr);
+        return collectResult(allocator, rc, response_ptr, response_len, error_ptr);
+    }
+
+    /// Releases a completed call without looking at its outcome.
+    pub fn deinit(self: AsyncCall) void {
+        c.mic_grpc_call_free(self.handle);
+    }
+};
+
+/// Stops every call made through an endpoint that carries it
+/// (`endpoint.withCancel(token.handle())`): open streams are reset and the
+/// calls fail. `cancel` may be called from any thread; free the token only
+/// once those calls have returned.
+pub const CancelToken = struct {
+    ptr: *c.mic_grpc_cancel_token,
+
+    pub fn init() !CancelToken {
+        const ptr = c.mic_grpc_cancel_token_new() orelse return error.OutOfMemory;
+        return .{ .ptr = ptr };
+    }
+
+    pub fn deinit(self: *CancelToken) void {
+        c.mic_grpc_cancel_token_free(self.ptr);
+    }
+
+    pub fn cancel(self: CancelToken) void {
+        c.mic_grpc_cancel_token_cancel(self.ptr);
+    }
+
+    pub fn isCancelled(self: CancelToken) bool {
+        return c.mic_grpc_cancel_token_is_cancelled(self.ptr) != 0;
+    }
+
+    pub fn handle(self: CancelToken) *grpc_endpoint.Cancel {
+        return @ptrCast(self.ptr);
+    }
+};
+
+fn callOptions(endpoint: grpc_endpoint.Endpoint) c.mic_grpc_call_options {
+    return .{
+        .timeout_ms = endpoint.timeout_ms,
+        .cancel = if (endpoint.cancel) |cancel| @ptrCast(cancel) else null,
+    };
+}
+
+/// Closes idle pooled connections. Call once before the process exits.
+pub fn shutdownPool() void {
+    c.mic_grpc_pool_shutdown();
+}
+
+/// HTTP/2 flow-control settings for one profile; see `mic_grpc_flow_control`.
+pub const FlowControl = struct {
+    stream_window: u32,
+    connection_window: u32,
+    max_frame_size: u32,
+    max_window: u32,
+};
+
+/// Overrides a profile's flow-control settings for connections opened afterwards.
+pub fn setFlowControl(profile: grpc_endpoint.Profile, flow: FlowControl) void {
+    const settings = c.mic_grpc_flow_control{
+        .stream_window = flow.stream_window,
+        .connection_window = flow.connection_window,
+        .max_frame_size = flow.max_frame_size,
+        .max_window = flow.max_window,
+    };
+    c.mic_grpc_set_flow_control(@intFromEnum(profile), &settings);
+}
+
+pub const TlsStats = struct {
+    handshakes: u64,
+    resumed: u64,
+
+    /// Fraction of TLS handshakes that resumed a cached session.
+    pub fn resumptionRate(self: TlsStats) f64 {
+        if (self.handshakes == 0) return 0;
+        return @as(f64, @floatFromInt(self.resumed)) / @as(f64, @floatFromInt(self.handshakes));
+    }
+};
+
+pub fn tlsStats() TlsStats {
+    var handshakes: u64 = 0;
+    var resumed: u64 = 0;
+    c.mic_grpc_tls_stats(&handshakes, &resumed);
+    return .{ .handshakes = handshakes, .resumed = resumed };
+}
+
+/// Prints one line per finished gRPC call to stderr: phase times in
+/// milliseconds since the call started ("-" where a phase did not happen),
+/// then the stream's bytes and frames, any flow-control stalls and the
+/// connection's smoothed round-trip time.
+pub fn enableTrace() void {
+    c.mic_grpc_set_trace(traceCall, null);
+}
+
+fn traceCall(ctx: ?*anyopaque, trace_ptr: [*c]const c.mic_grpc_call_trace) callconv(.c) void {
+    _ = ctx;
+    const trace = trace_ptr.*;
+    var bufs: [9][24]u8 = undefined;
+    std.debug.print(
+        "rpc {s} {s} attempts={d} dns={s} connect={s} tls={s} headers={s} first_byte={s} trailers={s} total={s} " ++
+            "sent={d}B/{d} frames recv={d}B/{d} frames stalls={d} ({s}) rtt={s}\n",
+        .{
+            std.mem.span(trace.method),
+            if (trace.ok != 0) "ok" else "failed",
+            trace.attempts,
+            formatMs(&bufs[0], trace.resolved_us),
+            formatMs(&bufs[1], trace.connected_us),
+            formatMs(&bufs[2], trace.tls_done_us),
+            formatMs(&bufs[3], trace.headers_sent_us),
+            formatMs(&bufs[4], trace.first_byte_us),
+            formatMs(&bufs[5], trace.trailers_us),
+            formatMs(&bufs[6], trace.total_us),
+            trace.bytes_sent,
+            trace.frames_sent,
+            trace.bytes_received,
+            trace.frames_received,
+            trace.window_stalls,
+            formatMs(&bufs[7], trace.stall_us),
+            formatMs(&bufs[8], trace.rtt_us),
+        },
+    );
+}
+
+fn formatMs(buf: []u8, us: u64) []const u8 {
+    if (us == 0) return "-";
+    return std.fmt.bufPrint(buf, "{d:.2}ms", .{@as(f64, @floatFromInt(us)) / 1000.0}) catch "?";
+}
+
+/// Latency histogram with power-of-two microsecond buckets; see `mic_grpc_histogram`.
+pub const Histogram = struct {
+    count: u64,
+    sum_us: u64,
+    max_us: u64,
+    buckets: [c.MIC_GRPC_HISTOGRAM_BUCKETS]u64,
+
+    fn fromC(histogram: c.mic_grpc_histogram) Histogram {
+        return .{
+            .count = histogram.count,
+            .sum_us = histogram.sum_us,
+            .max_us = histogram.max_us,
+            .buckets = histogram.buckets,
+        };
+    }
+
+    pub fn meanUs(self: Histogram) u64 {
+        return if (self.count == 0) 0 else self.sum_us / self.count;
+    }
+
+    /// Upper bound of the bucket holding the given percentile (0-100), capped at the maximum seen.
+    pub fn percentileUs(self: Histogram, percentile: f64) u64 {
+        if (self.count == 0) return 0;
+        const rank: u64 = @intFromFloat(@ceil(@as(f64, @floatFromInt(self.count)) * percentile / 100.0));
+        var seen: u64 = 0;
+        for (self.buckets, 0..) |bucket, i| {
+            seen += bucket;
+            if (seen >= @max(rank, 1)) {
+                const upper = @as(u64, 2) << @intCast(i);
+                return @min(upper, self.max_us);
+            }
+        }
+        return self.max_us;
+    }
+};
+
+pub const Stats = struct {
+    calls: u64,
+    calls_failed: u64,
+    retries: u64,
+    connections_opened: u64,
+    bytes_sent: u64,
+    bytes_received: u64,
+    frames_sent: u64,
+    frames_received: u64,
+    window_stalls: u64,
+    dns_lookups: u64,
+    dns_cache_hits: u64,
+    connect_fallbacks: u64,
+    keepalive_pings: u64,
+    keepalive_failures: u64,
+    resolve: Histogram,
+    connect: Histogram,
+    tls: Histogram,
+    rtt: Histogram,
+    first_byte: Histogram,
+    total: Histogram,
+};
+
+/// Process-wide transport counters since start.
+pub fn stats() Stats {
+    var raw: c.mic_grpc_stats = undefined;
+    c.mic_grpc_get_stats(&raw);
+    return .{
+        .calls = raw.calls,
+        .calls_failed = raw.calls_failed,
+        .retries = raw.retries,
+        .connections_opened = raw.connections_opened,
+        .bytes_sent = raw.bytes_sent,
+        .bytes_received = raw.bytes_received,
+        .frames_sent = raw.frames_sent,
+        .frames_received = raw.frames_received,
+        .window_stalls = raw.window_stalls,
+        .dns_lookups = raw.dns_lookups,
+        .dns_cache_hits = raw.dns_cache_hits,
+        .connect_fallbacks = raw.connect_fallbacks,
+        .keepalive_pings = raw.keepalive_pings,
+        .keepalive_failures = raw.keepalive_failures,
+        .resolve = Histogram.fromC(raw.resolve),
+        .connect = Histogram.fromC(raw.connect),
+        .tls = Histogram.fromC(raw.tls),
+        .rtt = Histogram.fromC(raw.rtt),
+        .first_byte = Histogram.fromC(raw.first_byte),
+        .total = Histogram.fromC(raw.total),
+    };
+}
+
+/// Prints the totals from `stats` and `tlsStats` to stderr.
+pub fn printStats() void {
+    const s = stats();
+    const tls = tlsStats();
+    std.debug.print(
+        "rpc totals: {d} calls ({d} failed, {d} retries), {d} connections, {d} TLS handshakes ({d} resumed)\n",
+        .{ s.calls, s.calls_failed, s.retries, s.connections_opened, tls.handshakes, tls.resumed },
+    );
+    std.debug.print(
+        "rpc wire: sent {d}B in {d} frames, received {d}B in {d} frames, {d} window stalls\n",
+        .{ s.bytes_sent, s.frames_sent, s.bytes_received, s.frames_received, s.window_stalls },
+    );
+    std.debug.print(
+        "rpc dns: {d} lookups, {d} cache hits; {d} connections fell back to a later address\n",
+        .{ s.dns_lookups, s.dns_cache_hits, s.connect_fallbacks },
+    );
+    std.debug.print(
+        "rpc keepalive: {d} pings, {d} idle connections dropped\n",
+        .{ s.keepalive_pings, s.keepalive_failures },
+    );
+    printHistogram("resolve", s.resolve);
+    printHistogram("connect", s.connect);
+    printHistogram("tls", s.tls);
+    printHistogram("rtt", s.rtt);
+    printHistogram("first_byte", s.first_byte);
+    printHistogram("total", s.total);
+}
+
+fn printHistogram(name: []const u8, histogram: Histogram) void {
+    if (histogram.count == 0) return;
+    var bufs: [4][24]u8 = undefined;
+    std.debug.print("rpc {s}: n={d} mean={s} p50<={s} p99<={s} max={s}\n", .{
+        name,
+        histogram.count,
+        formatMs(&bufs[0], histogram.meanUs()),
+        formatMs(&bufs[1], histogram.percentileUs(50)),
+        formatMs(&bufs[2], histogram.percentileUs(99)),
+        formatMs(&bufs[3], histogram.max_us),
+    });
+}
+
+test "histogram percentiles report bucket upper bounds" {
+    var histogram = Histogram{ .count = 0, .sum_us = 0, .max_us = 0, .buckets = [_]u64{0} ** c.MIC_GRPC_HISTOGRAM_BUCKETS };
+    try std.testing.expectEqual(@as(u64, 0), histogram.percentileUs(50));
+
+    // 90 calls in [512, 1024) us and 10 in [65536, 131072) us
+    histogram.buckets[9] = 90;
+    histogram.buckets[16] = 10;
+    histogram.count = 100;
+    histogram.max_us = 100_000;
+    try std.testing.expectEqual(@as(u64, 1024), histogram.percentileUs(50));
+    try std.testing.expectEqual(@as(u64, 1024), histogram.percentileUs(90));
+    try std.testing.expectEqual(@as(u64, 100_000), histogram.percentileUs(99));
+}
+
+/// Lets the transport write a unary response directly into `allocator`
+/// memory, sized from the gRPC length prefix, instead of handing back a C
+/// buffer to copy. A retried call asks again; only the last buffer is kept.
+const ResponseBuffer = struct {
+    allocator: std.mem.Allocator,
+    bytes: ?[]u8 = null,
+
+    fn alloc(ctx: ?*anyopaque, len: usize) callconv(.c) [*c]u8 {
+        const self: *ResponseBuffer = @ptrCast(@alignCast(ctx.?));
+        self.release();
+        const bytes = self.allocator.alloc(u8, len) catch return null;
+        self.bytes = bytes;
+        return bytes.ptr;
+    }
+
+    fn release(self: *ResponseBuffer) void {
+        if (self.bytes) |bytes| self.allocator.free(bytes);
+        self.bytes = null;
+    }
+
+    /// Like `collectResult`; on success the buffer becomes the response.
+    fn finish(self: *ResponseBuffer, rc: c_int, response_len: usize, error_ptr: [*c]u8) !CallResult {
+        defer if (error_ptr != null) c.mic_grpc_free(error_ptr);
+
+        if (rc != 0) {
+            self.release();
+            const message = if (error_ptr != null) std.mem.span(error_ptr) else "gRPC call failed";
+            return .{ .err = try self.allocator.dupe(u8, message) };
+        }
+
+        if (response_len == 0) {
+            self.release();
+            return error.EmptyResponse;
+        }
+
+        const bytes = self.bytes orelse return error.EmptyResponse;
+        self.bytes = null;
+        return .{ .ok = .{ .bytes = bytes } };
+    }
+};
+
+fn collectResult(
+    allocator: std.mem.Allocator,
+    rc: c_int,
+    response_ptr: [*c]u8,
+    response_len: usize,
+    error_ptr: [*c]u8,
+) !CallResult {
     defer if (error_ptr != null) c.mic_grpc_free(error_ptr);
 
     if (rc != 0) {
@@ -16,6 +16,16 @@ pub const PathResponse = struct {
     blob_hash: []const u8,
 };
 
+/// One blob from a GetBlobs stream. Both slices point into the message.
+/// A deferred entry carries only the size; the content must be fetched
+/// another way.
+pub const BlobEntry = struct {
+    blob_hash: []const u8,
+    content: []const u8,
+    size: u64,
+    deferred: bool,
+};
+
 pub const BlameLine = struct {
     line_number: u32,
     text: []const u8,
@@ -74,6 +84,28 @@ pub fn encodeGetBlobRequest(
     return buf.toOwnedSlice();
 }
 
+pub fn encodeGetBlobsRequest(
+    allocator: std.mem.Allocator,
+    account: []const u8,
+    project: []const u8,
+    blob_hashes: []const []const u8,
+    max_blob_bytes: u64,
+    max_batch_bytes: u64,
+) ![]u8 {
+    var buf = std.Io.Writer.Allocating.init(allocator);
+    defer buf.deinit();
+
+    try proto.encodeStringField(&buf.writer, 2, account);
+    try proto.encodeStringField(&buf.writer, 3, project);
+    for (blob_hashes) |blob_hash| {
+        try proto.encodeBytesField(&buf.writer, 4, blob_hash);
+    }
+    if (max_blob_bytes > 0) try proto.encodeVarintField(&buf.writer, 5, max_blob_bytes);
+    if (max_batch_bytes > 0) try proto.encodeVarintField(&buf.writer, 6, max_batch_bytes);
+
+    return buf.toOwnedSlice();
+}
+
 pub fn encodeGetPathRequest(
     allocator: std.mem.Allocator,
     account: []const u8,
@@ -176,6 +208,64 @@ pub fn decodeBlobResponse(allocator: std.mem.Allocator, data: []const u8) ![]con
     return content;
 }
 
+/// Decodes a StreamBlob chunk. The returned slice points into `data`.
+pub fn decodeBlobChunk(data: []const u8) ![]const u8 {
+    var decoder = proto.Decoder.init(data);
+    var chunk: []const u8 = &[_]u8{};
+
+    while (!decoder.eof()) {
+        const key = try decoder.readVarint();
+        const field_number: u32 = @intCast(key >> 3);
+        const wire_type: proto.WireType = @enumFromInt(@as(u3, @intCast(key & 0x07)));
+
+        switch (field_number) {
+            1 => {
+                if (wire_type != .length_delimited) return error.InvalidWireType;
+                chunk = try decoder.readBytesView();
+            },
+            else => try decoder.skipField(wire_type),
+        }
+    }
+
+    return chunk;
+}
+
+pub fn decodeBlobEntry(data: []const u8) !BlobEntry {
+    var decoder = proto.Decoder.init(data);
+    var blob_hash: []const u8 = &[_]u8{};
+    var content: []const u8 = &[_]u8{};
+    var size: u64 = 0;
+    var deferred = false;
+
+    while (!decoder.eof()) {
+        const key = try decoder.readVarint();
+        const field_number: u32 = @intCast(key >> 3);
+        const wire_type: proto.WireType = @enumFromInt(@as(u3, @intCast(key & 0x07)));
+
+        switch (field_number) {
+            1 => {
+                if (wire_type != .length_delimited) return error.InvalidWireType;
+                blob_hash = try decoder.readBytesView();
+            },
+            2 => {
+                if (wire_type != .length_delimited) return error.InvalidWireType;
+                content = try decoder.readBytesView();
+            },
+            3 => {
+                if (wire_type != .varint) return error.InvalidWireType;
+                size = try decoder.readVarint();
+            },
+            4 => {
+                if (wire_type != .varint) return error.InvalidWireType;
+                deferred = (try decoder.readVarint()) != 0;
+            },
+            else => try decoder.skipField(wire_type),
+        }
+    }
+
+    return .{ .blob_hash = blob_hash, .content = content, .size = size, .deferred = deferred };
+}
+
 pub fn decodePathResponse(allocator: std.mem.Allocator, data: []const u8) !PathResponse {
     var decoder = proto.Decoder.init(data);
     var content: []const u8 = &[_]u8{};
@@ -383,3 +473,63 @@ fn encodeBlameLine(
 
     return buf.toOwnedSlice();
 }
+
+test "decode blob chunk without copying" {
+    const allocator = std.testing.allocator;
+
+    var buf = std.Io.Writer.Allocating.init(allocator);
+    defer buf.deinit();
+
+    try proto.encodeBytesField(&buf.writer, 1, "chunk-bytes");
+    const chunk_bytes = try buf.toOwnedSlice();
+    defer allocator.free(chunk_bytes);
+
+    const chunk = try decodeBlobChunk(chunk_bytes);
+    try std.testing.expectEqualStrings("chunk-bytes", chunk);
+    try std.testing.expect(chunk.ptr == chunk_bytes.ptr + 2);
+
+    const empty = try decodeBlobChunk(&[_]u8{});
+    try std.testing.expectEqual(@as(usize, 0), empty.len);
+}
+
+test "encode GetBlobs request and decode blob entry" {
+    const allocator = std.testing.allocator;
+
+    const hashes = [_][]const u8{ "hash-one", "hash-two" };
+    const request = try encodeGetBlobsRequest(allocator, "acme", "app", &hashes, 0, 4096);
+    defer allocator.free(request);
+
+    var decoder = proto.Decoder.init(request);
+    var seen: usize = 0;
+    var max_batch_bytes: u64 = 0;
+    while (!decoder.eof()) {
+        const key = try decoder.readVarint();
+        const field_number: u32 = @intCast(key >> 3);
+        const wire_type: proto.WireType = @enumFromInt(@as(u3, @intCast(key & 0x07)));
+        switch (field_number) {
+            4 => {
+                try std.testing.expectEqualStrings(hashes[seen], try decoder.readBytesView());
+                seen += 1;
+            },
+            5 => return error.TestUnexpectedResult,
+            6 => max_batch_bytes = try decoder.readVarint(),
+            else => try decoder.skipField(wire_type),
+        }
+    }
+    try std.testing.expectEqual(@as(usize, 2), seen);
+    try std.testing.expectEqual(@as(u64, 4096), max_batch_bytes);
+
+    var buf = std.Io.Writer.Allocating.init(allocator);
+    defer buf.deinit();
+    try proto.encodeBytesField(&buf.writer, 1, "hash-one");
+    try proto.encodeBytesField(&buf.writer, 2, "content");
+    try proto.encodeVarintField(&buf.writer, 3, 7);
+    const entry_bytes = try buf.toOwnedSlice();
+    defer allocator.free(entry_bytes);
+
+    const entry = try decodeBlobEntry(entry_bytes);
+    try std.testing.expectEqualStrings("hash-one", entry.blob_hash);
+    try std.testing.expectEqualStrings("content", entry.content);
+    try std.testing.expectEqual(@as(u64, 7), entry.size);
+    try std.testing.expect(!entry.deferred);
+}
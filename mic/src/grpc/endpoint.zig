@@ -1,9 +1,51 @@
 const std = @import("std");
 
+/// HTTP/2 tuning for the connections a call uses. `latency` is for small
+/// metadata RPCs; `bulk` opens large flow-control windows for blob transfers
+/// and uploads. Values match `mic_grpc_profile` in client.h.
+pub const Profile = enum(u8) {
+    latency = 0,
+    bulk = 1,
+};
+
+/// Cancellation token handle; see `CancelToken` in client.zig.
+pub const Cancel = opaque {};
+
+/// Deadline for RPCs whose response grows with the tree (GetHeadTree,
+/// GetTreeAtPosition, GetBlame). The latency default suits small metadata
+/// calls, not a full tree of a large project.
+pub const tree_timeout_ms: u32 = 300_000;
+
 pub const Endpoint = struct {
     target: []const u8,
     host: []const u8,
     use_tls: bool = true,
+    profile: Profile = .latency,
+    /// Deadline for each call in milliseconds; 0 uses the profile's default
+    /// (`MIC_GRPC_LATENCY_TIMEOUT_MS` / `MIC_GRPC_BULK_TIMEOUT_MS`).
+    timeout_ms: u32 = 0,
+    cancel: ?*Cancel = null,
+
+    /// Same server, with calls routed over connections tuned for `profile`.
+    pub fn withProfile(self: Endpoint, profile: Profile) Endpoint {
+        var endpoint = self;
+        endpoint.profile = profile;
+        return endpoint;
+    }
+
+    /// Same server, with every call limited to `timeout_ms`.
+    pub fn withTimeout(self: Endpoint, timeout_ms: u32) Endpoint {
+        var endpoint = self;
+        endpoint.timeout_ms = timeout_ms;
+        return endpoint;
+    }
+
+    /// Same server, with calls stopped once `cancel` is cancelled.
+    pub fn withCancel(self: Endpoint, cancel: *Cancel) Endpoint {
+        var endpoint = self;
+        endpoint.cancel = cancel;
+        return endpoint;
+    }
 };
 
 pub fn parseServer(allocator: std.mem.Allocator, server: []const u8) !Endpoint {
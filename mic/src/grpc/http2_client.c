@@ -12,13 +12,20 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/bio.h>
+#include <zlib.h>
+#include <zstd.h>
 
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -28,32 +35,318 @@
 /* gRPC framing: 1 byte compression flag + 4 bytes big-endian length */
 #define GRPC_HEADER_SIZE 5
 
+/* Connection setup limit, further capped by the deadline of the call that opens it */
+#define CONNECT_TIMEOUT_MS 10000
+
+/* Resolved addresses are reused for this long before the name is looked up again */
+#define DNS_CACHE_TTL_MS 30000
+#define DNS_CACHE_MAX 16
+#define DNS_MAX_ADDRESSES 8
+
+/* Head start each connect attempt gets before the next address joins the race (RFC 8305) */
+#define CONNECT_ATTEMPT_DELAY_MS 250
+
+/* Connection pool limits */
+#define POOL_MAX_IDLE 16
+#define POOL_IDLE_TIMEOUT_MS 60000
+
+/* Ceiling for HTTP/2 window sizes (2^31 - 1) */
+#define H2_MAX_WINDOW 0x7fffffff
+
+/* Opaque payload of the PING used to measure bandwidth-delay product */
+#define BDP_PING_DATA "mic-bdp!"
+
+/*
+ * Keepalive: idle pooled connections are PINGed after KEEPALIVE_IDLE_MS and
+ * dropped if the ACK takes longer than KEEPALIVE_TIMEOUT_MS. That is at most
+ * one PING per idle spell before POOL_IDLE_TIMEOUT_MS retires the connection,
+ * which gRPC servers' default ping policing tolerates.
+ */
+#define KEEPALIVE_IDLE_MS 30000
+#define KEEPALIVE_TIMEOUT_MS 5000
+#define KEEPALIVE_CHECK_MS 5000
+#define KEEPALIVE_PING_DATA "mic-ka!!"
+
+/* TLS sessions kept for resumption, one per connection key */
+#define TLS_SESSION_CACHE_MAX 32
+
+/* Request messages below this size are sent uncompressed */
+#define COMPRESS_MIN_BYTES 1024
+#define ZSTD_LEVEL 3
+
+/* Largest response message we are willing to decompress */
+#define MAX_DECOMPRESSED_SIZE ((size_t)1 << 30)
+
+/* Servers whose grpc-accept-encoding we remember */
+#define ENCODING_CACHE_MAX 16
+
+/* grpc-encoding of a response we cannot decode */
+#define ENCODING_UNKNOWN (-1)
+
+/* Outcome of a call on a single connection */
+#define CALL_OK 0
+#define CALL_FAILED 1
+#define CALL_RETRYABLE 2
+#define CALL_PENDING 3
+
+/* Per-call state; one per HTTP/2 stream, attached as nghttp2 stream user data */
 typedef struct {
-    SSL_CTX *ssl_ctx;
-    SSL *ssl;
-    BIO *bio;
-    int fd;
-    int use_tls;
-    nghttp2_session *session;
-    
-    /* Request data */
-    const uint8_t *request_data;
-    size_t request_len;
-    size_t request_sent;
-    int request_stream_id;
-    
+    /* Call inputs */
+    const char *method;
+    const uint8_t *message;
+    size_t message_len;
+
+    int32_t stream_id;
+
+    /*
+     * Request messages: the single message above, or pulled from a producer.
+     * Message bytes go to the socket without being copied into nghttp2's
+     * buffers (NGHTTP2_DATA_FLAG_NO_COPY), prefixed by send_prefix.
+     */
+    mic_grpc_producer_fn producer;
+    void *producer_ctx;
+    int producer_started;
+    int producer_failed;
+    int single_message_taken;
+    const uint8_t *send_message;
+    size_t send_message_len;
+    size_t send_offset;
+    uint8_t send_prefix[GRPC_HEADER_SIZE];
+    int send_has_message;
+    int send_done;
+
+    /*
+     * Request compression: what the caller asked for, what the server accepts
+     * and this stream therefore uses, and the compressor reused across messages
+     */
+    mic_grpc_compression compression;
+    mic_grpc_compression send_encoding;
+    uint8_t *compress_buf;
+    size_t compress_cap;
+    z_stream *deflate;
+    ZSTD_CCtx *zstd_cctx;
+
     /* Response data */
     uint8_t *response_data;
     size_t response_len;
     size_t response_capacity;
-    size_t response_expected_len;
+
+    /* Streaming receive: messages are handed to the sink as each one completes */
+    mic_grpc_message_fn on_message;
+    void *on_message_ctx;
+    uint8_t frame_header[GRPC_HEADER_SIZE];
+    size_t frame_header_len;
+    size_t frame_len;
+    int sink_failed;
+
+    /*
+     * Unary receive into caller memory: the message is copied from nghttp2's
+     * buffer straight into what alloc returned for the length prefix
+     */
+    mic_grpc_alloc_fn alloc;
+    void *alloc_ctx;
+    uint8_t *into;
+    size_t into_len;
+    int into_done;
+    int alloc_failed;
+
+    /* grpc-encoding of the response, and scratch space for decompressed stream messages */
+    int response_encoding;
+    int decode_failed;
+    uint8_t *inflate_buf;
+    size_t inflate_cap;
+
+    int headers_received;
     int response_complete;
-    
+    int stream_closed;
+    uint32_t close_error_code;
+
     /* Error handling */
     char *error_message;
     int grpc_status;
+    int http_status;
+
+    /* Call outcome */
+    int result;
+    uint8_t *result_message;
+    size_t result_message_len;
+    char *result_error;
+
+    /* Telemetry: phases are stamped into trace as they happen, relative to started_us */
+    long long started_us;
+    long long stall_started_us;
+    mic_grpc_call_trace trace;
+
+    /* Absolute deadline (monotonic ms) and the caller's cancellation token */
+    long long deadline_ms;
+    mic_grpc_cancel_token *cancel;
+    int stream_reset;
+} grpc_call;
+
+/* Becomes readable once cancelled, so event loops can poll for it */
+struct mic_grpc_cancel_token {
+    int cancelled;
+    int fds[2];
+};
+
+typedef struct grpc_connection {
+    SSL *ssl;
+    BIO *bio;
+    int fd;
+    int use_tls;
+    nghttp2_session *session;
+
+    /* Direction OpenSSL is blocked on, independent of what nghttp2 wants */
+    int ssl_want_read;
+    int ssl_want_write;
+
+    /* Flow control: settings for this connection's profile and current receive windows */
+    mic_grpc_profile profile;
+    mic_grpc_flow_control flow;
+    uint32_t stream_window;
+    uint32_t connection_window;
+
+    /* BDP estimation: bytes received since the outstanding PING was sent */
+    int bdp_ping_pending;
+    int bdp_ping_stale;  /* the connection went idle before the ACK was read */
+    long long bdp_ping_sent_us;
+    size_t bdp_bytes;
+
+    /* Round-trip time smoothed over PING ACKs (RFC 6298 gain), 0 until measured */
+    long long srtt_us;
+    long long keepalive_sent_us;  /* outstanding keepalive PING, 0 if none */
+    long long keepalive_ms;       /* when the last keepalive PING was acked */
+
+    /* When connection_open began, and when each setup phase finished (monotonic us) */
+    long long opened_us;
+    long long resolved_us;
+    long long connected_us;
+    long long tls_done_us;
+    int connect_fallback;  /* won by an address other than the first tried */
+
+    /* TCP connect and TLS handshake must finish by then (monotonic ms) */
+    long long setup_deadline_ms;
+
+    /* Tail of a zero-copy DATA frame the socket did not accept in one go */
+    uint8_t *out_buf;
+    size_t out_len;
+    size_t out_off;
+    size_t out_cap;
+
+    /* Pool bookkeeping: "<tls>|<profile>|<target>|<host>" */
+    char *key;
+    long long last_used_ms;
+    int reused;
+    int broken;
+    int goaway;
+    int32_t goaway_last_stream_id;
+    struct grpc_connection *next;
+
+    /* Error handling */
+    char *error_message;
 } grpc_connection;
 
+struct mic_grpc_channel {
+    char *target;
+    char *host;
+    int use_tls;
+    mic_grpc_profile profile;
+};
+
+/* Process-wide pool of idle connections, most recently used first */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static grpc_connection *pool_idle = NULL;
+static int pool_idle_count = 0;
+/* The keepalive sweep thread, guarded by pool_mutex; shutdown stops and joins it */
+static pthread_t keepalive_thread;
+static pthread_cond_t keepalive_cond = PTHREAD_COND_INITIALIZER;
+static int keepalive_running = 0;
+static int keepalive_stop = 0;
+
+/*
+ * Flow-control settings per profile. Latency keeps HTTP/2's small defaults
+ * for metadata RPCs; bulk opens large windows and frames up front for blob
+ * transfers and uploads. Both let windows grow toward max_window as measured
+ * bandwidth-delay product demands.
+ */
+static mic_grpc_flow_control flow_profiles[] = {
+    [MIC_GRPC_PROFILE_LATENCY] = {
+        .stream_window = 65535,
+        .connection_window = 1 << 20,
+        .max_frame_size = 16384,
+        .max_window = 4 << 20,
+    },
+    [MIC_GRPC_PROFILE_BULK] = {
+        .stream_window = 4 << 20,
+        .connection_window = 16 << 20,
+        .max_frame_size = 1 << 20,
+        .max_window = 64 << 20,
+    },
+};
+
+/*
+ * Encodings each server listed in grpc-accept-encoding, keyed by
+ * "<target>|<host>". Requests are only compressed with an encoding the
+ * server has advertised, so the first call to a server always goes out plain.
+ */
+typedef struct {
+    char *key;
+    unsigned accepted;
+} accepted_encodings;
+
+static pthread_mutex_t encoding_mutex = PTHREAD_MUTEX_INITIALIZER;
+static accepted_encodings encoding_cache[ENCODING_CACHE_MAX];
+static size_t encoding_cache_next = 0;
+
+/*
+ * Resolver cache keyed by "<host>:<port>". getaddrinfo reports no TTL, so
+ * entries live for DNS_CACHE_TTL_MS, and one whose addresses all refused a
+ * connection is dropped early. Addresses are stored in connect order.
+ */
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t len;
+} resolved_address;
+
+typedef struct {
+    char *key;
+    resolved_address addrs[DNS_MAX_ADDRESSES];
+    size_t count;
+    long long expires_ms;
+} resolved_host;
+
+static pthread_mutex_t dns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static resolved_host dns_cache[DNS_CACHE_MAX];
+static size_t dns_cache_next = 0;
+
+/*
+ * Process-lifetime TLS context (CA store loaded once) and a client session
+ * cache keyed like the pool, so new connections resume instead of doing a
+ * full handshake.
+ */
+typedef struct {
+    char *key;
+    SSL_SESSION *session;
+    unsigned long long stamp;
+} tls_cached_session;
+
+static pthread_once_t tls_once = PTHREAD_ONCE_INIT;
+static SSL_CTX *tls_ctx = NULL;
+static pthread_mutex_t tls_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tls_cached_session tls_sessions[TLS_SESSION_CACHE_MAX];
+static unsigned long long tls_session_stamp = 0;
+static unsigned long long tls_handshakes = 0;
+static unsigned long long tls_resumed = 0;
+
+/*
+ * Telemetry. Socket byte and frame counters are bumped atomically from the
+ * I/O paths; everything else is updated under stats_mutex as calls finish.
+ */
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mic_grpc_stats stats;
+static mic_grpc_trace_fn trace_fn = NULL;
+static void *trace_ctx = NULL;
+
 static void set_error(grpc_connection *conn, const char *msg) {
     if (conn->error_message) free(conn->error_message);
     conn->error_message = strdup(msg);
@@ -64,6 +357,33 @@ static char *dup_string(const char *s) {
     return strdup(s);
 }
 
+static long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+static long long monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000L;
+}
+
+/* Microseconds since the call started, never 0 so that 0 can mean "not reached" */
+static uint64_t call_elapsed_us(const grpc_call *call) {
+    long long elapsed = monotonic_us() - call->started_us;
+    return elapsed > 0 ? (uint64_t)elapsed : 1;
+}
+
+static void histogram_add(mic_grpc_histogram *histogram, uint64_t us) {
+    int bucket = us < 2 ? 0 : 63 - __builtin_clzll(us);
+    if (bucket >= MIC_GRPC_HISTOGRAM_BUCKETS) bucket = MIC_GRPC_HISTOGRAM_BUCKETS - 1;
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_us += us;
+    if (us > histogram->max_us) histogram->max_us = us;
+}
+
 void mic_grpc_free(void *ptr) {
     free(ptr);
 }
@@ -74,20 +394,27 @@ static ssize_t conn_send(grpc_connection *conn, const uint8_t *data, size_t len)
         int ret = SSL_write(conn->ssl, data, (int)len);
         if (ret <= 0) {
             int err = SSL_get_error(conn->ssl, ret);
-            if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+            if (err == SSL_ERROR_WANT_WRITE) {
+                conn->ssl_want_write = 1;
+                return NGHTTP2_ERR_WOULDBLOCK;
+            }
+            if (err == SSL_ERROR_WANT_READ) {
+                conn->ssl_want_read = 1;
                 return NGHTTP2_ERR_WOULDBLOCK;
             }
             return NGHTTP2_ERR_CALLBACK_FAILURE;
         }
+        __atomic_add_fetch(&stats.bytes_sent, (uint64_t)ret, __ATOMIC_RELAXED);
         return ret;
     } else {
-        ssize_t ret = write(conn->fd, data, len);
+        ssize_t ret = send(conn->fd, data, len, MSG_NOSIGNAL);
         if (ret < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 return NGHTTP2_ERR_WOULDBLOCK;
             }
             return NGHTTP2_ERR_CALLBACK_FAILURE;
         }
+        __atomic_add_fetch(&stats.bytes_sent, (uint64_t)ret, __ATOMIC_RELAXED);
         return ret;
     }
 }
@@ -97,7 +424,11 @@ static ssize_t conn_recv(grpc_connection *conn, uint8_t *data, size_t len) {
         int ret = SSL_read(conn->ssl, data, (int)len);
         if (ret <= 0) {
             int err = SSL_get_error(conn->ssl, ret);
-            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            if (err == SSL_ERROR_WANT_READ) {
+                return NGHTTP2_ERR_WOULDBLOCK;
+            }
+            if (err == SSL_ERROR_WANT_WRITE) {
+                conn->ssl_want_write = 1;
                 return NGHTTP2_ERR_WOULDBLOCK;
             }
             if (err == SSL_ERROR_ZERO_RETURN) {
@@ -105,6 +436,7 @@ static ssize_t conn_recv(grpc_connection *conn, uint8_t *data, size_t len) {
             }
             return NGHTTP2_ERR_CALLBACK_FAILURE;
         }
+        __atomic_add_fetch(&stats.bytes_received, (uint64_t)ret, __ATOMIC_RELAXED);
         return ret;
     } else {
         ssize_t ret = read(conn->fd, data, len);
@@ -117,15 +449,96 @@ static ssize_t conn_recv(grpc_connection *conn, uint8_t *data, size_t len) {
         if (ret == 0) {
             return NGHTTP2_ERR_EOF;
         }
+        __atomic_add_fetch(&stats.bytes_received, (uint64_t)ret, __ATOMIC_RELAXED);
         return ret;
     }
 }
 
+/* Write out buffered frame bytes; returns 0 when drained, 1 if the socket is full, -1 on error */
+static int flush_pending_output(grpc_connection *conn) {
+    while (conn->out_off < conn->out_len) {
+        ssize_t ret = conn_send(conn, conn->out_buf + conn->out_off, conn->out_len - conn->out_off);
+        if (ret == NGHTTP2_ERR_WOULDBLOCK) return 1;
+        if (ret < 0) return -1;
+        conn->out_off += (size_t)ret;
+    }
+    conn->out_len = 0;
+    conn->out_off = 0;
+    return 0;
+}
+
+/*
+ * Gathered write of one frame. Whatever the socket does not take right away is
+ * copied to out_buf, so the caller's buffers are free once this returns 0.
+ * Returns NGHTTP2_ERR_WOULDBLOCK only when nothing was written.
+ */
+static int conn_writev(grpc_connection *conn, const struct iovec *iov, int iovcnt) {
+    if (conn->out_len > 0) {
+        int ret = flush_pending_output(conn);
+        if (ret < 0) return NGHTTP2_ERR_CALLBACK_FAILURE;
+        if (ret > 0) return NGHTTP2_ERR_WOULDBLOCK;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+
+    size_t written = 0;
+    if (conn->use_tls) {
+        for (int i = 0; i < iovcnt; i++) {
+            ssize_t ret = conn_send(conn, iov[i].iov_base, iov[i].iov_len);
+            if (ret == NGHTTP2_ERR_WOULDBLOCK) break;
+            if (ret < 0) return NGHTTP2_ERR_CALLBACK_FAILURE;
+            written += (size_t)ret;
+        }
+    } else {
+        struct msghdr msg = {0};
+        msg.msg_iov = (struct iovec *)iov;
+        msg.msg_iovlen = (size_t)iovcnt;
+        ssize_t ret = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return NGHTTP2_ERR_CALLBACK_FAILURE;
+            ret = 0;
+        }
+        written = (size_t)ret;
+        __atomic_add_fetch(&stats.bytes_sent, (uint64_t)written, __ATOMIC_RELAXED);
+    }
+
+    if (written == 0 && total > 0) return NGHTTP2_ERR_WOULDBLOCK;
+    if (written == total) return 0;
+
+    size_t rest = total - written;
+    if (rest > conn->out_cap) {
+        uint8_t *buf = realloc(conn->out_buf, rest);
+        if (!buf) return NGHTTP2_ERR_CALLBACK_FAILURE;
+        conn->out_buf = buf;
+        conn->out_cap = rest;
+    }
+
+    size_t skip = written;
+    for (int i = 0; i < iovcnt; i++) {
+        const uint8_t *base = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        memcpy(conn->out_buf + conn->out_len, base + skip, len - skip);
+        conn->out_len += len - skip;
+        skip = 0;
+    }
+    return 0;
+}
+
 /* nghttp2 callbacks */
 static ssize_t send_callback(nghttp2_session *session, const uint8_t *data,
                              size_t length, int flags, void *user_data) {
     (void)session; (void)flags;
     grpc_connection *conn = (grpc_connection *)user_data;
+    if (conn->out_len > 0) {
+        int ret = flush_pending_output(conn);
+        if (ret < 0) return NGHTTP2_ERR_CALLBACK_FAILURE;
+        if (ret > 0) return NGHTTP2_ERR_WOULDBLOCK;
+    }
     return conn_send(conn, data, length);
 }
 
@@ -136,488 +549,3326 @@ static ssize_t recv_callback(nghttp2_session *session, uint8_t *buf,
     return conn_recv(conn, buf, length);
 }
 
+/*
+ * Bandwidth-delay product estimation, as gRPC does it: a PING goes out with
+ * the first DATA after the previous one was acked. Bytes received until the
+ * ACK approximate what one round trip can carry. When that gets close to
+ * the window, the window is what limits throughput, so it is doubled.
+ */
+static void track_bdp(grpc_connection *conn, size_t len) {
+    if (conn->bdp_ping_pending) {
+        conn->bdp_bytes += len;
+        return;
+    }
+    if (conn->stream_window >= conn->flow.max_window) return;
+
+    if (nghttp2_submit_ping(conn->session, NGHTTP2_FLAG_NONE, (const uint8_t *)BDP_PING_DATA) == 0) {
+        conn->bdp_ping_pending = 1;
+        conn->bdp_ping_sent_us = monotonic_us();
+        conn->bdp_bytes = len;
+    }
+}
+
+static void record_rtt(grpc_connection *conn, long long sample_us) {
+    if (sample_us < 1) sample_us = 1;
+    if (conn->srtt_us == 0) {
+        conn->srtt_us = sample_us;
+    } else {
+        conn->srtt_us += (sample_us - conn->srtt_us) / 8;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    histogram_add(&stats.rtt, (uint64_t)sample_us);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+static void grow_windows(grpc_connection *conn) {
+    if (!conn->bdp_ping_pending) return;
+    conn->bdp_ping_pending = 0;
+    if (conn->bdp_ping_stale) {
+        conn->bdp_ping_stale = 0;
+        return;
+    }
+    record_rtt(conn, monotonic_us() - conn->bdp_ping_sent_us);
+
+    uint64_t bdp = conn->bdp_bytes;
+    if (bdp * 3 < (uint64_t)conn->stream_window * 2) return;
+
+    uint64_t target = bdp * 2;
+    if (target > conn->flow.max_window) target = conn->flow.max_window;
+    if (target > H2_MAX_WINDOW) target = H2_MAX_WINDOW;
+    if (target <= conn->stream_window) return;
+
+    nghttp2_settings_entry setting = {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, (uint32_t)target};
+    if (nghttp2_submit_settings(conn->session, NGHTTP2_FLAG_NONE, &setting, 1) != 0) return;
+    conn->stream_window = (uint32_t)target;
+
+    /* Several streams may be running at full speed; keep the connection window ahead */
+    uint64_t connection_target = target * 4;
+    if (connection_target > H2_MAX_WINDOW) connection_target = H2_MAX_WINDOW;
+    if (connection_target > conn->connection_window &&
+        nghttp2_session_set_local_window_size(conn->session, NGHTTP2_FLAG_NONE, 0,
+                                              (int32_t)connection_target) == 0) {
+        conn->connection_window = (uint32_t)connection_target;
+    }
+}
+
 static int on_frame_recv_callback(nghttp2_session *session,
                                   const nghttp2_frame *frame, void *user_data) {
-    (void)session;
     grpc_connection *conn = (grpc_connection *)user_data;
-    
-    if (frame->hd.stream_id == conn->request_stream_id) {
-        if (frame->hd.type == NGHTTP2_HEADERS && 
-            frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
-            conn->response_complete = 1;
+
+    __atomic_add_fetch(&stats.frames_received, 1, __ATOMIC_RELAXED);
+
+    if (frame->hd.type == NGHTTP2_PING && (frame->hd.flags & NGHTTP2_FLAG_ACK) &&
+        memcmp(frame->ping.opaque_data, BDP_PING_DATA, 8) == 0) {
+        grow_windows(conn);
+        return 0;
+    }
+    if (frame->hd.type == NGHTTP2_PING && (frame->hd.flags & NGHTTP2_FLAG_ACK) &&
+        memcmp(frame->ping.opaque_data, KEEPALIVE_PING_DATA, 8) == 0) {
+        if (conn->keepalive_sent_us) {
+            record_rtt(conn, monotonic_us() - conn->keepalive_sent_us);
+            conn->keepalive_sent_us = 0;
+            conn->keepalive_ms = monotonic_ms();
         }
+        return 0;
     }
-    return 0;
-}
 
-static int on_data_chunk_recv_callback(nghttp2_session *session, uint8_t flags,
-                                       int32_t stream_id, const uint8_t *data,
-                                       size_t len, void *user_data) {
-    (void)session; (void)flags;
-    grpc_connection *conn = (grpc_connection *)user_data;
-    
-    if (stream_id != conn->request_stream_id) return 0;
-    
-    /* Grow response buffer if needed */
-    size_t needed = conn->response_len + len;
-    if (needed > conn->response_capacity) {
-        size_t new_cap = conn->response_capacity * 2;
-        if (new_cap < needed) new_cap = needed;
-        if (new_cap < 4096) new_cap = 4096;
-        uint8_t *new_buf = realloc(conn->response_data, new_cap);
-        if (!new_buf) return NGHTTP2_ERR_CALLBACK_FAILURE;
-        conn->response_data = new_buf;
-        conn->response_capacity = new_cap;
+    /* GOAWAY: stop handing this connection out; streams above last_stream_id were refused */
+    if (frame->hd.type == NGHTTP2_GOAWAY) {
+        conn->goaway = 1;
+        conn->goaway_last_stream_id = frame->goaway.last_stream_id;
+        return 0;
     }
-    
-    memcpy(conn->response_data + conn->response_len, data, len);
-    conn->response_len += len;
 
-    if (conn->response_expected_len == 0 && conn->response_len >= GRPC_HEADER_SIZE) {
-        uint32_t msg_len = (conn->response_data[1] << 24) |
-                           (conn->response_data[2] << 16) |
-                           (conn->response_data[3] << 8) |
-                           (conn->response_data[4]);
-        conn->response_expected_len = GRPC_HEADER_SIZE + msg_len;
+    grpc_call *call = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if (call) {
+        call->trace.frames_received++;
+        call->trace.bytes_received += 9 + frame->hd.length;
+        if (frame->hd.type == NGHTTP2_HEADERS) {
+            call->headers_received = 1;
+        }
+        /* The response is complete only once the server ends the stream */
+        if ((frame->hd.type == NGHTTP2_HEADERS || frame->hd.type == NGHTTP2_DATA) &&
+            (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+            call->response_complete = 1;
+            if (frame->hd.type == NGHTTP2_HEADERS) call->trace.trailers_us = call_elapsed_us(call);
+        }
     }
+    return 0;
+}
 
-    if (conn->response_expected_len > 0 && conn->response_len >= conn->response_expected_len) {
-        conn->response_complete = 1;
-    }
+static int on_frame_send_callback(nghttp2_session *session,
+                                  const nghttp2_frame *frame, void *user_data) {
+    (void)user_data;
+    __atomic_add_fetch(&stats.frames_sent, 1, __ATOMIC_RELAXED);
 
+    grpc_call *call = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if (call) {
+        call->trace.frames_sent++;
+        call->trace.bytes_sent += 9 + frame->hd.length;
+        if (frame->hd.type == NGHTTP2_HEADERS && call->trace.headers_sent_us == 0) {
+            call->trace.headers_sent_us = call_elapsed_us(call);
+        }
+    }
     return 0;
 }
 
-static int on_stream_close_callback(nghttp2_session *session, int32_t stream_id,
-                                    uint32_t error_code, void *user_data) {
-    (void)session; (void)error_code;
-    grpc_connection *conn = (grpc_connection *)user_data;
-    
-    if (stream_id == conn->request_stream_id) {
-        conn->response_complete = 1;
-    }
+static int ensure_response_capacity(grpc_call *call, size_t needed) {
+    if (needed <= call->response_capacity) return 0;
+
+    size_t new_cap = call->response_capacity * 2;
+    if (new_cap < needed) new_cap = needed;
+    if (new_cap < 4096) new_cap = 4096;
+    uint8_t *new_buf = realloc(call->response_data, new_cap);
+    if (!new_buf) return -1;
+    call->response_data = new_buf;
+    call->response_capacity = new_cap;
     return 0;
 }
 
-static int on_header_callback(nghttp2_session *session, const nghttp2_frame *frame,
-                              const uint8_t *name, size_t namelen,
-                              const uint8_t *value, size_t valuelen,
-                              uint8_t flags, void *user_data) {
-    (void)session; (void)flags;
-    grpc_connection *conn = (grpc_connection *)user_data;
-    
-    if (frame->hd.stream_id != conn->request_stream_id) return 0;
-    
-    /* Check for grpc-status header in trailers */
-    if (namelen == 11 && memcmp(name, "grpc-status", 11) == 0) {
-        conn->grpc_status = atoi((const char *)value);
-        conn->response_complete = 1;
-    } else if (namelen == 12 && memcmp(name, "grpc-message", 12) == 0) {
-        if (conn->error_message) free(conn->error_message);
-        conn->error_message = strndup((const char *)value, valuelen);
-    }
-    
+/* Grow a decompression buffer to hold needed bytes, refusing anything past MAX_DECOMPRESSED_SIZE */
+static int grow_buffer(uint8_t **buf, size_t *cap, size_t needed) {
+    if (needed <= *cap) return 0;
+    if (needed > MAX_DECOMPRESSED_SIZE) return -1;
+
+    size_t new_cap = *cap * 2;
+    if (new_cap < needed) new_cap = needed;
+    if (new_cap < 4096) new_cap = 4096;
+    if (new_cap > MAX_DECOMPRESSED_SIZE) new_cap = MAX_DECOMPRESSED_SIZE;
+    uint8_t *new_buf = realloc(*buf, new_cap);
+    if (!new_buf) return -1;
+    *buf = new_buf;
+    *cap = new_cap;
     return 0;
 }
 
-/* Data provider for request body */
-static ssize_t data_source_read_callback(nghttp2_session *session, int32_t stream_id,
-                                         uint8_t *buf, size_t length,
-                                         uint32_t *data_flags,
-                                         nghttp2_data_source *source,
-                                         void *user_data) {
-    (void)session; (void)stream_id; (void)source;
-    grpc_connection *conn = (grpc_connection *)user_data;
-    
-    size_t remaining = conn->request_len - conn->request_sent;
-    size_t to_send = remaining < length ? remaining : length;
-    
-    memcpy(buf, conn->request_data + conn->request_sent, to_send);
-    conn->request_sent += to_send;
-    
-    if (conn->request_sent >= conn->request_len) {
-        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+static const char *encoding_name(mic_grpc_compression encoding) {
+    switch (encoding) {
+    case MIC_GRPC_COMPRESS_GZIP: return "gzip";
+    case MIC_GRPC_COMPRESS_ZSTD: return "zstd";
+    default: return "identity";
     }
-    
-    return (ssize_t)to_send;
 }
 
-/* Connect to server */
-static int connect_to_server(grpc_connection *conn, const char *host, int port) {
-    struct addrinfo hints = {0}, *res, *rp;
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+static int parse_encoding(const uint8_t *value, size_t len) {
+    if (len == 8 && memcmp(value, "identity", 8) == 0) return MIC_GRPC_COMPRESS_NONE;
+    if (len == 4 && memcmp(value, "gzip", 4) == 0) return MIC_GRPC_COMPRESS_GZIP;
+    if (len == 4 && memcmp(value, "zstd", 4) == 0) return MIC_GRPC_COMPRESS_ZSTD;
+    return ENCODING_UNKNOWN;
+}
 
-    char port_str[16];
-    snprintf(port_str, sizeof(port_str), "%d", port);
+/* Bitmask (1 << encoding) of the encodings in a grpc-accept-encoding value */
+static unsigned parse_accept_encoding(const uint8_t *value, size_t len) {
+    unsigned mask = 0;
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (value[i] == ',' || value[i] == ' ')) i++;
+        size_t start = i;
+        while (i < len && value[i] != ',' && value[i] != ' ') i++;
+        int encoding = parse_encoding(value + start, i - start);
+        if (encoding > MIC_GRPC_COMPRESS_NONE) mask |= 1u << encoding;
+    }
+    return mask;
+}
 
-    int ret = getaddrinfo(host, port_str, &hints, &res);
-    if (ret != 0) {
-        set_error(conn, gai_strerror(ret));
-        return -1;
+/* The "<target>|<host>" tail of a pool key */
+static const char *server_key(const grpc_connection *conn) {
+    const char *key = conn->key;
+    for (int field = 0; key && field < 2; field++) {
+        key = strchr(key, '|');
+        if (key) key++;
     }
-    
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
-        conn->fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (conn->fd < 0) continue;
+    return key;
+}
 
-        if (connect(conn->fd, rp->ai_addr, rp->ai_addrlen) == 0) break;
+static void encoding_cache_store(const char *key, unsigned accepted) {
+    if (!key) return;
 
-        close(conn->fd);
-        conn->fd = -1;
+    pthread_mutex_lock(&encoding_mutex);
+    accepted_encodings *slot = NULL;
+    for (int i = 0; i < ENCODING_CACHE_MAX; i++) {
+        if (encoding_cache[i].key && strcmp(encoding_cache[i].key, key) == 0) {
+            slot = &encoding_cache[i];
+            break;
+        }
+    }
+    if (!slot) {
+        char *owned_key = strdup(key);
+        if (owned_key) {
+            slot = &encoding_cache[encoding_cache_next];
+            encoding_cache_next = (encoding_cache_next + 1) % ENCODING_CACHE_MAX;
+            free(slot->key);
+            slot->key = owned_key;
+        }
     }
+    if (slot) slot->accepted = accepted;
+    pthread_mutex_unlock(&encoding_mutex);
+}
 
-    freeaddrinfo(res);
+static unsigned encoding_cache_lookup(const char *key) {
+    unsigned accepted = 0;
+    if (!key) return 0;
 
-    if (conn->fd < 0) {
-        set_error(conn, "Failed to connect to server");
-        return -1;
+    pthread_mutex_lock(&encoding_mutex);
+    for (int i = 0; i < ENCODING_CACHE_MAX; i++) {
+        if (encoding_cache[i].key && strcmp(encoding_cache[i].key, key) == 0) {
+            accepted = encoding_cache[i].accepted;
+            break;
+        }
     }
+    pthread_mutex_unlock(&encoding_mutex);
+    return accepted;
+}
 
-    /* Disable Nagle's algorithm for lower latency */
-    int flag = 1;
-    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
-
-    struct timeval tv;
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+/* Pick the request encoding for a call: the one asked for, else gzip, if the server accepts it */
+static mic_grpc_compression negotiate_encoding(grpc_connection *conn, mic_grpc_compression wanted) {
+    if (wanted != MIC_GRPC_COMPRESS_GZIP && wanted != MIC_GRPC_COMPRESS_ZSTD) {
+        return MIC_GRPC_COMPRESS_NONE;
+    }
 
-    return 0;
+    unsigned accepted = encoding_cache_lookup(server_key(conn));
+    if (accepted & (1u << wanted)) return wanted;
+    if (accepted & (1u << MIC_GRPC_COMPRESS_GZIP)) return MIC_GRPC_COMPRESS_GZIP;
+    return MIC_GRPC_COMPRESS_NONE;
 }
 
-/* Setup TLS */
-static int setup_tls(grpc_connection *conn, const char *host) {
-    SSL_library_init();
-    SSL_load_error_strings();
-    
-    conn->ssl_ctx = SSL_CTX_new(TLS_client_method());
-    if (!conn->ssl_ctx) {
-        set_error(conn, "Failed to create SSL context");
-        return -1;
+/*
+ * Compress a request message into call->compress_buf. Returns the compressed
+ * length, or 0 when the message should go out as is: too small to bother, or
+ * not smaller once compressed (the buffer is sized to the input, so output
+ * that doesn't fit is exactly the case not worth sending).
+ */
+static size_t compress_message(grpc_call *call, const uint8_t *message, size_t len) {
+    if (len < COMPRESS_MIN_BYTES || len > UINT32_MAX) return 0;
+
+    if (len > call->compress_cap) {
+        uint8_t *buf = realloc(call->compress_buf, len);
+        if (!buf) return 0;
+        call->compress_buf = buf;
+        call->compress_cap = len;
     }
-    
-    /* Use system CA certificates */
-    SSL_CTX_set_default_verify_paths(conn->ssl_ctx);
-    SSL_CTX_set_verify(conn->ssl_ctx, SSL_VERIFY_PEER, NULL);
-    
-    /* Enable ALPN for HTTP/2 */
-    unsigned char alpn[] = "\x02h2";
-    SSL_CTX_set_alpn_protos(conn->ssl_ctx, alpn, sizeof(alpn) - 1);
-    
-    conn->ssl = SSL_new(conn->ssl_ctx);
-    if (!conn->ssl) {
-        set_error(conn, "Failed to create SSL object");
-        return -1;
+
+    if (call->send_encoding == MIC_GRPC_COMPRESS_ZSTD) {
+        if (!call->zstd_cctx && !(call->zstd_cctx = ZSTD_createCCtx())) return 0;
+        size_t out = ZSTD_compressCCtx(call->zstd_cctx, call->compress_buf, len,
+                                       message, len, ZSTD_LEVEL);
+        return ZSTD_isError(out) || out >= len ? 0 : out;
     }
-    
-    /* Set SNI hostname */
-    SSL_set_tlsext_host_name(conn->ssl, host);
-    
-    /* Connect SSL to socket */
-    SSL_set_fd(conn->ssl, conn->fd);
-    
-    int ret = SSL_connect(conn->ssl);
-    if (ret != 1) {
-        char buf[256];
-        ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
-        set_error(conn, buf);
-        return -1;
+
+    if (!call->deflate) {
+        z_stream *zs = calloc(1, sizeof(*zs));
+        if (!zs) return 0;
+        /* windowBits 15 + 16 selects the gzip wrapper the "gzip" encoding names */
+        if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(zs);
+            return 0;
+        }
+        call->deflate = zs;
+    } else if (deflateReset(call->deflate) != Z_OK) {
+        return 0;
     }
-    
-    /* Verify ALPN negotiated HTTP/2 */
-    const unsigned char *alpn_out;
-    unsigned int alpn_len;
-    SSL_get0_alpn_selected(conn->ssl, &alpn_out, &alpn_len);
-    if (alpn_len != 2 || memcmp(alpn_out, "h2", 2) != 0) {
-        set_error(conn, "Server did not negotiate HTTP/2");
-        return -1;
+
+    z_stream *zs = call->deflate;
+    zs->next_in = (Bytef *)message;
+    zs->avail_in = (uInt)len;
+    zs->next_out = call->compress_buf;
+    zs->avail_out = (uInt)len;
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END) return 0;
+    return zs->total_out < len ? zs->total_out : 0;
+}
+
+/*
+ * Decompress one response message into *buf, growing it (capacity in *cap)
+ * as needed. Returns the decompressed length, or -1 if the message is
+ * corrupt, too large, or in an encoding we don't support.
+ */
+static ssize_t decompress_message(int encoding, const uint8_t *data, size_t len,
+                                  uint8_t **buf, size_t *cap) {
+    size_t out = 0;
+
+    if (encoding == MIC_GRPC_COMPRESS_GZIP) {
+        if (len > UINT32_MAX) return -1;
+        if (grow_buffer(buf, cap, len < MAX_DECOMPRESSED_SIZE / 4 ? len * 4 : MAX_DECOMPRESSED_SIZE) != 0) {
+            return -1;
+        }
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        /* windowBits 15 + 32 accepts both gzip and zlib headers */
+        if (inflateInit2(&zs, 15 + 32) != Z_OK) return -1;
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)len;
+
+        int ret = Z_MEM_ERROR;
+        do {
+            if (out == *cap && grow_buffer(buf, cap, out + 1) != 0) break;
+            size_t avail = *cap - out;
+            if (avail > UINT32_MAX) avail = UINT32_MAX;
+            zs.next_out = *buf + out;
+            zs.avail_out = (uInt)avail;
+            ret = inflate(&zs, Z_NO_FLUSH);
+            out += avail - zs.avail_out;
+        } while (ret == Z_OK);
+
+        inflateEnd(&zs);
+        return ret == Z_STREAM_END ? (ssize_t)out : -1;
     }
-    
-    return 0;
+
+    if (encoding == MIC_GRPC_COMPRESS_ZSTD) {
+        unsigned long long content_size = ZSTD_getFrameContentSize(data, len);
+        size_t initial = len < MAX_DECOMPRESSED_SIZE / 4 ? len * 4 : MAX_DECOMPRESSED_SIZE;
+        if (content_size == ZSTD_CONTENTSIZE_ERROR) return -1;
+        if (content_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+            if (content_size > MAX_DECOMPRESSED_SIZE) return -1;
+            initial = (size_t)content_size;
+        }
+        if (grow_buffer(buf, cap, initial) != 0) return -1;
+
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        if (!dctx) return -1;
+        ZSTD_inBuffer in = { data, len, 0 };
+        int ok = 0;
+        for (;;) {
+            if (out == *cap && grow_buffer(buf, cap, out + 1) != 0) break;
+            ZSTD_outBuffer dst = { *buf + out, *cap - out, 0 };
+            size_t ret = ZSTD_decompressStream(dctx, &dst, &in);
+            if (ZSTD_isError(ret)) break;
+            out += dst.pos;
+            if (ret == 0) {
+                ok = 1;
+                break;
+            }
+            /* Input used up with room left over: the frame is truncated */
+            if (in.pos == in.size && dst.pos < dst.size) break;
+        }
+        ZSTD_freeDCtx(dctx);
+        return ok ? (ssize_t)out : -1;
+    }
+
+    return -1;
 }
 
-/* Setup nghttp2 session */
-static int setup_http2(grpc_connection *conn) {
-    nghttp2_session_callbacks *callbacks;
-    nghttp2_session_callbacks_new(&callbacks);
-    
-    nghttp2_session_callbacks_set_send_callback(callbacks, send_callback);
-    nghttp2_session_callbacks_set_recv_callback(callbacks, recv_callback);
-    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, on_frame_recv_callback);
-    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, on_data_chunk_recv_callback);
-    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, on_stream_close_callback);
-    nghttp2_session_callbacks_set_on_header_callback(callbacks, on_header_callback);
-    
-    int ret = nghttp2_session_client_new(&conn->session, callbacks, conn);
-    nghttp2_session_callbacks_del(callbacks);
-    
+/*
+ * Split DATA into gRPC messages for a streaming call. A message that arrives
+ * whole inside one chunk is passed to the sink straight from nghttp2's buffer;
+ * only messages spanning chunks are assembled in response_data, which is
+ * reused, so memory is bounded by the largest single message.
+ */
+static int deliver_stream_data(grpc_call *call, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        if (call->frame_header_len < GRPC_HEADER_SIZE) {
+            size_t take = GRPC_HEADER_SIZE - call->frame_header_len;
+            if (take > len) take = len;
+            memcpy(call->frame_header + call->frame_header_len, data, take);
+            call->frame_header_len += take;
+            data += take;
+            len -= take;
+            if (call->frame_header_len < GRPC_HEADER_SIZE) break;
+
+            call->frame_len = ((size_t)call->frame_header[1] << 24) |
+                              ((size_t)call->frame_header[2] << 16) |
+                              ((size_t)call->frame_header[3] << 8) |
+                              (size_t)call->frame_header[4];
+            call->response_len = 0;
+        }
+
+        size_t needed = call->frame_len - call->response_len;
+        size_t take = needed < len ? needed : len;
+        const uint8_t *message = NULL;
+
+        if (call->response_len == 0 && take == needed) {
+            message = data;
+        } else {
+            if (ensure_response_capacity(call, call->frame_len) != 0) return -1;
+            memcpy(call->response_data + call->response_len, data, take);
+            call->response_len += take;
+            if (call->response_len == call->frame_len) message = call->response_data;
+        }
+        data += take;
+        len -= take;
+
+        if (message) {
+            size_t message_len = call->frame_len;
+            call->frame_header_len = 0;
+            call->response_len = 0;
+            if (call->frame_header[0] & 1) {
+                ssize_t n = decompress_message(call->response_encoding, message, message_len,
+                                               &call->inflate_buf, &call->inflate_cap);
+                if (n < 0) {
+                    call->decode_failed = 1;
+                    return -1;
+                }
+                message = call->inflate_buf;
+                message_len = (size_t)n;
+            }
+            if (call->on_message(call->on_message_ctx, message, message_len) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Unary DATA for a call with an allocator. Once the length prefix is in, the
+ * caller's buffer is requested at exactly that size and the message goes
+ * into it as it arrives. A compressed message is gathered in response_data
+ * instead and decoded at the end, since its size is only known then. Bytes
+ * after the first message are ignored, as parse_grpc_response does.
+ */
+static int deliver_unary_into(grpc_call *call, const uint8_t *data, size_t len) {
+    while (len > 0 && !call->into_done) {
+        if (call->frame_header_len < GRPC_HEADER_SIZE) {
+            size_t take = GRPC_HEADER_SIZE - call->frame_header_len;
+            if (take > len) take = len;
+            memcpy(call->frame_header + call->frame_header_len, data, take);
+            call->frame_header_len += take;
+            data += take;
+            len -= take;
+            if (call->frame_header_len < GRPC_HEADER_SIZE) break;
+
+            call->frame_len = ((size_t)call->frame_header[1] << 24) |
+                              ((size_t)call->frame_header[2] << 16) |
+                              ((size_t)call->frame_header[3] << 8) |
+                              (size_t)call->frame_header[4];
+            call->response_len = 0;
+            if (call->frame_header[0] & 1) {
+                if (ensure_response_capacity(call, call->frame_len) != 0) return -1;
+            } else {
+                call->into = call->alloc(call->alloc_ctx, call->frame_len);
+                if (!call->into && call->frame_len > 0) {
+                    call->alloc_failed = 1;
+                    return -1;
+                }
+                call->into_len = call->frame_len;
+            }
+        }
+
+        size_t take = call->frame_len - call->response_len;
+        if (take > len) take = len;
+        uint8_t *dst = (call->frame_header[0] & 1) ? call->response_data : call->into;
+        if (take > 0) memcpy(dst + call->response_len, data, take);
+        call->response_len += take;
+        data += take;
+        len -= take;
+        if (call->response_len == call->frame_len) call->into_done = 1;
+    }
+    return 0;
+}
+
+static int on_data_chunk_recv_callback(nghttp2_session *session, uint8_t flags,
+                                       int32_t stream_id, const uint8_t *data,
+                                       size_t len, void *user_data) {
+    (void)flags;
+    grpc_connection *conn = (grpc_connection *)user_data;
+    grpc_call *call = nghttp2_session_get_stream_user_data(session, stream_id);
+
+    track_bdp(conn, len);
+
+    if (!call) return 0;
+    if (call->trace.first_byte_us == 0) call->trace.first_byte_us = call_elapsed_us(call);
+    if (call->sink_failed) return 0;
+
+    if (call->on_message) {
+        if (deliver_stream_data(call, data, len) != 0) {
+            /* Receiver gave up; stop the server from sending the rest */
+            call->sink_failed = 1;
+            nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_CANCEL);
+        }
+        return 0;
+    }
+
+    if (call->alloc) {
+        if (deliver_unary_into(call, data, len) != 0) {
+            call->sink_failed = 1;
+            nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_CANCEL);
+        }
+        return 0;
+    }
+
+    /* Grow response buffer if needed */
+    if (ensure_response_capacity(call, call->response_len + len) != 0) {
+        return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+
+    memcpy(call->response_data + call->response_len, data, len);
+    call->response_len += len;
+
+    return 0;
+}
+
+static int on_stream_close_callback(nghttp2_session *session, int32_t stream_id,
+                                    uint32_t error_code, void *user_data) {
+    (void)user_data;
+    grpc_call *call = nghttp2_session_get_stream_user_data(session, stream_id);
+
+    if (call) {
+        call->stream_closed = 1;
+        call->close_error_code = error_code;
+        call->response_complete = 1;
+    }
+    return 0;
+}
+
+static int on_header_callback(nghttp2_session *session, const nghttp2_frame *frame,
+                              const uint8_t *name, size_t namelen,
+                              const uint8_t *value, size_t valuelen,
+                              uint8_t flags, void *user_data) {
+    (void)flags;
+    grpc_connection *conn = (grpc_connection *)user_data;
+    grpc_call *call = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+
+    if (!call) return 0;
+
+    /* Check for grpc-status header in trailers */
+    if (namelen == 7 && memcmp(name, ":status", 7) == 0) {
+        call->http_status = atoi((const char *)value);
+    } else if (namelen == 11 && memcmp(name, "grpc-status", 11) == 0) {
+        call->grpc_status = atoi((const char *)value);
+    } else if (namelen == 12 && memcmp(name, "grpc-message", 12) == 0) {
+        if (call->error_message) free(call->error_message);
+        call->error_message = strndup((const char *)value, valuelen);
+    } else if (namelen == 13 && memcmp(name, "grpc-encoding", 13) == 0) {
+        call->response_encoding = parse_encoding(value, valuelen);
+    } else if (namelen == 20 && memcmp(name, "grpc-accept-encoding", 20) == 0) {
+        encoding_cache_store(server_key(conn), parse_accept_encoding(value, valuelen));
+    }
+
+    return 0;
+}
+
+/* Load the next request message; returns 1 if there is one, 0 at end of stream, -1 on error */
+static int next_request_message(grpc_call *call) {
+    const uint8_t *message = NULL;
+    size_t message_len = 0;
+
+    if (call->producer) {
+        call->producer_started = 1;
+        int ret = call->producer(call->producer_ctx, &message, &message_len);
+        if (ret < 0) return -1;
+        if (ret == 0) {
+            call->send_done = 1;
+            return 0;
+        }
+    } else {
+        if (call->single_message_taken) {
+            call->send_done = 1;
+            return 0;
+        }
+        call->single_message_taken = 1;
+        message = call->message;
+        message_len = call->message_len;
+    }
+
+    size_t compressed_len = call->send_encoding != MIC_GRPC_COMPRESS_NONE
+        ? compress_message(call, message, message_len)
+        : 0;
+    if (compressed_len > 0) {
+        message = call->compress_buf;
+        message_len = compressed_len;
+    }
+
+    /* gRPC header: compression flag + 4-byte big-endian length */
+    call->send_prefix[0] = compressed_len > 0 ? 1 : 0;
+    call->send_prefix[1] = (message_len >> 24) & 0xFF;
+    call->send_prefix[2] = (message_len >> 16) & 0xFF;
+    call->send_prefix[3] = (message_len >> 8) & 0xFF;
+    call->send_prefix[4] = message_len & 0xFF;
+    call->send_message = message;
+    call->send_message_len = message_len;
+    call->send_offset = 0;
+    call->send_has_message = 1;
+    return 1;
+}
+
+/* Data provider for request body: sizes each DATA frame, send_data_callback writes it */
+static ssize_t data_source_read_callback(nghttp2_session *session, int32_t stream_id,
+                                         uint8_t *buf, size_t length,
+                                         uint32_t *data_flags,
+                                         nghttp2_data_source *source,
+                                         void *user_data) {
+    (void)session; (void)stream_id; (void)buf; (void)user_data;
+    grpc_call *call = (grpc_call *)source->ptr;
+
+    if (!call->send_has_message && !call->send_done) {
+        if (next_request_message(call) < 0) {
+            call->producer_failed = 1;
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+    }
+
+    if (!call->send_has_message) {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        return 0;
+    }
+
+    size_t remaining = GRPC_HEADER_SIZE + call->send_message_len - call->send_offset;
+    size_t to_send = remaining < length ? remaining : length;
+
+    *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+
+    /* A unary request ends with its only message; no trailing empty frame needed */
+    if (to_send == remaining && !call->producer) {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+
+    return (ssize_t)to_send;
+}
+
+static int send_data_callback(nghttp2_session *session, nghttp2_frame *frame,
+                              const uint8_t *framehd, size_t length,
+                              nghttp2_data_source *source, void *user_data) {
+    grpc_connection *conn = (grpc_connection *)user_data;
+    grpc_call *call = (grpc_call *)source->ptr;
+
+    struct iovec iov[3];
+    int iovcnt = 0;
+    iov[iovcnt].iov_base = (void *)framehd;
+    iov[iovcnt].iov_len = 9;
+    iovcnt++;
+
+    size_t offset = call->send_offset;
+    size_t left = length;
+    if (offset < GRPC_HEADER_SIZE && left > 0) {
+        size_t take = GRPC_HEADER_SIZE - offset;
+        if (take > left) take = left;
+        iov[iovcnt].iov_base = call->send_prefix + offset;
+        iov[iovcnt].iov_len = take;
+        iovcnt++;
+        offset += take;
+        left -= take;
+    }
+    if (left > 0) {
+        iov[iovcnt].iov_base = (void *)(call->send_message + (offset - GRPC_HEADER_SIZE));
+        iov[iovcnt].iov_len = left;
+        iovcnt++;
+    }
+
+    int ret = conn_writev(conn, iov, iovcnt);
+    if (ret != 0) return ret;
+
+    if (call->stall_started_us) {
+        call->trace.stall_us += (uint64_t)(monotonic_us() - call->stall_started_us);
+        call->stall_started_us = 0;
+    }
+
+    call->send_offset += length;
+    if (call->send_offset == GRPC_HEADER_SIZE + call->send_message_len) {
+        call->send_has_message = 0;
+    }
+
+    /*
+     * nghttp2 charges the frame to the windows after this returns. If it uses
+     * up what is left while there is more to send, the stream now waits for a
+     * WINDOW_UPDATE.
+     */
+    if ((call->send_has_message || (call->producer && !call->send_done)) &&
+        (nghttp2_session_get_stream_remote_window_size(session, frame->hd.stream_id) <= (int32_t)length ||
+         nghttp2_session_get_remote_window_size(session) <= (int32_t)length)) {
+        call->trace.window_stalls++;
+        call->stall_started_us = monotonic_us();
+    }
+    return 0;
+}
+
+/* Wait until fd is ready for events; returns poll's revents, 0 on timeout, -1 on error */
+static int wait_fd(int fd, short events, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = events, .revents = 0 };
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    if (ret <= 0) return ret;
+    return pfd.revents;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* Copy the cached addresses for key into addrs; returns how many (0 if absent or expired) */
+static size_t dns_cache_lookup(const char *key, resolved_address *addrs) {
+    size_t count = 0;
+    long long now = monotonic_ms();
+
+    pthread_mutex_lock(&dns_mutex);
+    for (int i = 0; i < DNS_CACHE_MAX; i++) {
+        resolved_host *entry = &dns_cache[i];
+        if (entry->key && strcmp(entry->key, key) == 0) {
+            if (entry->expires_ms > now) {
+                count = entry->count;
+                memcpy(addrs, entry->addrs, count * sizeof(resolved_address));
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dns_mutex);
+    return count;
+}
+
+static void dns_cache_store(const char *key, const resolved_address *addrs, size_t count) {
+    pthread_mutex_lock(&dns_mutex);
+    resolved_host *slot = NULL;
+    for (int i = 0; i < DNS_CACHE_MAX; i++) {
+        if (dns_cache[i].key && strcmp(dns_cache[i].key, key) == 0) {
+            slot = &dns_cache[i];
+            break;
+        }
+    }
+    if (!slot) {
+        char *owned_key = strdup(key);
+        if (owned_key) {
+            slot = &dns_cache[dns_cache_next];
+            dns_cache_next = (dns_cache_next + 1) % DNS_CACHE_MAX;
+            free(slot->key);
+            slot->key = owned_key;
+        }
+    }
+    if (slot) {
+        memcpy(slot->addrs, addrs, count * sizeof(resolved_address));
+        slot->count = count;
+        slot->expires_ms = monotonic_ms() + DNS_CACHE_TTL_MS;
+    }
+    pthread_mutex_unlock(&dns_mutex);
+}
+
+static void dns_cache_forget(const char *key) {
+    pthread_mutex_lock(&dns_mutex);
+    for (int i = 0; i < DNS_CACHE_MAX; i++) {
+        if (dns_cache[i].key && strcmp(dns_cache[i].key, key) == 0) {
+            dns_cache[i].expires_ms = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dns_mutex);
+}
+
+/*
+ * Resolve host:port into addrs, from the cache when possible. Addresses are
+ * interleaved by family, IPv6 first, so a broken family costs one attempt
+ * delay rather than a timeout per address. Returns the count, 0 on failure.
+ */
+static size_t resolve_host(grpc_connection *conn, const char *key, const char *host, int port,
+                           resolved_address *addrs) {
+    size_t count = dns_cache_lookup(key, addrs);
+    if (count > 0) {
+        pthread_mutex_lock(&stats_mutex);
+        stats.dns_cache_hits++;
+        pthread_mutex_unlock(&stats_mutex);
+        return count;
+    }
+
+    struct addrinfo hints = {0}, *res, *rp;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    int ret = getaddrinfo(host, port_str, &hints, &res);
+    pthread_mutex_lock(&stats_mutex);
+    stats.dns_lookups++;
+    pthread_mutex_unlock(&stats_mutex);
     if (ret != 0) {
-        set_error(conn, "Failed to create HTTP/2 session");
+        set_error(conn, gai_strerror(ret));
+        return 0;
+    }
+
+    /* Split by family, keeping the resolver's (RFC 6724) order within each */
+    resolved_address v6[DNS_MAX_ADDRESSES], v4[DNS_MAX_ADDRESSES];
+    size_t v6_count = 0, v4_count = 0;
+    for (rp = res; rp != NULL; rp = rp->ai_next) {
+        if (rp->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+        resolved_address *dst = NULL;
+        if (rp->ai_family == AF_INET6 && v6_count < DNS_MAX_ADDRESSES) {
+            dst = &v6[v6_count++];
+        } else if (rp->ai_family == AF_INET && v4_count < DNS_MAX_ADDRESSES) {
+            dst = &v4[v4_count++];
+        }
+        if (!dst) continue;
+        memcpy(&dst->addr, rp->ai_addr, rp->ai_addrlen);
+        dst->len = (socklen_t)rp->ai_addrlen;
+    }
+    freeaddrinfo(res);
+
+    size_t i6 = 0, i4 = 0;
+    while (count < DNS_MAX_ADDRESSES && (i6 < v6_count || i4 < v4_count)) {
+        if (i6 < v6_count) addrs[count++] = v6[i6++];
+        if (count < DNS_MAX_ADDRESSES && i4 < v4_count) addrs[count++] = v4[i4++];
+    }
+    if (count == 0) {
+        set_error(conn, "No usable address for server");
+        return 0;
+    }
+
+    dns_cache_store(key, addrs, count);
+    return count;
+}
+
+/*
+ * Happy Eyeballs (RFC 8305): start a non-blocking connect to each address in
+ * turn, giving every attempt CONNECT_ATTEMPT_DELAY_MS (or until it fails)
+ * before the next one joins, and keep the first socket that connects. Returns
+ * that socket with *winner_out set to its address index, or -1 by deadline_ms.
+ */
+static int connect_racing(const resolved_address *addrs, size_t count, long long deadline_ms,
+                          size_t *winner_out) {
+    struct pollfd attempts[DNS_MAX_ADDRESSES];
+    size_t attempt_addr[DNS_MAX_ADDRESSES];
+    size_t active = 0;
+    size_t next = 0;
+    long long next_attempt_ms = 0;
+    int winner = -1;
+
+    while (winner < 0) {
+        long long now = monotonic_ms();
+        if (now >= deadline_ms) break;
+
+        if (next < count && (active == 0 || now >= next_attempt_ms)) {
+            size_t index = next++;
+            const resolved_address *addr = &addrs[index];
+            int fd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+            if (fd < 0) continue;
+            if (set_nonblocking(fd) != 0) {
+                close(fd);
+                continue;
+            }
+            if (connect(fd, (const struct sockaddr *)&addr->addr, addr->len) == 0) {
+                winner = fd;
+                *winner_out = index;
+                break;
+            }
+            if (errno != EINPROGRESS) {
+                close(fd);
+                continue;
+            }
+            attempts[active] = (struct pollfd){ .fd = fd, .events = POLLOUT, .revents = 0 };
+            attempt_addr[active] = index;
+            active++;
+            next_attempt_ms = now + CONNECT_ATTEMPT_DELAY_MS;
+            continue;
+        }
+        if (active == 0) break;
+
+        long long wait = deadline_ms - now;
+        if (next < count && next_attempt_ms - now < wait) wait = next_attempt_ms - now;
+        int ready = poll(attempts, active, (int)wait);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (size_t i = 0; i < active && winner < 0;) {
+            if (!attempts[i].revents) {
+                i++;
+                continue;
+            }
+            int so_error = 0;
+            socklen_t len = sizeof(so_error);
+            int fd = attempts[i].fd;
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) == 0 && so_error == 0) {
+                winner = fd;
+                *winner_out = attempt_addr[i];
+            } else {
+                close(fd);
+                /* A refused address hands its turn to the next one straight away */
+                next_attempt_ms = now;
+            }
+            active--;
+            attempts[i] = attempts[active];
+            attempt_addr[i] = attempt_addr[active];
+        }
+    }
+
+    for (size_t i = 0; i < active; i++) close(attempts[i].fd);
+    return winner;
+}
+
+/* Connect to server */
+static int connect_to_server(grpc_connection *conn, const char *host, int port) {
+    char key[NI_MAXHOST + 16];
+    snprintf(key, sizeof(key), "%s:%d", host, port);
+
+    resolved_address addrs[DNS_MAX_ADDRESSES];
+    size_t count = resolve_host(conn, key, host, port, addrs);
+    if (count == 0) return -1;
+    conn->resolved_us = monotonic_us();
+
+    size_t winner = 0;
+    conn->fd = connect_racing(addrs, count, conn->setup_deadline_ms, &winner);
+    if (conn->fd < 0) {
+        /* The name may have moved; resolve it afresh next time */
+        dns_cache_forget(key);
+        set_error(conn, "Failed to connect to server");
+        return -1;
+    }
+    conn->connected_us = monotonic_us();
+    conn->connect_fallback = winner != 0;
+
+    /* Disable Nagle's algorithm for lower latency */
+    int flag = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    /* Pooled connections sit idle between calls; let the kernel notice dead peers */
+    setsockopt(conn->fd, SOL_SOCKET, SO_KEEPALIVE, &flag, sizeof(flag));
+
+    return 0;
+}
+
+/* Store a session ticket for key; takes ownership of the session reference */
+static void tls_session_put(const char *key, SSL_SESSION *session) {
+    char *owned_key = strdup(key);
+    if (!owned_key) {
+        SSL_SESSION_free(session);
+        return;
+    }
+
+    pthread_mutex_lock(&tls_mutex);
+    tls_cached_session *slot = NULL;
+    for (int i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+        tls_cached_session *entry = &tls_sessions[i];
+        if (entry->key && strcmp(entry->key, key) == 0) {
+            slot = entry;
+            break;
+        }
+        /* Otherwise prefer an empty slot, then the least recently stored one */
+        if (!slot || (slot->key && (!entry->key || entry->stamp < slot->stamp))) {
+            slot = entry;
+        }
+    }
+
+    char *old_key = slot->key;
+    SSL_SESSION *old_session = slot->session;
+    slot->key = owned_key;
+    slot->session = session;
+    slot->stamp = ++tls_session_stamp;
+    pthread_mutex_unlock(&tls_mutex);
+
+    free(old_key);
+    if (old_session) SSL_SESSION_free(old_session);
+}
+
+/* Remove and return the cached session for key; TLS 1.3 tickets are single-use */
+static SSL_SESSION *tls_session_take(const char *key) {
+    SSL_SESSION *session = NULL;
+
+    pthread_mutex_lock(&tls_mutex);
+    for (int i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+        tls_cached_session *entry = &tls_sessions[i];
+        if (entry->key && entry->session && strcmp(entry->key, key) == 0) {
+            session = entry->session;
+            entry->session = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&tls_mutex);
+
+    return session;
+}
+
+static int tls_new_session_callback(SSL *ssl, SSL_SESSION *session) {
+    grpc_connection *conn = SSL_get_app_data(ssl);
+    if (!conn || !conn->key || !SSL_SESSION_is_resumable(session)) return 0;
+    tls_session_put(conn->key, session);
+    return 1;
+}
+
+static void tls_init(void) {
+    SSL_library_init();
+    SSL_load_error_strings();
+
+    tls_ctx = SSL_CTX_new(TLS_client_method());
+    if (!tls_ctx) return;
+
+    /* Use system CA certificates */
+    SSL_CTX_set_default_verify_paths(tls_ctx);
+    SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_PEER, NULL);
+
+    /* Enable ALPN for HTTP/2 */
+    unsigned char alpn[] = "\x02h2";
+    SSL_CTX_set_alpn_protos(tls_ctx, alpn, sizeof(alpn) - 1);
+
+    /* Sessions are cached by connection key in tls_sessions, not by OpenSSL */
+    SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(tls_ctx, tls_new_session_callback);
+}
+
+/* Setup TLS */
+static int setup_tls(grpc_connection *conn, const char *host) {
+    pthread_once(&tls_once, tls_init);
+    if (!tls_ctx) {
+        set_error(conn, "Failed to create SSL context");
+        return -1;
+    }
+
+    conn->ssl = SSL_new(tls_ctx);
+    if (!conn->ssl) {
+        set_error(conn, "Failed to create SSL object");
         return -1;
     }
-    
-    /* Send HTTP/2 client connection preface and SETTINGS */
-    nghttp2_settings_entry settings[] = {
-        {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100},
-        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, 65535}
-    };
-    
-    ret = nghttp2_submit_settings(conn->session, NGHTTP2_FLAG_NONE, settings, 2);
-    if (ret != 0) {
-        set_error(conn, "Failed to submit SETTINGS");
-        return -1;
+    SSL_set_app_data(conn->ssl, conn);
+
+    SSL_SESSION *cached = tls_session_take(conn->key);
+    if (cached) {
+        SSL_set_session(conn->ssl, cached);
+        SSL_SESSION_free(cached);
+    }
+
+    /* Set SNI hostname */
+    SSL_set_tlsext_host_name(conn->ssl, host);
+
+    /* Connect SSL to socket */
+    SSL_set_fd(conn->ssl, conn->fd);
+
+    /* Retried writes may come from out_buf rather than the original buffer */
+    SSL_set_mode(conn->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    /* The socket is non-blocking; drive the handshake with poll */
+    long long deadline = conn->setup_deadline_ms;
+    for (;;) {
+        int ret = SSL_connect(conn->ssl);
+        if (ret == 1) break;
+
+        int err = SSL_get_error(conn->ssl, ret);
+        short events;
+        if (err == SSL_ERROR_WANT_READ) {
+            events = POLLIN;
+        } else if (err == SSL_ERROR_WANT_WRITE) {
+            events = POLLOUT;
+        } else {
+            char buf[256];
+            ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+            set_error(conn, buf);
+            return -1;
+        }
+
+        long long remaining = deadline - monotonic_ms();
+        if (remaining <= 0 || wait_fd(conn->fd, events, (int)remaining) <= 0) {
+            set_error(conn, "TLS handshake timed out");
+            return -1;
+        }
+    }
+
+    /* Verify ALPN negotiated HTTP/2 */
+    const unsigned char *alpn_out;
+    unsigned int alpn_len;
+    SSL_get0_alpn_selected(conn->ssl, &alpn_out, &alpn_len);
+    if (alpn_len != 2 || memcmp(alpn_out, "h2", 2) != 0) {
+        set_error(conn, "Server did not negotiate HTTP/2");
+        return -1;
+    }
+
+    conn->tls_done_us = monotonic_us();
+    __atomic_add_fetch(&tls_handshakes, 1, __ATOMIC_RELAXED);
+    if (SSL_session_reused(conn->ssl)) {
+        __atomic_add_fetch(&tls_resumed, 1, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+/* Let DATA frames grow past 16 KiB up to what the peer and our profile allow */
+static ssize_t data_source_read_length_callback(nghttp2_session *session, uint8_t frame_type,
+                                                int32_t stream_id, int32_t session_remote_window_size,
+                                                int32_t stream_remote_window_size,
+                                                uint32_t remote_max_frame_size, void *user_data) {
+    (void)session; (void)frame_type; (void)stream_id;
+    grpc_connection *conn = (grpc_connection *)user_data;
+
+    ssize_t len = remote_max_frame_size;
+    if (conn->flow.max_frame_size < remote_max_frame_size) len = conn->flow.max_frame_size;
+    if (session_remote_window_size < len) len = session_remote_window_size;
+    if (stream_remote_window_size < len) len = stream_remote_window_size;
+    return len > 0 ? len : 1;
+}
+
+/* Setup nghttp2 session */
+static int setup_http2(grpc_connection *conn) {
+    nghttp2_session_callbacks *callbacks;
+    nghttp2_session_callbacks_new(&callbacks);
+
+    nghttp2_session_callbacks_set_send_callback(callbacks, send_callback);
+    nghttp2_session_callbacks_set_send_data_callback(callbacks, send_data_callback);
+    nghttp2_session_callbacks_set_data_source_read_length_callback(callbacks, data_source_read_length_callback);
+    nghttp2_session_callbacks_set_recv_callback(callbacks, recv_callback);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, on_frame_recv_callback);
+    nghttp2_session_callbacks_set_on_frame_send_callback(callbacks, on_frame_send_callback);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, on_data_chunk_recv_callback);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, on_stream_close_callback);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, on_header_callback);
+
+    int ret = nghttp2_session_client_new(&conn->session, callbacks, conn);
+    nghttp2_session_callbacks_del(callbacks);
+
+    if (ret != 0) {
+        set_error(conn, "Failed to create HTTP/2 session");
+        return -1;
+    }
+
+    /* Send HTTP/2 client connection preface and SETTINGS */
+    nghttp2_settings_entry settings[] = {
+        {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100},
+        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, conn->flow.stream_window},
+        {NGHTTP2_SETTINGS_MAX_FRAME_SIZE, conn->flow.max_frame_size}
+    };
+
+    ret = nghttp2_submit_settings(conn->session, NGHTTP2_FLAG_NONE, settings, 3);
+    if (ret != 0) {
+        set_error(conn, "Failed to submit SETTINGS");
+        return -1;
+    }
+    conn->stream_window = conn->flow.stream_window;
+
+    /* The connection window starts at 65535 regardless of SETTINGS; open it up front */
+    if (conn->flow.connection_window > 65535) {
+        ret = nghttp2_session_set_local_window_size(conn->session, NGHTTP2_FLAG_NONE, 0,
+                                                    (int32_t)conn->flow.connection_window);
+        if (ret != 0) {
+            set_error(conn, "Failed to set connection window");
+            return -1;
+        }
+    }
+    conn->connection_window = conn->flow.connection_window;
+
+    return 0;
+}
+
+/* Tear down a connection, telling the server we are going away when possible */
+static void connection_free(grpc_connection *conn) {
+    if (!conn) return;
+    if (conn->session) {
+        if (!conn->broken) {
+            nghttp2_session_terminate_session(conn->session, NGHTTP2_NO_ERROR);
+            nghttp2_session_send(conn->session);
+        }
+        nghttp2_session_del(conn->session);
+    }
+    free(conn->out_buf);
+    if (conn->ssl) {
+        /*
+         * GOAWAY already closed the conversation cleanly. Mark TLS as shut down
+         * too (without writing to a possibly closed socket), or OpenSSL treats
+         * the session as bad and it can no longer be resumed.
+         */
+        if (!conn->broken) SSL_set_shutdown(conn->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        SSL_free(conn->ssl);
+    }
+    if (conn->fd >= 0) close(conn->fd);
+    if (conn->error_message) free(conn->error_message);
+    free(conn->key);
+    free(conn);
+}
+
+static char *connection_key(const char *target, const char *host, int use_tls,
+                            mic_grpc_profile profile) {
+    size_t len = strlen(target) + strlen(host) + 16;
+    char *key = malloc(len);
+    if (!key) return NULL;
+    snprintf(key, len, "%d|%d|%s|%s", use_tls ? 1 : 0, (int)profile, target, host);
+    return key;
+}
+
+/* Open a fresh connection: TCP connect, optional TLS handshake, HTTP/2 preface */
+static grpc_connection *connection_open(const char *target, int use_tls,
+                                        mic_grpc_profile profile, long long deadline_ms,
+                                        char *key, char **error_out) {
+    grpc_connection *conn = calloc(1, sizeof(grpc_connection));
+    if (!conn) {
+        free(key);
+        *error_out = dup_string("Failed to allocate connection");
+        return NULL;
+    }
+    conn->use_tls = use_tls;
+    conn->fd = -1;
+    conn->key = key;
+    conn->profile = profile;
+    conn->opened_us = monotonic_us();
+    conn->setup_deadline_ms = monotonic_ms() + CONNECT_TIMEOUT_MS;
+    if (deadline_ms < conn->setup_deadline_ms) conn->setup_deadline_ms = deadline_ms;
+    pthread_mutex_lock(&pool_mutex);
+    conn->flow = flow_profiles[profile];
+    pthread_mutex_unlock(&pool_mutex);
+
+    /* Parse target (host:port) */
+    char *target_copy = strdup(target);
+    if (!target_copy) {
+        *error_out = dup_string("Failed to allocate connection");
+        connection_free(conn);
+        return NULL;
+    }
+    char *colon = strrchr(target_copy, ':');
+    int port = use_tls ? 443 : 80;
+    char *hostname = target_copy;
+
+    if (colon) {
+        *colon = '\0';
+        port = atoi(colon + 1);
+    }
+
+    int failed = connect_to_server(conn, hostname, port) != 0;
+    if (!failed && use_tls) {
+        failed = setup_tls(conn, hostname) != 0;
+    }
+    free(target_copy);
+
+    if (!failed) {
+        failed = setup_http2(conn) != 0;
+    }
+
+    if (failed) {
+        *error_out = dup_string(conn->error_message ? conn->error_message : "Failed to connect");
+        conn->broken = 1;
+        connection_free(conn);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.connections_opened++;
+    if (conn->connect_fallback) stats.connect_fallbacks++;
+    histogram_add(&stats.resolve, (uint64_t)(conn->resolved_us - conn->opened_us));
+    histogram_add(&stats.connect, (uint64_t)(conn->connected_us - conn->resolved_us));
+    if (use_tls) histogram_add(&stats.tls, (uint64_t)(conn->tls_done_us - conn->connected_us));
+    pthread_mutex_unlock(&stats_mutex);
+
+    return conn;
+}
+
+/* A pooled connection is only handed out again if the peer has not closed it */
+static int connection_is_alive(grpc_connection *conn) {
+    if (conn->broken || conn->goaway) return 0;
+    if (!nghttp2_session_want_read(conn->session) && !nghttp2_session_want_write(conn->session)) {
+        return 0;
+    }
+
+    uint8_t byte;
+    ssize_t ret = recv(conn->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (ret == 0) return 0;
+    if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return 0;
+    return 1;
+}
+
+/* Take an idle connection for key out of the pool, evicting expired ones on the way */
+static grpc_connection *pool_take(const char *key) {
+    grpc_connection *found = NULL;
+    grpc_connection *expired = NULL;
+    long long now = monotonic_ms();
+
+    pthread_mutex_lock(&pool_mutex);
+    grpc_connection **link = &pool_idle;
+    while (*link) {
+        grpc_connection *conn = *link;
+        if (now - conn->last_used_ms > POOL_IDLE_TIMEOUT_MS) {
+            *link = conn->next;
+            pool_idle_count--;
+            conn->next = expired;
+            expired = conn;
+            continue;
+        }
+        if (!found && strcmp(conn->key, key) == 0) {
+            *link = conn->next;
+            pool_idle_count--;
+            conn->next = NULL;
+            found = conn;
+            continue;
+        }
+        link = &conn->next;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    while (expired) {
+        grpc_connection *next = expired->next;
+        connection_free(expired);
+        expired = next;
+    }
+
+    return found;
+}
+
+/* A live idle connection for key from the pool, or NULL; never blocks on the network */
+static grpc_connection *pool_take_alive(const char *key) {
+    grpc_connection *conn;
+    while ((conn = pool_take(key)) != NULL) {
+        if (connection_is_alive(conn)) {
+            conn->reused = 1;
+            return conn;
+        }
+        conn->broken = 1;
+        connection_free(conn);
+    }
+    return NULL;
+}
+
+/* A pooled connection for the key, or a new one that must be set up by deadline_ms */
+static grpc_connection *pool_acquire(const char *target, const char *host,
+                                     int use_tls, mic_grpc_profile profile,
+                                     long long deadline_ms, char **error_out) {
+    char *key = connection_key(target, host, use_tls, profile);
+    if (!key) {
+        *error_out = dup_string("Failed to allocate connection");
+        return NULL;
+    }
+
+    grpc_connection *conn = pool_take_alive(key);
+    if (conn) {
+        free(key);
+        return conn;
+    }
+
+    return connection_open(target, use_tls, profile, deadline_ms, key, error_out);
+}
+
+static void keepalive_start(void);
+
+/* Put a connection into the pool at its place by last use, or close it if it can no longer carry streams */
+static void pool_put(grpc_connection *conn) {
+    if (conn->broken || conn->goaway ||
+        (!nghttp2_session_want_read(conn->session) && !nghttp2_session_want_write(conn->session))) {
+        connection_free(conn);
+        return;
+    }
+
+    grpc_connection *evicted = NULL;
+
+    pthread_mutex_lock(&pool_mutex);
+    grpc_connection **position = &pool_idle;
+    while (*position && (*position)->last_used_ms > conn->last_used_ms) position = &(*position)->next;
+    conn->next = *position;
+    *position = conn;
+    pool_idle_count++;
+    if (pool_idle_count > POOL_MAX_IDLE) {
+        /* Drop the least recently used connection at the tail */
+        grpc_connection **link = &pool_idle;
+        while ((*link)->next) link = &(*link)->next;
+        evicted = *link;
+        *link = NULL;
+        pool_idle_count--;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    connection_free(evicted);
+}
+
+/* Return a connection to the pool after use */
+static void pool_release(grpc_connection *conn) {
+    if (!conn) return;
+    conn->last_used_ms = monotonic_ms();
+    /* Nobody reads the socket while it is pooled, so an ACK read later says nothing about RTT */
+    if (conn->bdp_ping_pending) conn->bdp_ping_stale = 1;
+    pool_put(conn);
+    keepalive_start();
+}
+
+/* Flush what nghttp2 has queued; returns 0 or an nghttp2 error */
+static int connection_send(grpc_connection *conn) {
+    conn->ssl_want_read = 0;
+    conn->ssl_want_write = 0;
+    if (conn->out_len > 0 && flush_pending_output(conn) < 0) return NGHTTP2_ERR_CALLBACK_FAILURE;
+    return nghttp2_session_send(conn->session);
+}
+
+/*
+ * PING every connection in the list and wait for the ACKs together. Those
+ * acked in time go back to the pool with a fresh RTT sample; the rest are
+ * closed.
+ */
+static void keepalive_probe(grpc_connection *due) {
+    struct pollfd pfds[POOL_MAX_IDLE];
+    grpc_connection *polled[POOL_MAX_IDLE];
+    uint64_t pings = 0;
+
+    for (grpc_connection *conn = due; conn; conn = conn->next) {
+        conn->keepalive_sent_us = monotonic_us();
+        if (nghttp2_submit_ping(conn->session, NGHTTP2_FLAG_NONE,
+                                (const uint8_t *)KEEPALIVE_PING_DATA) != 0 ||
+            connection_send(conn) != 0) {
+            conn->broken = 1;
+        }
+        pings++;
+    }
+
+    long long deadline = monotonic_ms() + KEEPALIVE_TIMEOUT_MS;
+    for (;;) {
+        nfds_t nfds = 0;
+        for (grpc_connection *conn = due; conn && nfds < POOL_MAX_IDLE; conn = conn->next) {
+            if (conn->broken || !conn->keepalive_sent_us) continue;
+            short events = POLLIN;
+            if (nghttp2_session_want_write(conn->session) || conn->ssl_want_write || conn->out_len > 0) {
+                events |= POLLOUT;
+            }
+            pfds[nfds] = (struct pollfd){ .fd = conn->fd, .events = events, .revents = 0 };
+            polled[nfds] = conn;
+            nfds++;
+        }
+        long long remaining = deadline - monotonic_ms();
+        if (nfds == 0 || remaining <= 0) break;
+
+        int ready = poll(pfds, nfds, (int)remaining);
+        if (ready < 0 && errno != EINTR) break;
+        for (nfds_t i = 0; ready > 0 && i < nfds; i++) {
+            grpc_connection *conn = polled[i];
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (nghttp2_session_recv(conn->session) != 0) conn->broken = 1;
+            }
+            /* The server may have PINGed or sent SETTINGS meanwhile; answer it */
+            if (!conn->broken && connection_send(conn) != 0) conn->broken = 1;
+        }
+    }
+
+    uint64_t failures = 0;
+    while (due) {
+        grpc_connection *next = due->next;
+        due->next = NULL;
+        if (due->keepalive_sent_us) {
+            due->broken = 1;
+            failures++;
+        }
+        pool_put(due);
+        due = next;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.keepalive_pings += pings;
+    stats.keepalive_failures += failures;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+/*
+ * Background sweep over the pool: connections past POOL_IDLE_TIMEOUT_MS are
+ * closed, and those idle for KEEPALIVE_IDLE_MS since their last use or PING
+ * are taken out and probed, so a call never gets one the network has lost.
+ * Runs until mic_grpc_pool_shutdown sets keepalive_stop.
+ */
+static void *keepalive_thread_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += KEEPALIVE_CHECK_MS / 1000;
+        wake.tv_nsec += (KEEPALIVE_CHECK_MS % 1000) * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&pool_mutex);
+        while (!keepalive_stop) {
+            if (pthread_cond_timedwait(&keepalive_cond, &pool_mutex, &wake) == ETIMEDOUT) break;
+        }
+        if (keepalive_stop) {
+            pthread_mutex_unlock(&pool_mutex);
+            break;
+        }
+
+        long long now = monotonic_ms();
+        grpc_connection *due = NULL;
+        grpc_connection *expired = NULL;
+
+        grpc_connection **link = &pool_idle;
+        while (*link) {
+            grpc_connection *conn = *link;
+            long long quiet_since = conn->last_used_ms > conn->keepalive_ms ? conn->last_used_ms
+                                                                             : conn->keepalive_ms;
+            if (now - conn->last_used_ms > POOL_IDLE_TIMEOUT_MS) {
+                *link = conn->next;
+                pool_idle_count--;
+                conn->next = expired;
+                expired = conn;
+                continue;
+            }
+            if (now - quiet_since >= KEEPALIVE_IDLE_MS) {
+                *link = conn->next;
+                pool_idle_count--;
+                conn->next = due;
+                due = conn;
+                continue;
+            }
+            link = &conn->next;
+        }
+        pthread_mutex_unlock(&pool_mutex);
+
+        while (expired) {
+            grpc_connection *next = expired->next;
+            connection_free(expired);
+            expired = next;
+        }
+        if (due) keepalive_probe(due);
+    }
+    return NULL;
+}
+
+static void keepalive_start(void) {
+    pthread_mutex_lock(&pool_mutex);
+    if (!keepalive_running && !keepalive_stop &&
+        pthread_create(&keepalive_thread, NULL, keepalive_thread_main, NULL) == 0) {
+        keepalive_running = 1;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void mic_grpc_pool_shutdown(void) {
+    /* Stop the sweep first: joining it also waits out a probe, which puts its connections back in the pool */
+    pthread_mutex_lock(&pool_mutex);
+    int running = keepalive_running;
+    keepalive_stop = 1;
+    pthread_cond_signal(&keepalive_cond);
+    pthread_mutex_unlock(&pool_mutex);
+    if (running) pthread_join(keepalive_thread, NULL);
+
+    pthread_mutex_lock(&pool_mutex);
+    keepalive_running = 0;
+    keepalive_stop = 0;
+    grpc_connection *conn = pool_idle;
+    pool_idle = NULL;
+    pool_idle_count = 0;
+    pthread_mutex_unlock(&pool_mutex);
+
+    while (conn) {
+        grpc_connection *next = conn->next;
+        connection_free(conn);
+        conn = next;
+    }
+
+    pthread_mutex_lock(&encoding_mutex);
+    for (int i = 0; i < ENCODING_CACHE_MAX; i++) {
+        free(encoding_cache[i].key);
+        encoding_cache[i].key = NULL;
+        encoding_cache[i].accepted = 0;
+    }
+    pthread_mutex_unlock(&encoding_mutex);
+
+    pthread_mutex_lock(&dns_mutex);
+    for (int i = 0; i < DNS_CACHE_MAX; i++) {
+        free(dns_cache[i].key);
+        dns_cache[i].key = NULL;
+        dns_cache[i].count = 0;
+    }
+    pthread_mutex_unlock(&dns_mutex);
+
+    pthread_mutex_lock(&tls_mutex);
+    for (int i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+        free(tls_sessions[i].key);
+        if (tls_sessions[i].session) SSL_SESSION_free(tls_sessions[i].session);
+        tls_sessions[i].key = NULL;
+        tls_sessions[i].session = NULL;
+    }
+    pthread_mutex_unlock(&tls_mutex);
+}
+
+void mic_grpc_set_flow_control(mic_grpc_profile profile, const mic_grpc_flow_control *settings) {
+    if (!settings || profile < MIC_GRPC_PROFILE_LATENCY || profile > MIC_GRPC_PROFILE_BULK) return;
+
+    mic_grpc_flow_control flow = *settings;
+    if (flow.stream_window == 0 || flow.stream_window > H2_MAX_WINDOW) flow.stream_window = 65535;
+    if (flow.connection_window > H2_MAX_WINDOW) flow.connection_window = H2_MAX_WINDOW;
+    if (flow.max_frame_size < 16384) flow.max_frame_size = 16384;
+    if (flow.max_frame_size > 16777215) flow.max_frame_size = 16777215;
+
+    /* Applies to connections opened from now on; pooled ones keep their settings */
+    pthread_mutex_lock(&pool_mutex);
+    flow_profiles[profile] = flow;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void mic_grpc_tls_stats(uint64_t *handshakes_out, uint64_t *resumed_out) {
+    if (handshakes_out) *handshakes_out = __atomic_load_n(&tls_handshakes, __ATOMIC_RELAXED);
+    if (resumed_out) *resumed_out = __atomic_load_n(&tls_resumed, __ATOMIC_RELAXED);
+}
+
+void mic_grpc_set_trace(mic_grpc_trace_fn fn, void *ctx) {
+    pthread_mutex_lock(&stats_mutex);
+    trace_fn = fn;
+    trace_ctx = ctx;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void mic_grpc_get_stats(mic_grpc_stats *stats_out) {
+    if (!stats_out) return;
+    pthread_mutex_lock(&stats_mutex);
+    *stats_out = stats;
+    pthread_mutex_unlock(&stats_mutex);
+    stats_out->bytes_sent = __atomic_load_n(&stats.bytes_sent, __ATOMIC_RELAXED);
+    stats_out->bytes_received = __atomic_load_n(&stats.bytes_received, __ATOMIC_RELAXED);
+    stats_out->frames_sent = __atomic_load_n(&stats.frames_sent, __ATOMIC_RELAXED);
+    stats_out->frames_received = __atomic_load_n(&stats.frames_received, __ATOMIC_RELAXED);
+}
+
+/* Extract the response message; returns -1 if it is malformed, -2 if it cannot be decompressed */
+static int parse_grpc_response(const uint8_t *data, size_t len, int encoding,
+                               uint8_t **message_out, size_t *message_len_out) {
+    if (len < GRPC_HEADER_SIZE) return -1;
+
+    uint32_t message_len = ((uint32_t)data[1] << 24) |
+                           ((uint32_t)data[2] << 16) |
+                           ((uint32_t)data[3] << 8) |
+                           (uint32_t)data[4];
+
+    if (len < GRPC_HEADER_SIZE + message_len) return -1;
+
+    if (data[0] & 1) {
+        uint8_t *buf = NULL;
+        size_t cap = 0;
+        ssize_t n = decompress_message(encoding, data + GRPC_HEADER_SIZE, message_len, &buf, &cap);
+        if (n < 0) {
+            free(buf);
+            return -2;
+        }
+        *message_out = buf;
+        *message_len_out = (size_t)n;
+        return 0;
+    }
+
+    *message_out = malloc(message_len);
+    if (!*message_out) return -1;
+
+    memcpy(*message_out, data + GRPC_HEADER_SIZE, message_len);
+    *message_len_out = message_len;
+    return 0;
+}
+
+
+static void call_init(grpc_call *call, const char *method, const uint8_t *message, size_t message_len) {
+    memset(call, 0, sizeof(*call));
+    call->method = method;
+    call->message = message;
+    call->message_len = message_len;
+    call->grpc_status = -1;
+    call->result = CALL_PENDING;
+    call->started_us = monotonic_us();
+    call->trace.attempts = 1;
+}
+
+/* Deadline from the caller's timeout or the profile's default, counted from now */
+static void call_set_options(grpc_call *call, const mic_grpc_call_options *options,
+                             mic_grpc_profile profile) {
+    uint32_t timeout_ms = options ? options->timeout_ms : 0;
+    if (timeout_ms == 0) {
+        timeout_ms = profile == MIC_GRPC_PROFILE_BULK ? MIC_GRPC_BULK_TIMEOUT_MS : MIC_GRPC_LATENCY_TIMEOUT_MS;
+    }
+    call->deadline_ms = monotonic_ms() + timeout_ms;
+    call->cancel = options ? options->cancel : NULL;
+}
+
+static int cancel_requested(const grpc_call *call) {
+    return call->cancel && __atomic_load_n(&call->cancel->cancelled, __ATOMIC_ACQUIRE);
+}
+
+/* Free per-attempt buffers; outcome fields are left to the caller */
+static void call_release(grpc_call *call) {
+    free(call->response_data);
+    free(call->error_message);
+    free(call->compress_buf);
+    free(call->inflate_buf);
+    if (call->deflate) {
+        deflateEnd(call->deflate);
+        free(call->deflate);
+    }
+    ZSTD_freeCCtx(call->zstd_cctx);
+    call->response_data = NULL;
+    call->error_message = NULL;
+    call->compress_buf = NULL;
+    call->compress_cap = 0;
+    call->inflate_buf = NULL;
+    call->inflate_cap = 0;
+    call->deflate = NULL;
+    call->zstd_cctx = NULL;
+}
+
+/* Prepare a refused call for another attempt on a different connection */
+static void call_reset(grpc_call *call) {
+    mic_grpc_message_fn on_message = call->on_message;
+    void *on_message_ctx = call->on_message_ctx;
+    mic_grpc_alloc_fn alloc = call->alloc;
+    void *alloc_ctx = call->alloc_ctx;
+    mic_grpc_producer_fn producer = call->producer;
+    void *producer_ctx = call->producer_ctx;
+    mic_grpc_compression compression = call->compression;
+    long long started_us = call->started_us;
+    int attempts = call->trace.attempts;
+    long long deadline_ms = call->deadline_ms;
+    mic_grpc_cancel_token *cancel = call->cancel;
+
+    call_release(call);
+    free(call->result_error);
+    call_init(call, call->method, call->message, call->message_len);
+    call->on_message = on_message;
+    call->on_message_ctx = on_message_ctx;
+    call->alloc = alloc;
+    call->alloc_ctx = alloc_ctx;
+    call->producer = producer;
+    call->producer_ctx = producer_ctx;
+    call->compression = compression;
+    call->started_us = started_us;
+    call->trace.attempts = attempts + 1;
+    call->deadline_ms = deadline_ms;
+    call->cancel = cancel;
+}
+
+/* Fold a finished call into the process-wide stats and hand its trace to the hook */
+static void call_report(grpc_call *call) {
+    mic_grpc_call_trace *trace = &call->trace;
+    trace->method = call->method ? call->method : "";
+    trace->ok = call->result == CALL_OK;
+    trace->total_us = call_elapsed_us(call);
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.calls++;
+    if (!trace->ok) stats.calls_failed++;
+    stats.retries += (uint64_t)(trace->attempts - 1);
+    stats.window_stalls += trace->window_stalls;
+    if (trace->first_byte_us) histogram_add(&stats.first_byte, trace->first_byte_us);
+    histogram_add(&stats.total, trace->total_us);
+    mic_grpc_trace_fn fn = trace_fn;
+    void *ctx = trace_ctx;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (fn) fn(ctx, trace);
+}
+
+/* What a public entry point returns for a call that did not end CALL_OK */
+static int call_error_code(const grpc_call *call) {
+    return call->grpc_status == MIC_GRPC_UNIMPLEMENTED ? MIC_GRPC_UNIMPLEMENTED : 1;
+}
+
+static void call_fail(grpc_call *call, int result, const char *msg) {
+    call->result = result;
+    free(call->result_error);
+    call->result_error = dup_string(msg);
+}
+
+/* Decide the outcome of a call whose response is complete */
+static void call_finish(grpc_call *call) {
+    if (call->stream_closed && call->close_error_code == NGHTTP2_REFUSED_STREAM) {
+        call_fail(call, CALL_RETRYABLE, "Request refused by server");
+        return;
+    }
+
+    /* Check gRPC status */
+    if (call->grpc_status != 0 && call->grpc_status != -1) {
+        if (call->error_message) {
+            call_fail(call, CALL_FAILED, call->error_message);
+        } else {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "gRPC error: status %d", call->grpc_status);
+            call_fail(call, CALL_FAILED, buf);
+        }
+        return;
+    }
+
+    /* A reset stream may have been cut off between messages, whatever arrived before it */
+    if (call->stream_closed && call->close_error_code != NGHTTP2_NO_ERROR) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "gRPC stream reset by server (HTTP/2 error %u)", call->close_error_code);
+        call_fail(call, CALL_FAILED, buf);
+        return;
+    }
+
+    /* Only the trailers say the response is complete; a proxy error page has none */
+    if (call->grpc_status == -1) {
+        char buf[64];
+        if (call->http_status != 0 && call->http_status != 200) {
+            snprintf(buf, sizeof(buf), "gRPC response missing grpc-status (HTTP %d)", call->http_status);
+        } else {
+            snprintf(buf, sizeof(buf), "gRPC response missing grpc-status");
+        }
+        call_fail(call, CALL_FAILED, buf);
+        return;
+    }
+
+    if (call->decode_failed) {
+        call_fail(call, CALL_FAILED, "Failed to decompress gRPC response");
+        return;
+    }
+
+    if (call->alloc_failed) {
+        call_fail(call, CALL_FAILED, "Failed to allocate gRPC response");
+        return;
+    }
+
+    if (call->sink_failed) {
+        call_fail(call, CALL_FAILED, "gRPC stream cancelled by receiver");
+        return;
+    }
+
+    if (call->producer_failed) {
+        call_fail(call, CALL_FAILED, "gRPC request stream aborted by producer");
+        return;
+    }
+
+    if (call->on_message) {
+        if (call->frame_header_len > 0) {
+            call_fail(call, CALL_FAILED, "Truncated gRPC message in stream");
+            return;
+        }
+        call->result = CALL_OK;
+        return;
+    }
+
+    if (call->alloc) {
+        if (call->frame_header_len > 0 && !call->into_done) {
+            call_fail(call, CALL_FAILED, "Failed to parse gRPC response");
+            return;
+        }
+        if (call->into_done && (call->frame_header[0] & 1)) {
+            ssize_t n = decompress_message(call->response_encoding, call->response_data, call->frame_len,
+                                           &call->inflate_buf, &call->inflate_cap);
+            if (n < 0) {
+                call_fail(call, CALL_FAILED, "Failed to decompress gRPC response");
+                return;
+            }
+            call->into = call->alloc(call->alloc_ctx, (size_t)n);
+            if (!call->into && n > 0) {
+                call_fail(call, CALL_FAILED, "Failed to allocate gRPC response");
+                return;
+            }
+            if (n > 0) memcpy(call->into, call->inflate_buf, (size_t)n);
+            call->into_len = (size_t)n;
+        }
+        call->result = CALL_OK;
+        return;
+    }
+
+    /* Parse gRPC response */
+    if (call->response_len > 0) {
+        int ret = parse_grpc_response(call->response_data, call->response_len, call->response_encoding,
+                                      &call->result_message, &call->result_message_len);
+        if (ret != 0) {
+            call_fail(call, CALL_FAILED, ret == -2 ? "Failed to decompress gRPC response"
+                                                   : "Failed to parse gRPC response");
+            return;
+        }
+    }
+
+    call->result = CALL_OK;
+}
+
+/* Submit a call as a new stream on the session; the call is the stream's user data */
+static int call_submit(grpc_connection *conn, const char *host, const char *auth_header, grpc_call *call) {
+    /* Build HTTP/2 headers */
+    nghttp2_nv headers[11];
+    int header_count = 0;
+
+    call->send_encoding = negotiate_encoding(conn, call->compression);
+
+    /* A connection opened after the call started was opened for it; its setup counts against the call */
+    if (conn->opened_us >= call->started_us) {
+        call->trace.new_connection = 1;
+        call->trace.resolved_us = conn->resolved_us ? (uint64_t)(conn->resolved_us - call->started_us) : 0;
+        call->trace.connected_us = conn->connected_us ? (uint64_t)(conn->connected_us - call->started_us) : 0;
+        call->trace.tls_done_us = conn->tls_done_us ? (uint64_t)(conn->tls_done_us - call->started_us) : 0;
+    }
+    call->trace.rtt_us = (uint64_t)conn->srtt_us;
+
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)":method", (uint8_t *)"POST", 7, 4, NGHTTP2_NV_FLAG_NONE
+    };
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)":scheme", (uint8_t *)(conn->use_tls ? "https" : "http"),
+        7, conn->use_tls ? 5 : 4, NGHTTP2_NV_FLAG_NONE
+    };
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)":path", (uint8_t *)call->method,
+        5, strlen(call->method), NGHTTP2_NV_FLAG_NONE
+    };
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)":authority", (uint8_t *)host,
+        10, strlen(host), NGHTTP2_NV_FLAG_NONE
+    };
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)"content-type", (uint8_t *)"application/grpc",
+        12, 16, NGHTTP2_NV_FLAG_NONE
+    };
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)"te", (uint8_t *)"trailers",
+        2, 8, NGHTTP2_NV_FLAG_NONE
+    };
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)"grpc-accept-encoding", (uint8_t *)"identity,gzip,zstd",
+        20, 18, NGHTTP2_NV_FLAG_NONE
+    };
+    if (call->send_encoding != MIC_GRPC_COMPRESS_NONE) {
+        const char *encoding = encoding_name(call->send_encoding);
+        headers[header_count++] = (nghttp2_nv){
+            (uint8_t *)"grpc-encoding", (uint8_t *)encoding,
+            13, strlen(encoding), NGHTTP2_NV_FLAG_NONE
+        };
+    }
+
+    if (auth_header) {
+        headers[header_count++] = (nghttp2_nv){
+            (uint8_t *)"authorization", (uint8_t *)auth_header,
+            13, strlen(auth_header), NGHTTP2_NV_FLAG_NONE
+        };
+    }
+
+    /* Time left, so the server can give up on the call when we do (at most 8 digits) */
+    char timeout[24];
+    long long remaining = call->deadline_ms - monotonic_ms();
+    if (remaining < 1) remaining = 1;
+    if (remaining <= 99999999) {
+        snprintf(timeout, sizeof(timeout), "%lldm", remaining);
+    } else {
+        snprintf(timeout, sizeof(timeout), "%lldS", remaining / 1000);
+    }
+    headers[header_count++] = (nghttp2_nv){
+        (uint8_t *)"grpc-timeout", (uint8_t *)timeout,
+        12, strlen(timeout), NGHTTP2_NV_FLAG_NONE
+    };
+
+    /* Setup data provider */
+    nghttp2_data_provider data_prd;
+    data_prd.source.ptr = call;
+    data_prd.read_callback = data_source_read_callback;
+
+    /* Streams beyond the server's concurrency limit are queued by nghttp2 */
+    call->stream_id = nghttp2_submit_request(
+        conn->session, NULL, headers, header_count, &data_prd, call
+    );
+
+    return call->stream_id < 0 ? -1 : 0;
+}
+
+/* Fail every call still in flight, marking it retryable if the server never answered it */
+static size_t fail_pending_calls(grpc_connection *conn, grpc_call **calls, size_t count, const char *msg) {
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        grpc_call *call = calls[i];
+        if (call->result != CALL_PENDING) continue;
+        call_fail(call, conn->reused && !call->headers_received ? CALL_RETRYABLE : CALL_FAILED, msg);
+        failed++;
+    }
+    return failed;
+}
+
+/* Fail calls whose token was cancelled or whose deadline passed; returns how many */
+static size_t expire_calls(grpc_call **calls, size_t count, long long now) {
+    size_t expired = 0;
+    for (size_t i = 0; i < count; i++) {
+        grpc_call *call = calls[i];
+        if (call->result != CALL_PENDING) continue;
+
+        if (cancel_requested(call)) {
+            call_fail(call, CALL_FAILED, "gRPC call cancelled");
+        } else if (now >= call->deadline_ms) {
+            call_fail(call, CALL_FAILED, "gRPC deadline exceeded");
+        } else {
+            continue;
+        }
+        expired++;
+    }
+    return expired;
+}
+
+/* Earliest deadline among pending calls, or -1 */
+static long long next_call_deadline(grpc_call **calls, size_t count) {
+    long long next = -1;
+    for (size_t i = 0; i < count; i++) {
+        if (calls[i]->result != CALL_PENDING) continue;
+        if (next < 0 || calls[i]->deadline_ms < next) next = calls[i]->deadline_ms;
+    }
+    return next;
+}
+
+/* Queue RST_STREAM for a settled call whose stream is still open, once */
+static int call_cancel_stream(grpc_connection *conn, grpc_call *call) {
+    if (call->stream_id <= 0 || call->stream_closed || call->stream_reset || conn->broken) return 0;
+    nghttp2_submit_rst_stream(conn->session, NGHTTP2_FLAG_NONE, call->stream_id, NGHTTP2_CANCEL);
+    call->stream_reset = 1;
+    return 1;
+}
+
+/* Settle calls whose stream has ended, or that can no longer complete; returns how many */
+static size_t collect_finished_calls(grpc_connection *conn, grpc_call **calls, size_t count, int eof) {
+    size_t finished = 0;
+    for (size_t i = 0; i < count; i++) {
+        grpc_call *call = calls[i];
+        if (call->result != CALL_PENDING) continue;
+
+        if (call->response_complete) {
+            call_finish(call);
+        } else if (conn->goaway && call->stream_id > conn->goaway_last_stream_id) {
+            /* Server is draining and never processed this stream */
+            call_fail(call, CALL_RETRYABLE, "Request refused by server (GOAWAY)");
+        } else if (eof) {
+            call_fail(call, conn->reused && !call->headers_received ? CALL_RETRYABLE : CALL_FAILED,
+                      "Connection closed by server");
+        } else {
+            continue;
+        }
+        finished++;
+    }
+    return finished;
+}
+
+/*
+ * Run a set of unary calls as concurrent streams on an established connection.
+ * Each call ends as CALL_OK, CALL_FAILED or CALL_RETRYABLE; retryable means the
+ * server never saw the request (refused stream, GOAWAY below our stream id, or a
+ * reused connection that turned out dead).
+ */
+static void connection_run_calls(grpc_connection *conn,
+                                 const char *host,
+                                 const char *auth_token,
+                                 grpc_call **calls,
+                                 size_t count) {
+    char auth_header[1024];
+    const char *auth = NULL;
+    if (auth_token && auth_token[0]) {
+        snprintf(auth_header, sizeof(auth_header), "Bearer %s", auth_token);
+        auth = auth_header;
+    }
+
+    /* Connection setup may already have used up a deadline */
+    expire_calls(calls, count, monotonic_ms());
+
+    size_t pending = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (calls[i]->result != CALL_PENDING) continue;
+        if (conn->broken || call_submit(conn, host, auth, calls[i]) != 0) {
+            call_fail(calls[i], conn->reused ? CALL_RETRYABLE : CALL_FAILED,
+                      "Failed to submit HTTP/2 request");
+            conn->broken = 1;
+            continue;
+        }
+        pending++;
+    }
+
+    /* Cancellation tokens are polled next to the socket; each distinct one once */
+    struct pollfd *pfds = malloc((count + 1) * sizeof(*pfds));
+    if (!pfds) {
+        fail_pending_calls(conn, calls, count, "Failed to allocate gRPC batch");
+        pending = 0;
+    }
+    nfds_t nfds = 1;
+    for (size_t i = 0; pfds && i < count; i++) {
+        mic_grpc_cancel_token *token = calls[i]->cancel;
+        if (!token || token->fds[0] < 0) continue;
+        nfds_t j = 1;
+        while (j < nfds && pfds[j].fd != token->fds[0]) j++;
+        if (j == nfds) pfds[nfds++] = (struct pollfd){ .fd = token->fds[0], .events = POLLIN };
+    }
+
+    /*
+     * Event loop: flush whatever nghttp2 has queued, then sleep in poll until
+     * the socket can make progress, a token is cancelled or the next deadline
+     * passes. Calls finish on END_STREAM or reset; an expired or cancelled
+     * call has its stream reset while the others carry on.
+     */
+    int eof = 0;
+
+    while (pending > 0) {
+        size_t expired = expire_calls(calls, count, monotonic_ms());
+        if (expired > 0) {
+            pending -= expired;
+            for (size_t i = 0; i < count; i++) {
+                if (calls[i]->result != CALL_PENDING) call_cancel_stream(conn, calls[i]);
+            }
+            if (pending == 0) break;
+        }
+
+        if (!eof) {
+            conn->ssl_want_read = 0;
+            conn->ssl_want_write = 0;
+            int ret = conn->out_len > 0 && flush_pending_output(conn) < 0
+                ? NGHTTP2_ERR_CALLBACK_FAILURE
+                : nghttp2_session_send(conn->session);
+            if (ret != 0) {
+                conn->broken = 1;
+                fail_pending_calls(conn, calls, count, nghttp2_strerror(ret));
+                break;
+            }
+        }
+
+        pending -= collect_finished_calls(conn, calls, count, eof);
+        if (pending == 0) break;
+        if (eof) {
+            conn->broken = 1;
+            break;
+        }
+
+        short events = 0;
+        if (nghttp2_session_want_read(conn->session) || conn->ssl_want_read) events |= POLLIN;
+        if (nghttp2_session_want_write(conn->session) || conn->ssl_want_write || conn->out_len > 0) {
+            events |= POLLOUT;
+        }
+        if (events == 0) {
+            /* Session is finished (e.g. after GOAWAY) with streams still open */
+            conn->broken = 1;
+            fail_pending_calls(conn, calls, count, "Connection closed by server");
+            break;
+        }
+
+        long long remaining = next_call_deadline(calls, count) - monotonic_ms();
+        if (remaining <= 0) continue;
+        pfds[0] = (struct pollfd){ .fd = conn->fd, .events = events };
+        for (nfds_t j = 1; j < nfds; j++) pfds[j].revents = 0;
+        int ready = poll(pfds, nfds, remaining > INT_MAX ? INT_MAX : (int)remaining);
+        if (ready < 0 && errno != EINTR) {
+            conn->broken = 1;
+            fail_pending_calls(conn, calls, count, strerror(errno));
+            break;
+        }
+        if (ready <= 0) continue;
+
+        short revents = pfds[0].revents;
+        if (revents & (POLLIN | POLLHUP | POLLERR)) {
+            int ret = nghttp2_session_recv(conn->session);
+            if (ret == NGHTTP2_ERR_EOF) {
+                eof = 1;
+            } else if (ret != 0) {
+                conn->broken = 1;
+                fail_pending_calls(conn, calls, count, nghttp2_strerror(ret));
+                break;
+            }
+        }
+    }
+    free(pfds);
+
+    /* Don't leave half-read streams behind on a connection that goes back to the pool */
+    int reset = 0;
+    for (size_t i = 0; i < count; i++) {
+        reset |= call_cancel_stream(conn, calls[i]);
+    }
+    if ((reset || nghttp2_session_want_write(conn->session)) && !conn->broken &&
+        nghttp2_session_send(conn->session) != 0) {
+        conn->broken = 1;
+    }
+
+    /* Calls live on the caller's stack; detach them from any stream that outlives this function */
+    for (size_t i = 0; i < count; i++) {
+        if (calls[i]->stream_id > 0) {
+            nghttp2_session_set_stream_user_data(conn->session, calls[i]->stream_id, NULL);
+        }
+    }
+}
+
+/* Run calls over a pooled connection, retrying refused ones once on a fresh connection */
+static void pooled_run_calls(const char *target,
+                             const char *host,
+                             int use_tls,
+                             mic_grpc_profile profile,
+                             const char *auth_token,
+                             grpc_call *calls,
+                             size_t count) {
+    grpc_call **batch = malloc(count * sizeof(*batch));
+    if (!batch) {
+        for (size_t i = 0; i < count; i++) {
+            if (calls[i].result == CALL_PENDING) {
+                call_fail(&calls[i], CALL_FAILED, "Failed to allocate gRPC batch");
+            }
+        }
+        return;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            grpc_call *call = &calls[i];
+            if (attempt > 0 && call->result == CALL_RETRYABLE) {
+                /* Messages already pulled from a producer cannot be replayed */
+                if (call->producer_started) {
+                    call->result = CALL_FAILED;
+                    continue;
+                }
+                call_reset(call);
+            }
+            if (call->result == CALL_PENDING) batch[n++] = call;
+        }
+        if (n == 0) break;
+
+        /* A new connection may take as long as the most patient call allows */
+        long long deadline_ms = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i]->deadline_ms > deadline_ms) deadline_ms = batch[i]->deadline_ms;
+        }
+
+        char *error = NULL;
+        grpc_connection *conn = pool_acquire(target, host, use_tls, profile, deadline_ms, &error);
+        if (!conn) {
+            expire_calls(batch, n, monotonic_ms());
+            for (size_t i = 0; i < n; i++) {
+                if (batch[i]->result != CALL_PENDING) continue;
+                call_fail(batch[i], CALL_FAILED, error ? error : "Failed to connect");
+            }
+            free(error);
+            break;
+        }
+
+        connection_run_calls(conn, host, auth_token, batch, n);
+        pool_release(conn);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        call_release(&calls[i]);
+        if (calls[i].result == CALL_RETRYABLE) calls[i].result = CALL_FAILED;
+        call_report(&calls[i]);
+    }
+    free(batch);
+}
+
+static int run_unary_call(const char *target,
+                          const char *host,
+                          const char *method,
+                          const uint8_t *request,
+                          size_t request_len,
+                          const char *auth_token,
+                          int use_tls,
+                          mic_grpc_profile profile,
+                          const mic_grpc_call_options *options,
+                          mic_grpc_alloc_fn alloc,
+                          void *alloc_ctx,
+                          uint8_t **response_out,
+                          size_t *response_len_out,
+                          char **error_out) {
+    if (!response_out || !response_len_out || !error_out) return 1;
+
+    *response_out = NULL;
+    *response_len_out = 0;
+    *error_out = NULL;
+
+    if (!target || !host || !method) {
+        *error_out = dup_string("Invalid gRPC call arguments");
+        return 1;
+    }
+
+    grpc_call call;
+    call_init(&call, method, request, request_len);
+    call_set_options(&call, options, profile);
+    call.alloc = alloc;
+    call.alloc_ctx = alloc_ctx;
+    pooled_run_calls(target, host, use_tls, profile, auth_token, &call, 1);
+
+    if (call.result != CALL_OK) {
+        *error_out = call.result_error ? call.result_error : dup_string("gRPC call failed");
+        return call_error_code(&call);
+    }
+
+    if (alloc) {
+        *response_out = call.into;
+        *response_len_out = call.into_len;
+        return 0;
+    }
+    *response_out = call.result_message;
+    *response_len_out = call.result_message_len;
+    return 0;
+}
+
+/* Main gRPC unary call function */
+int mic_grpc_unary_call(const char *target,
+                        const char *host,
+                        const char *method,
+                        const uint8_t *request,
+                        size_t request_len,
+                        const char *auth_token,
+                        int use_tls,
+                        const mic_grpc_call_options *options,
+                        uint8_t **response_out,
+                        size_t *response_len_out,
+                        char **error_out) {
+    return run_unary_call(target, host, method, request, request_len, auth_token, use_tls,
+                          MIC_GRPC_PROFILE_LATENCY, options, NULL, NULL,
+                          response_out, response_len_out, error_out);
+}
+
+int mic_grpc_unary_call_into(const char *target,
+                             const char *host,
+                             const char *method,
+                             const uint8_t *request,
+                             size_t request_len,
+                             const char *auth_token,
+                             int use_tls,
+                             const mic_grpc_call_options *options,
+                             mic_grpc_alloc_fn alloc,
+                             void *alloc_ctx,
+                             uint8_t **response_out,
+                             size_t *response_len_out,
+                             char **error_out) {
+    if (!alloc) {
+        if (error_out) *error_out = dup_string("Invalid gRPC call arguments");
+        return 1;
+    }
+    return run_unary_call(target, host, method, request, request_len, auth_token, use_tls,
+                          MIC_GRPC_PROFILE_LATENCY, options, alloc, alloc_ctx,
+                          response_out, response_len_out, error_out);
+}
+
+int mic_grpc_streaming_call(const char *target,
+                            const char *host,
+                            const char *method,
+                            const uint8_t *request,
+                            size_t request_len,
+                            const char *auth_token,
+                            int use_tls,
+                            mic_grpc_profile profile,
+                            const mic_grpc_call_options *options,
+                            mic_grpc_message_fn on_message,
+                            void *ctx,
+                            char **error_out) {
+    if (!error_out) return 1;
+    *error_out = NULL;
+
+    if (!target || !host || !method || !on_message) {
+        *error_out = dup_string("Invalid gRPC call arguments");
+        return 1;
+    }
+
+    grpc_call call;
+    call_init(&call, method, request, request_len);
+    call.on_message = on_message;
+    call.on_message_ctx = ctx;
+    call_set_options(&call, options, profile);
+    pooled_run_calls(target, host, use_tls, profile, auth_token, &call, 1);
+
+    if (call.result != CALL_OK) {
+        *error_out = call.result_error ? call.result_error : dup_string("gRPC call failed");
+        return call_error_code(&call);
+    }
+
+    return 0;
+}
+
+int mic_grpc_client_streaming_call(const char *target,
+                                   const char *host,
+                                   const char *method,
+                                   const char *auth_token,
+                                   int use_tls,
+                                   mic_grpc_profile profile,
+                                   mic_grpc_compression compression,
+                                   const mic_grpc_call_options *options,
+                                   mic_grpc_producer_fn producer,
+                                   void *ctx,
+                                   uint8_t **response_out,
+                                   size_t *response_len_out,
+                                   char **error_out) {
+    if (!response_out || !response_len_out || !error_out) return 1;
+
+    *response_out = NULL;
+    *response_len_out = 0;
+    *error_out = NULL;
+
+    if (!target || !host || !method || !producer) {
+        *error_out = dup_string("Invalid gRPC call arguments");
+        return 1;
+    }
+
+    grpc_call call;
+    call_init(&call, method, NULL, 0);
+    call.producer = producer;
+    call.producer_ctx = ctx;
+    call.compression = compression;
+    call_set_options(&call, options, profile);
+    pooled_run_calls(target, host, use_tls, profile, auth_token, &call, 1);
+
+    if (call.result != CALL_OK) {
+        *error_out = call.result_error ? call.result_error : dup_string("gRPC call failed");
+        return call_error_code(&call);
+    }
+
+    *response_out = call.result_message;
+    *response_len_out = call.result_message_len;
+    return 0;
+}
+
+typedef struct {
+    const struct iovec *messages;
+    size_t count;
+    size_t next;
+} iov_producer;
+
+static int iov_produce(void *ctx, const uint8_t **message, size_t *message_len) {
+    iov_producer *state = (iov_producer *)ctx;
+    if (state->next >= state->count) return 0;
+    *message = state->messages[state->next].iov_base;
+    *message_len = state->messages[state->next].iov_len;
+    state->next++;
+    return 1;
+}
+
+int mic_grpc_client_streaming_call_iov(const char *target,
+                                       const char *host,
+                                       const char *method,
+                                       const char *auth_token,
+                                       int use_tls,
+                                       mic_grpc_profile profile,
+                                       mic_grpc_compression compression,
+                                       const mic_grpc_call_options *options,
+                                       const struct iovec *messages,
+                                       size_t count,
+                                       uint8_t **response_out,
+                                       size_t *response_len_out,
+                                       char **error_out) {
+    iov_producer state = { messages, count, 0 };
+    return mic_grpc_client_streaming_call(target, host, method, auth_token, use_tls, profile,
+                                          compression, options, iov_produce, &state,
+                                          response_out, response_len_out, error_out);
+}
+
+int mic_grpc_unary_call_many(const char *target,
+                             const char *host,
+                             const char *auth_token,
+                             int use_tls,
+                             mic_grpc_profile profile,
+                             const mic_grpc_call_options *options,
+                             mic_grpc_batch_call *calls,
+                             size_t count) {
+    if (!calls) return 1;
+
+    for (size_t i = 0; i < count; i++) {
+        calls[i].response = NULL;
+        calls[i].response_len = 0;
+        calls[i].error = NULL;
+    }
+
+    if (!target || !host) {
+        for (size_t i = 0; i < count; i++) {
+            calls[i].error = dup_string("Invalid gRPC call arguments");
+        }
+        return 1;
+    }
+    if (count == 0) return 0;
+
+    grpc_call *state = calloc(count, sizeof(grpc_call));
+    if (!state) {
+        for (size_t i = 0; i < count; i++) {
+            calls[i].error = dup_string("Failed to allocate gRPC batch");
+        }
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        call_init(&state[i], calls[i].method, calls[i].request, calls[i].request_len);
+        state[i].compression = calls[i].compression;
+        call_set_options(&state[i], options, profile);
+        if (!calls[i].method) call_fail(&state[i], CALL_FAILED, "Invalid gRPC call arguments");
+    }
+
+    pooled_run_calls(target, host, use_tls, profile, auth_token, state, count);
+
+    int rc = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (state[i].result == CALL_OK) {
+            calls[i].response = state[i].result_message;
+            calls[i].response_len = state[i].result_message_len;
+        } else {
+            calls[i].error = state[i].result_error ? state[i].result_error : dup_string("gRPC call failed");
+            rc = 1;
+        }
+    }
+
+    free(state);
+    return rc;
+}
+
+/* Channel handles: a (target, host, TLS mode, profile) key into the connection pool */
+mic_grpc_channel *mic_grpc_channel_new(const char *target, const char *host, int use_tls,
+                                       mic_grpc_profile profile) {
+    if (!target || !host) return NULL;
+
+    mic_grpc_channel *channel = calloc(1, sizeof(mic_grpc_channel));
+    if (!channel) return NULL;
+
+    channel->target = strdup(target);
+    channel->host = strdup(host);
+    channel->use_tls = use_tls;
+    channel->profile = profile;
+    if (!channel->target || !channel->host) {
+        mic_grpc_channel_free(channel);
+        return NULL;
+    }
+
+    return channel;
+}
+
+int mic_grpc_channel_unary_call(mic_grpc_channel *channel,
+                                const char *method,
+                                const uint8_t *request,
+                                size_t request_len,
+                                const char *auth_token,
+                                const mic_grpc_call_options *options,
+                                uint8_t **response_out,
+                                size_t *response_len_out,
+                                char **error_out) {
+    if (!channel) {
+        if (error_out) *error_out = dup_string("Invalid gRPC channel");
+        return 1;
+    }
+
+    return run_unary_call(channel->target, channel->host, method, request, request_len,
+                          auth_token, channel->use_tls, channel->profile, options, NULL, NULL,
+                          response_out, response_len_out, error_out);
+}
+
+int mic_grpc_channel_unary_call_into(mic_grpc_channel *channel,
+                                     const char *method,
+                                     const uint8_t *request,
+                                     size_t request_len,
+                                     const char *auth_token,
+                                     const mic_grpc_call_options *options,
+                                     mic_grpc_alloc_fn alloc,
+                                     void *alloc_ctx,
+                                     uint8_t **response_out,
+                                     size_t *response_len_out,
+                                     char **error_out) {
+    if (!channel) {
+        if (error_out) *error_out = dup_string("Invalid gRPC channel");
+        return 1;
+    }
+    if (!alloc) {
+        if (error_out) *error_out = dup_string("Invalid gRPC call arguments");
+        return 1;
+    }
+
+    return run_unary_call(channel->target, channel->host, method, request, request_len,
+                          auth_token, channel->use_tls, channel->profile, options, alloc, alloc_ctx,
+                          response_out, response_len_out, error_out);
+}
+
+int mic_grpc_channel_unary_call_many(mic_grpc_channel *channel,
+                                     const char *auth_token,
+                                     const mic_grpc_call_options *options,
+                                     mic_grpc_batch_call *calls,
+                                     size_t count) {
+    if (!channel) {
+        return mic_grpc_unary_call_many(NULL, NULL, auth_token, 0, MIC_GRPC_PROFILE_LATENCY,
+                                        options, calls, count);
+    }
+
+    return mic_grpc_unary_call_many(channel->target, channel->host, auth_token,
+                                    channel->use_tls, channel->profile, options, calls, count);
+}
+
+void mic_grpc_channel_free(mic_grpc_channel *channel) {
+    if (!channel) return;
+    free(channel->target);
+    free(channel->host);
+    free(channel);
+}
+
+/*
+ * Asynchronous calls. One I/O thread owns every connection with async calls
+ * in flight and drives them from a single poll loop; callers hand calls over
+ * through a submission queue and a wakeup pipe, and collect them from
+ * completion sets.
+ */
+struct mic_grpc_completion_set {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    mic_grpc_async_call *head;
+    mic_grpc_async_call *tail;
+};
+
+struct mic_grpc_async_call {
+    /* Transport state; first so the I/O thread can treat the call as a grpc_call */
+    grpc_call call;
+
+    char *key;
+    char *target;
+    char *host;
+    char *method;
+    char *auth_header;
+    uint8_t *request;
+    int use_tls;
+    mic_grpc_profile profile;
+    int attempts;
+
+    mic_grpc_completion_set *set;
+    void *tag;
+    int cancelled;
+
+    /* Link in the submission queue, then in the completion set */
+    mic_grpc_async_call *next;
+};
+
+/* A connection owned by the I/O thread and the calls running on it */
+typedef struct io_connection {
+    grpc_connection *conn;
+    grpc_call **calls;
+    size_t count;
+    size_t capacity;
+    struct io_connection *next;
+} io_connection;
+
+/*
+ * A connection being opened on a helper thread, so that DNS, connect and the
+ * TLS handshake never stall the I/O thread. Later calls for the same key wait
+ * on it instead of opening their own.
+ */
+typedef struct io_connect {
+    char *key;
+    char *target;
+    int use_tls;
+    mic_grpc_profile profile;
+    long long deadline_ms;
+
+    /* Calls to start once connected, in arrival order; I/O thread only */
+    mic_grpc_async_call *waiting;
+    mic_grpc_async_call *waiting_tail;
+
+    /* Set by the helper thread under io_mutex */
+    int done;
+    grpc_connection *conn;
+    char *error;
+
+    struct io_connect *next;
+} io_connect;
+
+static pthread_once_t io_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int io_started = 0;
+static int io_wake_fds[2] = { -1, -1 };
+static mic_grpc_async_call *io_submit_head = NULL;
+static mic_grpc_async_call *io_submit_tail = NULL;
+static int io_cancel_pending = 0;
+
+static void io_wake(void) {
+    ssize_t ret;
+    do {
+        ret = write(io_wake_fds[1], "", 1);
+    } while (ret < 0 && errno == EINTR);
+    /* EAGAIN means the pipe already holds a wakeup */
+}
+
+static void io_drain_wakeups(void) {
+    char buf[64];
+    while (read(io_wake_fds[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+/* Hand a finished call to its completion set */
+static void async_complete(mic_grpc_async_call *async) {
+    call_release(&async->call);
+    if (async->call.result == CALL_RETRYABLE) async->call.result = CALL_FAILED;
+    call_report(&async->call);
+
+    mic_grpc_completion_set *set = async->set;
+    async->next = NULL;
+    pthread_mutex_lock(&set->mutex);
+    if (set->tail) {
+        set->tail->next = async;
+    } else {
+        set->head = async;
     }
-    
-    return 0;
+    set->tail = async;
+    pthread_cond_signal(&set->cond);
+    pthread_mutex_unlock(&set->mutex);
 }
 
-/* Build gRPC-framed request */
-static uint8_t *build_grpc_request(const uint8_t *message, size_t message_len, size_t *out_len) {
-    size_t total = GRPC_HEADER_SIZE + message_len;
-    uint8_t *buf = malloc(total);
-    if (!buf) return NULL;
-    
-    /* gRPC header: compression flag (0) + 4-byte big-endian length */
-    buf[0] = 0; /* no compression */
-    buf[1] = (message_len >> 24) & 0xFF;
-    buf[2] = (message_len >> 16) & 0xFF;
-    buf[3] = (message_len >> 8) & 0xFF;
-    buf[4] = message_len & 0xFF;
-    
-    if (message_len > 0 && message) {
-        memcpy(buf + GRPC_HEADER_SIZE, message, message_len);
-    }
-    
-    *out_len = total;
-    return buf;
-}
-
-/* Parse gRPC response */
-static int parse_grpc_response(const uint8_t *data, size_t len,
-                               uint8_t **message_out, size_t *message_len_out) {
-    if (len < GRPC_HEADER_SIZE) return -1;
-    
-    /* Skip compression flag */
-    uint32_t message_len = ((uint32_t)data[1] << 24) |
-                           ((uint32_t)data[2] << 16) |
-                           ((uint32_t)data[3] << 8) |
-                           (uint32_t)data[4];
-    
-    if (len < GRPC_HEADER_SIZE + message_len) return -1;
-    
-    *message_out = malloc(message_len);
-    if (!*message_out) return -1;
-    
-    memcpy(*message_out, data + GRPC_HEADER_SIZE, message_len);
-    *message_len_out = message_len;
+static int io_connection_add(io_connection *io, grpc_call *call) {
+    if (io->count == io->capacity) {
+        size_t capacity = io->capacity ? io->capacity * 2 : 8;
+        grpc_call **calls = realloc(io->calls, capacity * sizeof(*calls));
+        if (!calls) return -1;
+        io->calls = calls;
+        io->capacity = capacity;
+    }
+    io->calls[io->count++] = call;
     return 0;
 }
 
-/* Main gRPC unary call function */
-int mic_grpc_unary_call(const char *target,
-                        const char *host,
-                        const char *method,
-                        const uint8_t *request,
-                        size_t request_len,
-                        const char *auth_token,
-                        int use_tls,
-                        uint8_t **response_out,
-                        size_t *response_len_out,
-                        char **error_out) {
-    if (!response_out || !response_len_out || !error_out) return 1;
-    
-    *response_out = NULL;
-    *response_len_out = 0;
-    *error_out = NULL;
-    
-    grpc_connection conn = {0};
-    conn.use_tls = use_tls;
-    conn.fd = -1;
-    conn.grpc_status = -1;
-    
-    /* Parse target (host:port) */
-    char *target_copy = strdup(target);
-    char *colon = strrchr(target_copy, ':');
-    int port = use_tls ? 443 : 80;
-    char *hostname = target_copy;
-    
-    if (colon) {
-        *colon = '\0';
-        port = atoi(colon + 1);
+static io_connection *io_connection_new(io_connection **conns, grpc_connection *conn) {
+    io_connection *io = calloc(1, sizeof(io_connection));
+    if (!io) {
+        pool_release(conn);
+        return NULL;
     }
-    
-    /* Connect */
-    if (connect_to_server(&conn, hostname, port) != 0) {
-        *error_out = dup_string(conn.error_message);
-        free(target_copy);
-        if (conn.error_message) free(conn.error_message);
-        return 1;
+    io->conn = conn;
+    io->next = *conns;
+    *conns = io;
+    return io;
+}
+
+/* Start a call as a new stream on a connection the I/O thread owns */
+static void io_submit_call(io_connection *io, mic_grpc_async_call *async) {
+    if (io_connection_add(io, &async->call) != 0) {
+        call_fail(&async->call, CALL_FAILED, "Failed to allocate gRPC call");
+        async_complete(async);
+        return;
+    }
+
+    if (call_submit(io->conn, async->host, async->auth_header, &async->call) != 0) {
+        call_fail(&async->call, io->conn->reused ? CALL_RETRYABLE : CALL_FAILED,
+                  "Failed to submit HTTP/2 request");
+        io->conn->broken = 1;
+    }
+}
+
+static void io_connect_free(io_connect *pending) {
+    free(pending->key);
+    free(pending->target);
+    free(pending->error);
+    free(pending);
+}
+
+/* Helper thread: open the connection, then hand it back to the I/O thread */
+static void *io_connect_main(void *arg) {
+    io_connect *pending = arg;
+    char *error = NULL;
+    grpc_connection *conn = NULL;
+
+    char *key = strdup(pending->key);
+    if (key) {
+        conn = connection_open(pending->target, pending->use_tls, pending->profile,
+                               pending->deadline_ms, key, &error);
+    } else {
+        error = dup_string("Failed to allocate connection");
+    }
+
+    pthread_mutex_lock(&io_mutex);
+    pending->conn = conn;
+    pending->error = error;
+    pending->done = 1;
+    pthread_mutex_unlock(&io_mutex);
+    io_wake();
+    return NULL;
+}
+
+static io_connect *io_connect_start(mic_grpc_async_call *async) {
+    io_connect *pending = calloc(1, sizeof(io_connect));
+    if (!pending) return NULL;
+    pending->key = strdup(async->key);
+    pending->target = strdup(async->target);
+    pending->use_tls = async->use_tls;
+    pending->profile = async->profile;
+    pending->deadline_ms = async->call.deadline_ms;
+    if (!pending->key || !pending->target) {
+        io_connect_free(pending);
+        return NULL;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, io_connect_main, pending);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        io_connect_free(pending);
+        return NULL;
     }
+    return pending;
+}
+
+/* Queue the call on the connection being opened for its key, starting one if needed */
+static void io_connect_wait(io_connect **connecting, mic_grpc_async_call *async) {
+    io_connect *pending = *connecting;
+    while (pending && strcmp(pending->key, async->key) != 0) pending = pending->next;
 
-    /* Setup TLS if needed */
-    if (use_tls) {
-        if (setup_tls(&conn, hostname) != 0) {
-            *error_out = dup_string(conn.error_message);
-            close(conn.fd);
-            free(target_copy);
-            if (conn.error_message) free(conn.error_message);
-            return 1;
+    if (!pending) {
+        pending = io_connect_start(async);
+        if (!pending) {
+            call_fail(&async->call, CALL_FAILED, "Failed to start connecting");
+            async_complete(async);
+            return;
         }
+        pending->next = *connecting;
+        *connecting = pending;
     }
 
-    free(target_copy);
+    async->next = NULL;
+    if (pending->waiting_tail) {
+        pending->waiting_tail->next = async;
+    } else {
+        pending->waiting = async;
+    }
+    pending->waiting_tail = async;
+}
 
-    /* Setup HTTP/2 */
-    if (setup_http2(&conn) != 0) {
-        *error_out = dup_string(conn.error_message);
-        goto cleanup;
-    }
-    
-    /* Build gRPC-framed request */
-    size_t grpc_request_len;
-    uint8_t *grpc_request = build_grpc_request(request, request_len, &grpc_request_len);
-    if (!grpc_request) {
-        *error_out = dup_string("Failed to build gRPC request");
-        goto cleanup;
-    }
-    
-    conn.request_data = grpc_request;
-    conn.request_len = grpc_request_len;
-    conn.request_sent = 0;
-    
-    /* Build HTTP/2 headers */
-    char authority[256];
-    snprintf(authority, sizeof(authority), "%s", host);
-    
-    char content_length[32];
-    snprintf(content_length, sizeof(content_length), "%zu", grpc_request_len);
-    
-    char auth_header[1024];
-    if (auth_token && auth_token[0]) {
-        snprintf(auth_header, sizeof(auth_header), "Bearer %s", auth_token);
+/* Start the calls waiting on connections their helper threads have finished opening */
+static void io_finish_connects(io_connection **conns, io_connect **connecting) {
+    io_connect *finished = NULL;
+    pthread_mutex_lock(&io_mutex);
+    io_connect **link = connecting;
+    while (*link) {
+        io_connect *pending = *link;
+        if (!pending->done) {
+            link = &pending->next;
+            continue;
+        }
+        *link = pending->next;
+        pending->next = finished;
+        finished = pending;
     }
-    
-    nghttp2_nv headers[8];
-    int header_count = 0;
-    
-    headers[header_count++] = (nghttp2_nv){
-        (uint8_t *)":method", (uint8_t *)"POST", 7, 4, NGHTTP2_NV_FLAG_NONE
-    };
-    headers[header_count++] = (nghttp2_nv){
-        (uint8_t *)":scheme", (uint8_t *)(use_tls ? "https" : "http"),
-        7, use_tls ? 5 : 4, NGHTTP2_NV_FLAG_NONE
-    };
-    headers[header_count++] = (nghttp2_nv){
-        (uint8_t *)":path", (uint8_t *)method,
-        5, strlen(method), NGHTTP2_NV_FLAG_NONE
-    };
-    headers[header_count++] = (nghttp2_nv){
-        (uint8_t *)":authority", (uint8_t *)authority,
-        10, strlen(authority), NGHTTP2_NV_FLAG_NONE
-    };
-    headers[header_count++] = (nghttp2_nv){
-        (uint8_t *)"content-type", (uint8_t *)"application/grpc",
-        12, 16, NGHTTP2_NV_FLAG_NONE
-    };
-    headers[header_count++] = (nghttp2_nv){
-        (uint8_t *)"te", (uint8_t *)"trailers",
-        2, 8, NGHTTP2_NV_FLAG_NONE
-    };
-    
-    if (auth_token && auth_token[0]) {
-        headers[header_count++] = (nghttp2_nv){
-            (uint8_t *)"authorization", (uint8_t *)auth_header,
-            13, strlen(auth_header), NGHTTP2_NV_FLAG_NONE
-        };
+    pthread_mutex_unlock(&io_mutex);
+
+    while (finished) {
+        io_connect *pending = finished;
+        finished = pending->next;
+
+        /* With no calls left waiting, the connection still goes to the pool */
+        io_connection *io = pending->conn ? io_connection_new(conns, pending->conn) : NULL;
+        const char *error = pending->conn ? "Failed to allocate connection"
+                                          : pending->error ? pending->error : "Failed to connect";
+
+        mic_grpc_async_call *async = pending->waiting;
+        while (async) {
+            mic_grpc_async_call *next = async->next;
+            if (io) {
+                io_submit_call(io, async);
+            } else {
+                call_fail(&async->call, CALL_FAILED, error);
+                async_complete(async);
+            }
+            async = next;
+        }
+        io_connect_free(pending);
     }
-    
-    /* Setup data provider */
-    nghttp2_data_provider data_prd;
-    data_prd.source.ptr = &conn;
-    data_prd.read_callback = data_source_read_callback;
-    
-    /* Submit request */
-    conn.request_stream_id = nghttp2_submit_request(
-        conn.session, NULL, headers, header_count, &data_prd, &conn
-    );
-    
-    if (conn.request_stream_id < 0) {
-        *error_out = dup_string("Failed to submit HTTP/2 request");
-        free(grpc_request);
-        goto cleanup;
-    }
-    
-    /* Send/receive loop */
-    struct timespec start_time;
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-
-    while (!conn.response_complete) {
-        int ret = nghttp2_session_send(conn.session);
+}
+
+/* Run the call on a live connection for its key; if there is none, open one off-thread */
+static void io_start_call(io_connection **conns, io_connect **connecting, mic_grpc_async_call *async) {
+    pthread_mutex_lock(&io_mutex);
+    int cancelled = async->cancelled;
+    pthread_mutex_unlock(&io_mutex);
+    if (cancelled) {
+        call_fail(&async->call, CALL_FAILED, "gRPC call cancelled");
+        async_complete(async);
+        return;
+    }
+
+    for (io_connection *io = *conns; io; io = io->next) {
+        grpc_connection *conn = io->conn;
+        if (!conn->broken && !conn->goaway && strcmp(conn->key, async->key) == 0) {
+            io_submit_call(io, async);
+            return;
+        }
+    }
+
+    grpc_connection *conn = pool_take_alive(async->key);
+    if (!conn) {
+        io_connect_wait(connecting, async);
+        return;
+    }
+
+    io_connection *io = io_connection_new(conns, conn);
+    if (!io) {
+        call_fail(&async->call, CALL_FAILED, "Failed to allocate connection");
+        async_complete(async);
+        return;
+    }
+    io_submit_call(io, async);
+}
+
+/* Fail calls whose caller cancelled them or whose deadline passed */
+static void io_expire_calls(io_connection *conns, io_connect *connecting, int check_cancelled, long long now) {
+    mic_grpc_async_call *expired = NULL;
+
+    if (check_cancelled) pthread_mutex_lock(&io_mutex);
+    for (io_connection *io = conns; io; io = io->next) {
+        for (size_t i = 0; check_cancelled && i < io->count; i++) {
+            mic_grpc_async_call *async = (mic_grpc_async_call *)io->calls[i];
+            if (async->call.result == CALL_PENDING && async->cancelled) {
+                call_fail(&async->call, CALL_FAILED, "gRPC call cancelled");
+            }
+        }
+        expire_calls(io->calls, io->count, now);
+    }
+
+    /* Calls still waiting for a connection have no stream; complete them here */
+    for (io_connect *pending = connecting; pending; pending = pending->next) {
+        mic_grpc_async_call **link = &pending->waiting;
+        pending->waiting_tail = NULL;
+        while (*link) {
+            mic_grpc_async_call *async = *link;
+            grpc_call *call = &async->call;
+            if (check_cancelled && async->cancelled) {
+                call_fail(call, CALL_FAILED, "gRPC call cancelled");
+            } else {
+                expire_calls(&call, 1, now);
+            }
+            if (call->result == CALL_PENDING) {
+                pending->waiting_tail = async;
+                link = &async->next;
+                continue;
+            }
+            *link = async->next;
+            async->next = expired;
+            expired = async;
+        }
+    }
+    if (check_cancelled) pthread_mutex_unlock(&io_mutex);
+
+    while (expired) {
+        mic_grpc_async_call *async = expired;
+        expired = async->next;
+        async_complete(async);
+    }
+}
+
+/* Earliest deadline among calls waiting for a connection, or -1 */
+static long long io_connect_deadline(io_connect *connecting) {
+    long long next = -1;
+    for (io_connect *pending = connecting; pending; pending = pending->next) {
+        for (mic_grpc_async_call *async = pending->waiting; async; async = async->next) {
+            if (next < 0 || async->call.deadline_ms < next) next = async->call.deadline_ms;
+        }
+    }
+    return next;
+}
+
+/*
+ * Remove settled calls from a connection. Streams still open are reset and
+ * the reset flushed before the call is completed, since the caller may free
+ * the call (and the request buffer nghttp2 is reading from) right away.
+ * Refused calls are queued on *retry for one more attempt.
+ */
+static void io_settle_calls(io_connection *io, mic_grpc_async_call **retry) {
+    grpc_connection *conn = io->conn;
+    size_t i = 0;
+    while (i < io->count) {
+        grpc_call *call = io->calls[i];
+        if (call->result == CALL_PENDING) {
+            i++;
+            continue;
+        }
+        io->calls[i] = io->calls[--io->count];
+
+        if (call->stream_id > 0) {
+            if (call_cancel_stream(conn, call) && nghttp2_session_send(conn->session) != 0) {
+                conn->broken = 1;
+            }
+            nghttp2_session_set_stream_user_data(conn->session, call->stream_id, NULL);
+        }
+
+        mic_grpc_async_call *async = (mic_grpc_async_call *)call;
+        if (call->result == CALL_RETRYABLE && async->attempts < 2) {
+            call_reset(call);
+            async->attempts++;
+            async->next = *retry;
+            *retry = async;
+            continue;
+        }
+        async_complete(async);
+    }
+}
+
+/* Flush a connection and settle what finished; returns the poll events it needs next */
+static short io_connection_service(io_connection *io, int eof, mic_grpc_async_call **retry) {
+    grpc_connection *conn = io->conn;
+
+    if (!conn->broken && !eof) {
+        conn->ssl_want_read = 0;
+        conn->ssl_want_write = 0;
+        int ret = conn->out_len > 0 && flush_pending_output(conn) < 0
+            ? NGHTTP2_ERR_CALLBACK_FAILURE
+            : nghttp2_session_send(conn->session);
         if (ret != 0) {
-            *error_out = dup_string(nghttp2_strerror(ret));
-            free(grpc_request);
-            goto cleanup;
+            conn->broken = 1;
+            fail_pending_calls(conn, io->calls, io->count, nghttp2_strerror(ret));
+        }
+    }
+
+    collect_finished_calls(conn, io->calls, io->count, eof);
+    if (eof) conn->broken = 1;
+    if (conn->broken) {
+        fail_pending_calls(conn, io->calls, io->count, "Connection closed by server");
+    }
+    io_settle_calls(io, retry);
+    if (io->count == 0 || conn->broken) return 0;
+
+    short events = 0;
+    if (nghttp2_session_want_read(conn->session) || conn->ssl_want_read) events |= POLLIN;
+    if (nghttp2_session_want_write(conn->session) || conn->ssl_want_write || conn->out_len > 0) {
+        events |= POLLOUT;
+    }
+    if (events == 0) {
+        /* Session is finished (e.g. after GOAWAY) with streams still open */
+        conn->broken = 1;
+        fail_pending_calls(conn, io->calls, io->count, "Connection closed by server");
+        io_settle_calls(io, retry);
+    }
+    return events;
+}
+
+static void io_start_calls(io_connection **conns, io_connect **connecting, mic_grpc_async_call *calls) {
+    while (calls) {
+        mic_grpc_async_call *next = calls->next;
+        io_start_call(conns, connecting, calls);
+        calls = next;
+    }
+}
+
+/* Make room for needed poll entries; the wakeup pipe is always entry 0 */
+static int io_reserve_poll(struct pollfd **pfds, io_connection ***polled, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return 0;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    if (new_capacity < needed) new_capacity = needed;
+    struct pollfd *new_pfds = realloc(*pfds, new_capacity * sizeof(**pfds));
+    if (!new_pfds) return -1;
+    *pfds = new_pfds;
+    io_connection **new_polled = realloc(*polled, new_capacity * sizeof(**polled));
+    if (!new_polled) return -1;
+    *polled = new_polled;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static void *io_thread_main(void *arg) {
+    (void)arg;
+    io_connection *conns = NULL;
+    io_connect *connecting = NULL;
+    struct pollfd *pfds = NULL;
+    io_connection **polled = NULL;
+    size_t poll_capacity = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&io_mutex);
+        mic_grpc_async_call *submitted = io_submit_head;
+        io_submit_head = NULL;
+        io_submit_tail = NULL;
+        int check_cancelled = io_cancel_pending;
+        io_cancel_pending = 0;
+        pthread_mutex_unlock(&io_mutex);
+        io_drain_wakeups();
+
+        io_finish_connects(&conns, &connecting);
+        io_start_calls(&conns, &connecting, submitted);
+        io_expire_calls(conns, connecting, check_cancelled, monotonic_ms());
+
+        size_t conn_count = 0;
+        for (io_connection *io = conns; io; io = io->next) conn_count++;
+        if (io_reserve_poll(&pfds, &polled, &poll_capacity, conn_count + 1) != 0) {
+            /* Out of memory: back off briefly rather than spin */
+            wait_fd(io_wake_fds[0], POLLIN, 10);
+            continue;
         }
+        pfds[0] = (struct pollfd){ .fd = io_wake_fds[0], .events = POLLIN, .revents = 0 };
+        size_t nfds = 1;
+
+        /* Service every connection; those with no calls left go back to the pool */
+        long long next_deadline = io_connect_deadline(connecting);
+        mic_grpc_async_call *retry = NULL;
+        io_connection **link = &conns;
+        while (*link) {
+            io_connection *io = *link;
+            short events = io_connection_service(io, 0, &retry);
+            if (io->count == 0) {
+                *link = io->next;
+                pool_release(io->conn);
+                free(io->calls);
+                free(io);
+                continue;
+            }
 
-        ret = nghttp2_session_recv(conn.session);
-        if (ret != 0 && ret != NGHTTP2_ERR_EOF) {
-            *error_out = dup_string(nghttp2_strerror(ret));
-            free(grpc_request);
-            goto cleanup;
+            pfds[nfds] = (struct pollfd){ .fd = io->conn->fd, .events = events, .revents = 0 };
+            polled[nfds] = io;
+            nfds++;
+            long long deadline = next_call_deadline(io->calls, io->count);
+            if (next_deadline < 0 || (deadline >= 0 && deadline < next_deadline)) next_deadline = deadline;
+            link = &io->next;
         }
 
-        if (ret == NGHTTP2_ERR_EOF) break;
+        /* Refused calls start over on a connection that is still usable */
+        if (retry) {
+            io_start_calls(&conns, &connecting, retry);
+            continue;
+        }
 
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        long elapsed_ms =
-            (now.tv_sec - start_time.tv_sec) * 1000L + (now.tv_nsec - start_time.tv_nsec) / 1000000L;
+        int timeout = -1;
+        if (next_deadline >= 0) {
+            long long remaining = next_deadline - monotonic_ms();
+            timeout = remaining > 0 ? (int)remaining : 0;
+        }
+        if (poll(pfds, nfds, timeout) <= 0) continue;
 
-        if (elapsed_ms > 3000 && conn.response_len > 0) {
-            conn.response_complete = 1;
-        } else if (elapsed_ms > 300000) {  // 5 minute timeout for large uploads
-            *error_out = dup_string("gRPC request timed out");
-            free(grpc_request);
-            goto cleanup;
+        for (size_t i = 1; i < nfds; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            io_connection *io = polled[i];
+            int ret = nghttp2_session_recv(io->conn->session);
+            if (ret == NGHTTP2_ERR_EOF) {
+                io_connection_service(io, 1, &retry);
+            } else if (ret != 0) {
+                io->conn->broken = 1;
+                fail_pending_calls(io->conn, io->calls, io->count, nghttp2_strerror(ret));
+            }
         }
+        io_start_calls(&conns, &connecting, retry);
     }
-    
-    free(grpc_request);
-    
-    /* Check gRPC status */
-    if (conn.grpc_status != 0 && conn.grpc_status != -1) {
-        if (conn.error_message) {
-            *error_out = dup_string(conn.error_message);
-        } else {
-            char buf[64];
-            snprintf(buf, sizeof(buf), "gRPC error: status %d", conn.grpc_status);
-            *error_out = dup_string(buf);
+
+    return NULL;
+}
+
+static void io_init(void) {
+    if (pipe(io_wake_fds) != 0) return;
+    if (set_nonblocking(io_wake_fds[0]) != 0 || set_nonblocking(io_wake_fds[1]) != 0) return;
+    fcntl(io_wake_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(io_wake_fds[1], F_SETFD, FD_CLOEXEC);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, io_thread_main, NULL) == 0) io_started = 1;
+    pthread_attr_destroy(&attr);
+}
+
+mic_grpc_completion_set *mic_grpc_completion_set_new(void) {
+    mic_grpc_completion_set *set = calloc(1, sizeof(mic_grpc_completion_set));
+    if (!set) return NULL;
+    pthread_mutex_init(&set->mutex, NULL);
+    pthread_cond_init(&set->cond, NULL);
+    return set;
+}
+
+void mic_grpc_completion_set_free(mic_grpc_completion_set *set) {
+    if (!set) return;
+    mic_grpc_async_call *async = set->head;
+    while (async) {
+        mic_grpc_async_call *next = async->next;
+        mic_grpc_call_free(async);
+        async = next;
+    }
+    pthread_cond_destroy(&set->cond);
+    pthread_mutex_destroy(&set->mutex);
+    free(set);
+}
+
+mic_grpc_async_call *mic_grpc_call_start(mic_grpc_completion_set *set,
+                                         const char *target,
+                                         const char *host,
+                                         int use_tls,
+                                         mic_grpc_profile profile,
+                                         const char *method,
+                                         const uint8_t *request,
+                                         size_t request_len,
+                                         const char *auth_token,
+                                         const mic_grpc_call_options *options,
+                                         void *tag,
+                                         char **error_out) {
+    if (!error_out) return NULL;
+    *error_out = NULL;
+
+    if (!set || !target || !host || !method) {
+        *error_out = dup_string("Invalid gRPC call arguments");
+        return NULL;
+    }
+
+    pthread_once(&io_once, io_init);
+    if (!io_started) {
+        *error_out = dup_string("Failed to start gRPC I/O thread");
+        return NULL;
+    }
+
+    mic_grpc_async_call *async = calloc(1, sizeof(mic_grpc_async_call));
+    if (!async) {
+        *error_out = dup_string("Failed to allocate gRPC call");
+        return NULL;
+    }
+
+    async->key = connection_key(target, host, use_tls, profile);
+    async->target = strdup(target);
+    async->host = strdup(host);
+    async->method = strdup(method);
+    async->request = malloc(request_len ? request_len : 1);
+    if (auth_token && auth_token[0]) {
+        size_t len = strlen(auth_token) + 8;
+        async->auth_header = malloc(len);
+        if (async->auth_header) snprintf(async->auth_header, len, "Bearer %s", auth_token);
+    }
+    if (!async->key || !async->target || !async->host || !async->method || !async->request ||
+        (auth_token && auth_token[0] && !async->auth_header)) {
+        mic_grpc_call_free(async);
+        *error_out = dup_string("Failed to allocate gRPC call");
+        return NULL;
+    }
+    if (request_len) memcpy(async->request, request, request_len);
+
+    call_init(&async->call, async->method, async->request, request_len);
+    async->use_tls = use_tls;
+    async->profile = profile;
+    call_set_options(&async->call, options, profile);
+    async->attempts = 1;
+    async->set = set;
+    async->tag = tag;
+
+    pthread_mutex_lock(&io_mutex);
+    if (io_submit_tail) {
+        io_submit_tail->next = async;
+    } else {
+        io_submit_head = async;
+    }
+    io_submit_tail = async;
+    pthread_mutex_unlock(&io_mutex);
+    io_wake();
+
+    return async;
+}
+
+void mic_grpc_call_cancel(mic_grpc_async_call *async) {
+    if (!async) return;
+    pthread_mutex_lock(&io_mutex);
+    async->cancelled = 1;
+    io_cancel_pending = 1;
+    pthread_mutex_unlock(&io_mutex);
+    io_wake();
+}
+
+mic_grpc_cancel_token *mic_grpc_cancel_token_new(void) {
+    mic_grpc_cancel_token *token = calloc(1, sizeof(mic_grpc_cancel_token));
+    if (!token) return NULL;
+    if (pipe(token->fds) != 0) {
+        free(token);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        set_nonblocking(token->fds[i]);
+        fcntl(token->fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return token;
+}
+
+void mic_grpc_cancel_token_cancel(mic_grpc_cancel_token *token) {
+    if (!token || __atomic_exchange_n(&token->cancelled, 1, __ATOMIC_ACQ_REL)) return;
+
+    /* Never drained: the read end stays readable and wakes every loop polling it */
+    ssize_t ret;
+    do {
+        ret = write(token->fds[1], "", 1);
+    } while (ret < 0 && errno == EINTR);
+
+    /* Async calls are checked by the I/O thread whenever it wakes */
+    if (io_started) io_wake();
+}
+
+int mic_grpc_cancel_token_is_cancelled(const mic_grpc_cancel_token *token) {
+    return token && __atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE);
+}
+
+void mic_grpc_cancel_token_free(mic_grpc_cancel_token *token) {
+    if (!token) return;
+    close(token->fds[0]);
+    close(token->fds[1]);
+    free(token);
+}
+
+mic_grpc_async_call *mic_grpc_completion_set_next(mic_grpc_completion_set *set, int timeout_ms) {
+    if (!set) return NULL;
+
+    struct timespec deadline;
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
         }
-        goto cleanup;
     }
-    
-    /* Parse gRPC response */
-    if (conn.response_len > 0) {
-        uint8_t *message;
-        size_t message_len;
-        if (parse_grpc_response(conn.response_data, conn.response_len,
-                               &message, &message_len) == 0) {
-            *response_out = message;
-            *response_len_out = message_len;
-        } else {
-            *error_out = dup_string("Failed to parse gRPC response");
+
+    pthread_mutex_lock(&set->mutex);
+    while (!set->head && timeout_ms != 0) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&set->cond, &set->mutex);
+        } else if (pthread_cond_timedwait(&set->cond, &set->mutex, &deadline) == ETIMEDOUT) {
+            break;
         }
     }
+    mic_grpc_async_call *async = set->head;
+    if (async) {
+        set->head = async->next;
+        if (!set->head) set->tail = NULL;
+        async->next = NULL;
+    }
+    pthread_mutex_unlock(&set->mutex);
+    return async;
+}
+
+void *mic_grpc_call_tag(const mic_grpc_async_call *async) {
+    return async ? async->tag : NULL;
+}
+
+int mic_grpc_call_result(mic_grpc_async_call *async,
+                         uint8_t **response_out,
+                         size_t *response_len_out,
+                         char **error_out) {
+    if (!async || !response_out || !response_len_out || !error_out) return 1;
+
+    *response_out = NULL;
+    *response_len_out = 0;
+    *error_out = NULL;
+
+    if (async->call.result != CALL_OK) {
+        *error_out = async->call.result_error ? async->call.result_error : dup_string("gRPC call failed");
+        async->call.result_error = NULL;
+        return call_error_code(&async->call);
+    }
+
+    *response_out = async->call.result_message;
+    *response_len_out = async->call.result_message_len;
+    async->call.result_message = NULL;
+    async->call.result_message_len = 0;
+    return 0;
+}
 
-cleanup:
-    if (conn.response_data) free(conn.response_data);
-    if (conn.error_message) free(conn.error_message);
-    if (conn.session) nghttp2_session_del(conn.session);
-    if (conn.ssl) SSL_free(conn.ssl);
-    if (conn.ssl_ctx) SSL_CTX_free(conn.ssl_ctx);
-    if (conn.fd >= 0) close(conn.fd);
-    
-    return *error_out ? 1 : 0;
+void mic_grpc_call_free(mic_grpc_async_call *async) {
+    if (!async) return;
+    free(async->call.result_message);
+    free(async->call.result_error);
+    free(async->key);
+    free(async->target);
+    free(async->host);
+    free(async->method);
+    free(async->auth_header);
+    free(async->request);
+    free(async);
 }
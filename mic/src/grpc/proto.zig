@@ -62,11 +62,16 @@ pub const Decoder = struct {
     }
 
     pub fn readBytes(self: *Decoder, allocator: std.mem.Allocator) ![]u8 {
+        return allocator.dupe(u8, try self.readBytesView());
+    }
+
+    /// Like readBytes, but returns a slice into the decoder's input instead of a copy.
+    pub fn readBytesView(self: *Decoder) ![]const u8 {
         const len = try self.readVarint();
         if (self.pos + len > self.data.len) return error.UnexpectedEof;
         const slice = self.data[self.pos .. self.pos + @as(usize, @intCast(len))];
         self.pos += @as(usize, @intCast(len));
-        return allocator.dupe(u8, slice);
+        return slice;
     }
 
     pub fn skipField(self: *Decoder, wire_type: WireType) !void {
@@ -66,6 +66,48 @@ pub fn encodeLandSessionRequest(
     return buf.toOwnedSlice();
 }
 
+/// Number of file changes per LandSessionStream message when no batch size is configured.
+pub const default_land_stream_batch_size: usize = 256;
+
+/// Request producer for the client-streaming LandSessionStream call. Each
+/// `next()` encodes one epoch batch and frees the previous one, so only a single
+/// batch is held in memory while the stream is written. Changes that fit in one
+/// batch are sent as a single plain (epoch-less) LandSessionRequest.
+pub const LandRequestStream = struct {
+    allocator: std.mem.Allocator,
+    session_id: []const u8,
+    files: []const FileChange,
+    batch_size: usize,
+    target_branch: ?[]const u8 = null,
+    epoch: u32 = 0,
+    offset: usize = 0,
+    current: ?[]u8 = null,
+
+    pub fn deinit(self: *LandRequestStream) void {
+        if (self.current) |bytes| self.allocator.free(bytes);
+        self.current = null;
+    }
+
+    pub fn next(self: *LandRequestStream) !?[]const u8 {
+        self.deinit();
+        if (self.epoch > 0 and self.offset >= self.files.len) return null;
+
+        const single = self.batch_size == 0 or self.files.len <= self.batch_size;
+        const end = if (single) self.files.len else @min(self.offset + self.batch_size, self.files.len);
+        self.epoch += 1;
+
+        const options: LandSessionOptions = if (single)
+            .{ .target_branch = self.target_branch }
+        else
+            .{ .epoch = self.epoch, .finalize = end == self.files.len, .target_branch = self.target_branch };
+
+        const bytes = try encodeLandSessionRequest(self.allocator, self.session_id, self.files[self.offset..end], options);
+        self.offset = end;
+        self.current = bytes;
+        return bytes;
+    }
+};
+
 pub fn decodeSessionResponse(allocator: std.mem.Allocator, data: []const u8) !Session {
     var decoder = proto.Decoder.init(data);
     var session: ?Session = null;
@@ -211,3 +253,35 @@ pub fn decodeListSessionsResponse(allocator: std.mem.Allocator, data: []const u8
 
     return sessions.toOwnedSlice(allocator);
 }
+
+test "land request stream splits changes into epoch batches" {
+    const allocator = std.testing.allocator;
+    const files = [_]FileChange{
+        .{ .path = "a", .content = "1", .change_type = "added" },
+        .{ .path = "b", .content = "2", .change_type = "added" },
+        .{ .path = "c", .content = "3", .change_type = "modified" },
+    };
+
+    var stream = LandRequestStream{ .allocator = allocator, .session_id = "s", .files = &files, .batch_size = 2 };
+    defer stream.deinit();
+
+    const first = (try stream.next()).?;
+    const expected_first = try encodeLandSessionRequest(allocator, "s", files[0..2], .{ .epoch = 1 });
+    defer allocator.free(expected_first);
+    try std.testing.expectEqualSlices(u8, expected_first, first);
+
+    const second = (try stream.next()).?;
+    const expected_second = try encodeLandSessionRequest(allocator, "s", files[2..], .{ .epoch = 2, .finalize = true });
+    defer allocator.free(expected_second);
+    try std.testing.expectEqualSlices(u8, expected_second, second);
+
+    try std.testing.expect((try stream.next()) == null);
+
+    var single = LandRequestStream{ .allocator = allocator, .session_id = "s", .files = &files, .batch_size = 8 };
+    defer single.deinit();
+    const only = (try single.next()).?;
+    const expected_only = try encodeLandSessionRequest(allocator, "s", &files, .{});
+    defer allocator.free(expected_only);
+    try std.testing.expectEqualSlices(u8, expected_only, only);
+    try std.testing.expect((try single.next()) == null);
+}
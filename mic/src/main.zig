@@ -14,6 +14,7 @@ const log = @import("log.zig");
 const diff = @import("diff.zig");
 const goto = @import("goto.zig");
 const cli = @import("cli_output.zig");
+const grpc_client = @import("grpc/client.zig");
 
 const App = yazap.App;
 const Arg = yazap.Arg;
@@ -27,10 +28,10 @@ fn successResult() cli.CLIResult {
     return .{ .success = .{ .message = "", .details = null } };
 }
 
-fn jsonFlagFromArgs() bool {
+fn flagFromArgs(flag: []const u8) bool {
     var args = std.process.args();
     while (args.next()) |arg| {
-        if (std.mem.eql(u8, arg, "--json")) {
+        if (std.mem.eql(u8, arg, flag)) {
             return true;
         }
     }
@@ -52,11 +53,16 @@ pub fn main() void {
     var gpa = std.heap.GeneralPurposeAllocator(.{}){};
     defer _ = gpa.deinit();
     const allocator = gpa.allocator();
+    defer grpc_client.shutdownPool();
 
     var reporter = cli.CLIReporter.init(allocator);
     defer reporter.deinit();
 
-    const json_output = jsonFlagFromArgs();
+    const json_output = flagFromArgs("--json");
+
+    // Per-call transport timings go to stderr as calls finish, totals at exit
+    const trace_rpc = flagFromArgs("--trace-rpc");
+    if (trace_rpc) grpc_client.enableTrace();
 
     var env_map = std.process.getEnvMap(allocator) catch {
         std.debug.print("Error: failed to read environment\n", .{});
@@ -96,6 +102,8 @@ pub fn main() void {
         }
     }
 
+    if (trace_rpc) grpc_client.printStats();
+
     const exit_code: u8 = switch (result) {
         .success => 0,
         .@"error" => 1,
@@ -111,6 +119,7 @@ fn run(allocator: std.mem.Allocator, reporter: *cli.CLIReporter) !cli.CLIResult
 
     var root = app.rootCommand();
     try root.addArg(Arg.booleanOption("json", null, "Output JSON"));
+    try root.addArg(Arg.booleanOption("trace-rpc", null, "Print gRPC transport timings to stderr"));
 
     // Auth: Authenticate with a forge
     var auth_cmd = app.createCommand("auth", "Authenticate with a forge");
@@ -195,6 +204,10 @@ fn run(allocator: std.mem.Allocator, reporter: *cli.CLIReporter) !cli.CLIResult
     const status_cmd = app.createCommand("status", "Show workspace changes");
     try root.addSubcommand(status_cmd);
 
+    // Watch: Keep status incremental with a filesystem watcher
+    const watch_cmd = app.createCommand("watch", "Watch the workspace so status skips the tree walk");
+    try root.addSubcommand(watch_cmd);
+
     // Land: Land workspace changes
     var land_cmd = app.createCommand("land", "Land workspace changes");
     try land_cmd.addArg(Arg.positional("GOAL", "What you're trying to accomplish", null));
@@ -540,6 +553,11 @@ fn run(allocator: std.mem.Allocator, reporter: *cli.CLIReporter) !cli.CLIResult
         return successResult();
     }
 
+    if (matches.subcommandMatches("watch")) |_| {
+        try workspace.watch(allocator);
+        return successResult();
+    }
+
     if (matches.subcommandMatches("land")) |land_matches| {
         const goal = land_matches.getSingleValue("GOAL");
         if (goal == null) {
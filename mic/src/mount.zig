@@ -8,6 +8,7 @@ const nfs = @import("fs/nfs.zig");
 const workspace_fs = @import("workspace/fs.zig");
 const config = @import("config.zig");
 const hash = @import("core/hash.zig");
+const cache_mod = @import("cache.zig");
 
 pub const DefaultPort: u16 = 20490;
 const max_record_bytes: usize = 16 * 1024 * 1024;
@@ -164,16 +165,19 @@ pub fn mount(
     const tokens = try auth.requireTokensWithMessage(arena_alloc);
     const endpoint = try grpc_endpoint.parseServer(arena_alloc, tokens.server);
 
+    var blob_source = try BlobSource.init(allocator, tokens.server, tokens.access_token, account, project);
+    defer blob_source.deinit();
+
     var vfs = try buildVirtualFs(
         allocator,
         arena_alloc,
-        tokens.server,
         endpoint,
         tokens.access_token,
         account,
         project,
     );
     defer vfs.deinit();
+    vfs.loader = blob_source.loader();
 
     std.debug.print(
         "Serving {s}/{s} via NFS on 127.0.0.1:{d}\n",
@@ -314,10 +318,11 @@ fn ensureEmptyMountDir(path: []const u8) !void {
     }
 }
 
+/// Builds the VFS from tree metadata only. File contents are fetched by the
+/// VFS loader the first time NFS touches them.
 fn buildVirtualFs(
     allocator: std.mem.Allocator,
     arena: std.mem.Allocator,
-    server: []const u8,
     endpoint: grpc_endpoint.Endpoint,
     access_token: []const u8,
     account: []const u8,
@@ -328,7 +333,7 @@ fn buildVirtualFs(
 
     const response = try grpc_client.unaryCall(
         arena,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetHeadTree",
         request,
         access_token,
@@ -340,15 +345,6 @@ fn buildVirtualFs(
     var vfs = try nfs.VirtualFs.init(allocator);
     errdefer vfs.deinit();
 
-    var blob_options = try content_mod.prepareBlobFetchOptions(
-        allocator,
-        server,
-        account,
-        project,
-        access_token,
-    );
-    defer blob_options.deinit(allocator);
-
     for (tree.entries) |entry| {
         if (!isSafePath(entry.path)) {
             std.debug.print("Error: Unsafe path in tree: {s}\n", .{entry.path});
@@ -359,20 +355,221 @@ fn buildVirtualFs(
         defer allocator.free(vfs_path);
 
         try addParentDirs(&vfs, vfs_path);
+        try vfs.addLazyFile(vfs_path, entry.hash);
+    }
 
-        const content = try content_mod.fetchBlobWithOptions(
+    return vfs;
+}
+
+/// Serves blob contents to the VFS through `BlobCache`. Prefetch hints are
+/// fetched on a background thread that warms the cache, so a later read of
+/// a sibling file is a cache hit instead of a round trip.
+const BlobSource = struct {
+    allocator: std.mem.Allocator,
+    server: []const u8,
+    account: []const u8,
+    project: []const u8,
+    blob_options: content_mod.BlobFetchOptions,
+    blob_cache: cache_mod.BlobCache,
+    /// Guards `blob_cache`, `queue` and `stopping`.
+    mutex: std.Thread.Mutex = .{},
+    wake: std.Thread.Condition = .{},
+    queue: std.ArrayList([]u8) = .empty,
+    stopping: bool = false,
+    worker: ?std.Thread = null,
+
+    fn init(
+        allocator: std.mem.Allocator,
+        server: []const u8,
+        access_token: []const u8,
+        account: []const u8,
+        project: []const u8,
+    ) !BlobSource {
+        var blob_options = try content_mod.prepareBlobFetchOptions(
             allocator,
             server,
             account,
             project,
-            entry.hash,
-            &blob_options,
+            access_token,
         );
-        defer allocator.free(content);
-        try vfs.addFile(vfs_path, content);
+        errdefer blob_options.deinit(allocator);
+
+        return .{
+            .allocator = allocator,
+            .server = server,
+            .account = account,
+            .project = project,
+            .blob_options = blob_options,
+            .blob_cache = try cache_mod.BlobCache.init(allocator, .{}),
+        };
     }
 
-    return vfs;
+    fn deinit(self: *BlobSource) void {
+        self.mutex.lock();
+        self.stopping = true;
+        self.wake.signal();
+        self.mutex.unlock();
+        if (self.worker) |worker| worker.join();
+
+        for (self.queue.items) |blob_hash| self.allocator.free(blob_hash);
+        self.queue.deinit(self.allocator);
+        self.blob_cache.deinit();
+        self.blob_options.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    fn loader(self: *BlobSource) nfs.BlobLoader {
+        return .{ .ctx = self, .load = load, .prefetch = prefetch };
+    }
+
+    fn load(ctx: *anyopaque, blob_hash: []const u8) anyerror![]u8 {
+        const self: *BlobSource = @ptrCast(@alignCast(ctx));
+        const hash_hex = try hexEncode(self.allocator, blob_hash);
+        defer self.allocator.free(hash_hex);
+
+        if (self.cacheGet(hash_hex)) |cached| return cached;
+        return self.fetch(blob_hash, hash_hex);
+    }
+
+    fn prefetch(ctx: *anyopaque, blob_hashes: []const []const u8) void {
+        const self: *BlobSource = @ptrCast(@alignCast(ctx));
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.stopping) return;
+
+        for (blob_hashes) |blob_hash| {
+            const owned = self.allocator.dupe(u8, blob_hash) catch return;
+            self.queue.append(self.allocator, owned) catch {
+                self.allocator.free(owned);
+                return;
+            };
+        }
+
+        if (self.worker == null) {
+            // Prefetch is only a hint; without a worker, reads fetch on demand.
+            self.worker = std.Thread.spawn(.{}, prefetchMain, .{self}) catch return;
+        }
+        self.wake.signal();
+    }
+
+    /// Drains everything queued at once, so hints from several reads
+    /// coalesce into GetBlobs batches. Large blobs are left for reads to
+    /// fetch on demand.
+    fn prefetchMain(self: *BlobSource) void {
+        while (true) {
+            var pending = blk: {
+                self.mutex.lock();
+                defer self.mutex.unlock();
+                while (self.queue.items.len == 0 and !self.stopping) self.wake.wait(&self.mutex);
+                if (self.stopping) return;
+                const taken = self.queue;
+                self.queue = .empty;
+                break :blk taken;
+            };
+            defer {
+                for (pending.items) |blob_hash| self.allocator.free(blob_hash);
+                pending.deinit(self.allocator);
+            }
+
+            self.prefetchBatch(pending.items) catch {};
+        }
+    }
+
+    fn prefetchBatch(self: *BlobSource, blob_hashes: []const []u8) !void {
+        var misses: std.ArrayList([]const u8) = .empty;
+        defer misses.deinit(self.allocator);
+        var seen = std.StringHashMap(void).init(self.allocator);
+        defer seen.deinit();
+        for (blob_hashes) |blob_hash| {
+            if ((try seen.getOrPut(blob_hash)).found_existing) continue;
+
+            const hash_hex = try hexEncode(self.allocator, blob_hash);
+            defer self.allocator.free(hash_hex);
+
+            if (self.cacheGet(hash_hex)) |cached| {
+                self.allocator.free(cached);
+                continue;
+            }
+            try misses.append(self.allocator, blob_hash);
+        }
+        if (misses.items.len == 0) return;
+
+        if (self.blob_options.cdn_base_url != null) {
+            for (misses.items) |blob_hash| {
+                const hash_hex = try hexEncode(self.allocator, blob_hash);
+                defer self.allocator.free(hash_hex);
+                const content = self.fetch(blob_hash, hash_hex) catch continue;
+                self.allocator.free(content);
+            }
+            return;
+        }
+
+        const CacheSink = struct {
+            source: *BlobSource,
+
+            pub fn onBlob(sink: *@This(), blob_hash: []const u8, content: []const u8) !void {
+                const hash_hex = try hexEncode(sink.source.allocator, blob_hash);
+                defer sink.source.allocator.free(hash_hex);
+
+                sink.source.mutex.lock();
+                defer sink.source.mutex.unlock();
+                try sink.source.blob_cache.put(hash_hex, content);
+            }
+
+            pub fn onLarge(sink: *@This(), blob_hash: []const u8) !void {
+                _ = sink;
+                _ = blob_hash;
+            }
+        };
+        var sink = CacheSink{ .source = self };
+
+        try content_mod.fetchBlobsCoalesced(
+            self.allocator,
+            self.server,
+            self.account,
+            self.project,
+            misses.items,
+            &self.blob_options,
+            .{},
+            &sink,
+        );
+    }
+
+    /// Fetches a blob and stores it in the cache. The network round trip runs
+    /// without the lock so reads are not stuck behind prefetches.
+    fn fetch(self: *BlobSource, blob_hash: []const u8, hash_hex: []const u8) ![]u8 {
+        const content = try content_mod.fetchBlobWithOptions(
+            self.allocator,
+            self.server,
+            self.account,
+            self.project,
+            blob_hash,
+            &self.blob_options,
+        );
+        const owned: []u8 = @constCast(content);
+        errdefer self.allocator.free(owned);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.blob_cache.put(hash_hex, owned);
+        return owned;
+    }
+
+    fn cacheGet(self: *BlobSource, hash_hex: []const u8) ?[]u8 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.blob_cache.get(hash_hex);
+    }
+};
+
+fn hexEncode(allocator: std.mem.Allocator, bytes: []const u8) ![]u8 {
+    const hex = "0123456789abcdef";
+    var out = try allocator.alloc(u8, bytes.len * 2);
+    for (bytes, 0..) |byte, idx| {
+        out[idx * 2] = hex[byte >> 4];
+        out[idx * 2 + 1] = hex[byte & 0x0f];
+    }
+    return out;
 }
 
 fn formatVfsPath(allocator: std.mem.Allocator, path: []const u8) ![]u8 {
@@ -631,114 +631,122 @@ pub fn landSession(allocator: std.mem.Allocator, _: []const u8) !LandResult {
     const endpoint = try grpc_endpoint.parseServer(arena_alloc, server);
     const changes = try mapChangesFromOverlay(arena_alloc, session.files);
     defer arena_alloc.free(changes);
-    const batch_size = epochBatchSize(arena_alloc);
-
-    if (batch_size > 0 and changes.len > batch_size) {
-        var epoch: u32 = 0;
-        var offset: usize = 0;
-
-        while (offset < changes.len) {
-            const end = @min(offset + batch_size, changes.len);
-            const finalize = end == changes.len;
-            epoch += 1;
-
-            const request = try sessions_proto.encodeLandSessionRequest(
-                arena_alloc,
-                session.id,
-                changes[offset..end],
-                .{ .epoch = epoch, .finalize = finalize },
-            );
-            defer arena_alloc.free(request);
-
-            const result = try grpc_client.unaryCallResult(
-                arena_alloc,
-                endpoint,
-                "/micelio.sessions.v1.SessionService/LandSession",
-                request,
-                tokens.access_token,
-            );
-
-            switch (result) {
-                .ok => |response| {
-                    defer arena_alloc.free(response.bytes);
-                    if (finalize) {
-                        const landed =
-                            try sessions_proto.decodeSessionResponse(arena_alloc, response.bytes);
-                        return .{
-                            .success = .{
-                                .session_id = try allocator.dupe(u8, landed.session_id),
-                                .landing_position = landed.landing_position,
-                            },
-                        };
-                    }
-                },
-                .err => |message| {
-                    defer arena_alloc.free(message);
 
-                    // Check if this is a conflict error
-                    if (std.mem.startsWith(u8, message, "Conflicts detected: ")) {
-                        const paths_str = message["Conflicts detected: ".len..];
-                        var conflict_paths: std.ArrayList([]const u8) = .empty;
+    const result = try sendLand(
+        arena_alloc,
+        endpoint,
+        tokens.access_token,
+        session.id,
+        changes,
+        epochBatchSize(arena_alloc),
+    );
+
+    switch (result) {
+        .ok => |response| {
+            defer arena_alloc.free(response.bytes);
+            const landed = try sessions_proto.decodeSessionResponse(arena_alloc, response.bytes);
+            return .{
+                .success = .{
+                    .session_id = try allocator.dupe(u8, landed.session_id),
+                    .landing_position = landed.landing_position,
+                },
+            };
+        },
+        .err => |message| {
+            defer arena_alloc.free(message);
 
-                        var iter = std.mem.splitSequence(u8, paths_str, ", ");
-                        while (iter.next()) |p| {
-                            try conflict_paths.append(allocator, try allocator.dupe(u8, p));
-                        }
+            // Check if this is a conflict error
+            if (std.mem.startsWith(u8, message, "Conflicts detected: ")) {
+                const paths_str = message["Conflicts detected: ".len..];
+                var conflict_paths: std.ArrayList([]const u8) = .empty;
 
-                        return .{ .conflict = .{ .paths = try conflict_paths.toOwnedSlice(allocator) } };
-                    }
+                var iter = std.mem.splitSequence(u8, paths_str, ", ");
+                while (iter.next()) |p| {
+                    try conflict_paths.append(allocator, try allocator.dupe(u8, p));
+                }
 
-                    return .{ .err = try allocator.dupe(u8, message) };
-                },
+                return .{ .conflict = .{ .paths = try conflict_paths.toOwnedSlice(allocator) } };
             }
 
-            offset = end;
-        }
+            return .{ .err = try allocator.dupe(u8, message) };
+        },
+    }
+}
 
-        return .{ .err = "Landing failed." };
-    } else {
-        const request = try sessions_proto.encodeLandSessionRequest(arena_alloc, session.id, changes, .{});
-        defer arena_alloc.free(request);
+/// Sends a session's changes in epoch batches as the messages of one
+/// LandSessionStream call. Servers without that RPC get one unary
+/// LandSession call per batch. A `batch_size` of 0 means no configured size:
+/// the stream uses `default_land_stream_batch_size` and the unary fallback
+/// sends everything in one call. Returns the final response or the first
+/// error.
+pub fn sendLand(
+    allocator: std.mem.Allocator,
+    endpoint: grpc_endpoint.Endpoint,
+    access_token: ?[]const u8,
+    session_id: []const u8,
+    files: []const sessions_proto.FileChange,
+    batch_size: usize,
+) !grpc_client.CallResult {
+    var requests = sessions_proto.LandRequestStream{
+        .allocator = allocator,
+        .session_id = session_id,
+        .files = files,
+        .batch_size = if (batch_size == 0) sessions_proto.default_land_stream_batch_size else batch_size,
+    };
+    defer requests.deinit();
+
+    return grpc_client.clientStreamCallResult(
+        allocator,
+        endpoint.withProfile(.bulk),
+        "/micelio.sessions.v1.SessionService/LandSessionStream",
+        access_token,
+        .zstd,
+        &requests,
+    ) catch |err| switch (err) {
+        // Nothing was applied; start over with unary calls.
+        error.Unimplemented => try sendLandUnary(allocator, endpoint, access_token, session_id, files, batch_size),
+        else => return err,
+    };
+}
 
+fn sendLandUnary(
+    allocator: std.mem.Allocator,
+    endpoint: grpc_endpoint.Endpoint,
+    access_token: ?[]const u8,
+    session_id: []const u8,
+    files: []const sessions_proto.FileChange,
+    batch_size: usize,
+) !grpc_client.CallResult {
+    var requests = sessions_proto.LandRequestStream{
+        .allocator = allocator,
+        .session_id = session_id,
+        .files = files,
+        .batch_size = batch_size,
+    };
+    defer requests.deinit();
+
+    var last: ?grpc_client.Response = null;
+    errdefer if (last) |response| allocator.free(response.bytes);
+
+    while (try requests.next()) |request| {
+        if (last) |response| allocator.free(response.bytes);
+        last = null;
+
+        // The final epoch lands the session server-side; give it the bulk deadline.
         const result = try grpc_client.unaryCallResult(
-            arena_alloc,
-            endpoint,
+            allocator,
+            endpoint.withProfile(.bulk),
             "/micelio.sessions.v1.SessionService/LandSession",
             request,
-            tokens.access_token,
+            access_token,
         );
-
         switch (result) {
-            .ok => |response| {
-                defer arena_alloc.free(response.bytes);
-                const landed = try sessions_proto.decodeSessionResponse(arena_alloc, response.bytes);
-                return .{
-                    .success = .{
-                        .session_id = try allocator.dupe(u8, landed.session_id),
-                        .landing_position = landed.landing_position,
-                    },
-                };
-            },
-            .err => |message| {
-                defer arena_alloc.free(message);
-
-                // Check if this is a conflict error
-                if (std.mem.startsWith(u8, message, "Conflicts detected: ")) {
-                    const paths_str = message["Conflicts detected: ".len..];
-                    var conflict_paths: std.ArrayList([]const u8) = .empty;
-
-                    var iter = std.mem.splitSequence(u8, paths_str, ", ");
-                    while (iter.next()) |p| {
-                        try conflict_paths.append(allocator, try allocator.dupe(u8, p));
-                    }
-
-                    return .{ .conflict = .{ .paths = try conflict_paths.toOwnedSlice(allocator) } };
-                }
-
-                return .{ .err = try allocator.dupe(u8, message) };
-            },
+            .ok => |response| last = response,
+            .err => return result,
         }
     }
+
+    return .{ .ok = last.? };
 }
 
 pub fn abandon(allocator: std.mem.Allocator) !void {
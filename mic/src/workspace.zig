@@ -6,8 +6,12 @@ const grpc_client = @import("grpc/client.zig");
 const grpc_endpoint = @import("grpc/endpoint.zig");
 const content_proto = @import("grpc/content_proto.zig");
 const sessions_proto = @import("grpc/sessions_proto.zig");
+const session_mod = @import("session.zig");
 const manifest = @import("workspace/manifest.zig");
 const fs = @import("workspace/fs.zig");
+const fetch = @import("workspace/fetch.zig");
+const scan = @import("workspace/scan.zig");
+const watcher = @import("workspace/watch.zig");
 const ignore = @import("workspace/ignore.zig");
 const cache_mod = @import("cache.zig");
 
@@ -47,7 +51,7 @@ pub fn checkout(
 
     const response = try grpc_client.unaryCall(
         arena_alloc,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetHeadTree",
         request,
         tokens.access_token,
@@ -58,7 +62,7 @@ pub fn checkout(
     const tree_hash_hex = try hexEncode(arena_alloc, tree.tree_hash);
 
     var entries: std.ArrayList(manifest.WorkspaceEntry) = .empty;
-    var cache_hits: u32 = 0;
+    var jobs: std.ArrayList(fetch.Job) = .empty;
     var blob_options = try content_mod.prepareBlobFetchOptions(
         allocator,
         tokens.server,
@@ -76,34 +80,22 @@ pub fn checkout(
 
         const hash_hex = try hexEncode(arena_alloc, entry.hash);
 
-        // Try cache first
-        const content = if (blob_cache.get(hash_hex)) |cached| blk: {
-            cache_hits += 1;
-            break :blk cached;
-        } else blk: {
-            const fetched = try content_mod.fetchBlobWithOptions(
-                allocator,
-                tokens.server,
-                account,
-                project,
-                entry.hash,
-                &blob_options,
-            );
-            defer allocator.free(fetched);
-
-            try blob_cache.put(hash_hex, fetched);
-
-            break :blk try allocator.dupe(u8, fetched);
-        };
-        defer allocator.free(content);
-
         const file_path = try std.fs.path.join(arena_alloc, &[_][]const u8{ workspace_root, entry.path });
-        try fs.ensureParentDir(file_path);
-        try fs.writeFile(file_path, content);
-
+        try jobs.append(arena_alloc, .{ .blob_hash = entry.hash, .hash_hex = hash_hex, .path = file_path });
         try entries.append(arena_alloc, .{ .path = entry.path, .hash = hash_hex });
     }
 
+    const fetcher = fetch.Fetcher{
+        .allocator = allocator,
+        .blob_cache = &blob_cache,
+        .blob_options = &blob_options,
+        .server = tokens.server,
+        .account = account,
+        .project = project,
+        .concurrency = fetch.concurrencyFromEnv(arena_alloc),
+    };
+    const cache_hits = (try fetcher.run(jobs.items)).from_cache;
+
     const state = manifest.WorkspaceState{
         .version = 1,
         .server = tokens.server,
@@ -114,6 +106,9 @@ pub fn checkout(
     };
 
     try manifest.save(arena_alloc, workspace_root, state);
+    // Every file was just written from a known hash; record their stats so the
+    // first status does not read them all back.
+    scan.seedIndex(arena_alloc, workspace_root, state.entries) catch {};
 
     std.debug.print(
         "Workspace ready: {s} ({d} files",
@@ -152,6 +147,27 @@ pub fn status(allocator: std.mem.Allocator) !void {
     }
 }
 
+/// Runs the watch daemon for the current workspace until interrupted.
+pub fn watch(allocator: std.mem.Allocator) !void {
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const arena_alloc = arena.allocator();
+
+    if (!watcher.supported) {
+        std.debug.print("mic watch needs inotify and is only available on Linux.\n", .{});
+        return;
+    }
+
+    const workspace_root = try std.process.getCwdAlloc(arena_alloc);
+    const parsed = try manifest.load(arena_alloc, workspace_root);
+    if (parsed == null) {
+        std.debug.print("No workspace metadata found. Run 'mic link' or 'mic checkout'.\n", .{});
+        return;
+    }
+
+    try watcher.serve(allocator, workspace_root);
+}
+
 pub fn link(allocator: std.mem.Allocator, target: []const u8) !void {
     var arena = std.heap.ArenaAllocator.init(allocator);
     defer arena.deinit();
@@ -190,7 +206,7 @@ pub fn link(allocator: std.mem.Allocator, target: []const u8) !void {
 
     const response = try grpc_client.unaryCall(
         arena_alloc,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetHeadTree",
         request,
         tokens.access_token,
@@ -269,146 +285,58 @@ pub fn land(allocator: std.mem.Allocator, goal: []const u8) !void {
     const file_changes = try buildFileChanges(arena_alloc, workspace_root, changes);
     defer arena_alloc.free(file_changes);
 
-    const batch_size = epochBatchSize(arena_alloc);
-
-    if (batch_size > 0 and file_changes.len > batch_size) {
-        var epoch: u32 = 0;
-        var offset: usize = 0;
-
-        while (offset < file_changes.len) {
-            const end = @min(offset + batch_size, file_changes.len);
-            const finalize = end == file_changes.len;
-            epoch += 1;
+    const land_result = try session_mod.sendLand(
+        arena_alloc,
+        endpoint,
+        access_token,
+        session_id,
+        file_changes,
+        epochBatchSize(arena_alloc),
+    );
 
-            const land_request = try sessions_proto.encodeLandSessionRequest(
-                arena_alloc,
-                session_id,
-                file_changes[offset..end],
-                .{ .epoch = epoch, .finalize = finalize },
-            );
-            defer arena_alloc.free(land_request);
+    switch (land_result) {
+        .ok => |response| {
+            defer arena_alloc.free(response.bytes);
+            const landed = try sessions_proto.decodeSessionResponse(arena_alloc, response.bytes);
 
-            const land_result = try grpc_client.unaryCallResult(
+            try refreshManifest(
                 arena_alloc,
-                endpoint,
-                "/micelio.sessions.v1.SessionService/LandSession",
-                land_request,
+                state,
+                workspace_root,
                 access_token,
+                landed.landing_position,
             );
 
-            switch (land_result) {
-                .ok => |response| {
-                    defer arena_alloc.free(response.bytes);
-                    if (finalize) {
-                        const landed = try sessions_proto.decodeSessionResponse(
-                            arena_alloc,
-                            response.bytes,
-                        );
-
-                        try refreshManifest(
-                            arena_alloc,
-                            state,
-                            workspace_root,
-                            access_token,
-                            landed.landing_position,
-                        );
-
-                        std.debug.print("Landed session {s}.\n", .{landed.session_id});
-                        if (landed.landing_position > 0) {
-                            std.debug.print("Landing position: {d}\n", .{landed.landing_position});
-                        }
-                    }
-                },
-                .err => |message| {
-                    defer arena_alloc.free(message);
-
-                    // Check if this is a conflict error
-                    if (std.mem.startsWith(u8, message, "Conflicts detected: ")) {
-                        const paths_str = message["Conflicts detected: ".len..];
-
-                        std.debug.print("Error: Conflicts detected with upstream changes.\n", .{});
-                        std.debug.print("\nConflicting files:\n", .{});
-
-                        var iter = std.mem.splitSequence(u8, paths_str, ", ");
-                        while (iter.next()) |path| {
-                            std.debug.print("  - {s}\n", .{path});
-                        }
-
-                        std.debug.print("\nTo resolve:\n", .{});
-                        std.debug.print("  1. Run 'mic sync' to fetch the latest upstream state\n", .{});
-                        std.debug.print("  2. Review and merge your changes with the upstream versions\n", .{});
-                        std.debug.print("  3. Run 'mic land' again\n", .{});
-                        return error.ConflictsDetected;
-                    }
-
-                    std.debug.print("Error: {s}\n", .{message});
-                    return error.LandingFailed;
-                },
+            std.debug.print("Landed session {s}.\n", .{landed.session_id});
+            if (landed.landing_position > 0) {
+                std.debug.print("Landing position: {d}\n", .{landed.landing_position});
             }
+        },
+        .err => |message| {
+            defer arena_alloc.free(message);
 
-            offset = end;
-        }
-    } else {
-        const land_request = try sessions_proto.encodeLandSessionRequest(
-            arena_alloc,
-            session_id,
-            file_changes,
-            .{},
-        );
-        defer arena_alloc.free(land_request);
-
-        const land_result = try grpc_client.unaryCallResult(
-            arena_alloc,
-            endpoint,
-            "/micelio.sessions.v1.SessionService/LandSession",
-            land_request,
-            access_token,
-        );
+            // Check if this is a conflict error
+            if (std.mem.startsWith(u8, message, "Conflicts detected: ")) {
+                const paths_str = message["Conflicts detected: ".len..];
 
-        switch (land_result) {
-            .ok => |response| {
-                defer arena_alloc.free(response.bytes);
-                const landed = try sessions_proto.decodeSessionResponse(arena_alloc, response.bytes);
-
-                try refreshManifest(
-                    arena_alloc,
-                    state,
-                    workspace_root,
-                    access_token,
-                    landed.landing_position,
-                );
-
-                std.debug.print("Landed session {s}.\n", .{landed.session_id});
-                if (landed.landing_position > 0) {
-                    std.debug.print("Landing position: {d}\n", .{landed.landing_position});
-                }
-            },
-            .err => |message| {
-                defer arena_alloc.free(message);
-
-                // Check if this is a conflict error
-                if (std.mem.startsWith(u8, message, "Conflicts detected: ")) {
-                    const paths_str = message["Conflicts detected: ".len..];
-
-                    std.debug.print("Error: Conflicts detected with upstream changes.\n", .{});
-                    std.debug.print("\nConflicting files:\n", .{});
-
-                    var iter = std.mem.splitSequence(u8, paths_str, ", ");
-                    while (iter.next()) |path| {
-                        std.debug.print("  - {s}\n", .{path});
-                    }
-
-                    std.debug.print("\nTo resolve:\n", .{});
-                    std.debug.print("  1. Run 'mic sync' to fetch the latest upstream state\n", .{});
-                    std.debug.print("  2. Review and merge your changes with the upstream versions\n", .{});
-                    std.debug.print("  3. Run 'mic land' again\n", .{});
-                    return error.ConflictsDetected;
+                std.debug.print("Error: Conflicts detected with upstream changes.\n", .{});
+                std.debug.print("\nConflicting files:\n", .{});
+
+                var iter = std.mem.splitSequence(u8, paths_str, ", ");
+                while (iter.next()) |path| {
+                    std.debug.print("  - {s}\n", .{path});
                 }
 
-                std.debug.print("Error: {s}\n", .{message});
-                return error.LandingFailed;
-            },
-        }
+                std.debug.print("\nTo resolve:\n", .{});
+                std.debug.print("  1. Run 'mic sync' to fetch the latest upstream state\n", .{});
+                std.debug.print("  2. Review and merge your changes with the upstream versions\n", .{});
+                std.debug.print("  3. Run 'mic land' again\n", .{});
+                return error.ConflictsDetected;
+            }
+
+            std.debug.print("Error: {s}\n", .{message});
+            return error.LandingFailed;
+        },
     }
 }
 
@@ -429,7 +357,7 @@ fn refreshManifest(
 
     const response = try grpc_client.unaryCall(
         allocator,
-        endpoint,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetHeadTree",
         request,
         access_token,
@@ -463,57 +391,20 @@ fn collectChanges(
     workspace_root: []const u8,
     state: manifest.WorkspaceState,
 ) ![]WorkspaceChange {
-    var known = std.StringHashMap([]const u8).init(allocator);
-    defer {
-        known.deinit();
-    }
-
-    for (state.entries) |entry| {
-        try known.put(entry.path, entry.hash);
-    }
-
-    // Load ignore patterns
-    var ignore_patterns = try ignore.load(allocator, workspace_root);
-    defer ignore_patterns.deinit();
-
-    var changes: std.ArrayList(WorkspaceChange) = .empty;
+    const scanned = watcher.query(allocator, workspace_root) orelse blk: {
+        // Load ignore patterns
+        var ignore_patterns = try ignore.load(allocator, workspace_root);
+        defer ignore_patterns.deinit();
 
-    for (state.entries) |entry| {
-        const path = try std.fs.path.join(allocator, &[_][]const u8{ workspace_root, entry.path });
-        const exists = try fs.fileExists(path);
-        if (!exists) {
-            try changes.append(allocator, .{ .path = entry.path, .change_type = "deleted" });
-            continue;
-        }
-
-        const digest = fs.hashFileSha256(path) catch |err| switch (err) {
-            error.IsDir => {
-                try changes.append(allocator, .{ .path = entry.path, .change_type = "modified" });
-                continue;
-            },
-            else => return err,
-        };
-        const digest_hex = try hexEncode(allocator, &digest);
-        if (!std.mem.eql(u8, digest_hex, entry.hash)) {
-            try changes.append(allocator, .{ .path = entry.path, .change_type = "modified" });
-        }
-    }
-
-    var root_dir = try fs.openDir(workspace_root, true);
-    defer root_dir.close();
-    var walker = try root_dir.walk(allocator);
-    defer walker.deinit();
+        break :blk try scan.scan(allocator, workspace_root, state.entries, &ignore_patterns);
+    };
+    defer allocator.free(scanned);
 
-    while (try walker.next()) |entry| {
-        if (entry.kind != .file) continue;
-        if (isMetadataPath(entry.path)) continue;
-        if (ignore_patterns.shouldIgnore(entry.path)) continue;
-        if (known.contains(entry.path)) continue;
-        const path_copy = try allocator.dupe(u8, entry.path);
-        try changes.append(allocator, .{ .path = path_copy, .change_type = "added" });
+    const changes = try allocator.alloc(WorkspaceChange, scanned.len);
+    for (scanned, changes) |change, *mapped| {
+        mapped.* = .{ .path = change.path, .change_type = @tagName(change.kind) };
     }
-
-    return changes.toOwnedSlice(allocator);
+    return changes;
 }
 
 fn buildFileChanges(
@@ -542,10 +433,6 @@ fn buildFileChanges(
     return mapped;
 }
 
-fn isMetadataPath(path: []const u8) bool {
-    return std.mem.eql(u8, path, ".mic") or std.mem.startsWith(u8, path, ".mic/");
-}
-
 fn isSafePath(path: []const u8) bool {
     if (path.len == 0) return false;
     if (std.fs.path.isAbsolute(path)) return false;
@@ -751,9 +638,34 @@ pub fn syncWorkspace(allocator: std.mem.Allocator, strategy: MergeStrategy) !Syn
     );
     defer arena_alloc.free(head_request);
 
-    const head_response = try grpc_client.unaryCall(
+    const base_position = state.position orelse 0;
+    const base_request = try content_proto.encodeGetTreeAtPositionRequest(
+        arena_alloc,
+        state.account,
+        state.project,
+        base_position,
+    );
+    defer arena_alloc.free(base_request);
+
+    // Fetch the base tree while the head tree is in flight; it is dropped if already up to date
+    var pending_calls = try grpc_client.CompletionSet.init();
+    defer pending_calls.deinit();
+    var base_call: ?grpc_client.AsyncCall = try pending_calls.start(
         arena_alloc,
         endpoint,
+        "/micelio.content.v1.ContentService/GetTreeAtPosition",
+        base_request,
+        access_token,
+        0,
+    );
+    defer if (base_call) |call| {
+        call.cancel();
+        if (pending_calls.next(-1)) |done| done.deinit();
+    };
+
+    const head_response = try grpc_client.unaryCall(
+        arena_alloc,
+        endpoint.withTimeout(grpc_endpoint.tree_timeout_ms),
         "/micelio.content.v1.ContentService/GetHeadTree",
         head_request,
         access_token,
@@ -769,22 +681,16 @@ pub fn syncWorkspace(allocator: std.mem.Allocator, strategy: MergeStrategy) !Syn
         return .{ .updated = 0, .conflicts = &[_][]const u8{} };
     }
 
-    const base_position = state.position orelse 0;
-    const base_request = try content_proto.encodeGetTreeAtPositionRequest(
-        arena_alloc,
-        state.account,
-        state.project,
-        base_position,
-    );
-    defer arena_alloc.free(base_request);
-
-    const base_response = try grpc_client.unaryCall(
-        arena_alloc,
-        endpoint,
-        "/micelio.content.v1.ContentService/GetTreeAtPosition",
-        base_request,
-        access_token,
-    );
+    base_call = null;
+    const base_result = try pending_calls.next(-1).?.finish(arena_alloc);
+    const base_response = switch (base_result) {
+        .ok => |response| response,
+        .err => |message| {
+            defer arena_alloc.free(message);
+            std.debug.print("gRPC error: {s}\n", .{message});
+            return error.RequestFailed;
+        },
+    };
     defer arena_alloc.free(base_response.bytes);
 
     const base_tree = try content_proto.decodeTreeResponse(arena_alloc, base_response.bytes);
@@ -816,7 +722,7 @@ pub fn syncWorkspace(allocator: std.mem.Allocator, strategy: MergeStrategy) !Syn
     }
 
     var updated: u32 = 0;
-    var cache_hits: u32 = 0;
+    var jobs: std.ArrayList(fetch.Job) = .empty;
     var resolved_conflicts: u32 = 0;
     var conflicts: std.ArrayList([]const u8) = .empty;
     var blob_options = try content_mod.prepareBlobFetchOptions(
@@ -854,33 +760,22 @@ pub fn syncWorkspace(allocator: std.mem.Allocator, strategy: MergeStrategy) !Syn
             }
         }
 
-        // Try cache first
-        const content = if (blob_cache.get(new_hash_hex)) |cached| blk: {
-            cache_hits += 1;
-            break :blk cached;
-        } else blk: {
-            const fetched = try content_mod.fetchBlobWithOptions(
-                allocator,
-                state.server,
-                state.account,
-                state.project,
-                entry.hash,
-                &blob_options,
-            );
-            defer allocator.free(fetched);
-
-            try blob_cache.put(new_hash_hex, fetched);
-
-            break :blk try allocator.dupe(u8, fetched);
-        };
-        defer allocator.free(content);
-
         const file_path = try std.fs.path.join(arena_alloc, &[_][]const u8{ workspace_root, entry.path });
-        try fs.ensureParentDir(file_path);
-        try fs.writeFile(file_path, content);
+        try jobs.append(arena_alloc, .{ .blob_hash = entry.hash, .hash_hex = new_hash_hex, .path = file_path });
         updated += 1;
     }
 
+    const fetcher = fetch.Fetcher{
+        .allocator = allocator,
+        .blob_cache = &blob_cache,
+        .blob_options = &blob_options,
+        .server = state.server,
+        .account = state.account,
+        .project = state.project,
+        .concurrency = fetch.concurrencyFromEnv(arena_alloc),
+    };
+    const cache_hits = (try fetcher.run(jobs.items)).from_cache;
+
     // Handle files deleted upstream
     for (state.entries) |entry| {
         if (head_entries.contains(entry.path)) continue;
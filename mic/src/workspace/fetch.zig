@@ -0,0 +1,533 @@
+//! Parallel blob materialization for checkout and sync.
+//!
+//! Entries that share a hash are fetched once and copied to every path that
+//! needs them. Work runs on a bounded set of worker threads in two passes:
+//! first every unique blob is looked up in the cache and hits are written
+//! straight to disk, then the misses are fetched. Without a CDN, misses go out
+//! in GetBlobs batches and only blobs the server reports as large are
+//! streamed one by one. With several workers in flight, network receive for
+//! one batch overlaps disk writes for the others.
+
+const std = @import("std");
+const content_mod = @import("../content.zig");
+const cache_mod = @import("../cache.zig");
+const fs = @import("fs.zig");
+
+/// Blobs fetched at once when `MIC_FETCH_CONCURRENCY` is not set.
+pub const default_concurrency: usize = 8;
+
+/// Streamed blobs up to this size are also kept in memory so they can be cached.
+const stream_cache_max_bytes: usize = 4 * 1024 * 1024;
+
+pub const Job = struct {
+    blob_hash: []const u8,
+    hash_hex: []const u8,
+    path: []const u8,
+};
+
+pub const Summary = struct {
+    /// Files written from the blob cache.
+    from_cache: u32 = 0,
+    /// Unique blobs downloaded.
+    fetched: u32 = 0,
+};
+
+pub const Fetcher = struct {
+    allocator: std.mem.Allocator,
+    /// Not thread-safe on its own; workers go through `cache_mutex`.
+    blob_cache: *cache_mod.BlobCache,
+    blob_options: *const content_mod.BlobFetchOptions,
+    server: []const u8,
+    account: []const u8,
+    project: []const u8,
+    concurrency: usize = default_concurrency,
+    /// Null fetches every miss on its own.
+    batch: ?content_mod.BatchOptions = .{},
+
+    /// Writes every job's blob to its path. Returns the first error any
+    /// worker hit; files already written are left in place.
+    pub fn run(self: *const Fetcher, jobs: []const Job) !Summary {
+        if (jobs.len == 0) return .{};
+
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+        const arena_alloc = arena.allocator();
+
+        const groups = try groupJobs(arena_alloc, jobs);
+
+        // Batches skip the CDN, so keep per-blob fetches when one is configured.
+        const batch = if (self.blob_options.cdn_base_url == null) self.batch else null;
+
+        var run_state = RunState{
+            .fetcher = self,
+            .groups = groups,
+            .batch = batch,
+            .misses = try arena_alloc.alloc(usize, groups.len),
+        };
+
+        try run_state.runPass(arena_alloc, .cache, groups.len);
+        if (run_state.failure == null and run_state.miss_count > 0) {
+            try run_state.runPass(arena_alloc, .batch, run_state.batchUnits());
+        }
+
+        if (run_state.failure) |err| return err;
+        return .{
+            .from_cache = run_state.from_cache.load(.monotonic),
+            .fetched = run_state.fetched.load(.monotonic),
+        };
+    }
+};
+
+/// Reads `MIC_FETCH_CONCURRENCY`, falling back to `default_concurrency`.
+pub fn concurrencyFromEnv(allocator: std.mem.Allocator) usize {
+    const value = std.process.getEnvVarOwned(allocator, "MIC_FETCH_CONCURRENCY") catch return default_concurrency;
+    defer allocator.free(value);
+
+    const parsed = std.fmt.parseInt(usize, value, 10) catch return default_concurrency;
+    if (parsed == 0) return default_concurrency;
+    return parsed;
+}
+
+const Group = struct {
+    blob_hash: []const u8,
+    hash_hex: []const u8,
+    paths: std.ArrayList([]const u8) = .empty,
+};
+
+/// One group per unique hash, in first-seen order, holding every path that needs it.
+fn groupJobs(arena_alloc: std.mem.Allocator, jobs: []const Job) ![]Group {
+    var groups: std.ArrayList(Group) = .empty;
+    var by_hash = std.StringHashMap(usize).init(arena_alloc);
+    for (jobs) |job| {
+        const slot = try by_hash.getOrPut(job.hash_hex);
+        if (!slot.found_existing) {
+            slot.value_ptr.* = groups.items.len;
+            try groups.append(arena_alloc, .{ .blob_hash = job.blob_hash, .hash_hex = job.hash_hex });
+        }
+        try groups.items[slot.value_ptr.*].paths.append(arena_alloc, job.path);
+    }
+    return groups.items;
+}
+
+/// Whether a failed GetBlobs call should be retried blob by blob: the server
+/// lacks the method, or the call itself failed. Anything else, such as a disk
+/// write from the sink or a malformed response, is a real error.
+fn batchFallsBack(err: anyerror) bool {
+    return switch (err) {
+        error.Unimplemented, error.RequestFailed => true,
+        else => false,
+    };
+}
+
+const Pass = enum {
+    /// One item per group: write cache hits, then fetch or record misses.
+    cache,
+    /// One item per `batch.max_blobs` recorded misses.
+    batch,
+};
+
+const RunState = struct {
+    fetcher: *const Fetcher,
+    groups: []Group,
+    batch: ?content_mod.BatchOptions,
+    /// Group indexes of cache misses left for the batch pass.
+    misses: []usize,
+    miss_count: usize = 0,
+    next: std.atomic.Value(usize) = .init(0),
+    from_cache: std.atomic.Value(u32) = .init(0),
+    fetched: std.atomic.Value(u32) = .init(0),
+    /// Guards the blob cache and `misses`.
+    cache_mutex: std.Thread.Mutex = .{},
+    failure_mutex: std.Thread.Mutex = .{},
+    failure: ?anyerror = null,
+    failed: std.atomic.Value(bool) = .init(false),
+
+    fn runPass(self: *RunState, arena_alloc: std.mem.Allocator, pass: Pass, items: usize) !void {
+        self.next.store(0, .monotonic);
+
+        const worker_count = @max(1, @min(self.fetcher.concurrency, items));
+        const threads = try arena_alloc.alloc(std.Thread, worker_count - 1);
+        var spawned: usize = 0;
+        for (threads) |*thread| {
+            // Fewer workers is still correct, just slower.
+            thread.* = std.Thread.spawn(.{}, work, .{ self, pass, items }) catch break;
+            spawned += 1;
+        }
+        self.work(pass, items);
+
+        for (threads[0..spawned]) |thread| thread.join();
+    }
+
+    fn work(self: *RunState, pass: Pass, items: usize) void {
+        while (!self.failed.load(.acquire)) {
+            const index = self.next.fetchAdd(1, .monotonic);
+            if (index >= items) return;
+
+            const result = switch (pass) {
+                .cache => self.materialize(index),
+                .batch => self.fetchBatch(index),
+            };
+            result catch |err| {
+                self.failure_mutex.lock();
+                defer self.failure_mutex.unlock();
+                if (self.failure == null) self.failure = err;
+                self.failed.store(true, .release);
+                return;
+            };
+        }
+    }
+
+    fn materialize(self: *RunState, group_index: usize) !void {
+        const group = &self.groups[group_index];
+        const paths = group.paths.items;
+        for (paths) |path| try fs.ensureParentDir(path);
+
+        if (self.cacheGet(group.hash_hex)) |cached| {
+            defer self.fetcher.blob_cache.allocator.free(cached);
+            for (paths) |path| try fs.writeFile(path, cached);
+            _ = self.from_cache.fetchAdd(@intCast(paths.len), .monotonic);
+            return;
+        }
+
+        if (self.batch != null) {
+            self.cache_mutex.lock();
+            defer self.cache_mutex.unlock();
+            self.misses[self.miss_count] = group_index;
+            self.miss_count += 1;
+            return;
+        }
+
+        try self.downloadGroup(group);
+    }
+
+    fn fetchBatch(self: *RunState, unit: usize) !void {
+        const fetcher = self.fetcher;
+        const allocator = fetcher.allocator;
+        const batch = self.batch.?;
+
+        const group_indexes = self.batchMisses(unit);
+
+        const blob_hashes = try allocator.alloc([]const u8, group_indexes.len);
+        defer allocator.free(blob_hashes);
+        for (group_indexes, blob_hashes) |group_index, *blob_hash| {
+            blob_hash.* = self.groups[group_index].blob_hash;
+        }
+        const done = try allocator.alloc(bool, group_indexes.len);
+        defer allocator.free(done);
+        @memset(done, false);
+
+        const BatchSink = struct {
+            state: *RunState,
+            group_indexes: []const usize,
+            blob_hashes: []const []const u8,
+            done: []bool,
+
+            fn groupFor(self_sink: *@This(), blob_hash: []const u8) usize {
+                for (self_sink.blob_hashes, 0..) |candidate, idx| {
+                    if (candidate.ptr == blob_hash.ptr) return idx;
+                }
+                unreachable;
+            }
+
+            pub fn onBlob(self_sink: *@This(), blob_hash: []const u8, content: []const u8) !void {
+                const idx = self_sink.groupFor(blob_hash);
+                const group = &self_sink.state.groups[self_sink.group_indexes[idx]];
+                for (group.paths.items) |path| try fs.writeFile(path, content);
+                try self_sink.state.cachePut(group.hash_hex, content);
+                _ = self_sink.state.fetched.fetchAdd(1, .monotonic);
+                self_sink.done[idx] = true;
+            }
+
+            pub fn onLarge(self_sink: *@This(), blob_hash: []const u8) !void {
+                // Left undone, so it is streamed after the batch call returns.
+                _ = self_sink;
+                _ = blob_hash;
+            }
+        };
+        var sink = BatchSink{
+            .state = self,
+            .group_indexes = group_indexes,
+            .blob_hashes = blob_hashes,
+            .done = done,
+        };
+
+        // Older servers without GetBlobs, or a batch call that failed midway:
+        // whatever did not arrive is fetched one blob at a time below.
+        content_mod.fetchBlobsCoalesced(
+            allocator,
+            fetcher.server,
+            fetcher.account,
+            fetcher.project,
+            blob_hashes,
+            fetcher.blob_options,
+            batch,
+            &sink,
+        ) catch |err| if (!batchFallsBack(err)) return err;
+
+        for (group_indexes, done) |group_index, fetched| {
+            if (!fetched) try self.downloadGroup(&self.groups[group_index]);
+        }
+    }
+
+    fn batchBlobs(self: *const RunState) usize {
+        return @max(self.batch.?.max_blobs, 1);
+    }
+
+    /// Work items in the batch pass: recorded misses, `batchBlobs` at a time.
+    fn batchUnits(self: *const RunState) usize {
+        return std.math.divCeil(usize, self.miss_count, self.batchBlobs()) catch unreachable;
+    }
+
+    /// Group indexes fetched by batch pass item `unit`.
+    fn batchMisses(self: *const RunState, unit: usize) []const usize {
+        const start = unit * self.batchBlobs();
+        return self.misses[start..@min(start + self.batchBlobs(), self.miss_count)];
+    }
+
+    fn downloadGroup(self: *RunState, group: *const Group) !void {
+        const paths = group.paths.items;
+        try self.download(group.blob_hash, group.hash_hex, paths[0]);
+        _ = self.fetched.fetchAdd(1, .monotonic);
+
+        for (paths[1..]) |path| try fs.copyFile(paths[0], path);
+    }
+
+    /// Streams a missing blob into `path`, falling back to a whole-blob fetch
+    /// for servers without StreamBlob or a stream that failed midway.
+    fn download(self: *RunState, blob_hash: []const u8, hash_hex: []const u8, path: []const u8) !void {
+        const fetcher = self.fetcher;
+        const allocator = fetcher.allocator;
+
+        streamed: {
+            const file = try fs.createFile(path, .{ .truncate = true });
+            defer file.close();
+
+            var sink = BlobFileSink{ .allocator = allocator, .file = file };
+            defer sink.cached.deinit(allocator);
+
+            content_mod.streamBlobWithOptions(
+                allocator,
+                fetcher.server,
+                fetcher.account,
+                fetcher.project,
+                blob_hash,
+                fetcher.blob_options,
+                &sink,
+            ) catch break :streamed;
+
+            if (sink.cacheable) try self.cachePut(hash_hex, sink.cached.items);
+            return;
+        }
+
+        const fetched = try content_mod.fetchBlobWithOptions(
+            allocator,
+            fetcher.server,
+            fetcher.account,
+            fetcher.project,
+            blob_hash,
+            fetcher.blob_options,
+        );
+        defer allocator.free(fetched);
+
+        try self.cachePut(hash_hex, fetched);
+        try fs.writeFile(path, fetched);
+    }
+
+    fn cacheGet(self: *RunState, hash_hex: []const u8) ?[]u8 {
+        self.cache_mutex.lock();
+        defer self.cache_mutex.unlock();
+        return self.fetcher.blob_cache.get(hash_hex);
+    }
+
+    fn cachePut(self: *RunState, hash_hex: []const u8, data: []const u8) !void {
+        self.cache_mutex.lock();
+        defer self.cache_mutex.unlock();
+        try self.fetcher.blob_cache.put(hash_hex, data);
+    }
+};
+
+const BlobFileSink = struct {
+    allocator: std.mem.Allocator,
+    file: std.fs.File,
+    cached: std.ArrayList(u8) = .empty,
+    cacheable: bool = true,
+
+    pub fn writeChunk(self: *BlobFileSink, chunk: []const u8) !void {
+        try self.file.writeAll(chunk);
+
+        if (!self.cacheable) return;
+        if (self.cached.items.len + chunk.len > stream_cache_max_bytes) {
+            self.cacheable = false;
+            self.cached.clearAndFree(self.allocator);
+            return;
+        }
+        try self.cached.appendSlice(self.allocator, chunk);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+const test_hash_a = "aaaa1234567890abcdef1234567890abcdef1234567890abcdef1234567890ab";
+const test_hash_b = "bbbb1234567890abcdef1234567890abcdef1234567890abcdef1234567890ab";
+
+test "groupJobs fetches each hash once" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+
+    const jobs = [_]Job{
+        .{ .blob_hash = "a", .hash_hex = test_hash_a, .path = "one.txt" },
+        .{ .blob_hash = "b", .hash_hex = test_hash_b, .path = "two.txt" },
+        .{ .blob_hash = "a", .hash_hex = test_hash_a, .path = "copy/one.txt" },
+    };
+    const groups = try groupJobs(arena.allocator(), &jobs);
+
+    try std.testing.expectEqual(@as(usize, 2), groups.len);
+    try std.testing.expectEqualStrings(test_hash_a, groups[0].hash_hex);
+    try std.testing.expectEqual(@as(usize, 2), groups[0].paths.items.len);
+    try std.testing.expectEqualStrings("one.txt", groups[0].paths.items[0]);
+    try std.testing.expectEqualStrings("copy/one.txt", groups[0].paths.items[1]);
+    try std.testing.expectEqualStrings(test_hash_b, groups[1].hash_hex);
+    try std.testing.expectEqual(@as(usize, 1), groups[1].paths.items.len);
+}
+
+test "batch pass splits misses by max_blobs" {
+    const options = content_mod.BlobFetchOptions{};
+    var cache = try cache_mod.BlobCache.init(std.testing.allocator, .{ .ssd_enabled = false });
+    defer cache.deinit();
+    const fetcher = Fetcher{
+        .allocator = std.testing.allocator,
+        .blob_cache = &cache,
+        .blob_options = &options,
+        .server = "unused",
+        .account = "acme",
+        .project = "app",
+    };
+
+    var no_groups = [_]Group{};
+    var misses = [_]usize{ 4, 0, 3, 1, 2 };
+    var run_state = RunState{
+        .fetcher = &fetcher,
+        .groups = &no_groups,
+        .batch = .{ .max_blobs = 2 },
+        .misses = &misses,
+        .miss_count = misses.len,
+    };
+    try std.testing.expectEqual(@as(usize, 3), run_state.batchUnits());
+    try std.testing.expectEqualSlices(usize, &.{ 4, 0 }, run_state.batchMisses(0));
+    try std.testing.expectEqualSlices(usize, &.{ 3, 1 }, run_state.batchMisses(1));
+    try std.testing.expectEqualSlices(usize, &.{2}, run_state.batchMisses(2));
+
+    // A zero batch size still makes progress, one blob per call.
+    run_state.batch = .{ .max_blobs = 0 };
+    try std.testing.expectEqual(@as(usize, 5), run_state.batchUnits());
+    try std.testing.expectEqualSlices(usize, &.{3}, run_state.batchMisses(2));
+}
+
+test "batch falls back only for missing method or failed call" {
+    try std.testing.expect(batchFallsBack(error.Unimplemented));
+    try std.testing.expect(batchFallsBack(error.RequestFailed));
+    try std.testing.expect(!batchFallsBack(error.InvalidResponse));
+    try std.testing.expect(!batchFallsBack(error.OutOfMemory));
+    try std.testing.expect(!batchFallsBack(error.NoSpaceLeft));
+    try std.testing.expect(!batchFallsBack(error.AccessDenied));
+}
+
+test "cache pass writes hits and leaves misses for the batch pass" {
+    const allocator = std.testing.allocator;
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+
+    const base_dir = try temp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(base_dir);
+    const cached_path = try std.fs.path.join(allocator, &.{ base_dir, "src", "cached.txt" });
+    defer allocator.free(cached_path);
+    const missing_path = try std.fs.path.join(allocator, &.{ base_dir, "missing.txt" });
+    defer allocator.free(missing_path);
+
+    var cache = try cache_mod.BlobCache.init(allocator, .{ .ssd_enabled = false });
+    defer cache.deinit();
+    try cache.put(test_hash_a, "cached contents");
+
+    const options = content_mod.BlobFetchOptions{};
+    const fetcher = Fetcher{
+        .allocator = allocator,
+        .blob_cache = &cache,
+        .blob_options = &options,
+        .server = "unused",
+        .account = "acme",
+        .project = "app",
+    };
+
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const jobs = [_]Job{
+        .{ .blob_hash = "a", .hash_hex = test_hash_a, .path = cached_path },
+        .{ .blob_hash = "b", .hash_hex = test_hash_b, .path = missing_path },
+    };
+    const groups = try groupJobs(arena.allocator(), &jobs);
+    var run_state = RunState{
+        .fetcher = &fetcher,
+        .groups = groups,
+        .batch = .{},
+        .misses = try arena.allocator().alloc(usize, groups.len),
+    };
+    try run_state.runPass(arena.allocator(), .cache, groups.len);
+
+    try std.testing.expect(run_state.failure == null);
+    try std.testing.expectEqual(@as(u32, 1), run_state.from_cache.load(.monotonic));
+    try std.testing.expectEqual(@as(usize, 1), run_state.miss_count);
+    try std.testing.expectEqual(@as(usize, 1), run_state.misses[0]);
+
+    const written = try temp.dir.readFileAlloc(allocator, "src/cached.txt", 1024);
+    defer allocator.free(written);
+    try std.testing.expectEqualStrings("cached contents", written);
+    try std.testing.expectError(error.FileNotFound, temp.dir.access("missing.txt", .{}));
+}
+
+test "run copies one cached blob to every path that shares it" {
+    const allocator = std.testing.allocator;
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+
+    const base_dir = try temp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(base_dir);
+    const first_path = try std.fs.path.join(allocator, &.{ base_dir, "a.txt" });
+    defer allocator.free(first_path);
+    const second_path = try std.fs.path.join(allocator, &.{ base_dir, "nested", "a.txt" });
+    defer allocator.free(second_path);
+    const other_path = try std.fs.path.join(allocator, &.{ base_dir, "b.txt" });
+    defer allocator.free(other_path);
+
+    var cache = try cache_mod.BlobCache.init(allocator, .{ .ssd_enabled = false });
+    defer cache.deinit();
+    try cache.put(test_hash_a, "shared");
+    try cache.put(test_hash_b, "other");
+
+    const options = content_mod.BlobFetchOptions{};
+    const fetcher = Fetcher{
+        .allocator = allocator,
+        .blob_cache = &cache,
+        .blob_options = &options,
+        .server = "unused",
+        .account = "acme",
+        .project = "app",
+        .concurrency = 2,
+    };
+    const jobs = [_]Job{
+        .{ .blob_hash = "a", .hash_hex = test_hash_a, .path = first_path },
+        .{ .blob_hash = "b", .hash_hex = test_hash_b, .path = other_path },
+        .{ .blob_hash = "a", .hash_hex = test_hash_a, .path = second_path },
+    };
+    const summary = try fetcher.run(&jobs);
+
+    try std.testing.expectEqual(@as(u32, 3), summary.from_cache);
+    try std.testing.expectEqual(@as(u32, 0), summary.fetched);
+    // One lookup per unique hash, not per path.
+    try std.testing.expectEqual(@as(u64, 2), cache.stats.hits);
+
+    const copied = try temp.dir.readFileAlloc(allocator, "nested/a.txt", 1024);
+    defer allocator.free(copied);
+    try std.testing.expectEqualStrings("shared", copied);
+}
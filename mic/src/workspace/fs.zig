@@ -82,7 +82,7 @@ pub fn deleteBackup(path: []const u8) void {
     deleteFile(path) catch {};
 }
 
-fn copyFile(src: []const u8, dst: []const u8) !void {
+pub fn copyFile(src: []const u8, dst: []const u8) !void {
     const src_file = try openFile(src, .{});
     defer src_file.close();
 
@@ -134,7 +134,10 @@ pub fn openDir(path: []const u8, iterate: bool) !std.fs.Dir {
 pub fn hashFileSha256(path: []const u8) ![32]u8 {
     const file = try openFile(path, .{});
     defer file.close();
+    return hashOpenFileSha256(file);
+}
 
+pub fn hashOpenFileSha256(file: std.fs.File) ![32]u8 {
     var hasher = std.crypto.hash.sha2.Sha256.init(.{});
     var buf: [64 * 1024]u8 = undefined;
 
@@ -157,7 +160,7 @@ fn openFile(path: []const u8, flags: std.fs.File.OpenFlags) !std.fs.File {
     return std.fs.cwd().openFile(path, flags);
 }
 
-fn createFile(path: []const u8, flags: std.fs.File.CreateFlags) !std.fs.File {
+pub fn createFile(path: []const u8, flags: std.fs.File.CreateFlags) !std.fs.File {
     if (std.fs.path.isAbsolute(path)) {
         return std.fs.createFileAbsolute(path, flags);
     }
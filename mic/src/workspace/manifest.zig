@@ -16,7 +16,29 @@ pub const WorkspaceState = struct {
     entries: []WorkspaceEntry,
 };
 
+/// Stat data recorded when a tracked file was last hashed. While a file's
+/// stat still matches, its hash is reused instead of reading the file again.
+pub const IndexEntry = struct {
+    path: []const u8,
+    /// Hex SHA-256 of the file content at the time of the stat.
+    hash: []const u8,
+    size: u64,
+    mtime: i128,
+    ctime: i128,
+    inode: u64,
+};
+
+pub const WorkspaceIndex = struct {
+    version: u32 = 1,
+    /// When the scan that produced the index started. An entry modified at
+    /// or after this time could have changed again within the same
+    /// timestamp tick, so it is rehashed rather than trusted.
+    written_at: i128,
+    entries: []IndexEntry,
+};
+
 const manifest_filename = "workspace.json";
+const index_filename = "index.json";
 
 pub fn load(
     allocator: std.mem.Allocator,
@@ -58,12 +80,61 @@ pub fn save(
     try fs.writeFileAtomic(allocator, path, payload);
 }
 
+/// Loads the stat index. A missing or unreadable index is not an error;
+/// callers just rehash everything.
+pub fn loadIndex(
+    allocator: std.mem.Allocator,
+    workspace_root: []const u8,
+) !?std.json.Parsed(WorkspaceIndex) {
+    const path = try metadataPath(allocator, workspace_root, index_filename);
+    defer allocator.free(path);
+
+    const data = (fs.readFileAlloc(allocator, path, 256 * 1024 * 1024) catch null) orelse return null;
+    defer allocator.free(data);
+
+    return std.json.parseFromSlice(
+        WorkspaceIndex,
+        allocator,
+        data,
+        .{ .allocate = .alloc_always, .ignore_unknown_fields = true },
+    ) catch null;
+}
+
+pub fn saveIndex(
+    allocator: std.mem.Allocator,
+    workspace_root: []const u8,
+    index: WorkspaceIndex,
+) !void {
+    try ensureMetadataDir(workspace_root);
+
+    const path = try metadataPath(allocator, workspace_root, index_filename);
+    defer allocator.free(path);
+
+    var payload_buf = std.Io.Writer.Allocating.init(allocator);
+    defer payload_buf.deinit();
+    const formatter = std.json.fmt(index, .{});
+    try formatter.format(&payload_buf.writer);
+    const payload = try payload_buf.toOwnedSlice();
+    defer allocator.free(payload);
+
+    try fs.writeFileAtomic(allocator, path, payload);
+}
+
+/// True for `.mic` and anything inside it, relative to the workspace root.
+pub fn isMetadataPath(path: []const u8) bool {
+    return std.mem.eql(u8, path, ".mic") or std.mem.startsWith(u8, path, ".mic/");
+}
+
 pub fn ensureMetadataDir(workspace_root: []const u8) !void {
     const base = try std.fs.path.join(std.heap.page_allocator, &[_][]const u8{ workspace_root, ".mic" });
     defer std.heap.page_allocator.free(base);
     try fs.ensureDir(base);
 }
 
-fn manifestPath(allocator: std.mem.Allocator, workspace_root: []const u8) ![]u8 {
-    return std.fs.path.join(allocator, &[_][]const u8{ workspace_root, ".mic", manifest_filename });
+pub fn manifestPath(allocator: std.mem.Allocator, workspace_root: []const u8) ![]u8 {
+    return metadataPath(allocator, workspace_root, manifest_filename);
+}
+
+pub fn metadataPath(allocator: std.mem.Allocator, workspace_root: []const u8, filename: []const u8) ![]u8 {
+    return std.fs.path.join(allocator, &[_][]const u8{ workspace_root, ".mic", filename });
 }
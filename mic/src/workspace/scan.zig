@@ -0,0 +1,539 @@
+//! Change scan for status, land and sync.
+//!
+//! Tracked files are checked against the stat index kept next to the
+//! manifest: a file whose size, mtime, ctime and inode still match its index
+//! entry reuses the recorded hash, and only the rest are read and rehashed.
+//! Both the tracked-file pass and the directory walk that finds additions
+//! run on a pool of worker threads.
+
+const std = @import("std");
+const fs = @import("fs.zig");
+const ignore = @import("ignore.zig");
+const manifest = @import("manifest.zig");
+
+pub const Kind = enum {
+    added,
+    modified,
+    deleted,
+};
+
+pub const Change = struct {
+    path: []const u8,
+    kind: Kind,
+};
+
+const hash_hex_len = 64;
+
+/// Returns tracked files that were modified or deleted, in manifest order,
+/// followed by untracked files sorted by path. When any file had to be
+/// rehashed the index is rewritten so the next scan can skip it.
+pub fn scan(
+    allocator: std.mem.Allocator,
+    workspace_root: []const u8,
+    entries: []const manifest.WorkspaceEntry,
+    ignore_patterns: *const ignore.IgnorePatterns,
+) ![]Change {
+    const started_at = std.time.nanoTimestamp();
+
+    // Workers allocate too; the caller's allocator is usually an arena.
+    var thread_safe = std.heap.ThreadSafeAllocator{ .child_allocator = allocator };
+    const shared = thread_safe.allocator();
+
+    var root_dir = try fs.openDir(workspace_root, true);
+    defer root_dir.close();
+
+    const loaded_index = try manifest.loadIndex(allocator, workspace_root);
+    defer if (loaded_index) |parsed| parsed.deinit();
+
+    var indexed = std.StringHashMap(*const manifest.IndexEntry).init(allocator);
+    defer indexed.deinit();
+    var written_at: i128 = 0;
+    if (loaded_index) |parsed| {
+        written_at = parsed.value.written_at;
+        for (parsed.value.entries) |*entry| try indexed.put(entry.path, entry);
+    }
+
+    const results = try allocator.alloc(Tracked, entries.len);
+    defer allocator.free(results);
+
+    var tracked = TrackedPass{
+        .root_dir = root_dir,
+        .entries = entries,
+        .results = results,
+        .indexed = &indexed,
+        .written_at = written_at,
+    };
+    try runPool(allocator, entries.len, &tracked, TrackedPass.work);
+    if (tracked.failure) |err| return err;
+
+    var known = std.StringHashMap(void).init(allocator);
+    defer known.deinit();
+    for (entries) |entry| try known.put(entry.path, {});
+
+    var walk = Walk{
+        .root_dir = root_dir,
+        .allocator = shared,
+        .known = &known,
+        .ignore_patterns = ignore_patterns,
+    };
+    defer walk.pending.deinit(shared);
+    defer walk.added.deinit(shared);
+    try walk.pending.append(shared, "");
+    try runPool(allocator, std.math.maxInt(usize), &walk, Walk.work);
+    if (walk.failure) |err| return err;
+
+    var changes: std.ArrayList(Change) = .empty;
+    var index_entries: std.ArrayList(manifest.IndexEntry) = .empty;
+    defer index_entries.deinit(allocator);
+    var rehashed = false;
+
+    for (entries, results) |entry, *result| {
+        switch (result.state) {
+            .deleted => try changes.append(allocator, .{ .path = entry.path, .kind = .deleted }),
+            .directory => try changes.append(allocator, .{ .path = entry.path, .kind = .modified }),
+            .present => {
+                rehashed = rehashed or result.rehashed;
+                if (!std.mem.eql(u8, &result.hash, entry.hash)) {
+                    try changes.append(allocator, .{ .path = entry.path, .kind = .modified });
+                }
+                try index_entries.append(allocator, .{
+                    .path = entry.path,
+                    .hash = &result.hash,
+                    .size = result.stat.size,
+                    .mtime = result.stat.mtime,
+                    .ctime = result.stat.ctime,
+                    .inode = result.stat.inode,
+                });
+            },
+        }
+    }
+
+    std.mem.sort([]const u8, walk.added.items, {}, lessThanPath);
+    for (walk.added.items) |path| {
+        try changes.append(allocator, .{ .path = path, .kind = .added });
+    }
+
+    const index_stale = loaded_index == null or
+        loaded_index.?.value.entries.len != index_entries.items.len;
+    if (rehashed or index_stale) {
+        // The index only saves work; a failed write costs a rehash next time.
+        manifest.saveIndex(allocator, workspace_root, .{
+            .written_at = started_at,
+            .entries = index_entries.items,
+        }) catch {};
+    }
+
+    return changes.toOwnedSlice(allocator);
+}
+
+/// Records the stat of freshly written files against their known hashes, so
+/// the first scan after checkout does not have to read them back.
+pub fn seedIndex(
+    allocator: std.mem.Allocator,
+    workspace_root: []const u8,
+    entries: []const manifest.WorkspaceEntry,
+) !void {
+    const started_at = std.time.nanoTimestamp();
+
+    var root_dir = try fs.openDir(workspace_root, false);
+    defer root_dir.close();
+
+    var index_entries: std.ArrayList(manifest.IndexEntry) = .empty;
+    defer index_entries.deinit(allocator);
+
+    for (entries) |entry| {
+        const stat = root_dir.statFile(entry.path) catch continue;
+        if (stat.kind != .file) continue;
+        const record = Stat.from(stat);
+        try index_entries.append(allocator, .{
+            .path = entry.path,
+            .hash = entry.hash,
+            .size = record.size,
+            .mtime = record.mtime,
+            .ctime = record.ctime,
+            .inode = record.inode,
+        });
+    }
+
+    try manifest.saveIndex(allocator, workspace_root, .{
+        .written_at = started_at,
+        .entries = index_entries.items,
+    });
+}
+
+fn lessThanPath(_: void, a: []const u8, b: []const u8) bool {
+    return std.mem.lessThan(u8, a, b);
+}
+
+/// Runs `work(context)` on up to one thread per CPU, capped at `items`,
+/// including the calling thread.
+fn runPool(
+    allocator: std.mem.Allocator,
+    items: usize,
+    context: anytype,
+    comptime work: fn (@TypeOf(context)) void,
+) !void {
+    const cpus = std.Thread.getCpuCount() catch 4;
+    const worker_count = @max(1, @min(cpus, items));
+
+    const threads = try allocator.alloc(std.Thread, worker_count - 1);
+    defer allocator.free(threads);
+
+    var spawned: usize = 0;
+    for (threads) |*thread| {
+        thread.* = std.Thread.spawn(.{}, work, .{context}) catch break;
+        spawned += 1;
+    }
+    work(context);
+    for (threads[0..spawned]) |thread| thread.join();
+}
+
+const Stat = struct {
+    size: u64,
+    mtime: i128,
+    ctime: i128,
+    inode: u64,
+
+    fn from(stat: std.fs.File.Stat) Stat {
+        return .{
+            .size = stat.size,
+            .mtime = stat.mtime,
+            .ctime = stat.ctime,
+            .inode = @intCast(stat.inode),
+        };
+    }
+
+    fn matches(self: Stat, entry: *const manifest.IndexEntry) bool {
+        return self.size == entry.size and self.mtime == entry.mtime and
+            self.ctime == entry.ctime and self.inode == entry.inode;
+    }
+};
+
+const Tracked = struct {
+    state: enum { present, deleted, directory } = .deleted,
+    stat: Stat = undefined,
+    hash: [hash_hex_len]u8 = undefined,
+    rehashed: bool = false,
+};
+
+const TrackedPass = struct {
+    root_dir: std.fs.Dir,
+    entries: []const manifest.WorkspaceEntry,
+    results: []Tracked,
+    indexed: *const std.StringHashMap(*const manifest.IndexEntry),
+    written_at: i128,
+    next: std.atomic.Value(usize) = .init(0),
+    failure_mutex: std.Thread.Mutex = .{},
+    failure: ?anyerror = null,
+
+    fn work(self: *TrackedPass) void {
+        while (true) {
+            const index = self.next.fetchAdd(1, .monotonic);
+            if (index >= self.entries.len) return;
+
+            self.check(self.entries[index].path, &self.results[index]) catch |err| {
+                self.failure_mutex.lock();
+                defer self.failure_mutex.unlock();
+                if (self.failure == null) self.failure = err;
+                return;
+            };
+        }
+    }
+
+    fn check(self: *TrackedPass, path: []const u8, result: *Tracked) !void {
+        const file = self.root_dir.openFile(path, .{}) catch |err| switch (err) {
+            error.FileNotFound => {
+                result.* = .{ .state = .deleted };
+                return;
+            },
+            error.IsDir => {
+                result.* = .{ .state = .directory };
+                return;
+            },
+            else => return err,
+        };
+        defer file.close();
+
+        const stat = try file.stat();
+        if (stat.kind == .directory) {
+            result.* = .{ .state = .directory };
+            return;
+        }
+
+        result.* = .{ .state = .present, .stat = Stat.from(stat) };
+        if (self.indexed.get(path)) |entry| {
+            const trusted = result.stat.mtime < self.written_at and entry.hash.len == hash_hex_len;
+            if (trusted and result.stat.matches(entry)) {
+                @memcpy(&result.hash, entry.hash);
+                return;
+            }
+        }
+
+        const digest = try fs.hashOpenFileSha256(file);
+        result.hash = std.fmt.bytesToHex(digest, .lower);
+        result.rehashed = true;
+    }
+};
+
+/// Breadth-first walk shared by the pool. Each worker takes a directory off
+/// `pending`, lists it, and queues its subdirectories for whoever is free.
+const Walk = struct {
+    root_dir: std.fs.Dir,
+    allocator: std.mem.Allocator,
+    known: *const std.StringHashMap(void),
+    ignore_patterns: *const ignore.IgnorePatterns,
+    /// Guards everything below.
+    mutex: std.Thread.Mutex = .{},
+    changed: std.Thread.Condition = .{},
+    pending: std.ArrayList([]const u8) = .empty,
+    /// Directories being listed right now; the walk ends when this is zero
+    /// and nothing is pending.
+    active: usize = 0,
+    added: std.ArrayList([]const u8) = .empty,
+    failure: ?anyerror = null,
+
+    fn work(self: *Walk) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (true) {
+            while (self.pending.items.len == 0 and self.active > 0 and self.failure == null) {
+                self.changed.wait(&self.mutex);
+            }
+            if (self.pending.items.len == 0 or self.failure != null) {
+                self.changed.broadcast();
+                return;
+            }
+
+            const dir_path = self.pending.pop().?;
+            self.active += 1;
+
+            self.mutex.unlock();
+            const result = self.list(dir_path);
+            if (dir_path.len > 0) self.allocator.free(dir_path);
+            self.mutex.lock();
+
+            self.active -= 1;
+            result catch |err| {
+                if (self.failure == null) self.failure = err;
+            };
+            self.changed.broadcast();
+        }
+    }
+
+    fn list(self: *Walk, dir_path: []const u8) !void {
+        var dir = try self.root_dir.openDir(if (dir_path.len == 0) "." else dir_path, .{ .iterate = true });
+        defer dir.close();
+
+        var subdirs: std.ArrayList([]const u8) = .empty;
+        defer subdirs.deinit(self.allocator);
+        var added: std.ArrayList([]const u8) = .empty;
+        defer added.deinit(self.allocator);
+
+        var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+        var it = dir.iterate();
+        while (try it.next()) |entry| {
+            const path = if (dir_path.len == 0)
+                entry.name
+            else
+                try std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ dir_path, entry.name });
+
+            switch (entry.kind) {
+                .directory => {
+                    if (manifest.isMetadataPath(path)) continue;
+                    try subdirs.append(self.allocator, try self.allocator.dupe(u8, path));
+                },
+                .file => {
+                    if (manifest.isMetadataPath(path)) continue;
+                    if (self.ignore_patterns.shouldIgnore(path)) continue;
+                    if (self.known.contains(path)) continue;
+                    try added.append(self.allocator, try self.allocator.dupe(u8, path));
+                },
+                else => {},
+            }
+        }
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.pending.appendSlice(self.allocator, subdirs.items);
+        try self.added.appendSlice(self.allocator, added.items);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+fn testHash(content: []const u8) [hash_hex_len]u8 {
+    var digest: [32]u8 = undefined;
+    std.crypto.hash.sha2.Sha256.hash(content, &digest, .{});
+    return std.fmt.bytesToHex(digest, .lower);
+}
+
+fn expectChanges(expected: []const Change, actual: []const Change) !void {
+    try std.testing.expectEqual(expected.len, actual.len);
+    for (expected, actual) |want, got| {
+        try std.testing.expectEqualStrings(want.path, got.path);
+        try std.testing.expectEqual(want.kind, got.kind);
+    }
+}
+
+/// Saves an index whose only entry has `path`'s current stat and `hash`.
+fn seedTestIndex(root: []const u8, dir: std.fs.Dir, path: []const u8, hash: []const u8, written_at: i128) !void {
+    const stat = Stat.from(try dir.statFile(path));
+    var index_entries = [_]manifest.IndexEntry{.{
+        .path = path,
+        .hash = hash,
+        .size = stat.size,
+        .mtime = stat.mtime,
+        .ctime = stat.ctime,
+        .inode = stat.inode,
+    }};
+    try manifest.saveIndex(std.testing.allocator, root, .{
+        .written_at = written_at,
+        .entries = &index_entries,
+    });
+}
+
+test "scan reports modified, deleted and added files" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const allocator = arena.allocator();
+
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const root = try temp.dir.realpathAlloc(allocator, ".");
+
+    try temp.dir.writeFile(.{ .sub_path = "same.txt", .data = "same" });
+    try temp.dir.writeFile(.{ .sub_path = "edited.txt", .data = "after" });
+    try temp.dir.makePath("sub");
+    try temp.dir.writeFile(.{ .sub_path = "sub/new.txt", .data = "new" });
+    try temp.dir.writeFile(.{ .sub_path = "new.txt", .data = "new" });
+
+    const same_hash = testHash("same");
+    const before_hash = testHash("before");
+    const gone_hash = testHash("gone");
+    const entries = [_]manifest.WorkspaceEntry{
+        .{ .path = "same.txt", .hash = &same_hash },
+        .{ .path = "edited.txt", .hash = &before_hash },
+        .{ .path = "gone.txt", .hash = &gone_hash },
+    };
+    const patterns = ignore.IgnorePatterns{ .allocator = allocator, .patterns = &.{} };
+
+    const changes = try scan(allocator, root, &entries, &patterns);
+    try expectChanges(&.{
+        .{ .path = "edited.txt", .kind = .modified },
+        .{ .path = "gone.txt", .kind = .deleted },
+        .{ .path = "new.txt", .kind = .added },
+        .{ .path = "sub/new.txt", .kind = .added },
+    }, changes);
+
+    // The first scan wrote an index for the files still present.
+    const index = (try manifest.loadIndex(std.testing.allocator, root)).?;
+    defer index.deinit();
+    try std.testing.expectEqual(@as(usize, 2), index.value.entries.len);
+}
+
+test "scan skips ignored files and workspace metadata" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const allocator = arena.allocator();
+
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const root = try temp.dir.realpathAlloc(allocator, ".");
+
+    try temp.dir.writeFile(.{ .sub_path = ".micignore", .data = "*.log\nbuild\n" });
+    try temp.dir.writeFile(.{ .sub_path = "app.log", .data = "log" });
+    try temp.dir.makePath("build");
+    try temp.dir.writeFile(.{ .sub_path = "build/out.o", .data = "obj" });
+    try temp.dir.makePath(".mic");
+    try temp.dir.writeFile(.{ .sub_path = ".mic/workspace.json", .data = "{}" });
+    try temp.dir.writeFile(.{ .sub_path = "keep.txt", .data = "keep" });
+
+    var patterns = try ignore.load(allocator, root);
+    defer patterns.deinit();
+
+    const changes = try scan(allocator, root, &.{}, &patterns);
+    try expectChanges(&.{
+        .{ .path = ".micignore", .kind = .added },
+        .{ .path = "keep.txt", .kind = .added },
+    }, changes);
+}
+
+test "scan reuses the indexed hash while the stat matches" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const allocator = arena.allocator();
+
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const root = try temp.dir.realpathAlloc(allocator, ".");
+
+    try temp.dir.writeFile(.{ .sub_path = "file.txt", .data = "content" });
+    const stat = try temp.dir.statFile("file.txt");
+
+    // A recorded hash that disagrees with the content is only reported if
+    // the scan trusted the index instead of reading the file.
+    const stale_hash = testHash("something else");
+    try seedTestIndex(root, temp.dir, "file.txt", &stale_hash, stat.mtime + 1);
+
+    const real_hash = testHash("content");
+    const entries = [_]manifest.WorkspaceEntry{.{ .path = "file.txt", .hash = &real_hash }};
+    const patterns = ignore.IgnorePatterns{ .allocator = allocator, .patterns = &.{} };
+
+    const changes = try scan(allocator, root, &entries, &patterns);
+    try expectChanges(&.{.{ .path = "file.txt", .kind = .modified }}, changes);
+}
+
+test "scan rehashes files modified at or after the index was written" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const allocator = arena.allocator();
+
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const root = try temp.dir.realpathAlloc(allocator, ".");
+
+    try temp.dir.writeFile(.{ .sub_path = "file.txt", .data = "content" });
+    const stat = try temp.dir.statFile("file.txt");
+
+    // Same tick as the index write: the file could have changed again unseen.
+    const stale_hash = testHash("something else");
+    try seedTestIndex(root, temp.dir, "file.txt", &stale_hash, stat.mtime);
+
+    const real_hash = testHash("content");
+    const entries = [_]manifest.WorkspaceEntry{.{ .path = "file.txt", .hash = &real_hash }};
+    const patterns = ignore.IgnorePatterns{ .allocator = allocator, .patterns = &.{} };
+
+    const changes = try scan(allocator, root, &entries, &patterns);
+    try expectChanges(&.{}, changes);
+
+    // The rehash replaced the stale entry.
+    const index = (try manifest.loadIndex(std.testing.allocator, root)).?;
+    defer index.deinit();
+    try std.testing.expectEqualStrings(&real_hash, index.value.entries[0].hash);
+    try std.testing.expect(index.value.written_at > stat.mtime);
+}
+
+test "scan treats an unreadable index as missing" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const allocator = arena.allocator();
+
+    var temp = std.testing.tmpDir(.{});
+    defer temp.cleanup();
+    const root = try temp.dir.realpathAlloc(allocator, ".");
+
+    // Reading a directory fails rather than returning FileNotFound.
+    try temp.dir.makePath(".mic/index.json");
+    try temp.dir.writeFile(.{ .sub_path = "file.txt", .data = "content" });
+    try std.testing.expect(try manifest.loadIndex(std.testing.allocator, root) == null);
+
+    const real_hash = testHash("content");
+    const entries = [_]manifest.WorkspaceEntry{.{ .path = "file.txt", .hash = &real_hash }};
+    const patterns = ignore.IgnorePatterns{ .allocator = allocator, .patterns = &.{} };
+
+    const changes = try scan(allocator, root, &entries, &patterns);
+    try expectChanges(&.{}, changes);
+}
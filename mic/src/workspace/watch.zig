@@ -0,0 +1,769 @@
+//! Optional watch daemon behind `status`, `land` and `sync`.
+//!
+//! `mic watch` keeps an inotify watch on every directory of a workspace and
+//! tracks the set of paths that may differ from the manifest: whatever a full
+//! scan reported when it started, plus every path touched since. The change
+//! scan asks it over `.mic/watch.sock`, and only those paths are checked
+//! again. With no daemon listening, or after the kernel dropped events
+//! because the watch queue overflowed, callers walk the tree instead.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const fs = @import("fs.zig");
+const ignore = @import("ignore.zig");
+const manifest = @import("manifest.zig");
+const scan = @import("scan.zig");
+
+const linux = std.os.linux;
+const posix = std.posix;
+
+pub const supported = builtin.os.tag == .linux;
+
+const socket_filename = "watch.sock";
+const max_request_bytes = 64;
+const max_reply_bytes = 64 * 1024 * 1024;
+/// How long the daemon waits on a client that is slow to send its request or
+/// to read the reply before dropping it.
+const request_timeout_ms = 1000;
+/// How long a query waits for the daemon before falling back to a scan.
+const reply_timeout_ms = 30 * 1000;
+
+const watch_mask: u32 = linux.IN.CREATE | linux.IN.DELETE | linux.IN.MODIFY |
+    linux.IN.MOVED_FROM | linux.IN.MOVED_TO | linux.IN.ONLYDIR | linux.IN.DONT_FOLLOW;
+
+const Reply = struct {
+    /// False when the daemon cannot vouch for its dirty set; the caller
+    /// should scan the tree itself.
+    complete: bool,
+    changes: []const scan.Change = &.{},
+};
+
+/// Asks a running `mic watch` for the workspace changes, in the same order
+/// `scan.scan` returns them. Returns null when no daemon answers or it has
+/// lost track; callers then scan.
+pub fn query(allocator: std.mem.Allocator, workspace_root: []const u8) ?[]scan.Change {
+    return queryDaemon(allocator, workspace_root) catch null;
+}
+
+fn queryDaemon(allocator: std.mem.Allocator, workspace_root: []const u8) !?[]scan.Change {
+    const socket_path = try manifest.metadataPath(allocator, workspace_root, socket_filename);
+    defer allocator.free(socket_path);
+
+    const stream = try std.net.connectUnixSocket(socket_path);
+    defer stream.close();
+    try setTimeouts(stream, reply_timeout_ms);
+    try writeAll(stream, "status\n");
+
+    var reply: std.ArrayList(u8) = .empty;
+    defer reply.deinit(allocator);
+    var buf: [16 * 1024]u8 = undefined;
+    while (true) {
+        const read_len = try stream.read(&buf);
+        if (read_len == 0) break;
+        if (reply.items.len + read_len > max_reply_bytes) return error.ReplyTooLarge;
+        try reply.appendSlice(allocator, buf[0..read_len]);
+    }
+
+    const parsed = try std.json.parseFromSlice(Reply, allocator, reply.items, .{
+        .allocate = .alloc_always,
+        .ignore_unknown_fields = true,
+    });
+    defer parsed.deinit();
+    if (!parsed.value.complete) return null;
+
+    const changes = try allocator.alloc(scan.Change, parsed.value.changes.len);
+    errdefer allocator.free(changes);
+    for (parsed.value.changes, changes) |change, *copy| {
+        copy.* = .{ .path = try allocator.dupe(u8, change.path), .kind = change.kind };
+    }
+    return changes;
+}
+
+/// Runs the daemon for `workspace_root` until the process is stopped.
+pub fn serve(allocator: std.mem.Allocator, workspace_root: []const u8) !void {
+    if (comptime !supported) {
+        return error.Unsupported;
+    } else {
+        return serveLinux(allocator, workspace_root);
+    }
+}
+
+fn serveLinux(allocator: std.mem.Allocator, workspace_root: []const u8) !void {
+    try manifest.ensureMetadataDir(workspace_root);
+    const socket_path = try manifest.metadataPath(allocator, workspace_root, socket_filename);
+    defer allocator.free(socket_path);
+
+    // A socket nobody answers on was left behind by a daemon that was killed.
+    if (std.net.connectUnixSocket(socket_path)) |stream| {
+        stream.close();
+        std.debug.print("A watch daemon is already running for this workspace.\n", .{});
+        return;
+    } else |_| {
+        std.fs.deleteFileAbsolute(socket_path) catch |err| switch (err) {
+            error.FileNotFound => {},
+            else => return err,
+        };
+    }
+
+    var daemon = try Daemon.init(allocator, workspace_root);
+    defer daemon.deinit();
+    daemon.reseed() catch |err| {
+        if (err == error.UserResourceLimitReached) {
+            std.debug.print("Out of inotify watches; raise fs.inotify.max_user_watches.\n", .{});
+        }
+        return err;
+    };
+
+    const address = try std.net.Address.initUnix(socket_path);
+    var server = try address.listen(.{});
+    defer server.deinit();
+    defer std.fs.deleteFileAbsolute(socket_path) catch {};
+
+    std.debug.print("Watching {s} ({d} directories).\n", .{ workspace_root, daemon.dirs.count() });
+    std.debug.print("Press Ctrl+C to stop.\n", .{});
+
+    while (true) {
+        var fds = [_]posix.pollfd{
+            .{ .fd = daemon.inotify_fd.?, .events = posix.POLL.IN, .revents = 0 },
+            .{ .fd = server.stream.handle, .events = posix.POLL.IN, .revents = 0 },
+        };
+        _ = try posix.poll(&fds, -1);
+
+        if (fds[0].revents != 0) try daemon.drainEvents();
+        if (fds[1].revents != 0) {
+            const conn = try server.accept();
+            defer conn.stream.close();
+            daemon.answer(conn.stream) catch |err| {
+                std.log.warn("Watch query failed: {}", .{err});
+            };
+        }
+        // Reseed after replying, so the caller's own scan runs meanwhile.
+        if (daemon.stale) try daemon.reseed();
+    }
+}
+
+/// Identity of a file the dirty set depends on.
+const FileId = struct {
+    inode: u64 = 0,
+    size: u64 = 0,
+    mtime: i128 = 0,
+
+    fn read(path: []const u8) !FileId {
+        const stat = std.fs.cwd().statFile(path) catch |err| switch (err) {
+            error.FileNotFound => return .{},
+            else => return err,
+        };
+        return .{ .inode = @intCast(stat.inode), .size = stat.size, .mtime = stat.mtime };
+    }
+};
+
+const Daemon = struct {
+    allocator: std.mem.Allocator,
+    workspace_root: []const u8,
+    root_dir: std.fs.Dir,
+    manifest_path: []const u8,
+    ignore_path: []const u8,
+    inotify_fd: ?i32 = null,
+    /// Watch descriptor to the watched directory, relative to the root.
+    dirs: std.AutoHashMapUnmanaged(i32, []const u8) = .empty,
+    /// Paths that may differ from the manifest. Keys are owned.
+    dirty: std.StringHashMapUnmanaged(void) = .empty,
+    /// Holds the manifest, ignore patterns and `tracked` for the current seed.
+    seed_arena: std.heap.ArenaAllocator,
+    entries: []const manifest.WorkspaceEntry = &.{},
+    /// Manifest position of each tracked path.
+    tracked: std.StringHashMapUnmanaged(usize) = .empty,
+    ignore_patterns: ignore.IgnorePatterns = undefined,
+    /// Land and sync rewrite the manifest; either file changing means the
+    /// dirty set is relative to the wrong baseline.
+    manifest_id: FileId = .{},
+    ignore_id: FileId = .{},
+    /// Events were lost or the baseline moved; reseed before trusting `dirty`.
+    stale: bool = false,
+    request_timeout_ms: u32 = request_timeout_ms,
+
+    fn init(allocator: std.mem.Allocator, workspace_root: []const u8) !Daemon {
+        const manifest_path = try manifest.manifestPath(allocator, workspace_root);
+        errdefer allocator.free(manifest_path);
+        const ignore_path = try std.fs.path.join(allocator, &.{ workspace_root, ".micignore" });
+        errdefer allocator.free(ignore_path);
+
+        return .{
+            .allocator = allocator,
+            .workspace_root = workspace_root,
+            .root_dir = try fs.openDir(workspace_root, true),
+            .manifest_path = manifest_path,
+            .ignore_path = ignore_path,
+            .seed_arena = std.heap.ArenaAllocator.init(allocator),
+        };
+    }
+
+    fn deinit(self: *Daemon) void {
+        self.closeWatches();
+        self.dirs.deinit(self.allocator);
+        self.clearDirty();
+        self.dirty.deinit(self.allocator);
+        self.seed_arena.deinit();
+        self.root_dir.close();
+        self.allocator.free(self.manifest_path);
+        self.allocator.free(self.ignore_path);
+    }
+
+    /// Starts over from a full scan: fresh watches on every directory, and
+    /// the scan's changes as the dirty set.
+    fn reseed(self: *Daemon) !void {
+        self.closeWatches();
+        self.clearDirty();
+        _ = self.seed_arena.reset(.free_all);
+        self.tracked = .empty;
+        self.stale = false;
+        const arena_alloc = self.seed_arena.allocator();
+
+        // Read before the manifest, so a rewrite during the seed is noticed.
+        self.manifest_id = try FileId.read(self.manifest_path);
+        self.ignore_id = try FileId.read(self.ignore_path);
+
+        const parsed = (try manifest.load(arena_alloc, self.workspace_root)) orelse return error.NoWorkspace;
+        self.entries = parsed.value.entries;
+        for (self.entries, 0..) |entry, position| {
+            try self.tracked.put(arena_alloc, entry.path, position);
+        }
+        self.ignore_patterns = try ignore.load(arena_alloc, self.workspace_root);
+
+        // Watch before scanning so nothing written during the scan is missed.
+        self.inotify_fd = try posix.inotify_init1(linux.IN.NONBLOCK | linux.IN.CLOEXEC);
+        try self.watchTree("", false);
+
+        const changes = try scan.scan(arena_alloc, self.workspace_root, self.entries, &self.ignore_patterns);
+        for (changes) |change| try self.markDirty(change.path);
+    }
+
+    fn closeWatches(self: *Daemon) void {
+        if (self.inotify_fd) |fd| posix.close(fd);
+        self.inotify_fd = null;
+
+        var it = self.dirs.valueIterator();
+        while (it.next()) |dir_path| self.allocator.free(dir_path.*);
+        self.dirs.clearRetainingCapacity();
+    }
+
+    fn clearDirty(self: *Daemon) void {
+        var it = self.dirty.keyIterator();
+        while (it.next()) |path| self.allocator.free(path.*);
+        self.dirty.clearRetainingCapacity();
+    }
+
+    fn markDirty(self: *Daemon, path: []const u8) !void {
+        if (self.dirty.contains(path)) return;
+        const key = try self.allocator.dupe(u8, path);
+        errdefer self.allocator.free(key);
+        try self.dirty.put(self.allocator, key, {});
+    }
+
+    /// Watches `rel_dir` and every directory below it. With `mark_files`,
+    /// files found on the way are marked dirty: a directory that appears
+    /// later may have been filled before its watch existed.
+    fn watchTree(self: *Daemon, rel_dir: []const u8, mark_files: bool) !void {
+        var pending: std.ArrayList([]const u8) = .empty;
+        defer {
+            for (pending.items) |dir_path| self.allocator.free(dir_path);
+            pending.deinit(self.allocator);
+        }
+        try pending.append(self.allocator, try self.allocator.dupe(u8, rel_dir));
+
+        while (pending.pop()) |dir_path| {
+            defer self.allocator.free(dir_path);
+            if (!try self.addWatch(dir_path)) continue;
+
+            var dir = self.root_dir.openDir(if (dir_path.len == 0) "." else dir_path, .{ .iterate = true }) catch |err| switch (err) {
+                error.FileNotFound, error.NotDir => continue,
+                else => return err,
+            };
+            defer dir.close();
+
+            var it = dir.iterate();
+            while (try it.next()) |entry| {
+                const path = try joinRelative(self.allocator, dir_path, entry.name);
+                defer self.allocator.free(path);
+
+                switch (entry.kind) {
+                    .directory => {
+                        if (manifest.isMetadataPath(path)) continue;
+                        try pending.append(self.allocator, try self.allocator.dupe(u8, path));
+                    },
+                    .file => if (mark_files) try self.markDirty(path),
+                    else => {},
+                }
+            }
+        }
+    }
+
+    /// Returns false if the directory is already gone.
+    fn addWatch(self: *Daemon, rel_dir: []const u8) !bool {
+        const abs_path = try std.fs.path.join(self.allocator, &.{ self.workspace_root, rel_dir });
+        defer self.allocator.free(abs_path);
+
+        const wd = posix.inotify_add_watch(self.inotify_fd.?, abs_path, watch_mask) catch |err| switch (err) {
+            error.FileNotFound, error.NotDir => return false,
+            else => return err,
+        };
+
+        const owned = try self.allocator.dupe(u8, rel_dir);
+        errdefer self.allocator.free(owned);
+        const slot = try self.dirs.getOrPut(self.allocator, wd);
+        // Re-adding a directory that moved returns its existing descriptor.
+        if (slot.found_existing) self.allocator.free(slot.value_ptr.*);
+        slot.value_ptr.* = owned;
+        return true;
+    }
+
+    fn drainEvents(self: *Daemon) !void {
+        var buf: [64 * 1024]u8 align(@alignOf(linux.inotify_event)) = undefined;
+        while (true) {
+            const read_len = posix.read(self.inotify_fd.?, &buf) catch |err| switch (err) {
+                error.WouldBlock => return,
+                else => return err,
+            };
+
+            var offset: usize = 0;
+            while (offset < read_len) {
+                const event: *const linux.inotify_event = @ptrCast(@alignCast(&buf[offset]));
+                offset += @sizeOf(linux.inotify_event) + event.len;
+                try self.handleEvent(event);
+            }
+        }
+    }
+
+    fn handleEvent(self: *Daemon, event: *const linux.inotify_event) !void {
+        if (event.mask & linux.IN.Q_OVERFLOW != 0) {
+            self.stale = true;
+            return;
+        }
+        if (event.mask & linux.IN.IGNORED != 0) {
+            if (self.dirs.fetchRemove(event.wd)) |removed| self.allocator.free(removed.value);
+            return;
+        }
+
+        const dir_path = self.dirs.get(event.wd) orelse return;
+        const name = event.getName() orelse return;
+        const path = try joinRelative(self.allocator, dir_path, name);
+        defer self.allocator.free(path);
+        if (manifest.isMetadataPath(path)) return;
+
+        if (event.mask & linux.IN.ISDIR == 0) return self.markDirty(path);
+
+        if (event.mask & linux.IN.MOVED_FROM != 0) {
+            // Files inside leave without events of their own. The moved
+            // directory keeps its watches under the new name, so drop them;
+            // a move within the workspace adds them back on MOVED_TO.
+            for (self.entries) |entry| {
+                if (isWithin(entry.path, path)) try self.markDirty(entry.path);
+            }
+            var it = self.dirs.iterator();
+            while (it.next()) |watched| {
+                if (isWithin(watched.value_ptr.*, path)) {
+                    _ = linux.inotify_rm_watch(self.inotify_fd.?, watched.key_ptr.*);
+                }
+            }
+        }
+        if (event.mask & (linux.IN.CREATE | linux.IN.MOVED_TO) != 0) {
+            self.watchTree(path, true) catch |err| switch (err) {
+                // Out of watches; this subtree is invisible until a reseed.
+                error.UserResourceLimitReached, error.SystemResources => self.stale = true,
+                else => return err,
+            };
+        }
+    }
+
+    fn answer(self: *Daemon, stream: std.net.Stream) !void {
+        // The daemon serves one client at a time; one that stalls must not
+        // block it, so reads and writes fail once the timeout passes.
+        try setTimeouts(stream, self.request_timeout_ms);
+
+        var request_buf: [max_request_bytes]u8 = undefined;
+        var request_len: usize = 0;
+        while (std.mem.indexOfScalar(u8, request_buf[0..request_len], '\n') == null) {
+            if (request_len == request_buf.len) return error.InvalidRequest;
+            const read_len = try stream.read(request_buf[request_len..]);
+            if (read_len == 0) break;
+            request_len += read_len;
+        }
+        const request = std.mem.trimRight(u8, request_buf[0..request_len], "\r\n");
+
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+        const arena_alloc = arena.allocator();
+        const reply = try self.buildReply(arena_alloc, request);
+
+        var payload_buf = std.Io.Writer.Allocating.init(arena_alloc);
+        const formatter = std.json.fmt(reply, .{});
+        try formatter.format(&payload_buf.writer);
+        try writeAll(stream, payload_buf.written());
+    }
+
+    /// Catches up on events and answers `request`. The reply is incomplete
+    /// when events were lost or the manifest or ignore file changed since
+    /// the seed.
+    fn buildReply(self: *Daemon, allocator: std.mem.Allocator, request: []const u8) !Reply {
+        try self.drainEvents();
+        if (!std.meta.eql(try FileId.read(self.manifest_path), self.manifest_id) or
+            !std.meta.eql(try FileId.read(self.ignore_path), self.ignore_id))
+        {
+            self.stale = true;
+        }
+
+        if (self.stale or !std.mem.eql(u8, request, "status")) return .{ .complete = false };
+        return .{ .complete = true, .changes = try self.collect(allocator) };
+    }
+
+    /// Checks every dirty path against the manifest and drops the ones that
+    /// match it again.
+    fn collect(self: *Daemon, allocator: std.mem.Allocator) ![]scan.Change {
+        const Modified = struct {
+            position: usize,
+            change: scan.Change,
+
+            fn lessThan(_: void, a: @This(), b: @This()) bool {
+                return a.position < b.position;
+            }
+        };
+
+        var modified: std.ArrayList(Modified) = .empty;
+        var added: std.ArrayList([]const u8) = .empty;
+        var clean: std.ArrayList([]const u8) = .empty;
+
+        var it = self.dirty.keyIterator();
+        while (it.next()) |key| {
+            const path = key.*;
+            const kind = (try self.classify(path)) orelse {
+                try clean.append(allocator, path);
+                continue;
+            };
+            const owned = try allocator.dupe(u8, path);
+            if (self.tracked.get(path)) |position| {
+                try modified.append(allocator, .{ .position = position, .change = .{ .path = owned, .kind = kind } });
+            } else {
+                try added.append(allocator, owned);
+            }
+        }
+        for (clean.items) |path| {
+            const removed = self.dirty.fetchRemove(path).?;
+            self.allocator.free(removed.key);
+        }
+
+        // Same order as a full scan: tracked files by manifest position,
+        // then additions by path.
+        std.mem.sort(Modified, modified.items, {}, Modified.lessThan);
+        std.mem.sort([]const u8, added.items, {}, lessThanPath);
+
+        const changes = try allocator.alloc(scan.Change, modified.items.len + added.items.len);
+        for (modified.items, changes[0..modified.items.len]) |item, *change| change.* = item.change;
+        for (added.items, changes[modified.items.len..]) |path, *change| {
+            change.* = .{ .path = path, .kind = .added };
+        }
+        return changes;
+    }
+
+    /// How `path` differs from the manifest, or null if it does not.
+    fn classify(self: *Daemon, path: []const u8) !?scan.Kind {
+        const position = self.tracked.get(path) orelse {
+            // The walk only reports regular files, not links or directories.
+            const stat = posix.fstatat(self.root_dir.fd, path, posix.AT.SYMLINK_NOFOLLOW) catch |err| switch (err) {
+                error.FileNotFound, error.NotDir => return null,
+                else => return err,
+            };
+            if (!posix.S.ISREG(stat.mode) or self.ignore_patterns.shouldIgnore(path)) return null;
+            return .added;
+        };
+
+        const file = self.root_dir.openFile(path, .{}) catch |err| switch (err) {
+            error.FileNotFound, error.NotDir => return .deleted,
+            error.IsDir => return .modified,
+            else => return err,
+        };
+        defer file.close();
+
+        const stat = try file.stat();
+        if (stat.kind == .directory) return .modified;
+
+        const digest = try fs.hashOpenFileSha256(file);
+        const hash = std.fmt.bytesToHex(digest, .lower);
+        if (std.mem.eql(u8, &hash, self.entries[position].hash)) return null;
+        return .modified;
+    }
+};
+
+fn joinRelative(allocator: std.mem.Allocator, dir_path: []const u8, name: []const u8) ![]u8 {
+    if (dir_path.len == 0) return allocator.dupe(u8, name);
+    return std.fmt.allocPrint(allocator, "{s}/{s}", .{ dir_path, name });
+}
+
+/// True if `path` is `dir_path` or inside it.
+fn isWithin(path: []const u8, dir_path: []const u8) bool {
+    if (!std.mem.startsWith(u8, path, dir_path)) return false;
+    return path.len == dir_path.len or path[dir_path.len] == '/';
+}
+
+fn lessThanPath(_: void, a: []const u8, b: []const u8) bool {
+    return std.mem.lessThan(u8, a, b);
+}
+
+fn setTimeouts(stream: std.net.Stream, timeout_ms: u32) !void {
+    const timeout = posix.timeval{
+        .sec = @intCast(timeout_ms / 1000),
+        .usec = @intCast((timeout_ms % 1000) * 1000),
+    };
+    try posix.setsockopt(stream.handle, posix.SOL.SOCKET, posix.SO.RCVTIMEO, std.mem.asBytes(&timeout));
+    try posix.setsockopt(stream.handle, posix.SOL.SOCKET, posix.SO.SNDTIMEO, std.mem.asBytes(&timeout));
+}
+
+fn writeAll(stream: std.net.Stream, bytes: []const u8) !void {
+    var written: usize = 0;
+    while (written < bytes.len) {
+        written += try stream.write(bytes[written..]);
+    }
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+fn testHash(content: []const u8) [64]u8 {
+    var digest: [32]u8 = undefined;
+    std.crypto.hash.sha2.Sha256.hash(content, &digest, .{});
+    return std.fmt.bytesToHex(digest, .lower);
+}
+
+const TestWorkspace = struct {
+    temp: std.testing.TmpDir,
+    root: []u8,
+    daemon: Daemon,
+
+    /// A workspace tracking `tracked.txt`, `edited.txt` and `gone.txt`, with
+    /// `*.log` ignored and a daemon seeded on it. Set up in place: the seed
+    /// keeps pointers into the daemon.
+    fn init(self: *TestWorkspace) !void {
+        const allocator = std.testing.allocator;
+        self.temp = std.testing.tmpDir(.{});
+        errdefer self.temp.cleanup();
+        self.root = try self.temp.dir.realpathAlloc(allocator, ".");
+        errdefer allocator.free(self.root);
+
+        try self.temp.dir.writeFile(.{ .sub_path = "tracked.txt", .data = "tracked" });
+        try self.temp.dir.writeFile(.{ .sub_path = "edited.txt", .data = "after" });
+        try self.temp.dir.writeFile(.{ .sub_path = ".micignore", .data = "*.log\n" });
+        try saveTestManifest(self.root, "before");
+
+        self.daemon = try Daemon.init(allocator, self.root);
+        errdefer self.daemon.deinit();
+        try self.daemon.reseed();
+    }
+
+    fn deinit(self: *TestWorkspace) void {
+        self.daemon.deinit();
+        std.testing.allocator.free(self.root);
+        self.temp.cleanup();
+    }
+
+    /// Watch descriptor of the workspace root.
+    fn rootWatch(self: *TestWorkspace) i32 {
+        var it = self.daemon.dirs.iterator();
+        while (it.next()) |watched| {
+            if (watched.value_ptr.len == 0) return watched.key_ptr.*;
+        }
+        unreachable;
+    }
+};
+
+fn saveTestManifest(root: []const u8, edited_content: []const u8) !void {
+    const tracked_hash = testHash("tracked");
+    const edited_hash = testHash(edited_content);
+    const gone_hash = testHash("gone");
+    var entries = [_]manifest.WorkspaceEntry{
+        .{ .path = "tracked.txt", .hash = &tracked_hash },
+        .{ .path = "edited.txt", .hash = &edited_hash },
+        .{ .path = "gone.txt", .hash = &gone_hash },
+    };
+    try manifest.save(std.testing.allocator, root, .{
+        .version = 1,
+        .server = "localhost",
+        .account = "acme",
+        .project = "app",
+        .tree_hash = "",
+        .entries = &entries,
+    });
+}
+
+/// Feeds the daemon one event for `name` in the directory watched as `wd`.
+fn sendTestEvent(daemon: *Daemon, wd: i32, mask: u32, name: []const u8) !void {
+    const header = @sizeOf(linux.inotify_event);
+    var buf: [header + 64]u8 align(@alignOf(linux.inotify_event)) = @splat(0);
+    const event: *linux.inotify_event = @ptrCast(&buf);
+    event.* = .{ .wd = wd, .mask = mask, .cookie = 0, .len = 64 };
+    @memcpy(buf[header..][0..name.len], name);
+    try daemon.handleEvent(event);
+}
+
+test "seed marks what the initial scan reported" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+
+    try std.testing.expect(!daemon.stale);
+    try std.testing.expect(daemon.dirty.contains("edited.txt"));
+    try std.testing.expect(daemon.dirty.contains("gone.txt"));
+    try std.testing.expect(daemon.dirty.contains(".micignore"));
+    try std.testing.expect(!daemon.dirty.contains("tracked.txt"));
+}
+
+test "handleEvent marks touched files and skips metadata" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+    const wd = workspace.rootWatch();
+
+    try sendTestEvent(daemon, wd, linux.IN.MODIFY, "tracked.txt");
+    try std.testing.expect(daemon.dirty.contains("tracked.txt"));
+
+    try sendTestEvent(daemon, wd, linux.IN.CREATE, ".mic");
+    try std.testing.expect(!daemon.dirty.contains(".mic"));
+
+    // Events for descriptors the daemon no longer knows are dropped.
+    try sendTestEvent(daemon, wd + 1000, linux.IN.MODIFY, "elsewhere.txt");
+    try std.testing.expect(!daemon.dirty.contains("elsewhere.txt"));
+}
+
+test "handleEvent watches new directories and marks their files" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+
+    // Filled before any watch on it existed, as when `mkdir -p` races the daemon.
+    try workspace.temp.dir.makePath("sub/deeper");
+    try workspace.temp.dir.writeFile(.{ .sub_path = "sub/deeper/file.txt", .data = "x" });
+    const watches_before = daemon.dirs.count();
+
+    try sendTestEvent(daemon, workspace.rootWatch(), linux.IN.CREATE | linux.IN.ISDIR, "sub");
+    try std.testing.expect(daemon.dirty.contains("sub/deeper/file.txt"));
+    try std.testing.expectEqual(watches_before + 2, daemon.dirs.count());
+}
+
+test "handleEvent goes stale when the kernel drops events" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+
+    try sendTestEvent(daemon, -1, linux.IN.Q_OVERFLOW, "");
+    try std.testing.expect(daemon.stale);
+
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const reply = try daemon.buildReply(arena.allocator(), "status");
+    try std.testing.expect(!reply.complete);
+}
+
+test "classify compares tracked files and filters untracked ones" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+    const dir = workspace.temp.dir;
+
+    try dir.writeFile(.{ .sub_path = "new.txt", .data = "new" });
+    try dir.writeFile(.{ .sub_path = "debug.log", .data = "log" });
+    try dir.makePath("newdir");
+    try dir.symLink("tracked.txt", "link", .{});
+
+    try std.testing.expectEqual(@as(?scan.Kind, null), try daemon.classify("tracked.txt"));
+    try std.testing.expectEqual(@as(?scan.Kind, .modified), try daemon.classify("edited.txt"));
+    try std.testing.expectEqual(@as(?scan.Kind, .deleted), try daemon.classify("gone.txt"));
+    try std.testing.expectEqual(@as(?scan.Kind, .added), try daemon.classify("new.txt"));
+    try std.testing.expectEqual(@as(?scan.Kind, null), try daemon.classify("debug.log"));
+    try std.testing.expectEqual(@as(?scan.Kind, null), try daemon.classify("newdir"));
+    try std.testing.expectEqual(@as(?scan.Kind, null), try daemon.classify("link"));
+    try std.testing.expectEqual(@as(?scan.Kind, null), try daemon.classify("missing.txt"));
+
+    try dir.deleteFile("tracked.txt");
+    try dir.makePath("tracked.txt");
+    try std.testing.expectEqual(@as(?scan.Kind, .modified), try daemon.classify("tracked.txt"));
+}
+
+test "collect orders changes like a scan and forgets clean paths" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+
+    try workspace.temp.dir.writeFile(.{ .sub_path = "b.txt", .data = "b" });
+    try workspace.temp.dir.writeFile(.{ .sub_path = "a.txt", .data = "a" });
+    try daemon.markDirty("b.txt");
+    try daemon.markDirty("a.txt");
+    try daemon.markDirty("tracked.txt");
+
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const changes = try daemon.collect(arena.allocator());
+
+    const expected = [_]scan.Change{
+        .{ .path = "edited.txt", .kind = .modified },
+        .{ .path = "gone.txt", .kind = .deleted },
+        .{ .path = ".micignore", .kind = .added },
+        .{ .path = "a.txt", .kind = .added },
+        .{ .path = "b.txt", .kind = .added },
+    };
+    try std.testing.expectEqual(expected.len, changes.len);
+    for (expected, changes) |want, got| {
+        try std.testing.expectEqualStrings(want.path, got.path);
+        try std.testing.expectEqual(want.kind, got.kind);
+    }
+    try std.testing.expect(!daemon.dirty.contains("tracked.txt"));
+}
+
+test "reply is incomplete once the manifest changes" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    try std.testing.expect((try daemon.buildReply(arena.allocator(), "status")).complete);
+    try std.testing.expect(!(try daemon.buildReply(arena.allocator(), "unknown")).complete);
+
+    // A land rewrote the manifest; the dirty set is relative to the old one.
+    try saveTestManifest(workspace.root, "after");
+    try std.testing.expect(!(try daemon.buildReply(arena.allocator(), "status")).complete);
+    try std.testing.expect(daemon.stale);
+
+    try daemon.reseed();
+    const reply = try daemon.buildReply(arena.allocator(), "status");
+    try std.testing.expect(reply.complete);
+    try std.testing.expect(!daemon.dirty.contains("edited.txt"));
+}
+
+test "answer gives up on a client that never sends its request" {
+    if (comptime !supported) return error.SkipZigTest;
+    var workspace: TestWorkspace = undefined;
+    try workspace.init();
+    defer workspace.deinit();
+    const daemon = &workspace.daemon;
+    daemon.request_timeout_ms = 50;
+
+    var fds: [2]i32 = undefined;
+    try std.testing.expectEqual(@as(usize, 0), linux.socketpair(linux.AF.UNIX, linux.SOCK.STREAM, 0, &fds));
+    defer posix.close(fds[0]);
+    defer posix.close(fds[1]);
+
+    try std.testing.expectError(error.WouldBlock, daemon.answer(.{ .handle = fds[0] }));
+}
@@ -0,0 +1,240 @@
+defmodule Micelio.GRPC.ContentBlobsTest do
+  # async: false because global Mimic mocking requires exclusive ownership
+  use Micelio.DataCase, async: false
+
+  import Mimic
+
+  alias GRPC.Server.Stream
+  alias GRPC.Status
+  alias Micelio.Accounts
+  alias Micelio.GRPC.Content.V1.BlobChunk
+  alias Micelio.GRPC.Content.V1.BlobEntry
+  alias Micelio.GRPC.Content.V1.ContentService.Server, as: ContentServer
+  alias Micelio.GRPC.Content.V1.GetBlobRequest
+  alias Micelio.GRPC.Content.V1.GetBlobsRequest
+  alias Micelio.Mic.Repository
+  alias Micelio.Projects
+  alias Micelio.Storage
+  alias Micelio.StorageHelper
+
+  @chunk_size 64 * 1024
+
+  setup :verify_on_exit!
+  setup :set_mimic_global
+  setup :setup_storage
+
+  setup do
+    test_pid = self()
+
+    stub(GRPC.Server, :send_reply, fn stream, reply ->
+      send(test_pid, {:reply, reply})
+      stream
+    end)
+
+    unique = System.unique_integer([:positive])
+
+    {:ok, organization} =
+      Accounts.create_organization(%{handle: "blobs-org-#{unique}", name: "Blobs Org"})
+
+    {:ok, project} =
+      Projects.create_project(%{
+        handle: "blobs-project-#{unique}",
+        name: "Blobs Project",
+        organization_id: organization.id,
+        visibility: "public"
+      })
+
+    {:ok, organization: organization, project: project}
+  end
+
+  describe "stream_blob" do
+    test "splits content into 64 KiB chunks with a short tail", context do
+      content = :crypto.strong_rand_bytes(2 * @chunk_size + 1)
+      blob_hash = put_blob(context.project, content)
+
+      assert %Stream{} = ContentServer.stream_blob(blob_request(context, blob_hash), stream())
+
+      chunks = replies()
+      assert Enum.map(chunks, &byte_size(&1.data)) == [@chunk_size, @chunk_size, 1]
+      assert Enum.map_join(chunks, & &1.data) == content
+    end
+
+    test "sends a blob of exactly one chunk as a single message", context do
+      content = :crypto.strong_rand_bytes(@chunk_size)
+      blob_hash = put_blob(context.project, content)
+
+      assert %Stream{} = ContentServer.stream_blob(blob_request(context, blob_hash), stream())
+      assert [%BlobChunk{data: ^content}] = replies()
+    end
+
+    test "sends no chunks for an empty blob", context do
+      blob_hash = put_blob(context.project, "")
+
+      assert %Stream{} = ContentServer.stream_blob(blob_request(context, blob_hash), stream())
+      assert replies() == []
+    end
+
+    test "returns not found for a missing blob", context do
+      blob_hash = :crypto.hash(:sha256, "missing")
+
+      assert {:error, %GRPC.RPCError{status: status}} =
+               ContentServer.stream_blob(blob_request(context, blob_hash), stream())
+
+      assert status == Status.not_found()
+      assert replies() == []
+    end
+
+    test "rejects a malformed hash", context do
+      assert {:error, %GRPC.RPCError{status: status}} =
+               ContentServer.stream_blob(blob_request(context, "short"), stream())
+
+      assert status == Status.invalid_argument()
+    end
+  end
+
+  describe "get_blobs" do
+    test "answers each distinct hash once, in request order", context do
+      one = put_blob(context.project, "one")
+      two = put_blob(context.project, "two")
+
+      assert %Stream{} =
+               ContentServer.get_blobs(blobs_request(context, [two, one, two]), stream())
+
+      assert [
+               %BlobEntry{blob_hash: ^two, content: "two", size: 3, deferred: false},
+               %BlobEntry{blob_hash: ^one, content: "one", size: 3, deferred: false}
+             ] = replies()
+    end
+
+    test "defers blobs over max_blob_bytes with their size only", context do
+      large = put_blob(context.project, String.duplicate("l", 100))
+      small = put_blob(context.project, "small")
+
+      request = blobs_request(context, [large, small], max_blob_bytes: 10)
+      assert %Stream{} = ContentServer.get_blobs(request, stream())
+
+      assert [
+               %BlobEntry{blob_hash: ^large, content: "", size: 100, deferred: true},
+               %BlobEntry{blob_hash: ^small, content: "small", deferred: false}
+             ] = replies()
+    end
+
+    test "ends the stream before the blob that would exceed max_batch_bytes", context do
+      one = put_blob(context.project, String.duplicate("a", 6))
+      two = put_blob(context.project, String.duplicate("b", 6))
+      # Never loaded: a missing blob would otherwise end the call with not found.
+      missing = :crypto.hash(:sha256, "missing")
+
+      request = blobs_request(context, [one, two, missing], max_batch_bytes: 10)
+      assert %Stream{} = ContentServer.get_blobs(request, stream())
+      assert [%BlobEntry{blob_hash: ^one, deferred: false}] = replies()
+    end
+
+    test "stops loading once max_batch_bytes is used up", context do
+      one = put_blob(context.project, String.duplicate("a", 10))
+      missing = :crypto.hash(:sha256, "missing")
+
+      request = blobs_request(context, [one, missing], max_batch_bytes: 10)
+      assert %Stream{} = ContentServer.get_blobs(request, stream())
+      assert [%BlobEntry{blob_hash: ^one}] = replies()
+    end
+
+    test "always sends the first blob, even past max_batch_bytes", context do
+      big = put_blob(context.project, String.duplicate("a", 20))
+      next = put_blob(context.project, "b")
+
+      request = blobs_request(context, [big, next], max_batch_bytes: 10)
+      assert %Stream{} = ContentServer.get_blobs(request, stream())
+      assert [%BlobEntry{blob_hash: ^big, size: 20, deferred: false}] = replies()
+    end
+
+    test "deferred blobs do not use up max_batch_bytes", context do
+      large = put_blob(context.project, String.duplicate("l", 100))
+      small = put_blob(context.project, String.duplicate("s", 8))
+
+      request = blobs_request(context, [large, small], max_blob_bytes: 50, max_batch_bytes: 10)
+      assert %Stream{} = ContentServer.get_blobs(request, stream())
+
+      assert [
+               %BlobEntry{blob_hash: ^large, deferred: true},
+               %BlobEntry{blob_hash: ^small, deferred: false}
+             ] = replies()
+    end
+
+    test "ends the call with not found when a blob is missing", context do
+      one = put_blob(context.project, "one")
+      missing = :crypto.hash(:sha256, "missing")
+
+      assert {:error, %GRPC.RPCError{status: status}} =
+               ContentServer.get_blobs(blobs_request(context, [one, missing]), stream())
+
+      assert status == Status.not_found()
+      assert [%BlobEntry{blob_hash: ^one}] = replies()
+    end
+
+    test "rejects an empty, oversized or malformed hash list", context do
+      too_many = for i <- 1..257, do: :crypto.hash(:sha256, "blob-#{i}")
+
+      for hashes <- [[], too_many, ["short"]] do
+        assert {:error, %GRPC.RPCError{status: status}} =
+                 ContentServer.get_blobs(blobs_request(context, hashes), stream())
+
+        assert status == Status.invalid_argument()
+      end
+
+      assert replies() == []
+    end
+
+    test "returns not found for an unknown project", context do
+      blob_hash = put_blob(context.project, "x")
+      request = %{blobs_request(context, [blob_hash]) | project_handle: "nope"}
+
+      assert {:error, %GRPC.RPCError{status: status}} =
+               ContentServer.get_blobs(request, stream())
+
+      assert status == Status.not_found()
+    end
+  end
+
+  defp blob_request(context, blob_hash) do
+    %GetBlobRequest{
+      user_id: "",
+      account_handle: context.organization.account.handle,
+      project_handle: context.project.handle,
+      blob_hash: blob_hash
+    }
+  end
+
+  defp blobs_request(context, blob_hashes, limits \\ []) do
+    %GetBlobsRequest{
+      user_id: "",
+      account_handle: context.organization.account.handle,
+      project_handle: context.project.handle,
+      blob_hashes: blob_hashes,
+      max_blob_bytes: Keyword.get(limits, :max_blob_bytes, 0),
+      max_batch_bytes: Keyword.get(limits, :max_batch_bytes, 0)
+    }
+  end
+
+  defp put_blob(project, content) do
+    blob_hash = :crypto.hash(:sha256, content)
+    {:ok, _} = Storage.put(Repository.blob_key(project.id, blob_hash), content)
+    blob_hash
+  end
+
+  defp replies(acc \\ []) do
+    receive do
+      {:reply, reply} -> replies([reply | acc])
+    after
+      0 -> Enum.reverse(acc)
+    end
+  end
+
+  defp stream do
+    %Stream{http_request_headers: %{}}
+  end
+
+  defp setup_storage(context) do
+    StorageHelper.setup_isolated_storage(context)
+  end
+end
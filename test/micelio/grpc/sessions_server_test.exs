@@ -486,6 +486,60 @@ defmodule Micelio.GRPC.SessionsServerTest do
     assert persisted.metadata["epoch_batch"] == 1
   end
 
+  test "land_session_stream applies every batch and lands on the final one" do
+    {:ok, user} = Accounts.get_or_create_user_by_email("grpc-session-stream@example.com")
+
+    {:ok, organization} =
+      Accounts.create_organization_for_user(user, %{
+        handle: "grpc-session-stream-org",
+        name: "GRPC Sessions Stream Org"
+      })
+
+    {:ok, project} =
+      Projects.create_project(%{
+        handle: "grpc-session-stream-repo",
+        name: "GRPC Session Stream Repo",
+        organization_id: organization.id
+      })
+
+    {:ok, session} =
+      Sessions.create_session(%{
+        session_id: "session-grpc-stream-1",
+        goal: "Stream land",
+        project_id: project.id,
+        user_id: user.id
+      })
+
+    landing_time = DateTime.utc_now() |> DateTime.truncate(:second)
+
+    expect(Landing, :land_session, fn %Sessions.Session{} = landed_session ->
+      assert landed_session.metadata["epoch_batch"] == 2
+      {:ok, %{position: 3, landed_at: landing_time}}
+    end)
+
+    requests = [
+      %LandSessionRequest{
+        user_id: user.id,
+        session_id: session.session_id,
+        files: [%FileChange{path: "lib/one.ex", content: "one\n", change_type: "added"}],
+        epoch: 1
+      },
+      %LandSessionRequest{
+        user_id: user.id,
+        session_id: session.session_id,
+        files: [%FileChange{path: "lib/two.ex", content: "two\n", change_type: "added"}],
+        epoch: 2,
+        finalize: true
+      }
+    ]
+
+    response = SessionsServer.land_session_stream(requests, nil)
+
+    assert %SessionResponse{} = response
+    assert response.session.status == "landed"
+    assert response.session.landing_position == 3
+  end
+
   defp setup_storage(context) do
     StorageHelper.setup_isolated_storage(context)
   end
@@ -12,5 +12,6 @@ Mimic.copy(Micelio.Mic.Landing)
 Mimic.copy(Micelio.Notifications)
 Mimic.copy(Micelio.Webhooks)
 Mimic.copy(Req)
+Mimic.copy(GRPC.Server)
 
 Ecto.Adapters.SQL.Sandbox.mode(Micelio.Repo, :manual)